@@ -0,0 +1,387 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "BenchCommon.hpp"
+#include "DirectSum.hpp"
+#include "Distributions.hpp"
+#include "ParticleSimulation.hpp"
+
+// Accuracy versus throughput for each solver configuration.
+//
+// Accelerations from the solver are compared against DirectSum on the same
+// particles, then the configuration is stepped forward to measure throughput
+// and energy/momentum drift. Configurations that no other configuration beats
+// on both error and throughput are flagged as Pareto optimal.
+//
+//   accuracy_bench --n 20k --dist clustered --depth 4,6,8 --cap 16,64,256 --solvers tree,direct
+//   accuracy_bench --n 200k --dist uniform --solvers tree,mesh --mesh-cells 256,512,1024
+
+struct AccuracyConfig {
+    long long n = 20000;
+    Distributions::Type distribution = Distributions::CLUSTERED;
+    std::vector<long long> depths = { 4, 6, 8 };
+    std::vector<long long> capacities = { 16, 64, 256 };
+    bool run_tree = true;
+    bool run_direct = true;
+    bool run_mesh = false;
+    std::vector<long long> mesh_cells = { 512 };
+    bool mesh_short_range = true;
+    bool dynamic_bounds = false;
+    ForceKernels::BoundaryPolicy boundary = ForceKernels::REMOVE;
+    float accretion_speed = 0.0f;
+    std::vector<ForceKernels::FarFieldModel> far_fields = { ForceKernels::GLOBAL_COM };
+    float theta = 0.5f;
+    bool quantized_neighbours = false;
+    ParticleSimulation::Integrator integrator = ParticleSimulation::EULER;
+    int max_rung = 3;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int steps = 100;
+    float width = 1920.0f;
+    float height = 1080.0f;
+    unsigned int seed = 12345;
+    std::string output_path = "accuracy_bench.csv";
+};
+
+struct AccuracyResult {
+    std::string solver;
+    std::string far_field;
+    int depth;
+    int capacity;
+    double rms_relative_error;
+    double max_relative_error;
+    double global_relative_error;
+    double particles_per_second;
+    double energy_drift;
+    double momentum_drift;
+    long long particles_lost;
+    double force_evaluations;   // Per particle per step, 1 without block time steps
+    bool pareto;
+};
+
+static const float TIME_STEP = 0.000095f;
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --n <n>            Particle count (default 20k)\n"
+              << "  --dist <name>      uniform, clustered or sierpinski (default clustered)\n"
+              << "  --depth <list>     Tree max depths (default 4,6,8)\n"
+              << "  --cap <list>       Node capacities (default 16,64,256)\n"
+              << "  --solvers <list>   tree, direct and/or mesh (default tree,direct)\n"
+              << "  --mesh-cells <list> Mesh cells along the longer side (default 512)\n"
+              << "  --no-p3m           Mesh without the short range leaf pass\n"
+              << "  --accretion <speed> Merge touching particles below this relative speed\n"
+              << "  --boundary <name>  delete, reflect, periodic or clamp (default delete)\n"
+              << "  --dynamic-bounds   Root cell follows the particles, nobody is lost at the edges (delete boundary only)\n"
+              << "  --far-field <list> Tree far fields: global, monopole, quadrupole (default global)\n"
+              << "  --theta <x>        Opening angle of the monopole/quadrupole walk (default 0.5)\n"
+              << "  --quantized-neighbours Monopole/quadrupole neighbour leaves from 16 bit positions\n"
+              << "  --integrator <name> euler or leapfrog (default euler)\n"
+              << "  --max-rung <n>     Leapfrog rungs below the base step (default 3)\n"
+              << "  --threads <n>      Threads for solver and reference (default: hardware threads)\n"
+              << "  --steps <n>        Steps for throughput and drift (default 100)\n"
+              << "  --size <w> <h>     Simulation extents (default 1920 1080)\n"
+              << "  --seed <n>         Distribution seed (default 12345)\n"
+              << "  --output <file>    CSV output (default accuracy_bench.csv)\n";
+}
+
+static bool parseArgs(int argc, char* argv[], AccuracyConfig& config)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
+
+        if (!std::strcmp(argv[i], "--n") && has_value) {
+            config.n = Bench::parseIntList(argv[++i]).at(0);
+        } else if (!std::strcmp(argv[i], "--dist") && has_value) {
+            if (!Distributions::parse(argv[++i], config.distribution)) return false;
+        } else if (!std::strcmp(argv[i], "--depth") && has_value) {
+            config.depths = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--cap") && has_value) {
+            config.capacities = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--solvers") && has_value) {
+            config.run_tree = false;
+            config.run_direct = false;
+            config.run_mesh = false;
+            for (const std::string& name : Bench::parseList(argv[++i])) {
+                SolverPolicy::Mode mode;
+                if (!SolverPolicy::parse(name, mode) || mode == SolverPolicy::AUTO) return false;
+                if (mode == SolverPolicy::ALWAYS_TREE) config.run_tree = true;
+                if (mode == SolverPolicy::ALWAYS_DIRECT) config.run_direct = true;
+                if (mode == SolverPolicy::ALWAYS_MESH) config.run_mesh = true;
+            }
+        } else if (!std::strcmp(argv[i], "--mesh-cells") && has_value) {
+            config.mesh_cells = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--no-p3m")) {
+            config.mesh_short_range = false;
+        } else if (!std::strcmp(argv[i], "--accretion") && has_value) {
+            config.accretion_speed = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--boundary") && has_value) {
+            if (!ParticleSimulation::parseBoundary(argv[++i], config.boundary)) return false;
+        } else if (!std::strcmp(argv[i], "--dynamic-bounds")) {
+            config.dynamic_bounds = true;
+        } else if (!std::strcmp(argv[i], "--far-field") && has_value) {
+            config.far_fields.clear();
+            for (const std::string& name : Bench::parseList(argv[++i])) {
+                ForceKernels::FarFieldModel model;
+                if (!ParticleSimulation::parseFarField(name, model)) return false;
+                config.far_fields.push_back(model);
+            }
+            if (config.far_fields.empty()) return false;
+        } else if (!std::strcmp(argv[i], "--theta") && has_value) {
+            config.theta = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--quantized-neighbours")) {
+            config.quantized_neighbours = true;
+        } else if (!std::strcmp(argv[i], "--integrator") && has_value) {
+            if (!ParticleSimulation::parseIntegrator(argv[++i], config.integrator)) return false;
+        } else if (!std::strcmp(argv[i], "--max-rung") && has_value) {
+            config.max_rung = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--threads") && has_value) {
+            config.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--steps") && has_value) {
+            config.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+            config.width = std::atof(argv[++i]);
+            config.height = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--seed") && has_value) {
+            config.seed = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--output") && has_value) {
+            config.output_path = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    // Boundary policies act on the fixed simulation area
+    return !config.dynamic_bounds || config.boundary == ForceKernels::REMOVE;
+}
+
+static void compareAccelerations(const std::vector<Vector2a>& approx,
+                                 const std::vector<DirectSum::Vector2d>& exact,
+                                 AccuracyResult& result)
+{
+    double sum_relative_squared = 0.0;
+    double sum_error_squared = 0.0;
+    double sum_exact_squared = 0.0;
+    double max_relative = 0.0;
+    std::size_t counted = 0;
+
+    for (std::size_t i = 0; i < exact.size(); ++i) {
+        const double ex = exact[i].x;
+        const double ey = exact[i].y;
+        const double dx = approx[i].x - ex;
+        const double dy = approx[i].y - ey;
+        const double exact_squared = ex * ex + ey * ey;
+        const double error_squared = dx * dx + dy * dy;
+
+        sum_error_squared += error_squared;
+        sum_exact_squared += exact_squared;
+
+        // Particles in perfect balance have no meaningful relative error
+        if (exact_squared < 1e-12) continue;
+
+        const double relative = std::sqrt(error_squared / exact_squared);
+        sum_relative_squared += relative * relative;
+        max_relative = std::max(max_relative, relative);
+        ++counted;
+    }
+
+    result.rms_relative_error = counted ? std::sqrt(sum_relative_squared / counted) : 0.0;
+    result.max_relative_error = max_relative;
+    result.global_relative_error = sum_exact_squared > 0.0 ? std::sqrt(sum_error_squared / sum_exact_squared) : 0.0;
+}
+
+static SolverPolicy::Mode modeOf(SolverPolicy::Solver solver)
+{
+    switch (solver) {
+        case SolverPolicy::DIRECT: return SolverPolicy::ALWAYS_DIRECT;
+        case SolverPolicy::MESH: return SolverPolicy::ALWAYS_MESH;
+        default: return SolverPolicy::ALWAYS_TREE;
+    }
+}
+
+// The far field only applies to the tree and the mesh cells only to the mesh. Depth
+// and capacity are ignored by the direct solver and by the mesh without P3M.
+static AccuracyResult measureSolver(const AccuracyConfig& config,
+                                    const std::vector<Particle>& initial,
+                                    const std::vector<DirectSum::Vector2d>& reference,
+                                    SolverPolicy::Solver solver,
+                                    ForceKernels::FarFieldModel far_field,
+                                    int mesh_cells,
+                                    int depth,
+                                    int capacity)
+{
+    AccuracyResult result = {};
+    result.solver = SolverPolicy::name(solver);
+    result.far_field = "-";
+    if (solver == SolverPolicy::TREE) result.far_field = ParticleSimulation::farFieldName(far_field);
+    if (solver == SolverPolicy::TREE && far_field != ForceKernels::GLOBAL_COM && config.quantized_neighbours) {
+        result.far_field += "-q16";
+    }
+    if (solver == SolverPolicy::MESH) {
+        result.far_field = (config.mesh_short_range ? "p3m-" : "pm-") + std::to_string(mesh_cells);
+    }
+    result.depth = depth;
+    result.capacity = capacity;
+
+    ParticleSimulation sim(config.width, config.height, config.threads, TIME_STEP, depth, capacity);
+    sim.setSolverMode(modeOf(solver));
+    sim.addParticles(initial);
+    sim.setIntegrator(config.integrator, config.max_rung);
+    sim.setFarField(far_field, config.theta);
+    sim.setQuantizedNeighbours(config.quantized_neighbours);
+    sim.setMesh(mesh_cells, config.mesh_short_range);
+    sim.setBoundary(config.boundary);
+    sim.setAccretion(config.accretion_speed > 0.0f, config.accretion_speed);
+    sim.setDynamicBounds(config.dynamic_bounds);
+
+    std::vector<Vector2a> accelerations;
+    sim.computeAccelerations(accelerations);
+    compareAccelerations(accelerations, reference, result);
+
+    const double kinetic_start = DirectSum::kineticEnergy(sim.getParticles());
+    const double energy_start = kinetic_start + DirectSum::potentialEnergy(sim.getParticles(), config.threads);
+    const DirectSum::Vector2d momentum_start = DirectSum::momentum(sim.getParticles());
+
+    std::vector<double> step_ms;
+    double evaluations = 0.0;
+    double particle_steps = 0.0;
+    for (int step = 0; step < config.steps; ++step) {
+        particle_steps += sim.getParticleCount();
+        sim.step();
+        step_ms.push_back(sim.getPhaseTimings().simulationMs());
+        evaluations += sim.getPhaseTimings().active_particles;
+    }
+    result.force_evaluations = particle_steps > 0.0 ? evaluations / particle_steps : 0.0;
+
+    const double kinetic_end = DirectSum::kineticEnergy(sim.getParticles());
+    const double energy_end = kinetic_end + DirectSum::potentialEnergy(sim.getParticles(), config.threads);
+    const DirectSum::Vector2d momentum_end = DirectSum::momentum(sim.getParticles());
+    const double momentum_scale = DirectSum::momentumMagnitudeSum(sim.getParticles());
+
+    // The log potential has no natural zero, so drift is measured against the kinetic energy
+    const double energy_scale = std::max(kinetic_start, kinetic_end);
+    result.energy_drift = energy_scale > 0.0 ? std::fabs(energy_end - energy_start) / energy_scale : 0.0;
+
+    const double dpx = momentum_end.x - momentum_start.x;
+    const double dpy = momentum_end.y - momentum_start.y;
+    result.momentum_drift = momentum_scale > 0.0 ? std::sqrt(dpx * dpx + dpy * dpy) / momentum_scale : 0.0;
+
+    result.particles_lost = static_cast<long long>(initial.size()) - static_cast<long long>(sim.getParticleCount());
+    result.particles_per_second = initial.size() / (Bench::median(step_ms) * 1e-3);
+
+    return result;
+}
+
+static void markParetoFront(std::vector<AccuracyResult>& results)
+{
+    for (AccuracyResult& a : results) {
+        a.pareto = true;
+        for (const AccuracyResult& b : results) {
+            const bool dominates = b.rms_relative_error <= a.rms_relative_error &&
+                                   b.particles_per_second >= a.particles_per_second &&
+                                   (b.rms_relative_error < a.rms_relative_error ||
+                                    b.particles_per_second > a.particles_per_second);
+            if (dominates) {
+                a.pareto = false;
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    AccuracyConfig config;
+
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ofstream csv(config.output_path);
+    if (!csv) {
+        std::cerr << "Could not open " << config.output_path << "\n";
+        return 1;
+    }
+
+    std::vector<Particle> initial;
+    Distributions::generate(config.distribution, initial, config.n, config.width, config.height, 1.03f, config.seed);
+
+    Bench::Timer reference_timer;
+    std::vector<DirectSum::Vector2d> reference;
+    DirectSum::computeAccelerations(initial, reference, config.threads);
+    const double reference_ms = reference_timer.elapsedNs() * 1e-6;
+
+    std::printf("Direct sum reference: %lld particles, %.1f ms (%.3g particles/s)\n",
+                config.n, reference_ms, config.n / (reference_ms * 1e-3));
+    std::printf("Solver precision: %s\n", precisionName());
+
+    std::vector<AccuracyResult> results;
+
+    if (config.run_direct) {
+        std::fprintf(stderr, "direct\n");
+        results.push_back(measureSolver(config, initial, reference, SolverPolicy::DIRECT, ForceKernels::GLOBAL_COM,
+                                        0, 0, 0));
+    }
+
+    for (ForceKernels::FarFieldModel far_field : config.far_fields) {
+        for (long long depth : config.depths) {
+            for (long long capacity : config.capacities) {
+                if (!config.run_tree) continue;
+                std::fprintf(stderr, "tree %s depth %lld capacity %lld\n", ParticleSimulation::farFieldName(far_field),
+                             depth, capacity);
+                results.push_back(measureSolver(config, initial, reference, SolverPolicy::TREE, far_field,
+                                                0, depth, capacity));
+            }
+        }
+    }
+
+    for (long long cells : config.mesh_cells) {
+        if (!config.run_mesh) continue;
+
+        if (!config.mesh_short_range) {
+            std::fprintf(stderr, "mesh %lld cells\n", cells);
+            results.push_back(measureSolver(config, initial, reference, SolverPolicy::MESH, ForceKernels::GLOBAL_COM,
+                                            cells, 0, 0));
+            continue;
+        }
+
+        for (long long depth : config.depths) {
+            for (long long capacity : config.capacities) {
+                std::fprintf(stderr, "mesh %lld cells depth %lld capacity %lld\n", cells, depth, capacity);
+                results.push_back(measureSolver(config, initial, reference, SolverPolicy::MESH,
+                                                ForceKernels::GLOBAL_COM, cells, depth, capacity));
+            }
+        }
+    }
+
+    markParetoFront(results);
+
+    std::printf("\n%-10s %-14s %6s %6s %12s %12s %12s %14s %12s %12s %8s %8s %7s\n",
+                "solver", "far_field", "depth", "cap", "rms_rel", "max_rel", "global_rel",
+                "particles/s", "energy_drift", "mom_drift", "lost", "evals", "pareto");
+
+    csv << "solver,far_field,theta,integrator,distribution,n,depth,capacity,threads,rms_relative_error,max_relative_error,"
+           "global_relative_error,particles_per_second,energy_drift,momentum_drift,particles_lost,"
+           "force_evaluations,pareto\n";
+
+    for (const AccuracyResult& r : results) {
+        std::printf("%-10s %-14s %6d %6d %12.4e %12.4e %12.4e %14.4g %12.4e %12.4e %8lld %8.3f %7s\n",
+                    r.solver.c_str(), r.far_field.c_str(), r.depth, r.capacity, r.rms_relative_error, r.max_relative_error,
+                    r.global_relative_error, r.particles_per_second, r.energy_drift, r.momentum_drift,
+                    r.particles_lost, r.force_evaluations, r.pareto ? "*" : "");
+
+        csv << r.solver << ',' << r.far_field << ',' << config.theta << ',' << ParticleSimulation::integratorName(config.integrator) << ','
+            << Distributions::name(config.distribution) << ',' << config.n << ','
+            << r.depth << ',' << r.capacity << ',' << config.threads << ','
+            << r.rms_relative_error << ',' << r.max_relative_error << ',' << r.global_relative_error << ','
+            << r.particles_per_second << ',' << r.energy_drift << ',' << r.momentum_drift << ','
+            << r.particles_lost << ',' << r.force_evaluations << ',' << (r.pareto ? 1 : 0) << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "BenchCommon.hpp"
+#include "HugePageArena.hpp"
+
+// Replaces the global allocation functions so benchmarks can report how many bytes
+// an operation requested. The HugePageArena maps its large buffers itself, those
+// mappings are added in.
+
+static std::atomic<std::size_t> s_allocated_bytes(0);
+static std::atomic<std::size_t> s_allocation_count(0);
+
+namespace Bench {
+
+std::size_t allocatedBytes()
+{
+    return s_allocated_bytes.load(std::memory_order_relaxed) + HugePageArena::getTotalMappedBytes();
+}
+
+std::size_t allocationCount()
+{
+    return s_allocation_count.load(std::memory_order_relaxed);
+}
+
+} // namespace Bench
+
+static void* countedAlloc(std::size_t size)
+{
+    s_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size)
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
@@ -0,0 +1,74 @@
+#ifndef BENCH_COMMON
+#define BENCH_COMMON
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Small helpers shared by the benchmark executables.
+namespace Bench {
+
+// Totals for every operator new since program start, see AllocationCounter.cpp.
+std::size_t allocatedBytes();
+std::size_t allocationCount();
+
+class Timer {
+public:
+  Timer() : start_(std::chrono::steady_clock::now()) {}
+
+  void reset() { start_ = std::chrono::steady_clock::now(); }
+
+  double elapsedNs() const
+  {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+inline double median(std::vector<double> values)
+{
+  if (values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  const std::size_t mid = values.size() / 2;
+  return (values.size() % 2) ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+}
+
+inline double minimum(const std::vector<double>& values)
+{
+  return values.empty() ? 0.0 : *std::min_element(values.begin(), values.end());
+}
+
+// Splits "a,b,c" into its parts.
+inline std::vector<std::string> parseList(const std::string& str)
+{
+  std::vector<std::string> out;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) out.push_back(item);
+  }
+  return out;
+}
+
+// Parses "10000,100000" or "10k,5M" into integers.
+inline std::vector<long long> parseIntList(const std::string& str)
+{
+  std::vector<long long> out;
+  for (const std::string& item : parseList(str)) {
+    long long value = std::atoll(item.c_str());
+    const char suffix = item.back();
+    if (suffix == 'k' || suffix == 'K') value *= 1000;
+    if (suffix == 'm' || suffix == 'M') value *= 1000000;
+    out.push_back(value);
+  }
+  return out;
+}
+
+} // namespace Bench
+
+#endif
@@ -0,0 +1,246 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "BenchCommon.hpp"
+#include "DistributedSimulation.hpp"
+#include "Distributions.hpp"
+
+// Headless run of the multi-process solver on one host. The bench forks --ranks
+// processes that share one segment of rings, each generates its share of the
+// particles anywhere in the area and the first step sorts them into ORB domains.
+// Rank 0 gathers every rank's statistics each step and prints the load imbalance,
+// traffic and the total mass and momentum, which migration has to conserve, e.g.
+//
+//   distributed_bench --ranks 4 --n 1M --dist clustered --rebalance 10 --steps 30
+
+struct DistributedConfig {
+    int ranks = 4;
+    long long n = 1000000;
+    Distributions::Type distribution = Distributions::CLUSTERED;
+    int depth = 8;
+    int capacity = 64;
+    float theta = 0.5f;
+    int threads = 1;
+    int steps = 10;
+    int rebalance = 5;
+    int samples = 1024;
+    long long ring_kb = 1024;
+    float width = 1920.0f;
+    float height = 1080.0f;
+    unsigned int seed = 12345;
+    bool numa = false;
+    std::string output_path = "distributed_bench.csv";
+};
+
+// What each rank reports to rank 0 after a step
+struct RankReport {
+    DistributedSimulation::StepStats stats;
+    double step_ms;
+    double mass;
+    double momentum_x;
+    double momentum_y;
+};
+
+static const float TIME_STEP = 0.000095f;
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --ranks <n>        Processes (default 4)\n"
+              << "  --n <n>            Particles over all ranks (default 1M)\n"
+              << "  --dist <name>      uniform, clustered or sierpinski (default clustered)\n"
+              << "  --depth <n>        Tree max depth below the whole area (default 8)\n"
+              << "  --cap <n>          Tree node capacity (default 64)\n"
+              << "  --theta <x>        Opening angle (default 0.5)\n"
+              << "  --threads <n>      Threads per rank (default 1)\n"
+              << "  --steps <n>        Steps to run (default 10)\n"
+              << "  --rebalance <n>    Steps between rebalances, 0 balances once (default 5)\n"
+              << "  --samples <n>      Positions each rank contributes to a rebalance (default 1024)\n"
+              << "  --ring-kb <n>      Capacity of each ring in KB (default 1024)\n"
+              << "  --size <w> <h>     Simulation extents (default 1920 1080)\n"
+              << "  --seed <n>         Distribution seed of rank 0 (default 12345)\n"
+              << "  --numa             Pin the workers of all ranks to distinct CPUs, see NumaTopology\n"
+              << "  --output <file>    CSV output (default distributed_bench.csv)\n";
+}
+
+static bool parseArgs(int argc, char* argv[], DistributedConfig& config)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
+
+        if (!std::strcmp(argv[i], "--ranks") && has_value) {
+            config.ranks = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--n") && has_value) {
+            config.n = Bench::parseIntList(argv[++i]).at(0);
+        } else if (!std::strcmp(argv[i], "--dist") && has_value) {
+            if (!Distributions::parse(argv[++i], config.distribution)) return false;
+        } else if (!std::strcmp(argv[i], "--depth") && has_value) {
+            config.depth = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--cap") && has_value) {
+            config.capacity = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--theta") && has_value) {
+            config.theta = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--threads") && has_value) {
+            config.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--steps") && has_value) {
+            config.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--rebalance") && has_value) {
+            config.rebalance = std::max(0, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--samples") && has_value) {
+            config.samples = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--ring-kb") && has_value) {
+            config.ring_kb = std::max(1LL, Bench::parseIntList(argv[++i]).at(0));
+        } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+            config.width = std::atof(argv[++i]);
+            config.height = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--seed") && has_value) {
+            config.seed = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--numa")) {
+            config.numa = true;
+        } else if (!std::strcmp(argv[i], "--output") && has_value) {
+            config.output_path = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<RankReport> gatherReports(DistributedSimulation& simulation, const RankReport& report)
+{
+    const std::vector<char> message(reinterpret_cast<const char*>(&report),
+                                    reinterpret_cast<const char*>(&report) + sizeof(report));
+    const std::vector<std::vector<char>> gathered = simulation.allGather(message);
+
+    std::vector<RankReport> reports(gathered.size());
+    for (std::size_t rank = 0; rank < gathered.size(); ++rank) {
+        std::memcpy(&reports[rank], gathered[rank].data(), sizeof(RankReport));
+    }
+    return reports;
+}
+
+static void sumConserved(const std::vector<Particle>& particles, RankReport& report)
+{
+    report.mass = report.momentum_x = report.momentum_y = 0.0;
+    for (const Particle& particle : particles) {
+        report.mass += particle.mass;
+        report.momentum_x += particle.mass * particle.velocity.x;
+        report.momentum_y += particle.mass * particle.velocity.y;
+    }
+}
+
+static int runRank(const DistributedConfig& config, SharedMemoryRings& rings, int rank)
+{
+    const DistributedSimulation::Settings settings = { config.width, config.height, config.threads, TIME_STEP,
+                                                       config.depth, config.capacity, config.theta,
+                                                       config.rebalance, config.samples, config.numa };
+    DistributedSimulation simulation(settings, rings, rank);
+
+    const long long share = config.n / config.ranks;
+    const long long count = (rank == config.ranks - 1) ? config.n - share * (config.ranks - 1) : share;
+
+    std::vector<Particle> particles;
+    Distributions::generate(config.distribution, particles, static_cast<int>(count), config.width, config.height,
+                            1.03f, config.seed + rank);
+    simulation.addParticles(particles);
+
+    RankReport initial = RankReport();
+    sumConserved(simulation.getParticles(), initial);
+    const std::vector<RankReport> initial_reports = gatherReports(simulation, initial);
+
+    std::ofstream csv;
+    if (rank == 0) {
+        csv.open(config.output_path);
+        if (!csv) std::fprintf(stderr, "Could not open %s\n", config.output_path.c_str());
+
+        std::printf("%d ranks, %d thread(s) each, %s precision\n\n", config.ranks, config.threads, precisionName());
+        std::printf("%5s %10s %10s %10s %10s %11s %12s %12s %10s %10s %10s %8s %5s\n", "step", "n", "min_owned",
+                    "max_owned", "step_ms", "imbalance", "exchange_ms", "boundary_in", "summaries", "migrated",
+                    "MB_sent", "removed", "rebal");
+
+        csv << "step,ranks,threads,n,min_owned,max_owned,step_ms,force_imbalance,max_export_ms,max_exchange_ms,"
+               "boundary_in,summaries_in,migrated,mb_sent,removed,rebalanced,mass,momentum_x,momentum_y\n";
+    }
+
+    for (int step = 0; step < config.steps; ++step) {
+        Bench::Timer timer;
+        simulation.step();
+
+        RankReport report = RankReport();
+        report.stats = simulation.getStepStats();
+        report.step_ms = timer.elapsedNs() * 1e-6;
+        sumConserved(simulation.getParticles(), report);
+
+        const std::vector<RankReport> reports = gatherReports(simulation, report);
+        if (rank != 0) continue;
+
+        std::size_t n = 0, min_owned = static_cast<std::size_t>(-1), max_owned = 0;
+        std::size_t boundary = 0, summaries = 0, migrated = 0, bytes = 0, removed = 0;
+        double step_ms = 0.0, max_force = 0.0, total_force = 0.0, max_export = 0.0, max_exchange = 0.0;
+        double mass = 0.0, momentum_x = 0.0, momentum_y = 0.0;
+
+        for (const RankReport& r : reports) {
+            const std::size_t owned = r.stats.owned;
+            n += owned;
+            min_owned = std::min(min_owned, owned);
+            max_owned = std::max(max_owned, owned);
+            boundary += r.stats.boundary_in;
+            summaries += r.stats.summaries_in;
+            migrated += r.stats.migrated_out;
+            bytes += r.stats.bytes_sent;
+            removed += r.stats.removed;
+            step_ms = std::max(step_ms, r.step_ms);
+            max_force = std::max(max_force, r.stats.force_ms);
+            total_force += r.stats.force_ms;
+            max_export = std::max(max_export, r.stats.export_ms);
+            max_exchange = std::max(max_exchange, r.stats.exchange_ms);
+            mass += r.mass;
+            momentum_x += r.momentum_x;
+            momentum_y += r.momentum_y;
+        }
+
+        const double imbalance = (total_force > 0.0) ? max_force / (total_force / reports.size()) : 1.0;
+        const double mb_sent = bytes / (1024.0 * 1024.0);
+
+        std::printf("%5d %10zu %10zu %10zu %10.1f %11.2f %12.1f %12zu %10zu %10zu %10.2f %8zu %5s\n", step, n,
+                    min_owned, max_owned, step_ms, imbalance, max_exchange, boundary, summaries, migrated, mb_sent,
+                    removed, reports[0].stats.rebalanced ? "yes" : "");
+
+        csv << step << ',' << config.ranks << ',' << config.threads << ',' << n << ',' << min_owned << ','
+            << max_owned << ',' << step_ms << ',' << imbalance << ',' << max_export << ',' << max_exchange << ','
+            << boundary << ',' << summaries << ',' << migrated << ',' << mb_sent << ',' << removed << ','
+            << reports[0].stats.rebalanced << ',' << mass << ',' << momentum_x << ',' << momentum_y << '\n';
+
+        if (step == config.steps - 1) {
+            double initial_mass = 0.0, initial_x = 0.0, initial_y = 0.0;
+            for (const RankReport& r : initial_reports) {
+                initial_mass += r.mass;
+                initial_x += r.momentum_x;
+                initial_y += r.momentum_y;
+            }
+
+            std::printf("\nMass %.6g -> %.6g, momentum (%.6g, %.6g) -> (%.6g, %.6g)\n", initial_mass, mass,
+                        initial_x, initial_y, momentum_x, momentum_y);
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    DistributedConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    return DistributedSimulation::launch(config.ranks, static_cast<std::size_t>(config.ring_kb) * 1024,
+                                         [&config](SharedMemoryRings& rings, int rank) {
+        return runRank(config, rings, rank);
+    });
+}
@@ -0,0 +1,203 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "BenchCommon.hpp"
+#include "Distributions.hpp"
+#include "OutOfCoreSimulation.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Headless run of the out-of-core solver, for particle counts beyond RAM. The
+// particles are generated in chunks straight into the mapped file, then every step
+// reports the force and sort passes, how long the tile loader kept the solver
+// waiting, major page faults and the peak resident set, e.g.
+//
+//   outofcore_bench --n 100M --file /scratch/particles.bin --tile-level 4 --steps 5
+
+struct OutOfCoreConfig {
+    long long n = 10000000;
+    std::string file_path = "outofcore_particles.bin";
+    Distributions::Type distribution = Distributions::UNIFORM;
+    long long chunk = 1000000;
+    int tile_level = 3;
+    int summary_level = 8;
+    int depth = 6;
+    int capacity = 64;
+    float theta = 0.5f;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int steps = 5;
+    float width = 1920.0f;
+    float height = 1080.0f;
+    unsigned int seed = 12345;
+    bool numa = false;
+    std::string output_path = "outofcore_bench.csv";
+};
+
+static const float TIME_STEP = 0.000095f;
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --n <n>              Particle count (default 10M)\n"
+              << "  --file <path>        Particle file, created or truncated (default outofcore_particles.bin)\n"
+              << "  --dist <name>        uniform, clustered or sierpinski, generated per chunk (default uniform)\n"
+              << "  --chunk <n>          Particles generated at a time (default 1M)\n"
+              << "  --tile-level <n>     Tiles are the 4^n cells of this tree level (default 3)\n"
+              << "  --summary-level <n>  Finest level of the summary pyramid (default 8)\n"
+              << "  --depth <n>          Depth of each tile's tree (default 6)\n"
+              << "  --cap <n>            Node capacity (default 64)\n"
+              << "  --theta <x>          Opening angle of the summary walk (default 0.5)\n"
+              << "  --threads <n>        Threads for the force passes (default: hardware threads)\n"
+              << "  --steps <n>          Steps to run (default 5)\n"
+              << "  --size <w> <h>       Simulation extents (default 1920 1080)\n"
+              << "  --seed <n>           Distribution seed of the first chunk (default 12345)\n"
+              << "  --numa               Pin the force pass workers, see NumaTopology\n"
+              << "  --output <file>      CSV output (default outofcore_bench.csv)\n";
+}
+
+static bool parseArgs(int argc, char* argv[], OutOfCoreConfig& config)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
+
+        if (!std::strcmp(argv[i], "--n") && has_value) {
+            config.n = Bench::parseIntList(argv[++i]).at(0);
+        } else if (!std::strcmp(argv[i], "--file") && has_value) {
+            config.file_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--dist") && has_value) {
+            if (!Distributions::parse(argv[++i], config.distribution)) return false;
+        } else if (!std::strcmp(argv[i], "--chunk") && has_value) {
+            config.chunk = std::max(1LL, Bench::parseIntList(argv[++i]).at(0));
+        } else if (!std::strcmp(argv[i], "--tile-level") && has_value) {
+            config.tile_level = std::max(0, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--summary-level") && has_value) {
+            config.summary_level = std::max(0, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--depth") && has_value) {
+            config.depth = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--cap") && has_value) {
+            config.capacity = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--theta") && has_value) {
+            config.theta = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--threads") && has_value) {
+            config.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--steps") && has_value) {
+            config.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+            config.width = std::atof(argv[++i]);
+            config.height = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--seed") && has_value) {
+            config.seed = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--numa")) {
+            config.numa = true;
+        } else if (!std::strcmp(argv[i], "--output") && has_value) {
+            config.output_path = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Major faults so far and peak resident set in MB, zero where getrusage is missing
+static void resourceUsage(long long& major_faults, double& max_rss_mb)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    major_faults = usage.ru_majflt;
+#if defined(__APPLE__)
+    max_rss_mb = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    max_rss_mb = usage.ru_maxrss / 1024.0;
+#endif
+#else
+    major_faults = 0;
+    max_rss_mb = 0.0;
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    OutOfCoreConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ofstream csv(config.output_path);
+    if (!csv) {
+        std::cerr << "Could not open " << config.output_path << "\n";
+        return 1;
+    }
+
+    const OutOfCoreSimulation::Settings settings = { config.width, config.height, config.threads, TIME_STEP,
+                                                     config.tile_level, config.summary_level, config.depth,
+                                                     config.capacity, config.theta, config.numa };
+    OutOfCoreSimulation simulation(settings);
+
+    if (!simulation.open(config.file_path, config.n)) {
+        std::fprintf(stderr, "Could not map %s for %lld particles\n", config.file_path.c_str(), config.n);
+        return 1;
+    }
+
+    Bench::Timer generate_timer;
+    std::vector<Particle> chunk;
+
+    for (long long first = 0; first < config.n; first += config.chunk) {
+        const int count = static_cast<int>(std::min(config.chunk, config.n - first));
+        chunk.clear();
+        Distributions::generate(config.distribution, chunk, count, config.width, config.height, 1.03f,
+                                config.seed + static_cast<unsigned int>(first / config.chunk));
+        simulation.addParticles(chunk);
+    }
+
+    std::printf("Generated %zu particles into %s (%.1f MB) in %.1f s, %zu tiles\n",
+                simulation.getParticleCount(), config.file_path.c_str(),
+                simulation.getParticleCount() * sizeof(ParticleFile::Record) / (1024.0 * 1024.0),
+                generate_timer.elapsedNs() * 1e-9, simulation.getTileCount());
+
+    std::printf("\n%5s %12s %12s %12s %12s %10s %10s %12s %12s %10s %14s\n", "step", "n", "step_ms", "force_ms",
+                "load_wait_ms", "sort_ms", "moved", "removed", "largest_tile", "maj_faults", "particles/s");
+
+    csv << "step,n,tile_level,summary_level,depth,capacity,threads,step_ms,force_ms,load_wait_ms,sort_ms,"
+           "moved,removed,largest_tile,major_faults,max_rss_mb,particles_per_second\n";
+
+    long long faults_before = 0;
+    double max_rss_mb = 0.0;
+    resourceUsage(faults_before, max_rss_mb);
+
+    for (int step = 0; step < config.steps; ++step) {
+        const std::size_t n = simulation.getParticleCount();
+
+        Bench::Timer timer;
+        simulation.step();
+        const double step_ms = timer.elapsedNs() * 1e-6;
+
+        long long faults = 0;
+        resourceUsage(faults, max_rss_mb);
+
+        const OutOfCoreSimulation::StepStats& stats = simulation.getStepStats();
+        const double particles_per_second = n / (step_ms * 1e-3);
+
+        std::printf("%5d %12zu %12.1f %12.1f %12.1f %12.1f %10zu %10zu %12zu %10lld %14.4g\n",
+                    step, n, step_ms, stats.force_ms, stats.load_wait_ms, stats.sort_ms, stats.moved,
+                    stats.removed, stats.largest_tile, faults - faults_before, particles_per_second);
+
+        csv << step << ',' << n << ',' << config.tile_level << ',' << config.summary_level << ','
+            << config.depth << ',' << config.capacity << ',' << config.threads << ','
+            << step_ms << ',' << stats.force_ms << ',' << stats.load_wait_ms << ',' << stats.sort_ms << ','
+            << stats.moved << ',' << stats.removed << ',' << stats.largest_tile << ','
+            << faults - faults_before << ',' << max_rss_mb << ',' << particles_per_second << '\n';
+
+        faults_before = faults;
+    }
+
+    std::printf("\nPeak resident set: %.1f MB\n", max_rss_mb);
+
+    return 0;
+}
@@ -0,0 +1,398 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "BenchCommon.hpp"
+#include "Distributions.hpp"
+#include "ForceKernels.hpp"
+#include "HugePageArena.hpp"
+#include "QuadTree.hpp"
+
+// Microbenchmarks for the QuadTree build and the per-leaf force kernels.
+// Every (distribution, N, depth, capacity) point is measured in isolation and
+// written as one CSV row, e.g.
+//
+//   quadtree_bench --n 10k,1M --depth 6,8 --cap 16,64 --output baseline.csv
+//
+// Nothing here depends on a window, so it runs on headless build machines.
+
+struct BenchConfig {
+    std::vector<long long> sizes = { 10000, 100000, 1000000, 5000000 };
+    std::vector<long long> depths = { 6, 8, 10 };
+    std::vector<long long> capacities = { 16, 64, 256 };
+    std::vector<Distributions::Type> distributions = { Distributions::UNIFORM,
+                                                       Distributions::CLUSTERED,
+                                                       Distributions::SIERPINSKI };
+    int repetitions = 5;
+    int threads = 1;
+    float width = 1920.0f;
+    float height = 1080.0f;
+    unsigned int seed = 12345;
+    double max_pairs = 4e9;
+    HugePageArena::Policy huge_pages = HugePageArena::TRANSPARENT;
+    std::string output_path = "quadtree_bench.csv";
+};
+
+struct BenchResult {
+    const char* benchmark;
+    std::vector<double> samples_ns;
+    double pairs;
+    std::size_t bytes_allocated;
+};
+
+// Same time step main() hands to ParticleSimulation
+static const float TIME_STEP = 0.000095f;
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --n <list>         Particle counts, e.g. 10k,100k,1M,5M\n"
+              << "  --depth <list>     Tree max depths (default 6,8,10)\n"
+              << "  --cap <list>       Node capacities (default 16,64,256)\n"
+              << "  --dist <list>      uniform,clustered,sierpinski\n"
+              << "  --reps <n>         Repetitions per point (default 5)\n"
+              << "  --threads <n>      Threads for the force kernels (default 1)\n"
+              << "  --size <w> <h>     Simulation extents (default 1920 1080)\n"
+              << "  --seed <n>         Distribution seed (default 12345)\n"
+              << "  --max-pairs <n>    Skip near field points above this many pairs (default 4e9)\n"
+              << "  --huge-pages <p>   off, transparent or explicit huge pages for the tree (default transparent)\n"
+              << "  --output <file>    CSV output, '-' for stdout (default quadtree_bench.csv)\n";
+}
+
+static bool parseArgs(int argc, char* argv[], BenchConfig& config)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
+
+        if (!std::strcmp(argv[i], "--n") && has_value) {
+            config.sizes = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--depth") && has_value) {
+            config.depths = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--cap") && has_value) {
+            config.capacities = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--dist") && has_value) {
+            config.distributions.clear();
+            for (const std::string& name : Bench::parseList(argv[++i])) {
+                Distributions::Type type;
+                if (!Distributions::parse(name, type)) {
+                    std::cerr << "Unknown distribution: " << name << "\n";
+                    return false;
+                }
+                config.distributions.push_back(type);
+            }
+        } else if (!std::strcmp(argv[i], "--reps") && has_value) {
+            config.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--threads") && has_value) {
+            config.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+            config.width = std::atof(argv[++i]);
+            config.height = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--seed") && has_value) {
+            config.seed = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--max-pairs") && has_value) {
+            config.max_pairs = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--huge-pages") && has_value) {
+            if (!HugePageArena::parse(argv[++i], config.huge_pages)) return false;
+        } else if (!std::strcmp(argv[i], "--output") && has_value) {
+            config.output_path = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Splits the leaves into equal chunks like ParticleSimulation::updateForces does
+template <typename Kernel>
+static void runOverLeaves(std::size_t num_leaves, int num_threads, Kernel kernel)
+{
+    if (num_threads <= 1 || num_leaves < static_cast<std::size_t>(num_threads)) {
+        kernel(0, num_leaves);
+        return;
+    }
+
+    const std::size_t chunk_size = num_leaves / num_threads;
+    const std::size_t remainder = num_leaves % num_threads;
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    for (int i = 0; i < num_threads; ++i) {
+        const std::size_t start_index = i * chunk_size;
+        const std::size_t end_index = (i == num_threads-1) ? start_index + chunk_size + remainder : start_index + chunk_size;
+        threads.emplace_back(kernel, start_index, end_index);
+    }
+
+    for (auto& thread : threads) thread.join();
+}
+
+static void rebuild(QuadTree& tree, std::vector<Particle>& particles,
+                    std::vector<QuadTree::TreeNode*>& leaves, Accum& global_mass, Vector2a& global_com)
+{
+    int total_leaf_nodes = 0;
+    tree.deleteTree();
+    tree.insert(particles);
+    leaves.clear();
+    global_com = tree.getLeafNodes(leaves, total_leaf_nodes, global_mass);
+}
+
+static std::vector<BenchResult> benchmarkPoint(const BenchConfig& config,
+                                               const std::vector<Particle>& source,
+                                               int depth,
+                                               int capacity,
+                                               std::size_t& tree_bytes,
+                                               std::size_t& tree_huge_bytes,
+                                               std::size_t& num_leaves)
+{
+    std::vector<BenchResult> results;
+    const int reps = config.repetitions;
+
+    std::vector<Particle> particles = source;
+    std::vector<QuadTree::TreeNode*> leaves;
+    leaves.reserve(1 << (2 * depth));
+
+    Accum global_mass = 0.0f;
+    Vector2a global_com;
+
+    QuadTree tree(sf::FloatRect(0.0f, 0.0f, config.width, config.height), depth, capacity);
+
+    // insert: full build into an empty tree, split() included
+    {
+        BenchResult r = { "insert", {}, 0.0, 0 };
+        for (int rep = 0; rep < reps; ++rep) {
+            tree.deleteTree();
+            const std::size_t bytes_before = Bench::allocatedBytes();
+            Bench::Timer timer;
+            tree.insert(particles);
+            r.samples_ns.push_back(timer.elapsedNs());
+            r.bytes_allocated = std::max(r.bytes_allocated, Bench::allocatedBytes() - bytes_before);
+        }
+        results.push_back(r);
+    }
+
+    // split: all particles sit in the root leaf and are pushed into its four children
+    {
+        BenchResult r = { "split", {}, 0.0, 0 };
+
+        for (int rep = 0; rep < reps; ++rep) {
+            tree.setMaxDepth(0);
+            tree.deleteTree();
+            tree.insert(particles);
+            tree.setMaxDepth(depth);
+
+            const std::size_t bytes_before = Bench::allocatedBytes();
+            Bench::Timer timer;
+            tree.split(0, tree.getBounds(), particles);
+            r.samples_ns.push_back(timer.elapsedNs());
+            r.bytes_allocated = std::max(r.bytes_allocated, Bench::allocatedBytes() - bytes_before);
+        }
+        results.push_back(r);
+    }
+
+    // getLeafNodes: leaf gather plus the global COM reduction
+    {
+        BenchResult r = { "getLeafNodes", {}, 0.0, 0 };
+        rebuild(tree, particles, leaves, global_mass, global_com);
+        for (int rep = 0; rep < reps; ++rep) {
+            int total_leaf_nodes = 0;
+            leaves.clear();
+            const std::size_t bytes_before = Bench::allocatedBytes();
+            Bench::Timer timer;
+            global_com = tree.getLeafNodes(leaves, total_leaf_nodes, global_mass);
+            r.samples_ns.push_back(timer.elapsedNs());
+            r.bytes_allocated = std::max(r.bytes_allocated, Bench::allocatedBytes() - bytes_before);
+        }
+        results.push_back(r);
+    }
+
+    num_leaves = leaves.size();
+    tree_bytes = tree.getAllocatedBytes();
+    tree_huge_bytes = 0;
+
+    // How much of the tree the kernel actually put on huge pages
+    std::vector<QuadTree::StorageRange> ranges;
+    tree.getStorageRanges(ranges);
+    for (const QuadTree::StorageRange& range : ranges) {
+        std::size_t resident = 0, huge = 0;
+        HugePageArena::measure(range.data, range.bytes, resident, huge);
+        tree_huge_bytes += huge;
+    }
+
+    // near_field: O(k^2) pass inside every leaf
+    {
+        BenchResult r = { "near_field", {}, 0.0, 0 };
+        const HugePageVector<QuadTree::ParticleElementNode>& element_nodes = tree.getParticleElementNodeVec();
+
+        for (const QuadTree::TreeNode* leaf : leaves) {
+            r.pairs += static_cast<double>(leaf->count) * (leaf->count - 1);
+        }
+
+        if (r.pairs <= config.max_pairs) {
+            for (int rep = 0; rep < reps; ++rep) {
+                particles = source;
+                Bench::Timer timer;
+                runOverLeaves(leaves.size(), config.threads, [&](std::size_t start, std::size_t end) {
+                    ForceKernels::nearField(particles, element_nodes, leaves, start, end);
+                });
+                r.samples_ns.push_back(timer.elapsedNs());
+            }
+        }
+        results.push_back(r);
+    }
+
+    // far_field: global COM far field plus integration and recoloring
+    {
+        BenchResult r = { "far_field", {}, 0.0, 0 };
+        const ForceKernels::IntegrationParams params = { TIME_STEP, false, sf::Vector2f(0,0), ForceKernels::REMOVE,
+                                                         sf::FloatRect(), true };
+
+        for (int rep = 0; rep < reps; ++rep) {
+            particles = source;
+            Bench::Timer timer;
+            runOverLeaves(leaves.size(), config.threads, [&](std::size_t start, std::size_t end) {
+                ForceKernels::farFieldAndIntegrate(particles, tree, leaves, start, end,
+                                                   global_mass, global_com, params);
+            });
+            r.samples_ns.push_back(timer.elapsedNs());
+        }
+        results.push_back(r);
+    }
+
+    // neighbour_field: pairs with the neighbouring leaves of the monopole interaction lists,
+    // read from the particles or, for neighbour_field_q16, from the quantized copy with
+    // its encoding included
+    {
+        ForceKernels::InteractionLists lists;
+        lists.resize(leaves.size());
+        lists.leaf_indices.resize(leaves.size());
+        lists.root_bounds = tree.getBounds();
+        lists.theta = 0.5f;
+        ForceKernels::buildInteractionLists(tree, leaves, 0, leaves.size(), lists.theta, lists);
+
+        double pairs = 0.0;
+        for (std::size_t j = 0; j < leaves.size(); ++j) {
+            for (const ForceKernels::InteractionLists::Entry& entry : lists.near[j]) {
+                pairs += static_cast<double>(leaves[j]->count) * tree.getNode(entry.node).count;
+            }
+        }
+
+        ForceKernels::QuantizedLeaves quantized;
+
+        for (const bool use_quantized : { false, true }) {
+            BenchResult r = { use_quantized ? "neighbour_field_q16" : "neighbour_field", {}, pairs, 0 };
+
+            if (pairs <= config.max_pairs) {
+                for (int rep = 0; rep < reps; ++rep) {
+                    particles = source;
+                    const std::size_t bytes_before = Bench::allocatedBytes();
+                    Bench::Timer timer;
+
+                    if (use_quantized) {
+                        quantized.layout(tree, leaves);
+                        runOverLeaves(leaves.size(), config.threads, [&](std::size_t start, std::size_t end) {
+                            ForceKernels::quantizeLeaves(particles, tree, leaves, start, end, quantized);
+                        });
+                    }
+
+                    runOverLeaves(leaves.size(), config.threads, [&](std::size_t start, std::size_t end) {
+                        ForceKernels::nearFieldNeighbours(particles, tree, leaves, lists, start, end, nullptr,
+                                                          use_quantized ? &quantized : nullptr);
+                    });
+                    r.samples_ns.push_back(timer.elapsedNs());
+                    r.bytes_allocated = std::max(r.bytes_allocated, Bench::allocatedBytes() - bytes_before);
+                }
+            }
+            results.push_back(r);
+        }
+    }
+
+    // deleteTree: reset of every node plus the element lists
+    {
+        BenchResult r = { "deleteTree", {}, 0.0, 0 };
+        for (int rep = 0; rep < reps; ++rep) {
+            tree.deleteTree();
+            tree.insert(particles);
+            Bench::Timer timer;
+            tree.deleteTree();
+            r.samples_ns.push_back(timer.elapsedNs());
+        }
+        results.push_back(r);
+    }
+
+    return results;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config;
+
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    HugePageArena::setPolicy(config.huge_pages);
+
+    // QuadTree logs its constructor calls to stdout, so only use it for CSV on request
+    const bool to_stdout = (config.output_path == "-");
+
+    std::ofstream file;
+    if (!to_stdout) {
+        file.open(config.output_path);
+        if (!file) {
+            std::cerr << "Could not open " << config.output_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = to_stdout ? std::cout : file;
+
+    out << "benchmark,distribution,n,depth,capacity,threads,reps,leaves,"
+           "ns_median,ns_min,ns_per_particle,pairs,pairs_per_sec,bytes_allocated,tree_bytes,precision,huge_pages,"
+           "tree_huge_bytes\n";
+
+    for (Distributions::Type dist : config.distributions) {
+        for (long long n : config.sizes) {
+
+            std::vector<Particle> particles;
+            Distributions::generate(dist, particles, n, config.width, config.height, 1.03f, config.seed);
+
+            for (long long depth : config.depths) {
+                for (long long capacity : config.capacities) {
+
+                    std::size_t tree_bytes = 0;
+                    std::size_t tree_huge_bytes = 0;
+                    std::size_t num_leaves = 0;
+
+                    const std::vector<BenchResult> results = benchmarkPoint(config, particles, depth, capacity,
+                                                                            tree_bytes, tree_huge_bytes, num_leaves);
+
+                    for (const BenchResult& r : results) {
+                        // Points skipped because of --max-pairs have no samples
+                        if (r.samples_ns.empty()) {
+                            std::cerr << "skipped " << r.benchmark << " " << Distributions::name(dist)
+                                      << " n=" << n << " depth=" << depth << " cap=" << capacity
+                                      << " (" << r.pairs << " pairs)\n";
+                            continue;
+                        }
+
+                        const double ns = Bench::median(r.samples_ns);
+
+                        out << r.benchmark << ',' << Distributions::name(dist) << ',' << n << ','
+                            << depth << ',' << capacity << ',' << config.threads << ','
+                            << config.repetitions << ',' << num_leaves << ','
+                            << ns << ',' << Bench::minimum(r.samples_ns) << ','
+                            << ns / static_cast<double>(n) << ','
+                            << r.pairs << ',' << (r.pairs > 0.0 ? r.pairs / (ns * 1e-9) : 0.0) << ','
+                            << r.bytes_allocated << ',' << tree_bytes << ',' << precisionName() << ','
+                            << HugePageArena::name(config.huge_pages) << ',' << tree_huge_bytes << '\n';
+                    }
+
+                    out.flush();
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "BenchCommon.hpp"
+#include "Distributions.hpp"
+#include "ParticleSimulation.hpp"
+
+// Strong and weak scaling study for a headless ParticleSimulation.
+//
+// Strong scaling keeps N fixed and varies the thread count, weak scaling grows N
+// with the thread count. Every point is repeated, each phase of the frame is timed
+// separately and the Karp-Flatt metric (experimentally determined serial fraction)
+// is reported per phase, which shows which phase caps the overall speedup.
+//
+//   scaling_bench --max-threads 64 --n 500k --weak-n 50k --output scaling.csv
+
+struct ScalingConfig {
+    std::vector<long long> thread_counts;
+    int max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    bool every_thread_count = false;
+    long long strong_n = 200000;
+    long long weak_n = 25000;
+    Distributions::Type distribution = Distributions::UNIFORM;
+    int depth = 8;
+    int capacity = 64;
+    SolverPolicy::Mode solver = SolverPolicy::ALWAYS_TREE;
+    int frames = 20;
+    int warmup_frames = 3;
+    int repetitions = 3;
+    float width = 1920.0f;
+    float height = 1080.0f;
+    unsigned int seed = 12345;
+    bool run_strong = true;
+    bool run_weak = true;
+    bool numa = false;
+    std::string output_path = "scaling_bench.csv";
+};
+
+enum Phase {
+    DELETE_TREE,
+    COMPACTION,
+    INSERT,
+    LEAF_GATHER,
+    NEAR_FIELD,
+    FAR_FIELD,
+    DRAW,
+    TOTAL,
+    NUM_PHASES
+};
+
+static const char* phase_names[NUM_PHASES] = {
+    "delete_tree", "compaction", "insert", "leaf_gather", "near_field", "far_field", "draw", "total"
+};
+
+struct ScalingPoint {
+    int threads;
+    long long n;
+    double median_ms[NUM_PHASES];
+    double min_ms[NUM_PHASES];
+    double local_reads;         // Share of leaf particle reads from the reading thread's node
+};
+
+static const float TIME_STEP = 0.000095f;
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --max-threads <n>  Largest thread count (default: hardware threads)\n"
+              << "  --threads <list>   Explicit thread counts, overrides --max-threads\n"
+              << "  --all              Every count 1..max instead of powers of two\n"
+              << "  --n <n>            Particles for strong scaling (default 200k)\n"
+              << "  --weak-n <n>       Particles per thread for weak scaling (default 25k)\n"
+              << "  --strong-only      Skip the weak scaling study\n"
+              << "  --weak-only        Skip the strong scaling study\n"
+              << "  --dist <name>      uniform, clustered or sierpinski (default uniform)\n"
+              << "  --depth <n>        Tree max depth (default 8)\n"
+              << "  --cap <n>          Tree node capacity (default 64)\n"
+              << "  --solver <name>    tree, direct, mesh or auto (default tree)\n"
+              << "  --frames <n>       Measured frames per run (default 20)\n"
+              << "  --warmup <n>       Unmeasured frames per run (default 3)\n"
+              << "  --reps <n>         Runs per point (default 3)\n"
+              << "  --size <w> <h>     Simulation extents (default 1920 1080)\n"
+              << "  --seed <n>         Distribution seed (default 12345)\n"
+              << "  --numa             NUMA aware simulation, see ParticleSimulation::setNumaAware\n"
+              << "  --output <file>    CSV output (default scaling_bench.csv)\n";
+}
+
+static bool parseArgs(int argc, char* argv[], ScalingConfig& config)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
+
+        if (!std::strcmp(argv[i], "--max-threads") && has_value) {
+            config.max_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--threads") && has_value) {
+            config.thread_counts = Bench::parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--all")) {
+            config.every_thread_count = true;
+        } else if (!std::strcmp(argv[i], "--n") && has_value) {
+            config.strong_n = Bench::parseIntList(argv[++i]).at(0);
+        } else if (!std::strcmp(argv[i], "--weak-n") && has_value) {
+            config.weak_n = Bench::parseIntList(argv[++i]).at(0);
+        } else if (!std::strcmp(argv[i], "--strong-only")) {
+            config.run_weak = false;
+        } else if (!std::strcmp(argv[i], "--weak-only")) {
+            config.run_strong = false;
+        } else if (!std::strcmp(argv[i], "--dist") && has_value) {
+            if (!Distributions::parse(argv[++i], config.distribution)) return false;
+        } else if (!std::strcmp(argv[i], "--depth") && has_value) {
+            config.depth = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--cap") && has_value) {
+            config.capacity = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--solver") && has_value) {
+            if (!SolverPolicy::parse(argv[++i], config.solver)) return false;
+        } else if (!std::strcmp(argv[i], "--frames") && has_value) {
+            config.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--warmup") && has_value) {
+            config.warmup_frames = std::max(0, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--reps") && has_value) {
+            config.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+            config.width = std::atof(argv[++i]);
+            config.height = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--seed") && has_value) {
+            config.seed = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--numa")) {
+            config.numa = true;
+        } else if (!std::strcmp(argv[i], "--output") && has_value) {
+            config.output_path = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    if (config.thread_counts.empty()) {
+        for (int t = 1; t <= config.max_threads; t = config.every_thread_count ? t + 1 : t * 2) {
+            config.thread_counts.push_back(t);
+        }
+        if (config.thread_counts.back() != config.max_threads) config.thread_counts.push_back(config.max_threads);
+    }
+
+    return true;
+}
+
+static ScalingPoint measurePoint(const ScalingConfig& config, int threads, long long n)
+{
+    std::vector<Particle> initial;
+    Distributions::generate(config.distribution, initial, n, config.width, config.height, 1.03f, config.seed);
+
+    std::vector<double> rep_medians[NUM_PHASES];
+    std::vector<double> rep_local;
+
+    for (int rep = 0; rep < config.repetitions; ++rep) {
+        ParticleSimulation sim(config.width, config.height, threads, TIME_STEP, config.depth, config.capacity);
+        sim.setSolverMode(config.solver);
+        sim.setNumaAware(config.numa);
+        sim.addParticles(initial);
+
+        sf::VertexArray vertices;
+        std::vector<double> frame_ms[NUM_PHASES];
+
+        for (int frame = 0; frame < config.warmup_frames + config.frames; ++frame) {
+            sim.step();
+
+            // The draw phase is timed up to the point where SFML would take over
+            Bench::Timer draw_timer;
+            sim.buildParticleVertices(vertices);
+            const double draw_ms = draw_timer.elapsedNs() * 1e-6;
+
+            if (frame < config.warmup_frames) continue;
+
+            const ParticleSimulation::PhaseTimings& t = sim.getPhaseTimings();
+            frame_ms[DELETE_TREE].push_back(t.delete_tree_ms);
+            frame_ms[COMPACTION].push_back(t.compaction_ms);
+            frame_ms[INSERT].push_back(t.insert_ms);
+            frame_ms[LEAF_GATHER].push_back(t.leaf_gather_ms);
+            frame_ms[NEAR_FIELD].push_back(t.near_field_ms);
+            frame_ms[FAR_FIELD].push_back(t.far_field_ms);
+            frame_ms[DRAW].push_back(draw_ms);
+            frame_ms[TOTAL].push_back(t.simulationMs() + draw_ms);
+        }
+
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            rep_medians[p].push_back(Bench::median(frame_ms[p]));
+        }
+        rep_local.push_back(sim.measureNumaPlacement().localFraction());
+    }
+
+    ScalingPoint point;
+    point.threads = threads;
+    point.n = n;
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        point.median_ms[p] = Bench::median(rep_medians[p]);
+        point.min_ms[p] = Bench::minimum(rep_medians[p]);
+    }
+    point.local_reads = Bench::median(rep_local);
+    return point;
+}
+
+// Karp-Flatt metric: serial fraction that would explain the measured speedup on p threads
+static double serialFraction(double speedup, int threads)
+{
+    if (threads <= 1 || speedup <= 0.0) return 0.0;
+    return (1.0 / speedup - 1.0 / threads) / (1.0 - 1.0 / threads);
+}
+
+// Strong: speedup = T1 / Tp. Weak: scaled speedup = p * T1 / Tp, since Tp did p times the work.
+// When the first point is not a single thread it is assumed to scale perfectly.
+static double speedupOf(const ScalingPoint& base, const ScalingPoint& point, int phase, bool weak)
+{
+    if (point.median_ms[phase] <= 0.0) return 0.0;
+    const double ratio = base.median_ms[phase] / point.median_ms[phase];
+    return weak ? ratio * point.threads : ratio * base.threads;
+}
+
+static void printTable(const char* title, const std::vector<ScalingPoint>& points, bool weak, int metric)
+{
+    std::printf("\n%s\n%8s %10s", title, "threads", "n");
+    for (int p = 0; p < NUM_PHASES; ++p) std::printf(" %12s", phase_names[p]);
+    std::printf("\n");
+
+    for (const ScalingPoint& point : points) {
+        std::printf("%8d %10lld", point.threads, point.n);
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            const double speedup = speedupOf(points.front(), point, p, weak);
+            double value = point.median_ms[p];
+            if (metric == 1) value = speedup;
+            if (metric == 2) value = speedup / point.threads;
+            if (metric == 3) value = serialFraction(speedup, point.threads);
+            std::printf(" %12.4f", value);
+        }
+        std::printf("\n");
+    }
+}
+
+static void printAmdahlSummary(const std::vector<ScalingPoint>& points, bool weak)
+{
+    const ScalingPoint& first = points.front();
+    const ScalingPoint& last = points.back();
+
+    std::printf("\nAmdahl summary (%d -> %d threads)\n", first.threads, last.threads);
+    std::printf("%12s %12s %12s %12s %14s\n", "phase", "share@first", "share@last", "serial_frac", "max_speedup");
+
+    for (int p = 0; p < TOTAL; ++p) {
+        const double e = serialFraction(speedupOf(first, last, p, weak), last.threads);
+        const double share_first = first.median_ms[TOTAL] > 0.0 ? first.median_ms[p] / first.median_ms[TOTAL] : 0.0;
+        const double share_last = last.median_ms[TOTAL] > 0.0 ? last.median_ms[p] / last.median_ms[TOTAL] : 0.0;
+
+        // With serial fraction e the phase can never run more than 1/e times faster
+        if (e > 1e-6) {
+            std::printf("%12s %12.3f %12.3f %12.4f %14.1f\n", phase_names[p], share_first, share_last, e, 1.0 / e);
+        } else {
+            std::printf("%12s %12.3f %12.3f %12.4f %14s\n", phase_names[p], share_first, share_last, e, "-");
+        }
+    }
+}
+
+static void runStudy(const ScalingConfig& config, bool weak, std::ostream& csv)
+{
+    std::vector<ScalingPoint> points;
+
+    for (long long threads : config.thread_counts) {
+        const long long n = weak ? config.weak_n * threads : config.strong_n;
+        std::fprintf(stderr, "%s scaling: %lld threads, %lld particles\n", weak ? "weak" : "strong", threads, n);
+        points.push_back(measurePoint(config, threads, n));
+    }
+
+    std::printf("\n==== %s scaling, %s, depth %d, capacity %d ====\n",
+                weak ? "Weak" : "Strong", Distributions::name(config.distribution), config.depth, config.capacity);
+    printTable("Median time per frame (ms)", points, weak, 0);
+    printTable(weak ? "Scaled speedup" : "Speedup", points, weak, 1);
+    printTable("Parallel efficiency", points, weak, 2);
+    printTable("Serial fraction (Karp-Flatt)", points, weak, 3);
+    printAmdahlSummary(points, weak);
+
+    if (config.numa) {
+        std::printf("\nLocal leaf reads\n%8s %10s %12s\n", "threads", "n", "local");
+        for (const ScalingPoint& point : points) {
+            std::printf("%8d %10lld %12.3f\n", point.threads, point.n, point.local_reads);
+        }
+    }
+
+    for (const ScalingPoint& point : points) {
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            const double speedup = speedupOf(points.front(), point, p, weak);
+            csv << (weak ? "weak" : "strong") << ',' << Distributions::name(config.distribution) << ','
+                << config.depth << ',' << config.capacity << ',' << point.threads << ',' << point.n << ','
+                << phase_names[p] << ',' << point.median_ms[p] << ',' << point.min_ms[p] << ','
+                << speedup << ',' << speedup / point.threads << ','
+                << serialFraction(speedup, point.threads) << '\n';
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    ScalingConfig config;
+
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ofstream csv(config.output_path);
+    if (!csv) {
+        std::cerr << "Could not open " << config.output_path << "\n";
+        return 1;
+    }
+
+    if (config.numa) std::printf("NUMA topology: %s\n", NumaTopology().describe().c_str());
+
+    csv << "mode,distribution,depth,capacity,threads,n,phase,ms_median,ms_min,speedup,efficiency,serial_fraction\n";
+
+    if (config.run_strong) runStudy(config, false, csv);
+    if (config.run_weak) runStudy(config, true, csv);
+
+    return 0;
+}
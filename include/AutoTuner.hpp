@@ -0,0 +1,68 @@
+#ifndef AUTO_TUNER
+#define AUTO_TUNER
+
+#include <string>
+#include <vector>
+
+#include "Distributions.hpp"
+
+// Offline search for the tree depth, node capacity and thread count that give the
+// lowest simulation time on this machine. Each candidate runs a short headless
+// simulation of the scenario; depth and capacity are swept as a grid with every
+// hardware thread, then the thread count is swept with the best pair.
+//
+// The result is written to a per-machine profile (profiles/<machine id>.profile,
+// relative to the working directory like fonts/) as key=value lines, which main
+// loads when it is started without explicit tree arguments.
+namespace AutoTuner {
+
+struct Scenario {
+  Distributions::Type distribution;
+  int num_particles;
+  int width;
+  int height;
+  int warmup_frames;
+  int frames;
+  unsigned int seed;
+
+  Scenario();
+};
+
+struct Profile {
+  std::string machine;
+  int num_threads;
+  int tree_depth;
+  int node_capacity;
+
+  // Scenario the profile was tuned on
+  Distributions::Type distribution;
+  int num_particles;
+  int width;
+  int height;
+
+  // Median per-phase cost of the chosen configuration, in milliseconds
+  double insert_ms;
+  double leaf_gather_ms;
+  double near_field_ms;
+  double far_field_ms;
+  double frame_ms;
+
+  Profile();
+};
+
+// CPU model and hardware thread count, reduced to characters safe for a file name
+std::string machineId();
+std::string defaultProfilePath();
+
+bool saveProfile(const std::string& path, const Profile& profile);
+bool loadProfile(const std::string& path, Profile& profile);
+
+// Runs the sweep, printing one line per candidate, and returns the fastest configuration
+Profile tune(const Scenario& scenario,
+             const std::vector<int>& depths,
+             const std::vector<int>& capacities,
+             const std::vector<int>& thread_counts);
+
+} // namespace AutoTuner
+
+#endif
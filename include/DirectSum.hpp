@@ -0,0 +1,32 @@
+#ifndef DIRECT_SUM
+#define DIRECT_SUM
+
+#include <vector>
+
+#include "Particle.hpp"
+
+// Exact O(N^2) reference for the simulation's force law, evaluated in double
+// precision. Uses the same softening, minimum distance and collision cutoff as
+// ForceKernels, so any difference from a solver is approximation error only.
+namespace DirectSum {
+
+typedef sf::Vector2<double> Vector2d;
+
+// Acceleration of every particle from every other particle.
+void computeAccelerations(const std::vector<Particle>& particles,
+                          std::vector<Vector2d>& accelerations,
+                          int num_threads);
+
+// Sum over pairs of G * m_i * m_j * ln(r^2 + softening) / 2, the potential of the 1/r force law.
+double potentialEnergy(const std::vector<Particle>& particles, int num_threads);
+
+double kineticEnergy(const std::vector<Particle>& particles);
+
+Vector2d momentum(const std::vector<Particle>& particles);
+
+// Sum of |m_i * v_i|, a scale to judge momentum drift against.
+double momentumMagnitudeSum(const std::vector<Particle>& particles);
+
+} // namespace DirectSum
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef DISTRIBUTED_SIMULATION
+#define DISTRIBUTED_SIMULATION
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "ForceKernels.hpp"
+#include "NumaTopology.hpp"
+#include "OrbDecomposition.hpp"
+#include "QuadTree.hpp"
+#include "SharedMemoryRings.hpp"
+
+// One rank of a headless 2D tree simulation split over processes of one host. Every
+// rank owns the particles in its domain of an OrbDecomposition of the simulation area
+// and talks to the others only through SharedMemoryRings. A step
+//  - rebalances every rebalance_interval steps: each rank sends a sample of its
+//    particle positions, weighted by its force time of the last step, to all others
+//    and every rank bisects the same samples into the same new domains,
+//  - migrates particles that left the rank's domain to their new owner,
+//  - builds the rank's tree and walks it once per other domain: cells well separated
+//    from that whole domain go out as a GravityElementNode summary (mass and COM),
+//    the particles of leaves too close to it go out as boundary particles,
+//  - solves the owned particles with the MONOPOLE tree solver over a tree of owned,
+//    boundary particles and summaries, the latter two as sources only, and integrates.
+//
+// Collective: every rank of the rings must call step() the same number of times.
+class DistributedSimulation {
+
+public:
+  struct Settings {
+    float width;
+    float height;
+    int num_threads;            // Threads of this rank
+    float time_step;
+    int tree_depth;             // Depth below the whole simulation area
+    int node_capacity;
+    float theta;                // Opening angle of the local solver and of the export walk
+    int rebalance_interval;     // Steps between rebalances, 0 only balances on the first step
+    int samples_per_rank;
+    bool numa_aware;            // Pin the workers of all ranks to distinct CPUs, see NumaTopology
+  };
+
+  struct StepStats {
+    double rebalance_ms;
+    double migrate_ms;
+    double export_ms;           // Local tree and export walks
+    double exchange_ms;         // Boundary particles and summaries through the rings
+    double force_ms;
+    std::size_t owned;
+    std::size_t migrated_out;
+    std::size_t migrated_in;
+    std::size_t removed;        // Left the simulation area
+    std::size_t boundary_in;
+    std::size_t summaries_in;
+    std::size_t bytes_sent;
+    bool rebalanced;
+
+    StepStats()
+      : rebalance_ms(0.0), migrate_ms(0.0), export_ms(0.0), exchange_ms(0.0), force_ms(0.0), owned(0),
+        migrated_out(0), migrated_in(0), removed(0), boundary_in(0), summaries_in(0), bytes_sent(0),
+        rebalanced(false) {}
+  };
+
+  DistributedSimulation(const Settings& settings, SharedMemoryRings& rings, int rank);
+
+  // Creates rings of ring_bytes each between num_ranks ranks and calls run_rank(rings,
+  // rank) for every rank: rank 0 in this process, the others in processes forked from
+  // it that exit with its result. Returns 0 once every rank returned 0, else 1, also
+  // when the rings or a fork fail. Needs POSIX shared memory and fork().
+  static int launch(int num_ranks, std::size_t ring_bytes,
+                    const std::function<int(SharedMemoryRings& rings, int rank)>& run_rank);
+
+  // Particles may be anywhere in the area, the next step moves them to their owners
+  void addParticles(const std::vector<Particle>& particles);
+
+  void step();
+
+  // Collective: what every rank passed, in rank order, on every rank
+  std::vector<std::vector<char>> allGather(const std::vector<char>& message);
+
+  int getRank() const;
+  int getRankCount() const;
+  const std::vector<Particle>& getParticles() const;
+  const OrbDecomposition& getDecomposition() const;
+  const StepStats& getStepStats() const;
+
+private:
+  // What crosses the rings for one particle, boundary and migrating alike
+  struct Body {
+    Vector2r position;
+    Vector2r velocity;
+    Real mass;
+  };
+
+  struct Summary {
+    Accum com_x;
+    Accum com_y;
+    Accum total_mass;
+  };
+
+  Settings settings_;
+  SharedMemoryRings& rings_;
+  int rank_;
+  int num_ranks_;
+  long long steps_;
+  double last_force_ms_;
+
+  OrbDecomposition decomposition_;
+  std::vector<Particle> particles_;     // Owned particles, then during a step boundary particles and summaries
+  std::size_t num_owned_;
+
+  QuadTree quad_tree_;
+  std::vector<QuadTree::TreeNode*> leaf_nodes_;
+  std::vector<QuadTree::TreeNode*> owned_leaf_nodes_;
+  ForceKernels::InteractionLists interaction_lists_;
+  std::vector<std::vector<char>> outgoing_;
+  std::vector<std::vector<char>> incoming_;
+  std::vector<std::thread> threads_;
+  NumaTopology numa_topology_;
+  StepStats stats_;
+
+  void runOnChunks(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work);
+  void buildTree();
+  void rebalance();
+  void migrate();
+  void exportEssential(int peer, std::vector<char>& message);
+  void importEssential();
+  void computeForces();
+};
+
+#endif
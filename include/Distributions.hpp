@@ -0,0 +1,54 @@
+#ifndef DISTRIBUTIONS
+#define DISTRIBUTIONS
+
+#include <string>
+#include <vector>
+
+#include "Particle.hpp"
+#include "ParticleN.hpp"
+
+// Deterministic particle layouts used for benchmarks and headless runs. The same
+// seed always produces the same particles, so timings from different builds can
+// be compared against each other.
+namespace Distributions {
+
+enum Type {
+  UNIFORM,
+  CLUSTERED,
+  SIERPINSKI
+};
+
+const char* name(Type type);
+bool parse(const std::string& str, Type& type);
+
+// Appends n particles at rest within [0, width) x [0, height).
+void generate(Type type,
+              std::vector<Particle>& particles,
+              int n,
+              float width,
+              float height,
+              float mass,
+              unsigned int seed);
+
+void uniform(std::vector<Particle>& particles, int n, float width, float height, float mass, unsigned int seed);
+
+// Gaussian blobs with a spread of a few percent of the domain.
+void clustered(std::vector<Particle>& particles, int n, float width, float height, float mass, unsigned int seed);
+
+// Chaos game samples of the triangle that ParticleSimulation::run() builds recursively.
+void sierpinski(std::vector<Particle>& particles, int n, float width, float height, float mass, unsigned int seed);
+
+// The same layouts for the dimension templated engine, within [0, extent) on every
+// axis. SIERPINSKI samples the Sierpinski simplex, a tetrahedron in 3D. Instantiated
+// for D = 2 and 3.
+template <int D>
+void generateN(Type type,
+               std::vector<ParticleN<D>>& particles,
+               int n,
+               const VectorN<D>& extent,
+               float mass,
+               unsigned int seed);
+
+} // namespace Distributions
+
+#endif
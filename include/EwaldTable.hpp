@@ -0,0 +1,63 @@
+#ifndef EWALD_TABLE
+#define EWALD_TABLE
+
+#include <algorithm>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+// Periodic correction of the 2D log potential in a width x height box: the exact
+// acceleration from a unit G*m mass and all its periodic images (with the uniform
+// background that keeps the periodic sum finite) minus the acceleration of its
+// minimum image alone. Tree walks use minimum image cells and add this correction,
+// so no ghost particles are needed.
+//
+// The correction is odd in x and in y, only the quadrant [0, width] x [0, height] is
+// tabulated. Leaves that straddle half the box are summed with one image for all their
+// particles, so displacements to their center of mass can exceed half the box. It is
+// computed once by Ewald summation.
+class EwaldTable {
+
+public:
+  enum {
+    DEFAULT_CELLS = 128
+  };
+
+  EwaldTable();
+
+  void compute(float width, float height, int cells = DEFAULT_CELLS);
+  bool isReady() const;
+  const sf::Vector2f& getPeriod() const;
+
+  // Exact correction by Ewald summation, r is the displacement from the mass image
+  // to the point
+  static sf::Vector2f exact(double width, double height, double rx, double ry);
+
+  // Bilinear lookup, displacements beyond a whole box are clamped to the edge
+  inline sf::Vector2f correction(float rx, float ry) const
+  {
+    const float fx = std::min(std::abs(rx) * inv_cell_size_.x, static_cast<float>(cells_) - 0.001f);
+    const float fy = std::min(std::abs(ry) * inv_cell_size_.y, static_cast<float>(cells_) - 0.001f);
+    const int ix = static_cast<int>(fx);
+    const int iy = static_cast<int>(fy);
+    const float wx = fx - ix;
+    const float wy = fy - iy;
+
+    const sf::Vector2f* cell = &table_[static_cast<std::size_t>(iy) * (cells_ + 1) + ix];
+
+    const sf::Vector2f value = cell[0] * ((1.0f - wx) * (1.0f - wy)) +
+                               cell[1] * (wx * (1.0f - wy)) +
+                               cell[cells_ + 1] * ((1.0f - wx) * wy) +
+                               cell[cells_ + 2] * (wx * wy);
+
+    return sf::Vector2f(rx < 0.0f ? -value.x : value.x, ry < 0.0f ? -value.y : value.y);
+  }
+
+private:
+  sf::Vector2f period_;
+  int cells_;
+  sf::Vector2f inv_cell_size_;
+  std::vector<sf::Vector2f> table_;   // (cells_ + 1)^2 samples of the quadrant, row major
+};
+
+#endif
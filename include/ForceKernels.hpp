@@ -0,0 +1,357 @@
+#ifndef FORCE_KERNELS
+#define FORCE_KERNELS
+
+#include <cstdint>
+#include <vector>
+
+#include "Particle.hpp"
+#include "QuadTree.hpp"
+#include "EwaldTable.hpp"
+
+class MonotonicArena;
+
+// Gravity and collision passes used by ParticleSimulation::updateForces. The tree
+// passes operate on a [begin, end) range of leaves and the direct passes on a
+// range of particles, so callers decide how the work is split across threads.
+namespace ForceKernels {
+
+extern const float BIG_G;
+
+// Pairs closer than this are skipped entirely
+extern const float MIN_DISTANCE_SQUARED;
+
+// Pairs within one particle diameter collide instead of attracting
+extern const float COLLISION_RADIUS_SQUARED;
+
+// Added to the squared distance of attracting pairs
+extern const float SOFTENING;
+
+// Block time step criteria of the leapfrog integrator: a particle's step is at most
+// LEAPFROG_ETA * sqrt(COLLISION_RADIUS / |a|) and LEAPFROG_COURANT * COLLISION_RADIUS / |v|
+extern const float LEAPFROG_ETA;
+extern const float LEAPFROG_COURANT;
+
+// Tile sizes of the direct sum: an i tile of positions and accumulators is kept
+// in L1 while a j tile of positions and masses (12 bytes each, 24 with double
+// precision) streams past it.
+enum {
+  DIRECT_I_TILE = 64,
+  DIRECT_J_TILE = 1024
+};
+
+// Deepest supported rung, the coarsest step is 2^MAX_RUNG fine steps
+enum {
+  MAX_RUNG = 8
+};
+
+// Far field approximation of the tree solver. GLOBAL_COM treats everything outside
+// a leaf as one point mass. MONOPOLE and QUADRUPOLE use per leaf interaction lists:
+// neighbouring leaves exactly and the moments of every other cell.
+enum FarFieldModel {
+  GLOBAL_COM,
+  MONOPOLE,
+  QUADRUPOLE
+};
+
+// With an Ewald table the box it was computed for is periodic and every cell also
+// pulls with the periodic correction of its monopole.
+struct MultipoleParams {
+  float theta;
+  bool quadrupole;
+  const EwaldTable* ewald;
+};
+
+// Per leaf interaction lists of the MONOPOLE and QUADRUPOLE far fields, indexed like
+// the leaf vector. A cell goes on a leaf's far list, and is evaluated from its moments,
+// when its side is below theta times the distance from its center to the leaf's
+// bounding circle. Leaves failing that are on the near list and summed exactly.
+// The criterion only looks at cell geometry, so the lists stay valid as long as the
+// tree topology (the sequence of non-empty leaves) and the root cell do not change.
+// In a periodic box distances are to the minimum image of each cell, the entry records
+// which image that is, and a far cell must also be well separated from its next image.
+struct InteractionLists {
+  struct Entry {
+    int node;         // Tree index
+    short image_x;    // Image of the cell in periods of the box, 0 unless periodic
+    short image_y;
+  };
+
+  std::vector<int> leaf_indices;            // Tree index of each leaf the lists were built for
+  std::vector<std::vector<Entry>> near;     // Neighbouring leaves
+  std::vector<std::vector<Entry>> far;      // Well separated cells
+  sf::FloatRect root_bounds;
+  sf::Vector2f period;                      // Box size when periodic, else zero
+  float theta;
+
+  InteractionLists() : root_bounds(), period(0.0f, 0.0f), theta(0.0f) {}
+
+  void resize(std::size_t num_leaves);
+
+  // True when the lists were built for the same leaves, root, period and theta
+  bool matches(const QuadTree& quad_tree,
+               const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+               float list_theta,
+               const sf::Vector2f& list_period) const;
+
+  sf::Vector2f shift(const Entry& entry) const
+  {
+    return sf::Vector2f(entry.image_x * period.x, entry.image_y * period.y);
+  }
+};
+
+// Compact copy of the leaf particles as sources of the neighbour field, stored
+// contiguously in leaf order: positions as 16 bit offsets within the leaf's cell and a
+// float mass, 8 bytes per particle instead of a gather of whole Particles through the
+// element lists. A coordinate decodes to origin + q * step with step = cell side / 65535,
+// so it is off by at most step / 2 = cell side / 131070 per axis. For a 2000 unit root
+// at depth 8 that is 6e-5 units, the rounding error of a float coordinate there.
+struct QuantizedLeaves {
+  struct Cell {
+    sf::Vector2f origin;    // Top left corner of the leaf
+    sf::Vector2f step;      // Size of one quantization step per axis
+    int first;              // First source of the leaf
+  };
+
+  struct Source {
+    std::uint16_t x;
+    std::uint16_t y;
+    float mass;
+  };
+
+  std::vector<int> leaf_of_node;    // Leaf index of each non-empty leaf, by tree index
+  std::vector<Cell> cells;          // Indexed like the leaf vector
+  std::vector<Source> sources;
+
+  // Sizes the arrays and assigns every leaf its range of sources, run before quantizeLeaves()
+  void layout(const QuadTree& quad_tree, const std::vector<QuadTree::TreeNode*>& leaf_nodes);
+};
+
+// What happens to particles leaving the simulation area. REMOVE leaves them to the
+// compaction at the start of the next step, the others are applied wherever positions
+// are integrated and keep every particle within [left, left + width) x [top, top + height).
+// With PERIODIC the MONOPOLE and QUADRUPOLE tree solvers also make gravity periodic
+// (minimum image cells plus an Ewald correction), the other solvers stay isolated.
+enum BoundaryPolicy {
+  REMOVE,
+  REFLECT,
+  PERIODIC,
+  CLAMP
+};
+
+// update_colors recolors particles by speed, it can be off when nothing is drawn
+struct IntegrationParams {
+  float time_step;
+  bool attract_to_mouse;
+  sf::Vector2f mouse_pos;
+  BoundaryPolicy boundary;
+  sf::FloatRect area;
+  bool update_colors;
+};
+
+// Runtime switches the particle and pair loops are compiled for. Every kernel builds
+// the mask of its features from its arguments once per call and runs the
+// instantiation for exactly that mask, so the loops carry no tests of switched off
+// features. Only the subsets a kernel can reach are instantiated.
+enum KernelFeature {
+  FEATURE_ACTIVE      = 1 << 0,   // Only particles of the active mask receive forces
+  FEATURE_COLLISIONS  = 1 << 1,   // Pairs within COLLISION_RADIUS bounce instead of attracting
+  FEATURE_MERGE       = 1 << 2,   // Slow collisions merge, needs FEATURE_COLLISIONS
+  FEATURE_SHORT_RANGE = 1 << 3,   // Short range part of the attraction only
+  FEATURE_QUADRUPOLE  = 1 << 4,   // Far cells add their quadrupole
+  FEATURE_EWALD       = 1 << 5,   // Periodic correction
+  FEATURE_MOUSE       = 1 << 6,   // Mouse attraction
+  FEATURE_BOUNDARY    = 1 << 7,   // A boundary policy other than REMOVE
+  FEATURE_COLOR       = 1 << 8,   // Recoloring by speed
+  FEATURE_QUANTIZED   = 1 << 9    // Neighbour sources come from QuantizedLeaves
+};
+
+// FEATURE_MOUSE, FEATURE_BOUNDARY and FEATURE_COLOR as set by params
+unsigned integrationFeatures(const IntegrationParams& params);
+
+// Hierarchical power of two time steps. Rung r steps by min_time_step * 2^(max_rung - r),
+// so rung max_rung takes every fine step and rung 0 one in 2^max_rung. substep_end counts
+// fine steps since the start, including the one that just drifted.
+struct BlockStepParams {
+  float min_time_step;
+  int max_rung;
+  long long substep_end;
+  bool update_colors;
+};
+
+// Fine steps in one step of the rung
+inline long long rungPeriod(int rung, int max_rung)
+{
+  return 1LL << (max_rung - rung);
+}
+
+// True when a particle on the rung ends its step at substep_end. Unassigned
+// particles (rung -1) are always active so they get a first force evaluation.
+inline bool isRungActive(int rung, const BlockStepParams& block)
+{
+  return rung < 0 || block.substep_end % rungPeriod(rung, block.max_rung) == 0;
+}
+
+// Particle to particle gravity and elastic collisions within each leaf. Each
+// colliding pair exchanges one impulse, as in directSumTiled(). With an
+// active mask (indexed by particle) only active particles receive forces and
+// collision impulses, every particle still acts as a source. A split radius rs > 0 keeps only the short range
+// part exp(-d^2/rs^2) of the attraction, the rest comes from ParticleMesh.
+// With merge_speed > 0 colliding particles slower than that relative to each other
+// merge instead (accretion), conserving mass, momentum and the centre of mass. The
+// absorbed particle is left with zero mass for the compaction. Without collisions
+// touching pairs attract like any other, softened.
+void nearField(std::vector<Particle>& particles,
+               const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes,
+               const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+               std::size_t start_index,
+               std::size_t end_index,
+               const std::vector<unsigned char>* active = nullptr,
+               float split_radius = 0.0f,
+               float merge_speed = 0.0f,
+               bool collisions = true);
+
+// Gravity from the global COM with the leaf's own mass removed, accumulated into
+// each particle's acceleration only.
+void farField(std::vector<Particle>& particles,
+              QuadTree& quad_tree,
+              const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+              std::size_t start_index,
+              std::size_t end_index,
+              Accum global_mass,
+              const Vector2a& global_com,
+              const std::vector<unsigned char>* active = nullptr);
+
+// Same far field as above, followed by integration and recoloring of every
+// particle in the leaf while it is still in cache.
+void farFieldAndIntegrate(std::vector<Particle>& particles,
+                          QuadTree& quad_tree,
+                          const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                          std::size_t start_index,
+                          std::size_t end_index,
+                          Accum global_mass,
+                          const Vector2a& global_com,
+                          const IntegrationParams& params);
+
+// Rebuilds the lists of leaves [start_index, end_index), lists must already be sized
+// for every leaf and have their period set.
+void buildInteractionLists(const QuadTree& quad_tree,
+                           const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                           std::size_t start_index,
+                           std::size_t end_index,
+                           float theta,
+                           InteractionLists& lists);
+
+// Encodes the particles of leaves [start_index, end_index) into quantized, which must
+// have been laid out for the same leaves
+void quantizeLeaves(const std::vector<Particle>& particles,
+                    const QuadTree& quad_tree,
+                    const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                    std::size_t start_index,
+                    std::size_t end_index,
+                    QuantizedLeaves& quantized);
+
+// Exact gravity from the particles of each leaf's near list, complementing nearField()
+// within the leaf. Pairs across leaves always attract, softened, also within the
+// collision radius: they do not bounce, only nearField() resolves collisions. With
+// quantized the neighbours' particles are read from it instead of from particles.
+void nearFieldNeighbours(std::vector<Particle>& particles,
+                         const QuadTree& quad_tree,
+                         const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                         const InteractionLists& lists,
+                         std::size_t start_index,
+                         std::size_t end_index,
+                         const std::vector<unsigned char>* active = nullptr,
+                         const QuantizedLeaves* quantized = nullptr);
+
+// Far field from the moments of each leaf's far list (QuadTree::computeMoments() must
+// have run). Cells contribute their monopole and, with params.quadrupole, their
+// quadrupole. With params.ewald the far cells, the near leaves and the leaf itself
+// also add the periodic correction of their monopole. Long cell lists spill into
+// scratch, an arena of the calling thread that outlives the call, or the heap without.
+void farFieldMultipole(std::vector<Particle>& particles,
+                       const QuadTree& quad_tree,
+                       const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                       const InteractionLists& lists,
+                       std::size_t start_index,
+                       std::size_t end_index,
+                       const MultipoleParams& params,
+                       const std::vector<unsigned char>* active = nullptr,
+                       MonotonicArena* scratch = nullptr);
+
+// Same far field as above, followed by integration and recoloring.
+void farFieldMultipoleAndIntegrate(std::vector<Particle>& particles,
+                                   const QuadTree& quad_tree,
+                                   const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                                   const InteractionLists& lists,
+                                   std::size_t start_index,
+                                   std::size_t end_index,
+                                   const MultipoleParams& params,
+                                   const IntegrationParams& integration,
+                                   MonotonicArena* scratch = nullptr);
+
+// Mouse attraction, semi-implicit Euler step, boundary policy and recoloring for
+// particles in [start_index, end_index). Clears the accumulated acceleration.
+void integrate(std::vector<Particle>& particles,
+               std::size_t start_index,
+               std::size_t end_index,
+               const IntegrationParams& params);
+
+// Leapfrog drift of every particle by one fine step (params.time_step), with the
+// mouse attraction impulse and the boundary policy.
+void drift(std::vector<Particle>& particles,
+           std::size_t start_index,
+           std::size_t end_index,
+           const IntegrationParams& params);
+
+// End of step for the active particles of [start_index, end_index): closing half
+// kick with the new acceleration, rung reassignment and the opening half kick of
+// the next step, so kick-drift-kick collapses to one kick per force evaluation.
+// A velocity that differs from velocities_before means the particle collided and
+// it moves to the finest rung. Clears the accumulated acceleration of all particles.
+void kickBlockSteps(std::vector<Particle>& particles,
+                    const std::vector<unsigned char>& active,
+                    const std::vector<Vector2r>& velocities_before,
+                    std::size_t start_index,
+                    std::size_t end_index,
+                    const BlockStepParams& block);
+
+// Structure of arrays snapshot of the particles for the direct sum inner loop.
+struct ParticleSoA {
+  std::vector<Real> x;
+  std::vector<Real> y;
+  std::vector<Real> vx;
+  std::vector<Real> vy;
+  std::vector<Real> mass;
+
+  void load(const std::vector<Particle>& particles);
+};
+
+// A slow collision found by the direct sum, absorber takes in absorbed
+struct MergePair {
+  int absorber;
+  int absorbed;
+};
+
+// Exact pairwise gravity for particles [start_index, end_index) against all
+// particles in the snapshot, blocked into cache sized i/j tiles. Collisions are
+// resolved from the snapshot velocities, so ranges can run on separate threads.
+// With an active mask only active particles take collision impulses, gravity is
+// still computed for the whole range. With merge_speed > 0 colliding pairs slower
+// than that do not bounce but are appended to merges, each pair once, for
+// mergePairs() after every range is done.
+void directSumTiled(std::vector<Particle>& particles,
+                    const ParticleSoA& soa,
+                    std::size_t start_index,
+                    std::size_t end_index,
+                    const std::vector<unsigned char>* active = nullptr,
+                    float merge_speed = 0.0f,
+                    bool collisions = true,
+                    std::vector<MergePair>* merges = nullptr);
+
+// Applies the merges in order like nearField(), skipping pairs that lost a particle
+// to an earlier merge. Single threaded, merges are rare.
+void mergePairs(std::vector<Particle>& particles, const std::vector<MergePair>& merges);
+
+} // namespace ForceKernels
+
+#endif
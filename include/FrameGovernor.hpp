@@ -0,0 +1,72 @@
+#ifndef FRAME_GOVERNOR
+#define FRAME_GOVERNOR
+
+#include <string>
+
+// Holds an interactive session near a target frame time by trading accuracy and
+// fidelity for speed. The frame time is smoothed, and a knob is only moved after
+// the frame has been out of the band [UNDER_RATIO, OVER_RATIO] * target for
+// several frames in a row, followed by a cooldown. Restores that immediately
+// push the frame back over budget double the time before the next restore.
+//
+// Over budget, knobs are given up in this order: extra substeps, then whatever
+// the per-phase timings say dominates (draw LOD, leaf size or tree depth). Under
+// budget they come back in reverse, accuracy first, extra substeps last.
+// Every change is logged with the reason and what was traded.
+class FrameGovernor {
+
+public:
+  struct Knobs {
+    int tree_depth;
+    int node_capacity;
+    int substeps;       // Simulation steps per drawn frame
+    int draw_stride;    // Draw every n-th particle
+  };
+
+  // Work time of the last frame, in milliseconds, summed over its substeps
+  struct FrameCost {
+    double tree_ms;           // Delete, insert and leaf gather
+    double near_field_ms;
+    double far_field_ms;
+    double draw_ms;
+    double other_ms;
+
+    double total() const { return tree_ms + near_field_ms + far_field_ms + draw_ms + other_ms; }
+  };
+
+  enum {
+    MAX_SUBSTEPS = 4,
+    MAX_DRAW_STRIDE = 8
+  };
+
+  FrameGovernor();
+
+  // The baseline is what the user asked for and what the governor returns to when
+  // there is headroom. max_tree_depth is the deepest tree the nodes are allocated for.
+  void enable(double target_ms, const Knobs& baseline, int max_tree_depth);
+  void setBaseline(const Knobs& baseline);
+  bool isEnabled() const;
+  double getTargetMs() const;
+
+  // Returns true and updates knobs when a change was made.
+  bool update(const FrameCost& cost, Knobs& knobs);
+
+private:
+  bool enabled_;
+  double target_ms_;
+  Knobs baseline_;
+  int max_tree_depth_;
+  double smoothed_ms_;
+  int over_frames_;
+  int under_frames_;
+  int cooldown_frames_;
+  int restore_backoff_;
+  int frames_since_restore_;
+  long long frame_;
+
+  bool degrade(const FrameCost& cost, Knobs& knobs, std::string& reason);
+  bool restore(const FrameCost& cost, Knobs& knobs, std::string& reason);
+  void log(const std::string& direction, const std::string& reason) const;
+};
+
+#endif
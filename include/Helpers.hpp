@@ -4,6 +4,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <memory>
+#include <utility>
 #include <vector>
  
 // ---------------------------------------------------------------------------------
@@ -11,13 +13,20 @@
 // ---------------------------------------------------------------------------------
 // Stores a random-access sequence of elements similar to vector, but avoids 
 // heap allocations for small lists. T must be trivially constructible and 
-// destructible.
-template <class T>
+// destructible. The first InlineCapacity elements live inside the list, 0 keeps
+// every element in memory from the Allocator, which may be stateful (see
+// ArenaAllocator in MonotonicArena.hpp).
+template <class T, int InlineCapacity = 256, class Allocator = std::allocator<T>>
 class SmallList
 {
 public:
+    typedef Allocator allocator_type;
+
     // Creates an empty list.
     SmallList();
+
+    // Creates an empty list that grows with the given allocator.
+    explicit SmallList(const Allocator& allocator);
  
     // Creates a copy of the specified list.
     SmallList(const SmallList& other);
@@ -30,6 +39,9 @@ public:
  
     // Returns the number of agents in the list.
     int size() const;
+
+    // Returns the number of elements the list can hold without growing.
+    int capacity() const;
  
     // Returns the nth element.
     T& operator[](int n);
@@ -61,84 +73,104 @@ public:
  
     // Returns a pointer to the underlying buffer.
     const T* data() const;
+
+    // Iterators over the elements.
+    T* begin();
+    T* end();
+    const T* begin() const;
+    const T* end() const;
+
+    // Returns the allocator the list grows with.
+    allocator_type get_allocator() const;
  
 private:
-    enum {fixed_cap = 256};
+    typedef std::allocator_traits<Allocator> AllocTraits;
+    enum {fixed_cap = InlineCapacity, buf_size = InlineCapacity > 0 ? InlineCapacity : 1};
     struct ListData
     {
         ListData();
-        T buf[fixed_cap];
+        T buf[buf_size];
         T* data;
         int num;
         int cap;
     };
     ListData ld;
+    Allocator alloc;
 };
   
-template <class T>
-SmallList<T>::ListData::ListData(): data(buf), num(0), cap(fixed_cap)
+template <class T, int InlineCapacity, class Allocator>
+SmallList<T, InlineCapacity, Allocator>::ListData::ListData(): data(buf), num(0), cap(fixed_cap)
 {
 }
  
-template <class T>
-SmallList<T>::SmallList()
+template <class T, int InlineCapacity, class Allocator>
+SmallList<T, InlineCapacity, Allocator>::SmallList(): alloc()
+{
+}
+
+template <class T, int InlineCapacity, class Allocator>
+SmallList<T, InlineCapacity, Allocator>::SmallList(const Allocator& allocator): alloc(allocator)
 {
 }
  
-template <class T>
-SmallList<T>::SmallList(const SmallList& other)
+template <class T, int InlineCapacity, class Allocator>
+SmallList<T, InlineCapacity, Allocator>::SmallList(const SmallList& other)
+  : alloc(AllocTraits::select_on_container_copy_construction(other.alloc))
 {
-    if (other.ld.cap == fixed_cap)
-    {
-        ld = other.ld;
-        ld.data = ld.buf;
-    }
-    else
+    reserve(other.ld.num);
+    memcpy(ld.data, other.ld.data, other.ld.num * sizeof(T));
+    ld.num = other.ld.num;
+}
+ 
+// Keeps its own allocator and buffer, only grows when other does not fit
+template <class T, int InlineCapacity, class Allocator>
+SmallList<T, InlineCapacity, Allocator>& SmallList<T, InlineCapacity, Allocator>::operator=(const SmallList& other)
+{
+    if (this != &other)
     {
+        ld.num = 0;
         reserve(other.ld.num);
-        for (int j=0; j < other.size(); ++j)
-            ld.data[j] = other.ld.data[j];
+        memcpy(ld.data, other.ld.data, other.ld.num * sizeof(T));
         ld.num = other.ld.num;
-        ld.cap = other.ld.cap;
     }
-}
- 
-template <class T>
-SmallList<T>& SmallList<T>::operator=(const SmallList<T>& other)
-{
-    SmallList(other).swap(*this);
     return *this;
 }
  
-template <class T>
-SmallList<T>::~SmallList()
+template <class T, int InlineCapacity, class Allocator>
+SmallList<T, InlineCapacity, Allocator>::~SmallList()
 {
     if (ld.data != ld.buf)
-        free(ld.data);
+        AllocTraits::deallocate(alloc, ld.data, ld.cap);
 }
  
-template <class T>
-int SmallList<T>::size() const
+template <class T, int InlineCapacity, class Allocator>
+int SmallList<T, InlineCapacity, Allocator>::size() const
 {
     return ld.num;
 }
  
-template <class T>
-T& SmallList<T>::operator[](int n)
+template <class T, int InlineCapacity, class Allocator>
+int SmallList<T, InlineCapacity, Allocator>::capacity() const
+{
+    return ld.cap;
+}
+ 
+template <class T, int InlineCapacity, class Allocator>
+T& SmallList<T, InlineCapacity, Allocator>::operator[](int n)
 {
     assert(n >= 0 && n < ld.num);
     return ld.data[n];
 }
  
-template <class T>
-const T& SmallList<T>::operator[](int n) const
+template <class T, int InlineCapacity, class Allocator>
+const T& SmallList<T, InlineCapacity, Allocator>::operator[](int n) const
 {
     assert(n >= 0 && n < ld.num);
     return ld.data[n];
 }
  
-template <class T>
-int SmallList<T>::find_index(const T& element) const
+template <class T, int InlineCapacity, class Allocator>
+int SmallList<T, InlineCapacity, Allocator>::find_index(const T& element) const
 {
     for (int j=0; j < ld.num; ++j)
     {
@@ -148,43 +180,41 @@ int SmallList<T>::find_index(const T& element) const
     return -1;
 }
  
-template <class T>
-void SmallList<T>::clear()
+template <class T, int InlineCapacity, class Allocator>
+void SmallList<T, InlineCapacity, Allocator>::clear()
 {
     ld.num = 0;
 }
  
-template <class T>
-void SmallList<T>::reserve(int n)
+template <class T, int InlineCapacity, class Allocator>
+void SmallList<T, InlineCapacity, Allocator>::reserve(int n)
 {
     enum {type_size = sizeof(T)};
     if (n > ld.cap) {
-        if (ld.cap == fixed_cap) {
-            T* new_data = static_cast<T*>(malloc(n * type_size));
-            memcpy(new_data, ld.buf, ld.num * type_size);
-            ld.data = new_data; 
-        } else {
-            ld.data = static_cast<T*>(realloc(ld.data, n * type_size));
-        }
+        T* new_data = AllocTraits::allocate(alloc, n);
+        memcpy(new_data, ld.data, ld.num * type_size);
+        if (ld.data != ld.buf)
+            AllocTraits::deallocate(alloc, ld.data, ld.cap);
+        ld.data = new_data;
         ld.cap = n;
     }
 }
  
-template <class T>
-void SmallList<T>::push_back(const T& element)
+template <class T, int InlineCapacity, class Allocator>
+void SmallList<T, InlineCapacity, Allocator>::push_back(const T& element)
 {
-    if (ld.num >= ld.cap) reserve(ld.cap * 2);
+    if (ld.num >= ld.cap) reserve(ld.cap > 0 ? ld.cap * 2 : 16);
     ld.data[ld.num++] = element;
 }
  
-template <class T>
-T SmallList<T>::pop_back()
+template <class T, int InlineCapacity, class Allocator>
+T SmallList<T, InlineCapacity, Allocator>::pop_back()
 {
     return ld.data[--ld.num];
 }
  
-template <class T>
-void SmallList<T>::swap(SmallList& other)
+template <class T, int InlineCapacity, class Allocator>
+void SmallList<T, InlineCapacity, Allocator>::swap(SmallList& other)
 {
     ListData& ld1 = ld;
     ListData& ld2 = other.ld;
@@ -198,139 +228,51 @@ void SmallList<T>::swap(SmallList& other)
  
     if (use_fixed1) ld2.data = ld2.buf;
     if (use_fixed2) ld1.data = ld1.buf;
+
+    using std::swap;
+    swap(alloc, other.alloc);
 }
  
-template <class T>
-T* SmallList<T>::data()
+template <class T, int InlineCapacity, class Allocator>
+T* SmallList<T, InlineCapacity, Allocator>::data()
 {
     return ld.data;
 }
  
-template <class T>
-const T* SmallList<T>::data() const
+template <class T, int InlineCapacity, class Allocator>
+const T* SmallList<T, InlineCapacity, Allocator>::data() const
 {
     return ld.data;
 }
- 
-// ---------------------------------------------------------------------------------
-// FreeList Implementation
-// ---------------------------------------------------------------------------------
-/// Provides an indexed free list with constant-time removals from anywhere
-/// in the list without invalidating indices. T must be trivially constructible 
-/// and destructible.
-template <class T>
-class FreeList
+
+template <class T, int InlineCapacity, class Allocator>
+T* SmallList<T, InlineCapacity, Allocator>::begin()
 {
-public:
-    /// Creates a new free list.
-    FreeList();
- 
-    /// Inserts an element to the free list and returns an index to it.
-    int insert(const T& element);
- 
-    // Removes the nth element from the free list.
-    void erase(int n);
- 
-    // Removes all elements from the free list.
-    void clear();
- 
-    // Returns the range of valid indices.
-    int range() const;
- 
-    // Returns the nth element.
-    T& operator[](int n);
- 
-    // Returns the nth element.
-    const T& operator[](int n) const;
- 
-    // Reserves space for n elements.
-    void reserve(int n);
- 
-    // Swaps the contents of the two lists.
-    void swap(FreeList& other);
- 
-private:
-    union FreeElement
-    {
-        T element;
-        int next;
-        FreeElement() {}
-        FreeElement(const T& e) : element(e) {}
-        FreeElement& operator=(const T& e) { new(&element) T(e); return *this; }
-    };
-    SmallList<FreeElement> data;
-    int first_free;
-};
-// ---------------------------------------------------------------------------------
-// FreeList Implementation
-// ---------------------------------------------------------------------------------
-template <class T>
-FreeList<T>::FreeList(): first_free(-1)
-{
-}
- 
-template <class T>
-int FreeList<T>::insert(const T& element)
-{
-    if (first_free != -1) {
-        const int index = first_free;
-        first_free = data[first_free].next;
-        data[index].element = element;
-        return index;
-    } else {
-        FreeElement fe;
-        fe.element = element;
-        data.push_back(fe);
-        return data.size() - 1;
-    }
-}
- 
-template <class T>
-void FreeList<T>::erase(int n)
-{
-    assert(n >= 0 && n < data.size());
-    data[n].next = first_free;
-    first_free = n;
-}
- 
-template <class T>
-void FreeList<T>::clear()
-{
-    data.clear();
-    first_free = -1;
-}
- 
-template <class T>
-int FreeList<T>::range() const
-{
-    return data.size();
+    return ld.data;
 }
- 
-template <class T>
-T& FreeList<T>::operator[](int n)
+
+template <class T, int InlineCapacity, class Allocator>
+T* SmallList<T, InlineCapacity, Allocator>::end()
 {
-    return data[n].element;
+    return ld.data + ld.num;
 }
- 
-template <class T>
-const T& FreeList<T>::operator[](int n) const
+
+template <class T, int InlineCapacity, class Allocator>
+const T* SmallList<T, InlineCapacity, Allocator>::begin() const
 {
-    return data[n].element;
+    return ld.data;
 }
- 
-template <class T>
-void FreeList<T>::reserve(int n)
+
+template <class T, int InlineCapacity, class Allocator>
+const T* SmallList<T, InlineCapacity, Allocator>::end() const
 {
-    data.reserve(n);
+    return ld.data + ld.num;
 }
- 
-template <class T>
-void FreeList<T>::swap(FreeList& other)
+
+template <class T, int InlineCapacity, class Allocator>
+typename SmallList<T, InlineCapacity, Allocator>::allocator_type SmallList<T, InlineCapacity, Allocator>::get_allocator() const
 {
-    const int temp = first_free;
-    data.swap(other.data);
-    first_free = other.first_free;
-    other.first_free = temp;
+    return alloc;
 }
  
 #endif
@@ -0,0 +1,107 @@
+#ifndef HUGE_PAGE_ARENA
+#define HUGE_PAGE_ARENA
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Backing store for the large buffers that are walked in random order, like the tree
+// nodes and the particle element lists, where 4 KB pages run out of TLB entries long
+// before the buffers run out of cache. Every allocation of at least one huge page gets
+// its own mapping, rounded up to whole huge pages:
+//  - EXPLICIT first asks for MAP_HUGETLB pages, which must be reserved up front in
+//    /proc/sys/vm/nr_hugepages, and falls back to TRANSPARENT when there are none,
+//  - TRANSPARENT maps huge page aligned memory and madvise()s it MADV_HUGEPAGE, so
+//    transparent huge pages back it even where they are only enabled on request,
+//  - OFF, like every smaller allocation, goes to operator new.
+// Outside Linux everything goes to operator new.
+//
+// The policy is process wide and only applies to later allocations.
+class HugePageArena {
+
+public:
+  enum Policy {
+    OFF,
+    TRANSPARENT,
+    EXPLICIT
+  };
+
+  struct Stats {
+    std::size_t live_bytes;             // Requested and not yet freed, all paths
+    std::size_t peak_bytes;
+    std::size_t mapped_bytes;           // Live mappings, whole huge pages
+    std::size_t explicit_bytes;         // ... of which on MAP_HUGETLB pages
+    std::size_t advised_bytes;          // ... of which left to transparent huge pages
+    std::size_t total_mapped_bytes;     // Every mapping since program start
+    std::size_t allocations;            // Since program start, all paths
+    std::size_t explicit_failures;      // MAP_HUGETLB refused, fell back to TRANSPARENT
+    std::size_t resident_bytes;         // From /proc/self/smaps: what the live mappings have faulted in
+    std::size_t resident_huge_bytes;    // ... of which on huge pages
+
+    Stats()
+      : live_bytes(0), peak_bytes(0), mapped_bytes(0), explicit_bytes(0), advised_bytes(0), total_mapped_bytes(0),
+        allocations(0), explicit_failures(0), resident_bytes(0), resident_huge_bytes(0) {}
+
+    double hugeCoverage() const
+    {
+      return resident_bytes > 0 ? static_cast<double>(resident_huge_bytes) / resident_bytes : 0.0;
+    }
+  };
+
+  static void setPolicy(Policy policy);
+  static Policy getPolicy();
+  static bool parse(const char* name, Policy& policy);
+  static const char* name(Policy policy);
+
+  // Size of a transparent huge page, 2 MB on x86-64
+  static std::size_t hugePageSize();
+
+  static void* allocate(std::size_t bytes);
+  static void deallocate(void* data, std::size_t bytes);
+
+  // For buffers the arena does not own, i.e. std::vector<Particle>: marks the huge
+  // pages that lie entirely inside [data, data + bytes) MADV_HUGEPAGE. Returns the
+  // bytes marked, 0 under OFF.
+  static std::size_t advise(const void* data, std::size_t bytes);
+
+  // Resident and huge page backed bytes of [data, data + bytes) from /proc/self/smaps.
+  // smaps only counts per mapping, a mapping the range shares with others is
+  // attributed in proportion to the overlap.
+  static void measure(const void* data, std::size_t bytes, std::size_t& resident, std::size_t& huge);
+
+  // Counters plus a /proc/self/smaps scan of the live mappings
+  static Stats getStats();
+
+  // Stats::total_mapped_bytes without the scan
+  static std::size_t getTotalMappedBytes();
+};
+
+// Lets containers take their storage from the HugePageArena
+template <class T>
+struct HugePageAllocator {
+  typedef T value_type;
+
+  HugePageAllocator() noexcept {}
+  template <class U> HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(HugePageArena::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* data, std::size_t n) noexcept
+  {
+    HugePageArena::deallocate(data, n * sizeof(T));
+  }
+};
+
+template <class T, class U>
+bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) noexcept { return true; }
+
+template <class T, class U>
+bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) noexcept { return false; }
+
+template <class T>
+using HugePageVector = std::vector<T, HugePageAllocator<T>>;
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef MONOTONIC_ARENA
+#define MONOTONIC_ARENA
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for memory that only lives for one frame: allocate() moves an offset,
+// deallocate() does nothing and reset() hands everything out again. Chunks come from
+// the HugePageArena. When a frame needed more than one chunk, reset() replaces them
+// with a single chunk of their combined size, so after the first few frames every
+// frame bumps through one block and never reaches the heap.
+//
+// Not thread safe, threads need arenas of their own.
+class MonotonicArena {
+
+public:
+  explicit MonotonicArena(std::size_t initial_bytes = 64 * 1024);
+  ~MonotonicArena();
+
+  MonotonicArena(const MonotonicArena&) = delete;
+  MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+  void* allocate(std::size_t bytes, std::size_t alignment);
+
+  // Everything allocated so far must be dead
+  void reset();
+
+  std::size_t getUsedBytes() const;       // Since the last reset
+  std::size_t getPeakBytes() const;       // Most used between two resets
+  std::size_t getCapacityBytes() const;   // All chunks
+
+private:
+  struct Chunk {
+    char* data;
+    std::size_t bytes;
+  };
+
+  std::vector<Chunk> chunks_;
+  std::size_t offset_;          // Into chunks_.back()
+  std::size_t used_;
+  std::size_t peak_;
+  std::size_t capacity_;
+
+  void addChunk(std::size_t bytes);
+};
+
+// Lets containers take their storage from a MonotonicArena, i.e.
+//   ArenaVector<int> scratch(n, 0, ArenaAllocator<int>(arena));
+template <class T>
+struct ArenaAllocator {
+  typedef T value_type;
+
+  MonotonicArena* arena;
+
+  explicit ArenaAllocator(MonotonicArena& arena) noexcept : arena(&arena) {}
+  template <class U> ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+  T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, std::size_t) noexcept {}
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept { return a.arena == b.arena; }
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept { return a.arena != b.arena; }
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef NUMA_TOPOLOGY
+#define NUMA_TOPOLOGY
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// NUMA nodes and their CPUs as listed in /sys/devices/system/node, plus the few
+// placement calls the simulation needs: pinning a thread, moving or interleaving the
+// pages of a buffer, and asking which node holds each page. The calls go straight to
+// the mbind and move_pages system calls, no libnuma needed.
+//
+// Nodes are numbered 0..getNodeCount()-1 here, getNodeId() gives the kernel's id.
+// Where sysfs or the system calls are missing (other platforms, containers without
+// NUMA) there is a single node with every CPU and placement does nothing.
+class NumaTopology {
+
+public:
+  NumaTopology();
+
+  int getNodeCount() const;
+  int getNodeId(int node) const;
+  const std::vector<int>& getNodeCpus(int node) const;
+  int getCpuCount() const;
+
+  // Worker i of num_threads: workers go to the nodes in contiguous blocks, so
+  // contiguous chunks of work, and the memory they first touch, stay on one node
+  int threadNode(int thread, int num_threads) const;
+  int threadCpu(int thread, int num_threads) const;
+
+  static bool pinCurrentThread(int cpu);
+
+  // Moves the pages of [data, data + bytes) to node and prefers it for their later
+  // faults. Pages only partly inside the range are left alone.
+  bool placeOnNode(const void* data, std::size_t bytes, int node) const;
+
+  // Spreads the pages round robin over every node, for data all threads read
+  bool interleave(const void* data, std::size_t bytes) const;
+
+  // Node of every page of [data, data + bytes), -1 for pages not yet faulted in
+  void pageNodes(const void* data, std::size_t bytes, std::vector<int>& nodes) const;
+
+  static std::size_t pageSize();
+
+  // e.g. "2 nodes: 0-15 | 16-31"
+  std::string describe() const;
+
+private:
+  struct Node {
+    int id;
+    std::vector<int> cpus;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<int> node_of_id_;     // Index into nodes_ by kernel node id
+
+  int nodeIndex(int id) const;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef ORB_DECOMPOSITION
+#define ORB_DECOMPOSITION
+
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Precision.hpp"
+
+// Orthogonal recursive bisection of a root rectangle into domains of equal weight.
+// Each cut halves the longer side of a box at the weighted quantile of the points in
+// it that splits the remaining domains as evenly as possible, so any domain count
+// works. The cuts are kept as a tree, which makes domainOf() an exact partition
+// without gaps between neighbouring domain rectangles.
+//
+// build() is deterministic, ranks that build from the same points in the same
+// order agree on every domain without further communication.
+class OrbDecomposition {
+
+public:
+  struct WeightedPoint {
+    sf::Vector2f position;
+    float weight;
+  };
+
+  OrbDecomposition();
+
+  // Domains are numbered in the order the bisection reaches them, left or top first
+  void build(const sf::FloatRect& root, int num_domains, std::vector<WeightedPoint> points);
+
+  // -1 outside the root
+  int domainOf(const Vector2r& position) const;
+
+  int getDomainCount() const;
+  const sf::FloatRect& getDomainBounds(int domain) const;
+  const sf::FloatRect& getRootBounds() const;
+
+private:
+  // A cut sends positions below split along axis to children[0]. Children >= 0 are
+  // cuts, a child of -1 - d is domain d.
+  struct Cut {
+    int axis;
+    float split;
+    int children[2];
+  };
+
+  sf::FloatRect root_;
+  int root_node_;
+  std::vector<Cut> cuts_;
+  std::vector<sf::FloatRect> domains_;
+
+  int bisect(const sf::FloatRect& bounds,
+             int num_domains,
+             std::vector<WeightedPoint>& points,
+             std::size_t begin,
+             std::size_t end);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef OUT_OF_CORE_SIMULATION
+#define OUT_OF_CORE_SIMULATION
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ForceKernels.hpp"
+#include "NumaTopology.hpp"
+#include "ParticleFile.hpp"
+#include "QuadTree.hpp"
+
+// Headless 2D tree simulation whose particles live in a ParticleFile instead of RAM.
+// The simulation area is cut into tiles, the 4^tile_level cells of that level of the
+// quadtree over it, and the file is kept sorted by tile so every tile is one contiguous
+// run of records. A step streams the tiles once: each is copied into core, gets the
+// MONOPOLE tree solver of ParticleSimulation with the tile as the root and a Barnes-Hut
+// walk over a resident pyramid of summary cells for everything outside the tile, is
+// integrated and written back. The write back already bins the new positions into
+// the summary cells and counts where each particle belongs, so when particles changed
+// tile a counting sort streams the records into a second file in tile order and the
+// files swap.
+//
+// While a tile computes, a loader thread copies the next one into a second buffer and
+// the one after that is prefetched with madvise, so the disk works in parallel with
+// the force passes. In core are two tiles, one tile tree and the pyramid; the largest
+// tile has to fit, a deeper tile_level makes tiles smaller.
+class OutOfCoreSimulation {
+
+public:
+  struct Settings {
+    float width;
+    float height;
+    int num_threads;
+    float time_step;
+    int tile_level;         // Tiles are the cells of this level, 4^tile_level of them
+    int summary_level;      // Finest level of the summary pyramid, at least tile_level
+    int tree_depth;         // Depth of each tile's own tree below the tile
+    int node_capacity;
+    float theta;            // Opening angle of the tile trees and of the summary walk
+    bool numa_aware;        // Pin the workers, see NumaTopology
+  };
+
+  struct StepStats {
+    double force_ms;        // Copying tiles in and out plus the force passes
+    double load_wait_ms;    // Part of force_ms spent waiting for the loader
+    double sort_ms;         // Counting sort into tile order, zero when nothing moved
+    std::size_t moved;      // Particles that changed tile
+    std::size_t removed;    // Particles that left the simulation area
+    std::size_t largest_tile;
+
+    StepStats() : force_ms(0.0), load_wait_ms(0.0), sort_ms(0.0), moved(0), removed(0), largest_tile(0) {}
+  };
+
+  explicit OutOfCoreSimulation(const Settings& settings);
+
+  // Maps path, and path + ".swap" for the sort, with room for capacity particles
+  bool open(const std::string& path, std::size_t capacity);
+
+  // Appends to the file, false once it is full
+  bool addParticles(const std::vector<Particle>& particles);
+
+  void step();
+
+  std::size_t getParticleCount() const;
+  std::size_t getTileCount() const;
+  const StepStats& getStepStats() const;
+  const ParticleFile& getFile() const;
+
+private:
+  struct SummaryCell {
+    Accum mass;
+    Accum mass_x;     // Mass weighted position sums
+    Accum mass_y;
+
+    SummaryCell() : mass(0.0f), mass_x(0.0f), mass_y(0.0f) {}
+  };
+
+  Settings settings_;
+  int tiles_per_side_;
+  ParticleFile file_;
+  ParticleFile swap_file_;
+
+  std::vector<std::size_t> tile_offsets_;       // Record range of each tile, tiles + 1 entries
+  std::vector<std::size_t> tile_counts_;        // Particles now in each tile, from the last write back
+  std::vector<std::vector<SummaryCell>> pyramid_;   // Level l has 4^l cells, row major
+
+  bool sorted_;
+  bool summarized_;
+
+  QuadTree tile_tree_;
+  std::vector<QuadTree::TreeNode*> leaf_nodes_;
+  ForceKernels::InteractionLists interaction_lists_;
+  std::vector<Particle> tile_buffers_[2];
+  std::vector<std::thread> threads_;
+  NumaTopology numa_topology_;
+  StepStats stats_;
+
+  void runOnChunks(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work);
+  sf::FloatRect tileBounds(int tile) const;
+  int tileOf(const Vector2r& position) const;
+  void loadTile(int tile, std::vector<Particle>& buffer) const;
+  void binParticle(const Vector2r& position, Real mass, std::vector<SummaryCell>& finest);
+  void summarize();
+  void buildPyramid();
+  void sortByTile();
+  void computeTile(int tile, std::vector<Particle>& particles);
+  void summaryField(int tile, std::vector<Particle>& particles, std::size_t start_index, std::size_t end_index);
+  void writeBack(int tile, const std::vector<Particle>& particles, std::vector<SummaryCell>& finest);
+};
+
+#endif
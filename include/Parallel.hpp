@@ -0,0 +1,83 @@
+#ifndef PARALLEL
+#define PARALLEL
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "NumaTopology.hpp"
+
+// Threading and timing helpers shared by the simulations
+
+// Wall clock time since start
+inline double millisecondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Chunks runOnChunks() splits count items into, one per worker thread
+inline int chunkCount(std::size_t count, int num_threads, std::size_t alignment = 1)
+{
+    const std::size_t num_blocks = (count + alignment - 1) / alignment;
+    return static_cast<int>(std::min(num_blocks, static_cast<std::size_t>(std::max(num_threads, 1))));
+}
+
+// Chunk of runOnChunks() holding item index, which is also its worker's index
+inline int chunkOf(std::size_t index, std::size_t count, int num_threads, std::size_t alignment = 1)
+{
+    const int n_threads = chunkCount(count, num_threads, alignment);
+    const std::size_t chunk_size = (count + alignment - 1) / alignment / n_threads;
+    return static_cast<int>(std::min(index / alignment / chunk_size, static_cast<std::size_t>(n_threads - 1)));
+}
+
+// Splits [0, count) into one contiguous chunk per thread, at most num_threads of them
+// with every chunk boundary a multiple of alignment, runs work on each chunk and joins.
+// threads is the caller's scratch vector. With a topology, worker i is pinned to
+// numa->threadCpu(i, n), so the memory a chunk first touches stays on its node.
+// Processes sharing the host pass their first worker and the workers of all of them,
+// worker i then takes numa->threadCpu(first_worker + i, total_workers).
+inline void runOnChunks(std::vector<std::thread>& threads,
+                        int num_threads,
+                        std::size_t count,
+                        std::size_t alignment,
+                        const NumaTopology* numa,
+                        const std::function<void(std::size_t, std::size_t)>& work,
+                        int first_worker = 0,
+                        int total_workers = 0)
+{
+    if (count == 0) return;
+
+    const std::size_t num_blocks = (count + alignment - 1) / alignment;
+    const int n_threads = chunkCount(count, num_threads, alignment);
+
+    // Divide the blocks up evenly among threads
+    // It may be better to load balance based on distribution of particles
+    const std::size_t chunk_size = num_blocks / n_threads;
+    const std::size_t remainder = num_blocks % n_threads;
+
+    for (int i = 0; i < n_threads; i++) {
+        const std::size_t start_block = i * chunk_size;
+        const std::size_t end_block = (i == n_threads-1) ? start_block + chunk_size + remainder : start_block + chunk_size;
+
+        const std::size_t start_index = start_block * alignment;
+        const std::size_t end_index = std::min(end_block * alignment, count);
+
+        if (numa) {
+            const int cpu = (total_workers > 0) ? numa->threadCpu(first_worker + i, total_workers)
+                                                : numa->threadCpu(i, n_threads);
+            threads.emplace_back([&work, cpu, start_index, end_index]() {
+                NumaTopology::pinCurrentThread(cpu);
+                work(start_index, end_index);
+            });
+        } else {
+            threads.emplace_back(work, start_index, end_index);
+        }
+    }
+
+    for (auto& thread : threads) thread.join();
+    threads.clear();
+}
+
+#endif
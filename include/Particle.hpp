@@ -3,17 +3,22 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "Precision.hpp"
+
+// Position, velocity and mass are stored in the Real of the precision policy and the
+// acceleration, which the force passes sum into, in its Accum
 class Particle
 {
 public:
-    sf::Vector2f position;
-    sf::Vector2f velocity;
-    sf::Vector2f acceleration;
+    Vector2r position;
+    Vector2r velocity;
+    Vector2a acceleration;
     sf::Color color;
-    float mass;
+    Real mass;
+    int rung;   // Block time step level of the leapfrog integrator, -1 until first assigned
 
     Particle();
-    Particle(const sf::Vector2f& pos, const sf::Vector2f& vel, float m);
+    Particle(const Vector2r& pos, const Vector2r& vel, Real m);
     Particle(const Particle& particle);
     Particle(Particle&& particle);
     Particle& operator=(const Particle& particle);
@@ -0,0 +1,60 @@
+#ifndef PARTICLE_FILE
+#define PARTICLE_FILE
+
+#include <cstddef>
+#include <string>
+
+#include "Precision.hpp"
+
+// Particle state in a memory mapped file, for runs that do not fit in RAM. A record
+// holds what carries over between steps; accelerations, colors and rungs are rebuilt
+// in core. The mapping is shared, so the kernel writes dirty pages back to the file
+// and evicts clean ones under memory pressure instead of swapping.
+//
+// Only supported on POSIX systems, elsewhere open() returns false.
+class ParticleFile {
+
+public:
+  struct Record {
+    Vector2r position;
+    Vector2r velocity;
+    Real mass;
+  };
+
+  ParticleFile();
+  ~ParticleFile();
+
+  ParticleFile(const ParticleFile&) = delete;
+  ParticleFile& operator=(const ParticleFile&) = delete;
+
+  // Creates or truncates path and maps room for capacity records, size() starts at 0
+  bool open(const std::string& path, std::size_t capacity);
+  void close();
+  bool isOpen() const;
+
+  Record* data();
+  const Record* data() const;
+  std::size_t size() const;
+  void resize(std::size_t size);    // At most capacity()
+  std::size_t capacity() const;
+  const std::string& path() const;
+
+  // Hints for the pages of records [begin, end): start reading them in the background,
+  // or unmap them from this process. Released pages that were written still reach the
+  // file, the next access faults them back in.
+  void prefetch(std::size_t begin, std::size_t end) const;
+  void release(std::size_t begin, std::size_t end) const;
+
+  void swap(ParticleFile& other);
+
+private:
+  std::string path_;
+  int fd_;
+  Record* records_;
+  std::size_t size_;
+  std::size_t capacity_;
+
+  void advise(std::size_t begin, std::size_t end, int advice) const;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PARTICLE_MESH
+#define PARTICLE_MESH
+
+#include <complex>
+#include <functional>
+#include <vector>
+
+#include "Particle.hpp"
+
+// Particle-mesh gravity on a grid covering the simulation area. Masses are
+// deposited with cloud-in-cell weights, convolved with the force kernel by FFT on
+// a grid padded to twice the size (isolated boundaries, no periodic images), and
+// the acceleration field is interpolated back to the particles with the same
+// weights.
+//
+// The mesh kernel is the long range part G r/r^2 (1 - exp(-r^2/rs^2)) of the force
+// law, which is smooth at the origin so the grid can resolve it. nearField() with
+// the same split radius adds the short range remainder within each leaf (P3M).
+// Its x and y components are packed into one complex field, so a solve is one
+// forward and one inverse transform.
+class ParticleMesh {
+
+public:
+  // Runs work over ranges covering [0, count), possibly on several threads
+  typedef std::function<void(std::size_t, const std::function<void(std::size_t, std::size_t)>&)> Runner;
+
+  enum {
+    DEFAULT_CELLS = 512
+  };
+
+  ParticleMesh();
+
+  // cells is the number of cells along the longer side of area, rounded up to a power
+  // of two. Reallocates and recomputes the kernel only when the size, cells or slices
+  // changed. Particles outside the area are clamped to its edge cells.
+  void configure(const sf::FloatRect& area, int cells, int num_slices);
+
+  // Adds the mesh acceleration to every particle
+  void computeAccelerations(std::vector<Particle>& particles, const Runner& run);
+
+  float getCellSize() const;
+  float getSplitRadius() const;
+  std::size_t getAllocatedBytes() const;
+
+private:
+  typedef std::complex<float> Complex;
+
+  sf::Vector2f origin_;
+  float width_;
+  float height_;
+  int cells_;
+  int num_slices_;
+
+  float cell_size_;
+  float split_radius_;
+  int nx_;              // Cells covering the simulation area
+  int ny_;
+  int padded_nx_;       // Transform size, powers of two of at least twice nx_, ny_
+  int padded_ny_;
+  bool kernel_ready_;
+
+  std::vector<std::vector<float>> slices_;   // Per thread deposits, nx_ * ny_
+  std::vector<Complex> grid_;                // padded_nx_ * padded_ny_, row major
+  std::vector<Complex> kernel_;              // Transformed kernel, same layout
+  std::vector<Complex> twiddles_x_;
+  std::vector<Complex> twiddles_y_;
+
+  void computeKernel(const Runner& run);
+  void deposit(const std::vector<Particle>& particles, const Runner& run);
+  void transform(std::vector<Complex>& data, int rows, bool inverse, const Runner& run) const;
+  void interpolate(std::vector<Particle>& particles, const Runner& run) const;
+};
+
+#endif
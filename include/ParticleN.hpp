@@ -0,0 +1,20 @@
+#ifndef PARTICLE_N
+#define PARTICLE_N
+
+#include "VectorN.hpp"
+
+// Particle of the dimension templated engine. Carries only what gravity needs, the
+// 2D front end's Particle keeps its color and rung.
+template <int D>
+struct ParticleN {
+  VectorN<D> position;
+  VectorN<D> velocity;
+  VectorN<D> acceleration;
+  float mass;
+
+  ParticleN() : position(), velocity(), acceleration(), mass(1.0f) {}
+  ParticleN(const VectorN<D>& pos, const VectorN<D>& vel, float m)
+    : position(pos), velocity(vel), acceleration(), mass(m) {}
+};
+
+#endif
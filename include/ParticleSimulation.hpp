@@ -3,15 +3,89 @@
 
 #include "Particle.hpp"
 #include "QuadTree.hpp"
+#include "ForceKernels.hpp"
 #include "Profiler.hpp"
+#include "SamplingProfiler.hpp"
+#include "SolverPolicy.hpp"
+#include "FrameGovernor.hpp"
+#include "ParticleMesh.hpp"
+#include "NumaTopology.hpp"
+#include "HugePageArena.hpp"
+#include "MonotonicArena.hpp"
 
 #include <vector>
 #include <thread>
 #include <random>   // std::random_device
 #include <cmath>    // std::pow()
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 
 class ParticleSimulation
 {
+public:
+    // Semi-implicit Euler with one global step, or kick-drift-kick leapfrog where
+    // each particle sits on a power of two rung of the global step (block time steps)
+    // and forces are only evaluated for the rungs whose step ends.
+    enum Integrator {
+        EULER,
+        LEAPFROG
+    };
+
+    // Wall time of each phase of the last frame, in milliseconds. With the direct
+    // solver the tree phases are zero (unless the tree is displayed), near_field_ms
+    // holds the pairwise sum and far_field_ms the integration. With the mesh solver
+    // near_field_ms is the P3M short range pass and far_field_ms the mesh solve
+    // and integration. With the leapfrog
+    // far_field_ms also includes the kicks. With the monopole and quadrupole far
+    // fields leaf_gather_ms includes the moments and list rebuilds, near_field_ms
+    // the neighbouring leaves.
+    struct PhaseTimings {
+        double delete_tree_ms;
+        double compaction_ms;
+        double insert_ms;
+        double leaf_gather_ms;
+        double near_field_ms;
+        double far_field_ms;
+        double drift_ms;
+        double draw_ms;
+        SolverPolicy::Solver solver;
+        std::size_t active_particles;   // Particles that received a force evaluation
+        bool lists_rebuilt;             // Interaction lists of the far field were rebuilt
+
+        PhaseTimings() : delete_tree_ms(0.0), compaction_ms(0.0), insert_ms(0.0), leaf_gather_ms(0.0),
+                         near_field_ms(0.0), far_field_ms(0.0), drift_ms(0.0), draw_ms(0.0),
+                         solver(SolverPolicy::TREE), active_particles(0), lists_rebuilt(false) {}
+
+        double simulationMs() const
+        {
+            return delete_tree_ms + compaction_ms + insert_ms + leaf_gather_ms + near_field_ms + far_field_ms +
+                   drift_ms;
+        }
+    };
+
+    // Where the particle pages are and how the particle reads of the leaf passes split
+    // into reads from the reading thread's node and from other nodes. Reads are
+    // attributed to the node a worker of the leaf chunk is (or with NUMA mode would
+    // be) pinned to; pages not faulted in yet count as remote.
+    struct NumaStats {
+        int nodes;
+        bool pinned;
+        std::vector<std::size_t> pages_per_node;
+        std::size_t local_reads;
+        std::size_t remote_reads;
+
+        NumaStats() : nodes(1), pinned(false), pages_per_node(), local_reads(0), remote_reads(0) {}
+
+        double localFraction() const
+        {
+            const std::size_t reads = local_reads + remote_reads;
+            return reads > 0 ? static_cast<double>(local_reads) / reads : 1.0;
+        }
+    };
+
 private:
     sf::RenderWindow* game_window_;
     int num_threads_;
@@ -29,7 +103,7 @@ private:
     float time_step_;
     float particle_mass_;
 
-    sf::Vector2f global_com_;
+    Vector2a global_com_;
 
     sf::Vector2f current_mouse_pos_f_;
     sf::Vector2f initial_mouse_pos_f_;
@@ -58,6 +132,73 @@ private:
 
     QuadTree quad_tree_;
 
+    int total_leaf_nodes_;
+    PhaseTimings phase_timings_;
+
+    SolverPolicy solver_policy_;
+    ForceKernels::ParticleSoA particle_soa_;
+    std::vector<ForceKernels::MergePair> merge_pairs_;
+    std::mutex merge_mutex_;
+
+    FrameGovernor frame_governor_;
+    int substeps_;
+    int draw_stride_;
+
+    ForceKernels::FarFieldModel far_field_model_;
+    float theta_;
+    ForceKernels::InteractionLists interaction_lists_;
+    bool quantized_neighbours_;
+    ForceKernels::QuantizedLeaves quantized_leaves_;
+
+    ParticleMesh particle_mesh_;
+    int mesh_cells_;
+    bool mesh_short_range_;
+
+    ForceKernels::BoundaryPolicy boundary_;
+    EwaldTable ewald_table_;        // Periodic correction of the tree solver, periodic boundary only
+    bool collisions_;
+    bool accretion_;
+    float accretion_speed_;
+    bool dynamic_bounds_;
+    sf::FloatRect root_bounds_;     // Root cell of the tree and area of the mesh
+
+    Integrator integrator_;
+    int max_rung_;
+    long long substep_;
+    std::vector<unsigned char> active_;
+    std::vector<Vector2r> velocities_before_;
+    std::vector<Particle> compacted_particles_;    // Scratch buffer of the compaction, swapped with particles_
+
+    NumaTopology numa_topology_;
+    bool numa_aware_;
+    std::vector<QuadTree::StorageRange> placed_tree_storage_;
+    QuadTree::StorageRange advised_particle_storage_[2];    // particles_ and compacted_particles_
+    MonotonicArena frame_arena_;    // Scratch of the main thread, reset at the start of every step
+    std::vector<std::unique_ptr<MonotonicArena>> worker_arenas_;   // Scratch of each leaf chunk, reset with it
+
+    SamplingProfiler sampling_profiler_;
+    int sample_delay_frames_;
+    int sample_num_frames_;
+    int sample_frequency_hz_;
+    std::string sample_output_path_;
+
+    void updateSamplingProfiler(int frame);
+    FrameGovernor::Knobs getGovernorKnobs();
+    void setGovernorKnobs(const FrameGovernor::Knobs& knobs);
+    void runOnChunks(std::size_t count,
+                     std::size_t alignment,
+                     const std::function<void(std::size_t, std::size_t)>& work);
+    void runOnLeafChunks(const std::function<void(std::size_t, std::size_t)>& work);
+    void resetFrameArenas();
+    MonotonicArena* leafChunkArena(std::size_t start_index);
+    void runOnParticleTiles(const std::function<void(std::size_t, std::size_t)>& work);
+    void runMeshShortRange(const std::vector<unsigned char>* active, float merge_speed);
+    void runDirectSum(const std::vector<unsigned char>* active, float merge_speed);
+    void reorderByLeaves();
+    void placeTreeStorage();
+    void adviseParticleStorage();
+    void runMeshLongRange();
+
 public:
     ParticleSimulation(int simulation_width,
                        int simulation_height,
@@ -67,16 +208,117 @@ public:
                        int tree_depth,
                        int node_cap);
 
+    // Headless simulation without a window or font, used by benchmarks. Starts unpaused.
+    ParticleSimulation(int simulation_width,
+                       int simulation_height,
+                       int num_threads,
+                       float dt,
+                       int tree_depth,
+                       int node_cap);
+
     ~ParticleSimulation();
 
+    // Adapts tree depth, node capacity, substeps and draw LOD to hold target_ms of
+    // simulation and draw work per frame. The current settings are the baseline.
+    void enableFrameGovernor(double target_ms);
+
+    void enableSamplingProfiler(int delay_frames,
+                                int num_frames,
+                                int frequency_hz,
+                                const std::string& output_path);
+
     void run();
     void pollUserEvent();
     void updateAndDraw();
+    void step();
+    void buildParticleVertices(sf::VertexArray& particles_vertices) const;
+
+    void addParticles(const std::vector<Particle>& particles);
+    std::size_t getParticleCount() const;
+    const std::vector<Particle>& getParticles() const;
+    const PhaseTimings& getPhaseTimings() const;
+    void setPaused(bool paused);
+    void setNumThreads(int num_threads);
+    void setSolverMode(SolverPolicy::Mode mode);
+    void setIntegrator(Integrator integrator, int max_rung);
+    Integrator getIntegrator() const;
+    static const char* integratorName(Integrator integrator);
+    static bool parseIntegrator(const std::string& str, Integrator& integrator);
+    const SolverPolicy& getSolverPolicy() const;
+    void setFarField(ForceKernels::FarFieldModel model, float theta);
+    ForceKernels::FarFieldModel getFarField() const;
+    static const char* farFieldName(ForceKernels::FarFieldModel model);
+    static bool parseFarField(const std::string& str, ForceKernels::FarFieldModel& model);
+
+    // The monopole and quadrupole far fields read the neighbouring leaves' particles
+    // from a copy quantized to 16 bits within each leaf, see ForceKernels::QuantizedLeaves
+    void setQuantizedNeighbours(bool enabled);
+
+    // Grid cells along the longer side of the simulation for the mesh solver, and
+    // whether the leaf near field adds the short range forces (P3M)
+    void setMesh(int cells, bool short_range);
+
+    // What happens to particles leaving the simulation area, delete by default. With the
+    // periodic policy the MONOPOLE and QUADRUPOLE tree solvers also make gravity periodic
+    // (minimum image cells plus an Ewald correction), and the tree is then used whatever
+    // the solver mode. The GLOBAL_COM far field stays isolated with every solver.
+    // Returns false and changes nothing for a policy but delete with dynamic bounds on.
+    bool setBoundary(ForceKernels::BoundaryPolicy boundary);
+    ForceKernels::BoundaryPolicy getBoundary() const;
+    static const char* boundaryName(ForceKernels::BoundaryPolicy boundary);
+    static bool parseBoundary(const std::string& str, ForceKernels::BoundaryPolicy& boundary);
+
+    // Touching particles slower than max_speed relative to each other merge in the leaf
+    // near field, with the tree solver or the P3M pass of the mesh. Absorbed particles
+    // are compacted away at the start of the next step.
+    void setAccretion(bool enabled, float max_speed);
+
+    // Without collisions touching particles attract like any others, softened. On by
+    // default; accretion needs it.
+    void setCollisions(bool enabled);
+
+    // With dynamic bounds the root cell follows the particles, nobody is removed for
+    // leaving the simulation area even with the delete policy. Otherwise the root is
+    // the simulation area. Only the delete policy goes with them, the others need the
+    // fixed area: turning them on with another policy returns false and changes nothing.
+    bool setDynamicBounds(bool dynamic);
+    const sf::FloatRect& getRootBounds() const;
+
+    // NUMA mode pins the worker of every chunk to a CPU of its node (workers fill the
+    // nodes in contiguous blocks), stores particles in leaf order after every tree step
+    // with each leaf chunk's particles written by, and moved to the node of, the worker
+    // that runs that chunk, and interleaves the tree's buffers over the nodes.
+    // On a single node this only leaves the pinning and the leaf order.
+    void setNumaAware(bool enabled);
+    bool isNumaAware() const;
+    const NumaTopology& getNumaTopology() const;
+
+    // From the leaves of the last tree step
+    NumaStats measureNumaPlacement() const;
+
+    // HugePageArena statistics, with the particle buffers, which are only advised,
+    // added to the resident and huge page bytes
+    HugePageArena::Stats getHugePageStats() const;
 
     inline void drawAimLine();
     inline void drawParticleVelocity();
 
-    void updateForces(float total_mass);
+    void updateForces(Accum total_mass);
+    void runFarField(Accum global_mass, const std::vector<unsigned char>* active);
+    void updateInteractionLists();
+    void updateRootBounds();
+    void compactParticles();
+    float mergeSpeed() const;
+    ForceKernels::IntegrationParams integrationParams() const;
+    ForceKernels::MultipoleParams multipoleParams() const;
+    bool periodicGravity() const;
+    void runNeighbourField(const std::vector<unsigned char>* active);
+    void updateForcesDirect();
+    void updateForcesMesh();
+    void updateForcesLeapfrog(Accum global_mass, SolverPolicy::Solver solver);
+
+    // Runs the force solver on the current particles without integrating, for accuracy checks
+    void computeAccelerations(std::vector<Vector2a>& accelerations);
 
     void addSierpinskiTriangleParticleChunk(int x, int y, int size, int depth);
     void addCheckeredParticleChunk();
@@ -0,0 +1,51 @@
+#ifndef PRECISION
+#define PRECISION
+
+#include <SFML/Graphics.hpp>
+
+// Compile time precision policy, set with the NBODY_PRECISION CMake option:
+//   FLOAT   float state and float sums (default)
+//   MIXED   float state, double accelerations, tree moments and kernel sums
+//   DOUBLE  double state and sums
+// Real is the type particle positions, velocities and masses are stored in, Accum the
+// type sums over many particles are carried in. Tree cells, the mesh grid and SFML
+// vertices stay float.
+#if defined(NBODY_PRECISION_DOUBLE)
+typedef double Real;
+typedef double Accum;
+#elif defined(NBODY_PRECISION_MIXED)
+typedef float Real;
+typedef double Accum;
+#else
+typedef float Real;
+typedef float Accum;
+#endif
+
+typedef sf::Vector2<Real> Vector2r;
+typedef sf::Vector2<Accum> Vector2a;
+
+inline const char* precisionName()
+{
+#if defined(NBODY_PRECISION_DOUBLE)
+  return "double";
+#elif defined(NBODY_PRECISION_MIXED)
+  return "mixed";
+#else
+  return "float";
+#endif
+}
+
+// Component wise conversion, free when the types match
+template <typename T, typename U>
+inline sf::Vector2<T> vectorCast(const sf::Vector2<U>& v)
+{
+  return sf::Vector2<T>(static_cast<T>(v.x), static_cast<T>(v.y));
+}
+
+template <typename U>
+inline sf::Vector2f toVector2f(const sf::Vector2<U>& v)
+{
+  return vectorCast<float>(v);
+}
+
+#endif
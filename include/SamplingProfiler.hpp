@@ -0,0 +1,58 @@
+#ifndef SAMPLING_PROFILER_H
+#define SAMPLING_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// In-process statistical profiler. While running, a SIGPROF interval timer
+// interrupts whichever thread is burning CPU, and the signal handler records the
+// interrupted call stack into a preallocated buffer. Stacks are unwound by walking
+// frame pointers (each read is fault-checked) or, when that is not available,
+// with the libgcc unwinder. Symbolization happens after stop() using
+// /proc/self/maps and the dynamic symbol table, and the result is written as
+// folded stacks ("root;child;leaf count") for flamegraph tools.
+//
+// Only supported on Linux; on other platforms start() returns false.
+class SamplingProfiler {
+
+public:
+  enum UnwindMethod {
+    FRAME_POINTER,   // Walk the rbp/x29 chain, needs -fno-omit-frame-pointer
+    UNWIND_TABLES    // Use the libgcc unwinder (_Unwind_Backtrace())
+  };
+
+  struct Sample {
+    int depth;
+    uintptr_t frames[64];  // frames[0] is the interrupted pc, then return addresses
+  };
+
+  SamplingProfiler();
+  ~SamplingProfiler();
+
+  SamplingProfiler(const SamplingProfiler&) = delete;
+  SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+  bool start(int frequency_hz, int max_samples = 1 << 15);
+  void stop();
+  bool isRunning() const;
+
+  int getSampleCount() const;
+  int getDroppedSampleCount() const;
+  UnwindMethod getUnwindMethod() const;
+
+  bool writeFoldedStacks(const std::string& path) const;
+
+  // Called from the SIGPROF handler, must stay async-signal-safe.
+  void recordSample(void* ucontext);
+
+private:
+  std::vector<Sample> samples_;
+  std::atomic<int> next_sample_;
+  std::atomic<int> dropped_samples_;
+  UnwindMethod unwind_method_;
+  bool running_;
+};
+
+#endif //SAMPLING_PROFILER_H
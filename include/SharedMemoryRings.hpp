@@ -0,0 +1,60 @@
+#ifndef SHARED_MEMORY_RINGS
+#define SHARED_MEMORY_RINGS
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Byte rings between the ranks of one host, all in one POSIX shared memory segment.
+// Ring (i, j) has a single producer, rank i, and a single consumer, rank j, so head
+// and tail are plain atomics without locks. The creator maps the segment before
+// forking the ranks, or other processes attach to it by name.
+//
+// Only supported on POSIX systems, elsewhere create() and attach() return false.
+class SharedMemoryRings {
+
+public:
+  SharedMemoryRings();
+  ~SharedMemoryRings();
+
+  SharedMemoryRings(const SharedMemoryRings&) = delete;
+  SharedMemoryRings& operator=(const SharedMemoryRings&) = delete;
+
+  // name is a shm_open name, e.g. "/nbody-1234"
+  bool create(const std::string& name, int num_ranks, std::size_t ring_bytes);
+  bool attach(const std::string& name);
+  void unlink();    // Removes the name, existing mappings stay valid
+  void close();
+
+  int getRankCount() const;
+  std::size_t getRingBytes() const;
+
+  // Sends outgoing[j] to every other rank j and receives what each of them sent this
+  // rank into incoming[j], so every rank has to call it the same number of times.
+  // Messages may be larger than a ring: all rings are pumped in turn until every
+  // message is through, which also means no order of calls across ranks can deadlock.
+  // incoming[rank] is a copy of outgoing[rank].
+  void exchange(int rank,
+                const std::vector<std::vector<char>>& outgoing,
+                std::vector<std::vector<char>>& incoming);
+
+  std::uint64_t getBytesSent() const;
+
+private:
+  struct Header;
+  struct Ring;
+
+  std::string name_;
+  void* mapping_;
+  std::size_t mapping_bytes_;
+  Header* header_;
+  std::uint64_t bytes_sent_;
+
+  Ring* ring(int from, int to) const;
+  unsigned char* ringData(int from, int to) const;
+  std::size_t push(int from, int to, const unsigned char* data, std::size_t count);
+  std::size_t pop(int from, int to, unsigned char* data, std::size_t count);
+};
+
+#endif
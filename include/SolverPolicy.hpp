@@ -0,0 +1,66 @@
+#ifndef SOLVER_POLICY
+#define SOLVER_POLICY
+
+#include <cstddef>
+#include <string>
+
+// Picks the force solver for each frame. The tree is modeled as costing
+// c_tree * N and the tiled direct sum as c_direct * N^2. Both coefficients start
+// from a guess that crosses over at INITIAL_CROSSOVER particles and are then
+// learned from the measured time of previous frames. Switching needs the other
+// solver to be predicted clearly cheaper, and the solver not in use is re-probed
+// now and then when it is close, so stale estimates do not lock in a choice.
+// The particle-mesh solver trades short range accuracy for speed, so it is only
+// used when asked for and never picked automatically.
+class SolverPolicy {
+
+public:
+  enum Solver {
+    TREE,
+    DIRECT,
+    MESH
+  };
+
+  enum Mode {
+    AUTO,
+    ALWAYS_TREE,
+    ALWAYS_DIRECT,
+    ALWAYS_MESH
+  };
+
+  enum {
+    INITIAL_CROSSOVER = 2048,
+    PROBE_INTERVAL = 240      // Frames between probes of the solver not in use
+  };
+
+  SolverPolicy();
+
+  void setMode(Mode mode);
+  Mode getMode() const;
+
+  // Solver for the next frame, may change the current solver
+  Solver choose(std::size_t num_particles);
+
+  // Cheaper solver for num_particles according to the model, without side effects
+  Solver predict(std::size_t num_particles) const;
+
+  // Force computation time of a frame, including the tree build for TREE
+  void record(Solver solver, std::size_t num_particles, double milliseconds);
+
+  double predictMs(Solver solver, std::size_t num_particles) const;
+  Solver getCurrent() const;
+
+  static const char* name(Solver solver);
+  static bool parse(const std::string& str, Mode& mode);
+
+private:
+  Mode mode_;
+  Solver current_;
+  double tree_ms_per_particle_;
+  double direct_ms_per_pair_;
+  bool tree_measured_;
+  bool direct_measured_;
+  int frames_since_probe_;
+};
+
+#endif
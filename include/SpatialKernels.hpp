@@ -0,0 +1,43 @@
+#ifndef SPATIAL_KERNELS
+#define SPATIAL_KERNELS
+
+#include <vector>
+
+#include "SpatialTree.hpp"
+
+// The octree, SpatialTree<3>
+typedef SpatialTree<3> Octree;
+
+// Force passes of the 3D engine on the octree. 2D runs go through ForceKernels on the
+// same tree engine (QuadTree), which has the quadrupoles, collisions and boundaries.
+// Gravity follows the 3D force law G m r / r^3, softened with ForceKernels::SOFTENING.
+// There are no collisions, touching pairs attract with the softened law as across 2D
+// neighbour leaves and only pairs closer than ForceKernels::MIN_DISTANCE_SQUARED are skipped.
+namespace SpatialKernels {
+
+// Exact forces between the particles of each leaf in [start_index, end_index)
+void nearField(std::vector<ParticleN<3>>& particles,
+               const Octree& tree,
+               const std::vector<Octree::TreeNode*>& leaf_nodes,
+               std::size_t start_index,
+               std::size_t end_index);
+
+// Barnes-Hut walk for each leaf in [start_index, end_index): cells whose size is below
+// theta times their distance from the leaf's bounding sphere contribute their
+// monopole, neighbouring leaves are summed exactly. computeMoments() must have run.
+void treeField(std::vector<ParticleN<3>>& particles,
+               const Octree& tree,
+               const std::vector<Octree::TreeNode*>& leaf_nodes,
+               std::size_t start_index,
+               std::size_t end_index,
+               float theta);
+
+// Semi-implicit Euler over particles [start_index, end_index), clears the accelerations
+void integrate(std::vector<ParticleN<3>>& particles,
+               std::size_t start_index,
+               std::size_t end_index,
+               float time_step);
+
+} // namespace SpatialKernels
+
+#endif
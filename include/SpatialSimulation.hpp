@@ -0,0 +1,51 @@
+#ifndef SPATIAL_SIMULATION
+#define SPATIAL_SIMULATION
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "SpatialKernels.hpp"
+
+// Headless gravity simulation on the octree, the engine behind 3D runs. Every step
+// rebuilds the tree, runs the leaf near field and the Barnes-Hut walk over leaf chunks
+// on num_threads threads, and integrates. Particles leaving the root cell are removed.
+// The 2D front end with its solvers, boundaries and integrators is ParticleSimulation
+// on SpatialTree<2> (QuadTree).
+class SpatialSimulation {
+
+public:
+  typedef Octree::Cell Cell;
+
+  SpatialSimulation(const Cell& bounds, int num_threads, float dt, int tree_depth, int node_cap);
+
+  void addParticles(const std::vector<ParticleN<3>>& particles);
+  void step();
+
+  // Accelerations of the current particles without integrating, for accuracy checks
+  void computeAccelerations(std::vector<VectorN<3>>& accelerations);
+
+  const std::vector<ParticleN<3>>& getParticles() const;
+  std::size_t getParticleCount() const;
+  std::size_t getLeafCount() const;
+  const Cell& getBounds() const;
+  double getStepMs() const;
+  void setTheta(float theta);
+
+private:
+  Octree tree_;
+  std::vector<ParticleN<3>> particles_;
+  std::vector<Octree::TreeNode*> leaf_nodes_;
+  std::vector<std::thread> threads_;
+  int num_threads_;
+  float time_step_;
+  float theta_;
+  double step_ms_;
+
+  void runOnChunks(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work);
+  void removeOutside();
+  void buildTree();
+  void computeForces();
+};
+
+#endif
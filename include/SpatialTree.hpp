@@ -0,0 +1,241 @@
+#ifndef SPATIAL_TREE
+#define SPATIAL_TREE
+
+#include <vector>
+
+#include "Particle.hpp"
+#include "ParticleN.hpp"
+#include "Helpers.hpp"
+#include "HugePageArena.hpp"
+
+// Axis aligned cell of the 3D tree, contains() is half open like sf::FloatRect
+template <int D>
+struct CellN {
+  VectorN<D> corner;
+  VectorN<D> size;
+
+  bool contains(const VectorN<D>& point) const
+  {
+    for (int i = 0; i < D; ++i) {
+      if (point[i] < corner[i] || point[i] >= corner[i] + size[i]) return false;
+    }
+    return true;
+  }
+
+  VectorN<D> center() const { return corner + 0.5f * size; }
+
+  CellN child(int quadrant) const
+  {
+    CellN result = { corner, 0.5f * size };
+    for (int i = 0; i < D; ++i) {
+      if (quadrant & (1 << i)) result.corner[i] += result.size[i];
+    }
+    return result;
+  }
+};
+
+// What SpatialTree<D> stores and how it reads positions, per dimension
+template <int D>
+struct SpatialTraits;
+
+// The 2D front end: its Particle, sf::FloatRect cells and gravity nodes that also
+// carry the second moments of the quadrupole far field
+template <>
+struct SpatialTraits<2> {
+  typedef Particle ParticleType;
+  typedef sf::FloatRect Cell;
+  typedef Vector2a Vector;
+
+  // com_x and com_y are mass weighted position sums, divide by total_mass for the COM.
+  // qxx, qxy and qyy are second moments about the COM, only valid after computeMoments().
+  // All are sums over particles and carried in the Accum of the precision policy.
+  struct GravityElementNode {
+    Accum com_x;
+    Accum com_y;
+    Accum total_mass;
+    Accum qxx;
+    Accum qxy;
+    Accum qyy;
+
+    GravityElementNode() : com_x(0.0f), com_y(0.0f), total_mass(0.0f), qxx(0.0f), qxy(0.0f), qyy(0.0f) {}
+
+    void add(const Particle& particle)
+    {
+      total_mass += particle.mass;
+      com_x += static_cast<Accum>(particle.position.x) * particle.mass;
+      com_y += static_cast<Accum>(particle.position.y) * particle.mass;
+    }
+
+    void add(const GravityElementNode& other)
+    {
+      total_mass += other.total_mass;
+      com_x += other.com_x;
+      com_y += other.com_y;
+    }
+
+    Vector2a getCenterOfMass() const
+    {
+      return (total_mass > 0.0f) ? Vector2a(com_x / total_mass, com_y / total_mass) : Vector2a(0.0f, 0.0f);
+    }
+  };
+
+  static float coordinate(const Particle& particle, int axis)
+  {
+    return axis == 0 ? static_cast<float>(particle.position.x) : static_cast<float>(particle.position.y);
+  }
+
+  static bool contains(const sf::FloatRect& cell, const Particle& particle)
+  {
+    return cell.contains(toVector2f(particle.position));
+  }
+
+  static float center(const sf::FloatRect& cell, int axis)
+  {
+    return axis == 0 ? cell.left + cell.width * 0.5f : cell.top + cell.height * 0.5f;
+  }
+
+  static sf::FloatRect child(sf::FloatRect cell, int quadrant)
+  {
+    cell.width *= 0.5f;
+    cell.height *= 0.5f;
+    if (quadrant & 1) cell.left += cell.width;
+    if (quadrant & 2) cell.top += cell.height;
+    return cell;
+  }
+};
+
+// The 3D engine: ParticleN<3> in CellN<3> cells, monopoles only
+template <>
+struct SpatialTraits<3> {
+  typedef ParticleN<3> ParticleType;
+  typedef CellN<3> Cell;
+  typedef VectorN<3> Vector;
+
+  // com is the mass weighted position sum, divide by total_mass for the COM
+  struct GravityElementNode {
+    VectorN<3> com;
+    float total_mass;
+
+    GravityElementNode() : com(), total_mass(0.0f) {}
+
+    void add(const ParticleN<3>& particle)
+    {
+      total_mass += particle.mass;
+      com += particle.mass * particle.position;
+    }
+
+    void add(const GravityElementNode& other)
+    {
+      total_mass += other.total_mass;
+      com += other.com;
+    }
+
+    VectorN<3> getCenterOfMass() const
+    {
+      return (total_mass > 0.0f) ? (1.0f / total_mass) * com : VectorN<3>();
+    }
+  };
+
+  static float coordinate(const ParticleN<3>& particle, int axis) { return particle.position[axis]; }
+  static bool contains(const Cell& cell, const ParticleN<3>& particle) { return cell.contains(particle.position); }
+  static float center(const Cell& cell, int axis) { return cell.corner[axis] + 0.5f * cell.size[axis]; }
+  static Cell child(const Cell& cell, int quadrant) { return cell.child(quadrant); }
+};
+
+// Tree engine of both front ends: SpatialTree<2> is the quadtree (QuadTree) and
+// SpatialTree<3> the octree. Nodes live in one implicit array, the children of node i
+// are CHILDREN * i + j for j in [1, CHILDREN], and child j - 1 takes the upper half
+// of axis a when bit a of j - 1 is set. Leaves keep linked lists of particle indices.
+// Mass and mass weighted position sums live in a gravity node array parallel to the
+// nodes, so the walks read them without an indirection.
+//
+// Instantiated for D = 2 and 3 in SpatialTree.cpp, the 2D only parts are in QuadTree.cpp.
+template <int D>
+class SpatialTree {
+
+public:
+  enum {
+    CHILDREN = 1 << D
+  };
+
+  typedef typename SpatialTraits<D>::ParticleType ParticleType;
+  typedef typename SpatialTraits<D>::Cell Cell;
+  typedef typename SpatialTraits<D>::Vector Vector;
+  typedef typename SpatialTraits<D>::GravityElementNode GravityElementNode;
+
+  struct TreeNode {
+    int first_particle;     // Index of first element if leaf and not empty, else -1
+    int count;              // Number of elements in a leaf or -1 for a branch
+
+    TreeNode() : first_particle(-1), count(0) {}
+  };
+
+  struct ParticleElementNode {
+    int next_element_index;
+    int particle_index;
+
+    ParticleElementNode() = default;
+    ParticleElementNode(int next, int idx) : next_element_index(next), particle_index(idx) {}
+  };
+
+  // A contiguous buffer of the tree, for placing its pages (see NumaTopology)
+  struct StorageRange {
+    const void* data;
+    std::size_t bytes;
+  };
+
+  SpatialTree(const Cell& bounds, int max_depth, int capacity);
+
+  // Particles outside the root cell are not part of the tree
+  void insert(const std::vector<ParticleType>& particles);
+
+  // Moves the particles of a full leaf into its children, parent is the leaf's cell
+  void split(int parent_index, const Cell& parent, const std::vector<ParticleType>& particles);
+
+  void deleteTree();
+
+  // Appends the non-empty leaves, counts all leaves and returns the global COM
+  Vector getLeafNodes(std::vector<TreeNode*>& vec, int& total_leaf_nodes, Accum& global_mass);
+
+  // Mass and COM of every branch from its children, leaves are summed by insert().
+  // In 2D also the second moments, of leaves straight from their particles.
+  void computeMoments(const std::vector<ParticleType>& particles);
+
+  // 2D only, draws the leaf cells
+  void display(sf::RenderWindow* game_window, int total_leaf_nodes) const;
+
+  const HugePageVector<ParticleElementNode>& getParticleElementNodeVec() const;
+  HugePageVector<ParticleElementNode>& getParticleElementNodeVec();   // To renumber reordered particles
+  const TreeNode& getNode(int index) const;
+  int getNodeIndex(const TreeNode* node) const;
+  Cell getNodeBounds(int index) const;
+  const GravityElementNode& getGravityNode(const TreeNode& node) const;
+  const GravityElementNode& getGravityNode(int index) const;
+  std::size_t getAllocatedBytes() const;
+  void getStorageRanges(std::vector<StorageRange>& ranges) const;
+
+  const Cell& getBounds() const;
+  void setBounds(const Cell& bounds);   // Takes effect with the next insert(), the tree must be empty
+  int getMaxDepth() const;
+  void setMaxDepth(int depth);          // Up to the depth the tree was built for
+  int getNodeCapacity() const;
+  void setNodeCapacity(int capacity);
+
+private:
+  Cell bounds_;
+  int tree_max_depth_;
+  int node_cap_;
+
+  HugePageVector<TreeNode> tree_nodes_;
+  HugePageVector<ParticleElementNode> particle_nodes_;
+  // Parallel to tree_nodes_. An entry is only valid while its cell is part of the tree:
+  // insert() clears the root's, split() the children's.
+  HugePageVector<GravityElementNode> gravity_nodes_;
+
+  void addToLeaf(int node_index, int element_index, const ParticleType& particle);
+};
+
+template <>
+void SpatialTree<2>::display(sf::RenderWindow* game_window, int total_leaf_nodes) const;
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef VECTOR_N
+#define VECTOR_N
+
+#include <SFML/Graphics.hpp>
+
+// Fixed size float vector for the dimension templated tree. The loops have a
+// compile time trip count and unroll to the same code as sf::Vector2f.
+template <int D>
+struct VectorN {
+  float v[D];
+
+  VectorN()
+  {
+    for (int i = 0; i < D; ++i) v[i] = 0.0f;
+  }
+
+  float& operator[](int i) { return v[i]; }
+  float operator[](int i) const { return v[i]; }
+
+  VectorN& operator+=(const VectorN& other)
+  {
+    for (int i = 0; i < D; ++i) v[i] += other.v[i];
+    return *this;
+  }
+
+  VectorN& operator-=(const VectorN& other)
+  {
+    for (int i = 0; i < D; ++i) v[i] -= other.v[i];
+    return *this;
+  }
+
+  VectorN& operator*=(float scale)
+  {
+    for (int i = 0; i < D; ++i) v[i] *= scale;
+    return *this;
+  }
+};
+
+template <int D>
+inline VectorN<D> operator+(VectorN<D> a, const VectorN<D>& b) { return a += b; }
+
+template <int D>
+inline VectorN<D> operator-(VectorN<D> a, const VectorN<D>& b) { return a -= b; }
+
+template <int D>
+inline VectorN<D> operator*(VectorN<D> a, float scale) { return a *= scale; }
+
+template <int D>
+inline VectorN<D> operator*(float scale, VectorN<D> a) { return a *= scale; }
+
+template <int D>
+inline float dot(const VectorN<D>& a, const VectorN<D>& b)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < D; ++i) sum += a.v[i] * b.v[i];
+  return sum;
+}
+
+// Projection onto the first two axes, for drawing
+template <int D>
+inline sf::Vector2f toVector2f(const VectorN<D>& a)
+{
+  return sf::Vector2f(a.v[0], a.v[1]);
+}
+
+#endif
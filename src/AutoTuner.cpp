@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "AutoTuner.hpp"
+#include "ParticleSimulation.hpp"
+
+namespace AutoTuner {
+
+// Same fixed step as main, the tuned frames should look like real ones
+static const float TIME_STEP = 0.000095f;
+
+static const char* PROFILE_DIRECTORY = "profiles";
+
+Scenario::Scenario()
+  : distribution(Distributions::SIERPINSKI),
+    num_particles(177147),  // 3^11, the triangle ParticleSimulation::run() starts with
+    width(1920),
+    height(1080),
+    warmup_frames(3),
+    frames(10),
+    seed(12345)
+{}
+
+Profile::Profile()
+  : machine(),
+    num_threads(1),
+    tree_depth(8),
+    node_capacity(64),
+    distribution(Distributions::SIERPINSKI),
+    num_particles(0),
+    width(1920),
+    height(1080),
+    insert_ms(0.0),
+    leaf_gather_ms(0.0),
+    near_field_ms(0.0),
+    far_field_ms(0.0),
+    frame_ms(0.0)
+{}
+
+static double median(std::vector<double> values)
+{
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+std::string machineId()
+{
+    std::string model = "unknown-cpu";
+
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "Processor") == 0) {
+            const std::size_t colon = line.find(':');
+            if (colon != std::string::npos && colon + 2 < line.size()) model = line.substr(colon + 2);
+            break;
+        }
+    }
+
+    std::string id;
+    bool last_was_separator = true;
+    for (char c : model) {
+        const bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if (keep) {
+            id += c;
+            last_was_separator = false;
+        } else if (!last_was_separator) {
+            id += '-';
+            last_was_separator = true;
+        }
+    }
+    if (!id.empty() && id.back() == '-') id.pop_back();
+
+    return id + "-" + std::to_string(std::max(1u, std::thread::hardware_concurrency())) + "t";
+}
+
+std::string defaultProfilePath()
+{
+    return std::string(PROFILE_DIRECTORY) + "/" + machineId() + ".profile";
+}
+
+bool saveProfile(const std::string& path, const Profile& profile)
+{
+    const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    std::error_code error;
+    if (!parent.empty()) std::filesystem::create_directories(parent, error);
+
+    std::ofstream out(path);
+    if (!out) return false;
+
+    out << "# Written by main --autotune, delete to tune again\n"
+        << "machine=" << profile.machine << "\n"
+        << "threads=" << profile.num_threads << "\n"
+        << "tree_depth=" << profile.tree_depth << "\n"
+        << "node_capacity=" << profile.node_capacity << "\n"
+        << "distribution=" << Distributions::name(profile.distribution) << "\n"
+        << "particles=" << profile.num_particles << "\n"
+        << "width=" << profile.width << "\n"
+        << "height=" << profile.height << "\n"
+        << "insert_ms=" << profile.insert_ms << "\n"
+        << "leaf_gather_ms=" << profile.leaf_gather_ms << "\n"
+        << "near_field_ms=" << profile.near_field_ms << "\n"
+        << "far_field_ms=" << profile.far_field_ms << "\n"
+        << "frame_ms=" << profile.frame_ms << "\n";
+
+    return static_cast<bool>(out);
+}
+
+bool loadProfile(const std::string& path, Profile& profile)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+
+    Profile loaded;
+    bool has_depth = false;
+    bool has_capacity = false;
+    bool has_threads = false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        const std::size_t equals = line.find('=');
+        if (equals == std::string::npos) continue;
+
+        const std::string key = line.substr(0, equals);
+        const std::string value = line.substr(equals + 1);
+
+        if (key == "machine") {
+            loaded.machine = value;
+        } else if (key == "threads") {
+            loaded.num_threads = std::atoi(value.c_str());
+            has_threads = true;
+        } else if (key == "tree_depth") {
+            loaded.tree_depth = std::atoi(value.c_str());
+            has_depth = true;
+        } else if (key == "node_capacity") {
+            loaded.node_capacity = std::atoi(value.c_str());
+            has_capacity = true;
+        } else if (key == "distribution") {
+            Distributions::parse(value, loaded.distribution);
+        } else if (key == "particles") {
+            loaded.num_particles = std::atoi(value.c_str());
+        } else if (key == "width") {
+            loaded.width = std::atoi(value.c_str());
+        } else if (key == "height") {
+            loaded.height = std::atoi(value.c_str());
+        } else if (key == "insert_ms") {
+            loaded.insert_ms = std::atof(value.c_str());
+        } else if (key == "leaf_gather_ms") {
+            loaded.leaf_gather_ms = std::atof(value.c_str());
+        } else if (key == "near_field_ms") {
+            loaded.near_field_ms = std::atof(value.c_str());
+        } else if (key == "far_field_ms") {
+            loaded.far_field_ms = std::atof(value.c_str());
+        } else if (key == "frame_ms") {
+            loaded.frame_ms = std::atof(value.c_str());
+        }
+    }
+
+    if (!has_depth || !has_capacity || !has_threads) return false;
+    if (loaded.num_threads < 1 || loaded.tree_depth < 0 || loaded.node_capacity < 1) return false;
+
+    profile = loaded;
+    return true;
+}
+
+static Profile measure(const Scenario& scenario,
+                       const std::vector<Particle>& initial,
+                       int num_threads,
+                       int depth,
+                       int capacity)
+{
+    ParticleSimulation sim(scenario.width, scenario.height, num_threads, TIME_STEP, depth, capacity);
+    sim.setSolverMode(SolverPolicy::ALWAYS_TREE);
+    sim.addParticles(initial);
+
+    std::vector<double> insert_ms, leaf_gather_ms, near_field_ms, far_field_ms, frame_ms;
+
+    for (int frame = 0; frame < scenario.warmup_frames + scenario.frames; ++frame) {
+        sim.step();
+        if (frame < scenario.warmup_frames) continue;
+
+        const ParticleSimulation::PhaseTimings& t = sim.getPhaseTimings();
+        insert_ms.push_back(t.insert_ms);
+        leaf_gather_ms.push_back(t.leaf_gather_ms);
+        near_field_ms.push_back(t.near_field_ms);
+        far_field_ms.push_back(t.far_field_ms);
+        frame_ms.push_back(t.simulationMs());
+    }
+
+    Profile result;
+    result.num_threads = num_threads;
+    result.tree_depth = depth;
+    result.node_capacity = capacity;
+    result.insert_ms = median(insert_ms);
+    result.leaf_gather_ms = median(leaf_gather_ms);
+    result.near_field_ms = median(near_field_ms);
+    result.far_field_ms = median(far_field_ms);
+    result.frame_ms = median(frame_ms);
+
+    std::printf("%8d %6d %6d %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                num_threads, depth, capacity, result.insert_ms, result.leaf_gather_ms,
+                result.near_field_ms, result.far_field_ms, result.frame_ms);
+    std::fflush(stdout);
+
+    return result;
+}
+
+Profile tune(const Scenario& scenario,
+             const std::vector<int>& depths,
+             const std::vector<int>& capacities,
+             const std::vector<int>& thread_counts)
+{
+    std::vector<Particle> initial;
+    Distributions::generate(scenario.distribution, initial, scenario.num_particles,
+                            scenario.width, scenario.height, 1.03f, scenario.seed);
+
+    const int max_threads = thread_counts.empty() ? 1 : *std::max_element(thread_counts.begin(), thread_counts.end());
+
+    std::printf("%8s %6s %6s %10s %10s %10s %10s %10s\n",
+                "threads", "depth", "cap", "insert", "leaves", "near", "far", "frame_ms");
+
+    Profile best;
+    best.frame_ms = -1.0;
+
+    for (int depth : depths) {
+        for (int capacity : capacities) {
+            const Profile candidate = measure(scenario, initial, max_threads, depth, capacity);
+            if (best.frame_ms < 0.0 || candidate.frame_ms < best.frame_ms) best = candidate;
+        }
+    }
+
+    const int best_depth = best.tree_depth;
+    const int best_capacity = best.node_capacity;
+
+    for (int threads : thread_counts) {
+        if (threads == max_threads) continue;
+        const Profile candidate = measure(scenario, initial, threads, best_depth, best_capacity);
+        if (candidate.frame_ms < best.frame_ms) best = candidate;
+    }
+
+    best.machine = machineId();
+    best.distribution = scenario.distribution;
+    best.num_particles = scenario.num_particles;
+    best.width = scenario.width;
+    best.height = scenario.height;
+
+    return best;
+}
+
+} // namespace AutoTuner
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "DirectSum.hpp"
+#include "ForceKernels.hpp"
+
+namespace DirectSum {
+
+// Rows are interleaved across threads since the potential only walks j > i
+template <typename Work>
+static void parallelForRows(std::size_t n, int num_threads, Work work)
+{
+    if (num_threads <= 1 || n < static_cast<std::size_t>(num_threads)) {
+        work(0, 1);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back(work, static_cast<std::size_t>(t), static_cast<std::size_t>(num_threads));
+    }
+
+    for (auto& thread : threads) thread.join();
+}
+
+void computeAccelerations(const std::vector<Particle>& particles,
+                          std::vector<Vector2d>& accelerations,
+                          int num_threads)
+{
+    const std::size_t n = particles.size();
+    accelerations.assign(n, Vector2d(0.0, 0.0));
+
+    const double min_distance_squared = ForceKernels::MIN_DISTANCE_SQUARED;
+    const double collision_radius_squared = ForceKernels::COLLISION_RADIUS_SQUARED;
+    const double softening = ForceKernels::SOFTENING;
+    const double big_g = ForceKernels::BIG_G;
+
+    parallelForRows(n, num_threads, [&](std::size_t first, std::size_t stride) {
+        for (std::size_t i = first; i < n; i += stride) {
+            const double xi = particles[i].position.x;
+            const double yi = particles[i].position.y;
+            double ax = 0.0;
+            double ay = 0.0;
+
+            for (std::size_t j = 0; j < n; ++j) {
+                const double dx = particles[j].position.x - xi;
+                const double dy = particles[j].position.y - yi;
+                const double distance_squared = dx * dx + dy * dy;
+
+                // Colliding pairs exchange momentum instead of attracting
+                if (i == j || distance_squared < min_distance_squared || distance_squared <= collision_radius_squared)
+                    continue;
+
+                const double s = particles[j].mass / (distance_squared + softening);
+                ax += s * dx;
+                ay += s * dy;
+            }
+
+            accelerations[i] = Vector2d(big_g * ax, big_g * ay);
+        }
+    });
+}
+
+double potentialEnergy(const std::vector<Particle>& particles, int num_threads)
+{
+    const std::size_t n = particles.size();
+    const int workers = std::max(1, num_threads);
+    std::vector<double> partial(workers, 0.0);
+
+    parallelForRows(n, workers, [&](std::size_t first, std::size_t stride) {
+        double sum = 0.0;
+        for (std::size_t i = first; i < n; i += stride) {
+            for (std::size_t j = i + 1; j < n; ++j) {
+                const double dx = static_cast<double>(particles[j].position.x) - particles[i].position.x;
+                const double dy = static_cast<double>(particles[j].position.y) - particles[i].position.y;
+                const double distance_squared = dx * dx + dy * dy + ForceKernels::SOFTENING;
+                sum += static_cast<double>(particles[i].mass) * particles[j].mass * 0.5 * std::log(distance_squared);
+            }
+        }
+        partial[first] = sum;
+    });
+
+    double total = 0.0;
+    for (double p : partial) total += p;
+    return ForceKernels::BIG_G * total;
+}
+
+double kineticEnergy(const std::vector<Particle>& particles)
+{
+    double total = 0.0;
+    for (const Particle& p : particles) {
+        const double v2 = static_cast<double>(p.velocity.x) * p.velocity.x + static_cast<double>(p.velocity.y) * p.velocity.y;
+        total += 0.5 * p.mass * v2;
+    }
+    return total;
+}
+
+Vector2d momentum(const std::vector<Particle>& particles)
+{
+    Vector2d total(0.0, 0.0);
+    for (const Particle& p : particles) {
+        total.x += static_cast<double>(p.mass) * p.velocity.x;
+        total.y += static_cast<double>(p.mass) * p.velocity.y;
+    }
+    return total;
+}
+
+double momentumMagnitudeSum(const std::vector<Particle>& particles)
+{
+    double total = 0.0;
+    for (const Particle& p : particles) {
+        total += p.mass * std::sqrt(static_cast<double>(p.velocity.x) * p.velocity.x +
+                                    static_cast<double>(p.velocity.y) * p.velocity.y);
+    }
+    return total;
+}
+
+} // namespace DirectSum
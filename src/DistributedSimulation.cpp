@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "DistributedSimulation.hpp"
+#include "Parallel.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+template <typename T>
+static void appendRecords(std::vector<char>& message, const std::vector<T>& records)
+{
+    const std::uint64_t count = records.size();
+    const std::size_t offset = message.size();
+
+    message.resize(offset + sizeof(count) + count * sizeof(T));
+    std::memcpy(message.data() + offset, &count, sizeof(count));
+    if (count > 0) std::memcpy(message.data() + offset + sizeof(count), records.data(), count * sizeof(T));
+}
+
+// Reads what appendRecords() wrote at offset and returns the offset after it
+template <typename T>
+static std::size_t readRecords(const std::vector<char>& message, std::size_t offset, std::vector<T>& records)
+{
+    std::uint64_t count = 0;
+    std::memcpy(&count, message.data() + offset, sizeof(count));
+
+    records.resize(count);
+    if (count > 0) std::memcpy(records.data(), message.data() + offset + sizeof(count), count * sizeof(T));
+    return offset + sizeof(count) + count * sizeof(T);
+}
+
+DistributedSimulation::DistributedSimulation(const Settings& settings, SharedMemoryRings& rings, int rank)
+  : settings_(settings),
+    rings_(rings),
+    rank_(rank),
+    num_ranks_(std::max(rings.getRankCount(), 1)),
+    steps_(0),
+    last_force_ms_(0.0),
+    decomposition_(),
+    particles_(),
+    num_owned_(0),
+    quad_tree_(sf::FloatRect(0.0f, 0.0f, settings.width, settings.height),
+               settings.tree_depth,
+               settings.node_capacity),
+    leaf_nodes_(),
+    owned_leaf_nodes_(),
+    interaction_lists_(),
+    outgoing_(),
+    incoming_(),
+    threads_(),
+    numa_topology_(),
+    stats_()
+{
+    settings_.num_threads = std::max(settings_.num_threads, 1);
+    settings_.samples_per_rank = std::max(settings_.samples_per_rank, 1);
+
+    decomposition_.build(sf::FloatRect(0.0f, 0.0f, settings_.width, settings_.height), num_ranks_,
+                         std::vector<OrbDecomposition::WeightedPoint>());
+}
+
+int DistributedSimulation::launch(int num_ranks, std::size_t ring_bytes,
+                                  const std::function<int(SharedMemoryRings& rings, int rank)>& run_rank)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    const std::string name = "/nbody-" + std::to_string(getpid());
+    SharedMemoryRings rings;
+    if (!rings.create(name, num_ranks, ring_bytes)) {
+        std::cout << "Could not create shared memory " << name << "\n";
+        return 1;
+    }
+
+    // Children inherit the mapping, the name is not needed past the fork
+    std::cout.flush();
+    std::fflush(stdout);
+    std::vector<pid_t> children;
+
+    for (int rank = 1; rank < num_ranks; ++rank) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            const int status = run_rank(rings, rank);
+            std::cout.flush();
+            std::fflush(stdout);
+            _exit(status);
+        }
+        if (pid < 0) {
+            std::cout << "fork failed for rank " << rank << "\n";
+            rings.unlink();
+            for (pid_t child : children) kill(child, SIGKILL);
+            return 1;
+        }
+        children.push_back(pid);
+    }
+    rings.unlink();
+
+    int result = run_rank(rings, 0);
+
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) result = 1;
+    }
+
+    return result;
+#else
+    (void)num_ranks;
+    (void)ring_bytes;
+    (void)run_rank;
+    std::cout << "Multi-process runs need POSIX shared memory and fork()\n";
+    return 1;
+#endif
+}
+
+void DistributedSimulation::addParticles(const std::vector<Particle>& particles)
+{
+    particles_.insert(particles_.end(), particles.begin(), particles.end());
+    num_owned_ = particles_.size();
+}
+
+void DistributedSimulation::runOnChunks(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work)
+{
+    ::runOnChunks(threads_, settings_.num_threads, count, 1, settings_.numa_aware ? &numa_topology_ : nullptr, work,
+                  rank_ * settings_.num_threads, num_ranks_ * settings_.num_threads);
+}
+
+std::vector<std::vector<char>> DistributedSimulation::allGather(const std::vector<char>& message)
+{
+    outgoing_.assign(num_ranks_, message);
+    rings_.exchange(rank_, outgoing_, incoming_);
+    return incoming_;
+}
+
+void DistributedSimulation::buildTree()
+{
+    int total_leaf_nodes = 0;
+    Accum global_mass = 0.0f;
+
+    quad_tree_.deleteTree();
+    quad_tree_.insert(particles_);
+    quad_tree_.computeMoments(particles_);
+
+    leaf_nodes_.clear();
+    quad_tree_.getLeafNodes(leaf_nodes_, total_leaf_nodes, global_mass);
+}
+
+// Every rank contributes an evenly strided sample of its positions. The weights split
+// the rank's cost over its samples, particle counts on the first balance and the
+// force time of the last step after that, so the cuts follow work, not just density.
+void DistributedSimulation::rebalance()
+{
+    std::vector<OrbDecomposition::WeightedPoint> samples;
+
+    if (num_owned_ > 0) {
+        const std::size_t stride = std::max<std::size_t>(1, num_owned_ / settings_.samples_per_rank);
+        const std::size_t count = (num_owned_ + stride - 1) / stride;
+        const double cost = (steps_ > 0) ? last_force_ms_ : static_cast<double>(num_owned_);
+        const float weight = static_cast<float>(cost / count);
+
+        for (std::size_t i = 0; i < num_owned_; i += stride) {
+            samples.push_back({toVector2f(particles_[i].position), weight});
+        }
+    }
+
+    std::vector<char> message;
+    appendRecords(message, samples);
+    const std::vector<std::vector<char>> gathered = allGather(message);
+
+    // Concatenated in rank order, so every rank bisects the same sequence
+    std::vector<OrbDecomposition::WeightedPoint> points;
+    for (const std::vector<char>& rank_message : gathered) {
+        readRecords(rank_message, 0, samples);
+        points.insert(points.end(), samples.begin(), samples.end());
+    }
+
+    decomposition_.build(sf::FloatRect(0.0f, 0.0f, settings_.width, settings_.height), num_ranks_, points);
+    stats_.rebalanced = true;
+}
+
+void DistributedSimulation::migrate()
+{
+    std::vector<std::vector<Body>> leaving(num_ranks_);
+    std::size_t kept = 0;
+
+    for (std::size_t i = 0; i < num_owned_; ++i) {
+        const Particle& particle = particles_[i];
+        const int owner = (particle.mass > 0.0f) ? decomposition_.domainOf(particle.position) : -1;
+
+        if (owner == rank_) {
+            if (kept != i) particles_[kept] = particle;
+            kept++;
+        } else if (owner < 0) {
+            stats_.removed++;
+        } else {
+            leaving[owner].push_back({particle.position, particle.velocity, particle.mass});
+            stats_.migrated_out++;
+        }
+    }
+
+    particles_.resize(kept);
+
+    outgoing_.assign(num_ranks_, std::vector<char>());
+    for (int peer = 0; peer < num_ranks_; ++peer) {
+        if (peer != rank_) appendRecords(outgoing_[peer], leaving[peer]);
+    }
+
+    rings_.exchange(rank_, outgoing_, incoming_);
+
+    std::vector<Body> arriving;
+    for (int peer = 0; peer < num_ranks_; ++peer) {
+        if (peer == rank_) continue;
+
+        readRecords(incoming_[peer], 0, arriving);
+        for (const Body& body : arriving) particles_.emplace_back(body.position, body.velocity, body.mass);
+        stats_.migrated_in += arriving.size();
+    }
+
+    num_owned_ = particles_.size();
+}
+
+// Walks the tree of owned particles against the peer's whole domain, so what is sent
+// serves every particle the peer owns
+void DistributedSimulation::exportEssential(int peer, std::vector<char>& message)
+{
+    struct WalkData {
+        int index;
+        sf::FloatRect bounds;
+    };
+
+    const sf::FloatRect& domain = decomposition_.getDomainBounds(peer);
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree_.getParticleElementNodeVec();
+
+    std::vector<Body> bodies;
+    std::vector<Summary> summaries;
+
+    WalkData array[64];
+
+    int top = 0;
+    array[top++] = {0, quad_tree_.getBounds()};
+
+    while (top > 0) {
+        const WalkData current = array[--top];
+        const QuadTree::TreeNode& node = quad_tree_.getNode(current.index);
+
+        if (node.count == 0) continue;
+
+        const QuadTree::GravityElementNode& gNode = quad_tree_.getGravityNode(current.index);
+        if (gNode.total_mass <= 0.0f) continue;
+
+        // Gap between the cell and the nearest point of the domain
+        const float dx = std::max(0.0f, std::max(domain.left - (current.bounds.left + current.bounds.width),
+                                                 current.bounds.left - (domain.left + domain.width)));
+        const float dy = std::max(0.0f, std::max(domain.top - (current.bounds.top + current.bounds.height),
+                                                 current.bounds.top - (domain.top + domain.height)));
+        const float gap = std::sqrt(dx * dx + dy * dy);
+        const float size = std::max(current.bounds.width, current.bounds.height);
+
+        if (gap > 0.0f && size < settings_.theta * gap) {
+            summaries.push_back({gNode.com_x, gNode.com_y, gNode.total_mass});
+            continue;
+        }
+
+        if (node.count != -1) {
+            for (int i = node.first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+                const Particle& particle = particles_[particle_element_nodes[i].particle_index];
+                bodies.push_back({particle.position, particle.velocity, particle.mass});
+            }
+            continue;
+        }
+
+        const sf::Vector2f child_size(current.bounds.width * 0.5f, current.bounds.height * 0.5f);
+        const sf::Vector2f child_offsets[4] = {
+            sf::Vector2f(current.bounds.left, current.bounds.top),
+            sf::Vector2f(current.bounds.left + child_size.x, current.bounds.top),
+            sf::Vector2f(current.bounds.left, current.bounds.top + child_size.y),
+            sf::Vector2f(current.bounds.left + child_size.x, current.bounds.top + child_size.y),
+        };
+
+        for (int i = 1; i <= 4; ++i) {
+            array[top++] = {4 * current.index + i, sf::FloatRect(child_offsets[i-1], child_size)};
+        }
+    }
+
+    message.clear();
+    appendRecords(message, bodies);
+    appendRecords(message, summaries);
+}
+
+// Boundary particles and summaries go after the owned particles, as sources only.
+// A summary becomes a particle of its mass at its COM.
+void DistributedSimulation::importEssential()
+{
+    std::vector<Body> bodies;
+    std::vector<Summary> summaries;
+
+    for (int peer = 0; peer < num_ranks_; ++peer) {
+        if (peer == rank_) continue;
+
+        const std::size_t offset = readRecords(incoming_[peer], 0, bodies);
+        readRecords(incoming_[peer], offset, summaries);
+
+        for (const Body& body : bodies) particles_.emplace_back(body.position, body.velocity, body.mass);
+
+        for (const Summary& summary : summaries) {
+            const Vector2r com(static_cast<Real>(summary.com_x / summary.total_mass),
+                               static_cast<Real>(summary.com_y / summary.total_mass));
+            particles_.emplace_back(com, Vector2r(0, 0), static_cast<Real>(summary.total_mass));
+        }
+
+        stats_.boundary_in += bodies.size();
+        stats_.summaries_in += summaries.size();
+    }
+}
+
+// The MONOPOLE solver of ParticleSimulation over the leaves holding owned particles
+void DistributedSimulation::computeForces()
+{
+    buildTree();
+
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree_.getParticleElementNodeVec();
+
+    owned_leaf_nodes_.clear();
+    for (QuadTree::TreeNode* leaf : leaf_nodes_) {
+        for (int i = leaf->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+            if (static_cast<std::size_t>(particle_element_nodes[i].particle_index) < num_owned_) {
+                owned_leaf_nodes_.push_back(leaf);
+                break;
+            }
+        }
+    }
+
+    interaction_lists_.resize(owned_leaf_nodes_.size());
+    interaction_lists_.leaf_indices.resize(owned_leaf_nodes_.size());
+    interaction_lists_.root_bounds = quad_tree_.getBounds();
+    interaction_lists_.theta = settings_.theta;
+
+    const ForceKernels::MultipoleParams multipole = { settings_.theta, false, nullptr };
+
+    runOnChunks(owned_leaf_nodes_.size(), [&](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::buildInteractionLists(quad_tree_, owned_leaf_nodes_, start_index, end_index, settings_.theta,
+                                            interaction_lists_);
+        ForceKernels::nearField(particles_, particle_element_nodes, owned_leaf_nodes_, start_index, end_index);
+    });
+
+    runOnChunks(owned_leaf_nodes_.size(), [&](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::nearFieldNeighbours(particles_, quad_tree_, owned_leaf_nodes_, interaction_lists_,
+                                          start_index, end_index);
+        ForceKernels::farFieldMultipole(particles_, quad_tree_, owned_leaf_nodes_, interaction_lists_,
+                                        start_index, end_index, multipole);
+    });
+
+    const sf::FloatRect area(0.0f, 0.0f, settings_.width, settings_.height);
+    const ForceKernels::IntegrationParams params = { settings_.time_step, false, sf::Vector2f(0.0f, 0.0f),
+                                                     ForceKernels::REMOVE, area, false };
+
+    runOnChunks(num_owned_, [&](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::integrate(particles_, start_index, end_index, params);
+    });
+
+    particles_.resize(num_owned_);
+}
+
+void DistributedSimulation::step()
+{
+    stats_ = StepStats();
+    const std::uint64_t bytes_before = rings_.getBytesSent();
+
+    auto phase_start = std::chrono::steady_clock::now();
+    if (steps_ == 0 || (settings_.rebalance_interval > 0 && steps_ % settings_.rebalance_interval == 0)) {
+        rebalance();
+        stats_.rebalance_ms = millisecondsSince(phase_start);
+    }
+
+    phase_start = std::chrono::steady_clock::now();
+    migrate();
+    stats_.migrate_ms = millisecondsSince(phase_start);
+    stats_.owned = num_owned_;
+
+    phase_start = std::chrono::steady_clock::now();
+    buildTree();
+    outgoing_.assign(num_ranks_, std::vector<char>());
+    runOnChunks(num_ranks_, [&](std::size_t start_index, std::size_t end_index) {
+        for (std::size_t peer = start_index; peer < end_index; ++peer) {
+            if (static_cast<int>(peer) != rank_) exportEssential(static_cast<int>(peer), outgoing_[peer]);
+        }
+    });
+    stats_.export_ms = millisecondsSince(phase_start);
+
+    phase_start = std::chrono::steady_clock::now();
+    rings_.exchange(rank_, outgoing_, incoming_);
+    stats_.exchange_ms = millisecondsSince(phase_start);
+
+    phase_start = std::chrono::steady_clock::now();
+    importEssential();
+    computeForces();
+    stats_.force_ms = millisecondsSince(phase_start);
+
+    last_force_ms_ = stats_.force_ms;
+    stats_.bytes_sent = static_cast<std::size_t>(rings_.getBytesSent() - bytes_before);
+    steps_++;
+}
+
+int DistributedSimulation::getRank() const
+{
+    return rank_;
+}
+
+int DistributedSimulation::getRankCount() const
+{
+    return num_ranks_;
+}
+
+const std::vector<Particle>& DistributedSimulation::getParticles() const
+{
+    return particles_;
+}
+
+const OrbDecomposition& DistributedSimulation::getDecomposition() const
+{
+    return decomposition_;
+}
+
+const DistributedSimulation::StepStats& DistributedSimulation::getStepStats() const
+{
+    return stats_;
+}
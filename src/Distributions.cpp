@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <random>
+
+#include "Distributions.hpp"
+
+namespace Distributions {
+
+const char* name(Type type)
+{
+    switch (type) {
+        case UNIFORM:    return "uniform";
+        case CLUSTERED:  return "clustered";
+        case SIERPINSKI: return "sierpinski";
+    }
+    return "unknown";
+}
+
+bool parse(const std::string& str, Type& type)
+{
+    for (Type t : { UNIFORM, CLUSTERED, SIERPINSKI }) {
+        if (str == name(t)) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+void generate(Type type,
+              std::vector<Particle>& particles,
+              int n,
+              float width,
+              float height,
+              float mass,
+              unsigned int seed)
+{
+    switch (type) {
+        case UNIFORM:
+            uniform(particles, n, width, height, mass, seed);
+            break;
+        case CLUSTERED:
+            clustered(particles, n, width, height, mass, seed);
+            break;
+        case SIERPINSKI:
+            sierpinski(particles, n, width, height, mass, seed);
+            break;
+    }
+}
+
+void uniform(std::vector<Particle>& particles, int n, float width, float height, float mass, unsigned int seed)
+{
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis_x(0.0f, width);
+    std::uniform_real_distribution<float> dis_y(0.0f, height);
+
+    particles.reserve(particles.size() + n);
+
+    for (int i = 0; i < n; ++i) {
+        particles.emplace_back(Particle(Vector2r(dis_x(gen), dis_y(gen)), Vector2r(0,0), mass));
+    }
+}
+
+void clustered(std::vector<Particle>& particles, int n, float width, float height, float mass, unsigned int seed)
+{
+    const int num_clusters = 16;
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis_x(0.1f * width, 0.9f * width);
+    std::uniform_real_distribution<float> dis_y(0.1f * height, 0.9f * height);
+    std::uniform_int_distribution<int> dis_cluster(0, num_clusters - 1);
+    std::normal_distribution<float> dis_offset(0.0f, 0.03f * std::min(width, height));
+
+    sf::Vector2f centers[num_clusters];
+    for (int i = 0; i < num_clusters; ++i) {
+        centers[i] = sf::Vector2f(dis_x(gen), dis_y(gen));
+    }
+
+    particles.reserve(particles.size() + n);
+
+    for (int i = 0; i < n; ++i) {
+        const sf::Vector2f& center = centers[dis_cluster(gen)];
+        sf::Vector2f pos;
+
+        // Redraw the rare samples that land outside the domain
+        do {
+            pos = sf::Vector2f(center.x + dis_offset(gen), center.y + dis_offset(gen));
+        } while (pos.x < 0.0f || pos.x >= width || pos.y < 0.0f || pos.y >= height);
+
+        particles.emplace_back(Particle(vectorCast<Real>(pos), Vector2r(0,0), mass));
+    }
+}
+
+void sierpinski(std::vector<Particle>& particles, int n, float width, float height, float mass, unsigned int seed)
+{
+    const float size = std::min(width, height) * 0.999f;
+    const float x = (width - size) / 2.0f;
+
+    const sf::Vector2f vertices[3] = {
+        sf::Vector2f(x, 0.0f),
+        sf::Vector2f(x + size, 0.0f),
+        sf::Vector2f(x + size / 2.0f, size),
+    };
+
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dis_vertex(0, 2);
+
+    sf::Vector2f pos = vertices[0];
+
+    // Let the chaos game settle onto the attractor before keeping points
+    for (int i = 0; i < 32; ++i) {
+        const sf::Vector2f& v = vertices[dis_vertex(gen)];
+        pos = sf::Vector2f((pos.x + v.x) * 0.5f, (pos.y + v.y) * 0.5f);
+    }
+
+    particles.reserve(particles.size() + n);
+
+    for (int i = 0; i < n; ++i) {
+        const sf::Vector2f& v = vertices[dis_vertex(gen)];
+        pos = sf::Vector2f((pos.x + v.x) * 0.5f, (pos.y + v.y) * 0.5f);
+        particles.emplace_back(Particle(vectorCast<Real>(pos), Vector2r(0,0), mass));
+    }
+}
+
+template <int D>
+void generateN(Type type,
+               std::vector<ParticleN<D>>& particles,
+               int n,
+               const VectorN<D>& extent,
+               float mass,
+               unsigned int seed)
+{
+    const int num_clusters = 16;
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis_unit(0.0f, 1.0f);
+
+    float min_extent = extent[0];
+    for (int a = 1; a < D; ++a) min_extent = std::min(min_extent, extent[a]);
+
+    // Cluster centers, or the corners of the simplex: the origin and one point along
+    // each axis, the last one lifted over the middle of the others
+    std::vector<VectorN<D>> centers;
+
+    if (type == CLUSTERED) {
+        for (int c = 0; c < num_clusters; ++c) {
+            VectorN<D> center;
+            for (int a = 0; a < D; ++a) center[a] = extent[a] * (0.1f + 0.8f * dis_unit(gen));
+            centers.push_back(center);
+        }
+    } else if (type == SIERPINSKI) {
+        const float size = min_extent * 0.999f;
+        centers.push_back(VectorN<D>());
+        for (int a = 0; a < D; ++a) {
+            VectorN<D> vertex;
+            for (int b = 0; b < a; ++b) vertex[b] = size / (a + 1);
+            vertex[a] = size;
+            centers.push_back(vertex);
+        }
+    }
+
+    std::normal_distribution<float> dis_offset(0.0f, 0.03f * min_extent);
+    std::uniform_int_distribution<int> dis_center(0, std::max(static_cast<int>(centers.size()) - 1, 0));
+
+    VectorN<D> pos = centers.empty() ? VectorN<D>() : centers[0];
+
+    // Let the chaos game settle onto the attractor before keeping points
+    if (type == SIERPINSKI) {
+        for (int i = 0; i < 32; ++i) pos = 0.5f * (pos + centers[dis_center(gen)]);
+    }
+
+    particles.reserve(particles.size() + n);
+
+    for (int i = 0; i < n; ++i) {
+        if (type == UNIFORM) {
+            for (int a = 0; a < D; ++a) pos[a] = extent[a] * dis_unit(gen);
+        } else if (type == CLUSTERED) {
+            const VectorN<D>& center = centers[dis_center(gen)];
+            bool inside;
+
+            // Redraw the rare samples that land outside the domain
+            do {
+                inside = true;
+                for (int a = 0; a < D; ++a) {
+                    pos[a] = center[a] + dis_offset(gen);
+                    inside = inside && pos[a] >= 0.0f && pos[a] < extent[a];
+                }
+            } while (!inside);
+        } else {
+            pos = 0.5f * (pos + centers[dis_center(gen)]);
+        }
+
+        particles.emplace_back(ParticleN<D>(pos, VectorN<D>(), mass));
+    }
+}
+
+template void generateN<2>(Type, std::vector<ParticleN<2>>&, int, const VectorN<2>&, float, unsigned int);
+template void generateN<3>(Type, std::vector<ParticleN<3>>&, int, const VectorN<3>&, float, unsigned int);
+
+} // namespace Distributions
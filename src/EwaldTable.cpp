@@ -0,0 +1,98 @@
+#include <cmath>
+
+#include "EwaldTable.hpp"
+
+// Real space terms below exp(-EWALD_CUTOFF^2) and Fourier terms below
+// exp(-EWALD_CUTOFF^2) are dropped
+static const double EWALD_CUTOFF = 6.0;
+static const double PI = 3.14159265358979323846;
+
+EwaldTable::EwaldTable()
+  : period_(0.0f, 0.0f),
+    cells_(0),
+    inv_cell_size_(0.0f, 0.0f),
+    table_()
+{}
+
+void EwaldTable::compute(float width, float height, int cells)
+{
+    if (width == period_.x && height == period_.y && cells == cells_) return;
+
+    period_ = sf::Vector2f(width, height);
+    cells_ = std::max(cells, 1);
+    inv_cell_size_ = sf::Vector2f(cells_ / width, cells_ / height);
+    table_.assign(static_cast<std::size_t>(cells_ + 1) * (cells_ + 1), sf::Vector2f(0.0f, 0.0f));
+
+    for (int iy = 0; iy <= cells_; ++iy) {
+        for (int ix = 0; ix <= cells_; ++ix) {
+            const double rx = static_cast<double>(width) * ix / cells_;
+            const double ry = static_cast<double>(height) * iy / cells_;
+            table_[static_cast<std::size_t>(iy) * (cells_ + 1) + ix] = exact(width, height, rx, ry);
+        }
+    }
+}
+
+bool EwaldTable::isReady() const
+{
+    return !table_.empty();
+}
+
+const sf::Vector2f& EwaldTable::getPeriod() const
+{
+    return period_;
+}
+
+// The unit mass is split into a screened part -exp(-a^2 s^2) s / s^2, summed over
+// the nearby images in real space, and a smooth remainder summed over the reciprocal
+// lattice, -(2 pi / A) sum_k k sin(k.r) exp(-k^2 / 4a^2) / k^2. Leaving out k = 0 is
+// the neutralizing background.
+sf::Vector2f EwaldTable::exact(double width, double height, double rx, double ry)
+{
+    if (rx == 0.0 && ry == 0.0) return sf::Vector2f(0.0f, 0.0f);
+
+    const double alpha = 2.0 / std::min(width, height);
+    const double alpha_squared = alpha * alpha;
+    const double area = width * height;
+
+    double ax = 0.0;
+    double ay = 0.0;
+
+    const int real_x = static_cast<int>(std::ceil(EWALD_CUTOFF / (alpha * width))) + 1;
+    const int real_y = static_cast<int>(std::ceil(EWALD_CUTOFF / (alpha * height))) + 1;
+
+    for (int ny = -real_y; ny <= real_y; ++ny) {
+        for (int nx = -real_x; nx <= real_x; ++nx) {
+            const double sx = rx + nx * width;
+            const double sy = ry + ny * height;
+            const double s_squared = sx * sx + sy * sy;
+            const double screening = std::exp(-alpha_squared * s_squared);
+
+            // The image at r itself, less its direct acceleration -r / r^2
+            const double weight = (nx == 0 && ny == 0) ? (1.0 - screening) / s_squared : -screening / s_squared;
+
+            ax += weight * sx;
+            ay += weight * sy;
+        }
+    }
+
+    const double k_max = 2.0 * EWALD_CUTOFF * alpha;
+    const int fourier_x = static_cast<int>(std::ceil(k_max * width / (2.0 * PI)));
+    const int fourier_y = static_cast<int>(std::ceil(k_max * height / (2.0 * PI)));
+
+    for (int my = -fourier_y; my <= fourier_y; ++my) {
+        for (int mx = -fourier_x; mx <= fourier_x; ++mx) {
+            if (mx == 0 && my == 0) continue;
+
+            const double kx = 2.0 * PI * mx / width;
+            const double ky = 2.0 * PI * my / height;
+            const double k_squared = kx * kx + ky * ky;
+            const double weight = -2.0 * PI / area * std::sin(kx * rx + ky * ry) *
+                                  std::exp(-k_squared / (4.0 * alpha_squared)) / k_squared;
+
+            ax += weight * kx;
+            ay += weight * ky;
+        }
+    }
+
+    return sf::Vector2f(static_cast<float>(ax), static_cast<float>(ay));
+}
@@ -0,0 +1,1235 @@
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "ForceKernels.hpp"
+#include "MonotonicArena.hpp"
+
+namespace ForceKernels {
+
+const float BIG_G = 35.00f;
+const float MIN_DISTANCE_SQUARED = 0.01f;
+const float COLLISION_RADIUS_SQUARED = 1.0f;
+const float SOFTENING = 0.01f;
+const float LEAPFROG_ETA = 0.025f;
+const float LEAPFROG_COURANT = 0.25f;
+
+template <typename T>
+static inline T dot(const sf::Vector2<T>& vec1, const sf::Vector2<T>& vec2)
+{
+    return (vec1.x * vec2.x) + (vec1.y * vec2.y);
+}
+
+template <typename T>
+static inline T inv_Sqrt(T number)
+{
+    T squareRoot = std::sqrt(number);
+    return T(1) / squareRoot;
+}
+
+static inline void attractParticleToMousePos(Particle& particle, const sf::Vector2f& current_mouse_pos_f)
+{
+    particle.velocity -= Vector2r(0.35f * (particle.position.x - current_mouse_pos_f.x),
+                                  0.35f * (particle.position.y - current_mouse_pos_f.y));
+}
+
+static inline void colorByVelocity(Particle& particle)
+{
+    float vel = std::sqrt(particle.velocity.x * particle.velocity.x +
+                particle.velocity.y * particle.velocity.y);
+
+
+    float maxVel = 3000.0f;
+
+    if (vel > maxVel) vel = maxVel;
+
+    float p = vel / maxVel;
+
+    sf::Color c;
+    c.r = static_cast<uint8_t>(15.0f + (240.0f * p));
+    c.g = 0;
+    c.b = static_cast<uint8_t>(240.0f * (1.0f-p));
+    c.a = static_cast<uint8_t>(30.0f + (225.0f * p));
+
+    particle.color = c;
+}
+
+// One axis of the boundary policy, brings position back into [low, high)
+static inline void boundAxis(Real& position, Real& velocity, Real low, Real high, BoundaryPolicy policy)
+{
+    if (position >= low && position < high) return;
+
+    const Real size = high - low;
+    const Real last = std::nextafter(high, low);
+
+    switch (policy) {
+        case REFLECT:
+            if (position < low) {
+                position = 2.0f * low - position;
+                velocity = std::fabs(velocity);
+            } else {
+                position = 2.0f * high - position;
+                velocity = -std::fabs(velocity);
+            }
+            // More than a whole width in one step
+            position = std::max(low, std::min(position, last));
+            break;
+        case PERIODIC:
+            position -= size * std::floor((position - low) / size);
+            if (!(position >= low && position < high)) position = low;
+            break;
+        case CLAMP:
+            position = std::max(low, std::min(position, last));
+            velocity = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static inline void applyBoundary(Particle& particle, const IntegrationParams& params)
+{
+    if (params.boundary == REMOVE) return;
+
+    boundAxis(particle.position.x, particle.velocity.x, params.area.left,
+              params.area.left + params.area.width, params.boundary);
+    boundAxis(particle.position.y, particle.velocity.y, params.area.top,
+              params.area.top + params.area.height, params.boundary);
+}
+
+unsigned integrationFeatures(const IntegrationParams& params)
+{
+    return (params.attract_to_mouse ? FEATURE_MOUSE : 0) |
+           (params.boundary != REMOVE ? FEATURE_BOUNDARY : 0) |
+           (params.update_colors ? FEATURE_COLOR : 0);
+}
+
+// Calls kernel(std::integral_constant<unsigned, features>()). Mask lists the features
+// the kernel is specialised on, features must be a subset of it. The recursion steps
+// through the subsets of Mask in increasing order, so only those are instantiated.
+template <unsigned Mask, unsigned Features = 0, typename Kernel>
+static inline void dispatchFeatures(unsigned features, Kernel&& kernel)
+{
+    if (features == Features) {
+        kernel(std::integral_constant<unsigned, Features>());
+        return;
+    }
+
+    if constexpr (Features != Mask) {
+        dispatchFeatures<Mask, ((Features | ~Mask) + 1) & Mask>(features, std::forward<Kernel>(kernel));
+    }
+}
+
+enum : unsigned {
+    INTEGRATION_FEATURES = FEATURE_MOUSE | FEATURE_BOUNDARY | FEATURE_COLOR,
+
+    // Internal to the far field kernels, above every public feature
+    FEATURE_INTEGRATE = 1u << 16
+};
+
+template <unsigned Features>
+static inline void integrateParticle(Particle& particle, const IntegrationParams& params)
+{
+    if constexpr ((Features & FEATURE_MOUSE) != 0)
+        attractParticleToMousePos(particle, params.mouse_pos);
+
+    particle.velocity += vectorCast<Real>(particle.acceleration * static_cast<Accum>(params.time_step));
+    particle.position += particle.velocity * static_cast<Real>(params.time_step);
+
+    if constexpr ((Features & FEATURE_BOUNDARY) != 0) applyBoundary(particle, params);
+
+    if constexpr ((Features & FEATURE_COLOR) != 0) colorByVelocity(particle);
+
+    particle.acceleration.x = 0.0f;
+    particle.acceleration.y = 0.0f;
+}
+
+// Other is absorbed into particle, keeping mass, momentum and the centre of mass
+static inline void mergeParticles(Particle& particle, Particle& other)
+{
+    const Real mass = particle.mass + other.mass;
+    const Real weight = other.mass / mass;
+
+    particle.position += weight * (other.position - particle.position);
+    particle.velocity += weight * (other.velocity - particle.velocity);
+    particle.mass = mass;
+
+    // A finer rung never misses a step of the coarser one
+    particle.rung = std::max(particle.rung, other.rung);
+
+    other.mass = 0;
+}
+
+template <unsigned Features>
+static void nearFieldLeaves(std::vector<Particle>& particles,
+                            const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes,
+                            const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                            std::size_t start_index,
+                            std::size_t end_index,
+                            const std::vector<unsigned char>* active,
+                            float split_radius,
+                            float merge_speed)
+{
+    const Real inv_split_squared = (split_radius > 0.0f) ? 1.0f / (split_radius * split_radius) : 0.0f;
+    const Real merge_speed_squared = merge_speed * merge_speed;
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const QuadTree::TreeNode* curr_tree_node = leaf_nodes[j];
+        const int first_particle_idx = curr_tree_node->first_particle;
+
+        // Handle Particle to Particle interactions for each leaf
+        for (int i = first_particle_idx; i != -1; i = particle_element_nodes[i].next_element_index) {
+
+            int particle_index = particle_element_nodes[i].particle_index;
+            if constexpr ((Features & FEATURE_ACTIVE) != 0) {
+                if (!(*active)[particle_index]) continue;
+            }
+
+            Particle& particle = particles[particle_index];
+            bool after_particle = false;
+
+            for (int j = first_particle_idx; j != -1; j = particle_element_nodes[j].next_element_index) {
+
+                int other_index = particle_element_nodes[j].particle_index;
+                Particle& other = particles[other_index];
+
+                if (&other == &particle) {
+                    after_particle = true;
+                    continue;
+                }
+
+                const Real distance_squared = dot(particle.position - other.position,
+                                           particle.position - other.position);
+
+                if (distance_squared < MIN_DISTANCE_SQUARED) continue;
+
+                if constexpr ((Features & FEATURE_COLLISIONS) != 0) {
+                    if (distance_squared <= COLLISION_RADIUS_SQUARED) {
+                        // Each pair collides once, like in the direct sum: on the visit from
+                        // the earlier particle of the leaf, or from the active one
+                        bool resolves_pair = after_particle;
+                        if constexpr ((Features & FEATURE_ACTIVE) != 0) {
+                            resolves_pair = resolves_pair || !(*active)[other_index];
+                        }
+                        if (!resolves_pair) continue;
+
+                        // Already absorbed this step
+                        if (particle.mass <= 0.0f || other.mass <= 0.0f) continue;
+
+                        const Vector2r relative_velocity = other.velocity - particle.velocity;
+
+                        if constexpr ((Features & FEATURE_MERGE) != 0) {
+                            if (dot(relative_velocity, relative_velocity) < merge_speed_squared) {
+                                mergeParticles(particle, other);
+                                continue;
+                            }
+                        }
+
+                        Vector2r r_hat = (other.position - particle.position) * inv_Sqrt(distance_squared);
+
+                        const Real a1 = dot(particle.velocity, r_hat);
+                        const Real a2 = dot(other.velocity, r_hat);
+
+                        const Real p = 2.0f * particle.mass * other.mass * (a1-a2) / (particle.mass + other.mass);
+
+                        particle.velocity -= p / particle.mass * r_hat;
+
+                        // Inactive particles keep their velocity until their own step
+                        if constexpr ((Features & FEATURE_ACTIVE) != 0) {
+                            if (!(*active)[other_index]) continue;
+                        }
+
+                        other.velocity += p / other.mass * r_hat;
+                        continue;
+                    }
+                }
+
+                // Softening factor to prevent infinite forces at very small distances
+                const Real softened_distance_squared = distance_squared + SOFTENING;
+
+                Real weight = other.mass / softened_distance_squared;
+
+                // Beyond four split radii the short range part is below 1e-7 of the force
+                if constexpr ((Features & FEATURE_SHORT_RANGE) != 0) {
+                    const Real split_distance_squared = distance_squared * inv_split_squared;
+                    if (split_distance_squared > 16.0f) continue;
+                    weight *= std::exp(-split_distance_squared);
+                }
+
+                particle.acceleration += vectorCast<Accum>(weight * BIG_G * (other.position - particle.position));
+            }
+        }
+    }
+}
+
+void nearField(std::vector<Particle>& particles,
+               const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes,
+               const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+               std::size_t start_index,
+               std::size_t end_index,
+               const std::vector<unsigned char>* active,
+               float split_radius,
+               float merge_speed,
+               bool collisions)
+{
+    const unsigned features = (active ? FEATURE_ACTIVE : 0) |
+                              (collisions ? FEATURE_COLLISIONS : 0) |
+                              (collisions && merge_speed > 0.0f ? FEATURE_MERGE : 0) |
+                              (split_radius > 0.0f ? FEATURE_SHORT_RANGE : 0);
+
+    dispatchFeatures<FEATURE_ACTIVE | FEATURE_COLLISIONS | FEATURE_MERGE | FEATURE_SHORT_RANGE>(features,
+        [&](auto mask) {
+            nearFieldLeaves<decltype(mask)::value>(particles, particle_element_nodes, leaf_nodes, start_index,
+                                                   end_index, active, split_radius, merge_speed);
+        });
+}
+
+// COM and mass of everything outside the given leaf, returns false if the leaf holds every particle
+static inline bool nonLocalCOM(const std::vector<Particle>& particles,
+                               QuadTree& quad_tree,
+                               const QuadTree::TreeNode* curr_tree_node,
+                               Accum global_mass,
+                               const Vector2a& global_com,
+                               Vector2a& new_com,
+                               Accum& non_local_mass)
+{
+    const QuadTree::GravityElementNode& gNode = quad_tree.getGravityNode(*curr_tree_node);
+
+    int non_local_particle_count = (particles.size() - curr_tree_node->count);
+    non_local_mass = global_mass - gNode.total_mass;
+
+    if (non_local_particle_count == 0) return false;
+
+    new_com.x = (global_mass * global_com.x - gNode.com_x) / non_local_mass;
+    new_com.y = (global_mass * global_com.y - gNode.com_y) / non_local_mass;
+
+    return true;
+}
+
+void farField(std::vector<Particle>& particles,
+              QuadTree& quad_tree,
+              const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+              std::size_t start_index,
+              std::size_t end_index,
+              Accum global_mass,
+              const Vector2a& global_com,
+              const std::vector<unsigned char>* active)
+{
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree.getParticleElementNodeVec();
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const QuadTree::TreeNode* curr_tree_node = leaf_nodes[j];
+
+        Vector2a new_com(0,0);
+        Accum non_local_mass = 0.0f;
+
+        if (!nonLocalCOM(particles, quad_tree, curr_tree_node, global_mass, global_com, new_com, non_local_mass))
+            continue;
+
+        for (int i = curr_tree_node->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+
+            const int particle_index = particle_element_nodes[i].particle_index;
+            if (active && !(*active)[particle_index]) continue;
+
+            Particle& particle = particles[particle_index];
+
+            const Vector2a offset = new_com - vectorCast<Accum>(particle.position);
+            const Accum distance_squared = dot(offset, offset);
+
+            particle.acceleration += (non_local_mass / distance_squared) * BIG_G * offset;
+        }
+    }
+}
+
+template <unsigned Features>
+static void farFieldAndIntegrateLeaves(std::vector<Particle>& particles,
+                                       QuadTree& quad_tree,
+                                       const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                                       std::size_t start_index,
+                                       std::size_t end_index,
+                                       Accum global_mass,
+                                       const Vector2a& global_com,
+                                       const IntegrationParams& params)
+{
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree.getParticleElementNodeVec();
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const QuadTree::TreeNode* curr_tree_node = leaf_nodes[j];
+
+        Vector2a new_com(0,0);
+        Accum non_local_mass = 0.0f;
+
+        // A leaf holding every particle only integrates, decided once per leaf
+        if (!nonLocalCOM(particles, quad_tree, curr_tree_node, global_mass, global_com, new_com, non_local_mass)) {
+            for (int i = curr_tree_node->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+                integrateParticle<Features>(particles[particle_element_nodes[i].particle_index], params);
+            }
+            continue;
+        }
+
+        for (int i = curr_tree_node->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+
+            int particle_index = particle_element_nodes[i].particle_index;
+            Particle& particle = particles[particle_index];
+
+            const Vector2a offset = new_com - vectorCast<Accum>(particle.position);
+            const Accum distance_squared = dot(offset, offset);
+
+            particle.acceleration += (non_local_mass / distance_squared) * BIG_G * offset;
+
+            integrateParticle<Features>(particle, params);
+        }
+    }
+}
+
+void farFieldAndIntegrate(std::vector<Particle>& particles,
+                          QuadTree& quad_tree,
+                          const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                          std::size_t start_index,
+                          std::size_t end_index,
+                          Accum global_mass,
+                          const Vector2a& global_com,
+                          const IntegrationParams& params)
+{
+    dispatchFeatures<INTEGRATION_FEATURES>(integrationFeatures(params), [&](auto mask) {
+        farFieldAndIntegrateLeaves<decltype(mask)::value>(particles, quad_tree, leaf_nodes, start_index, end_index,
+                                                          global_mass, global_com, params);
+    });
+}
+
+void InteractionLists::resize(std::size_t num_leaves)
+{
+    near.resize(num_leaves);
+    far.resize(num_leaves);
+}
+
+bool InteractionLists::matches(const QuadTree& quad_tree,
+                               const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                               float list_theta,
+                               const sf::Vector2f& list_period) const
+{
+    if (list_theta != theta || list_period != period || leaf_nodes.size() != leaf_indices.size()) return false;
+    if (quad_tree.getBounds() != root_bounds) return false;
+
+    for (std::size_t i = 0; i < leaf_nodes.size(); ++i) {
+        if (quad_tree.getNodeIndex(leaf_nodes[i]) != leaf_indices[i]) return false;
+    }
+
+    return true;
+}
+
+void buildInteractionLists(const QuadTree& quad_tree,
+                           const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                           std::size_t start_index,
+                           std::size_t end_index,
+                           float theta,
+                           InteractionLists& lists)
+{
+    struct WalkData {
+        int index;
+        sf::FloatRect bounds;
+    };
+
+    WalkData array[64];
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const int leaf_index = quad_tree.getNodeIndex(leaf_nodes[j]);
+        const sf::FloatRect leaf_bounds = quad_tree.getNodeBounds(leaf_index);
+        const sf::Vector2f leaf_center(leaf_bounds.left + 0.5f * leaf_bounds.width,
+                                       leaf_bounds.top + 0.5f * leaf_bounds.height);
+        const float leaf_radius = 0.5f * std::sqrt(leaf_bounds.width * leaf_bounds.width +
+                                                   leaf_bounds.height * leaf_bounds.height);
+
+        lists.leaf_indices[j] = leaf_index;
+        std::vector<InteractionLists::Entry>& near = lists.near[j];
+        std::vector<InteractionLists::Entry>& far = lists.far[j];
+        near.clear();
+        far.clear();
+
+        int top = 0;
+        array[top++] = {0, quad_tree.getNodeBounds(0)};
+
+        while (top > 0) {
+            const WalkData current = array[--top];
+            if (current.index == leaf_index) continue;
+
+            const QuadTree::TreeNode& node = quad_tree.getNode(current.index);
+
+            // Cells are nested, any cell containing the leaf's center is one of its ancestors
+            if (!current.bounds.contains(leaf_center)) {
+                const sf::Vector2f center(current.bounds.left + 0.5f * current.bounds.width,
+                                          current.bounds.top + 0.5f * current.bounds.height);
+                sf::Vector2f offset = center - leaf_center;
+
+                InteractionLists::Entry entry = { current.index, 0, 0 };
+                if (lists.period.x > 0.0f) {
+                    entry.image_x = static_cast<short>(-std::round(offset.x / lists.period.x));
+                    entry.image_y = static_cast<short>(-std::round(offset.y / lists.period.y));
+                    offset += lists.shift(entry);
+                }
+
+                float distance = std::sqrt(dot(offset, offset));
+                const float size = std::max(current.bounds.width, current.bounds.height);
+
+                // The Ewald correction of a periodic cell is taken at its center of mass,
+                // so its next image must be well separated too
+                if (lists.period.x > 0.0f) {
+                    distance = std::min(distance, std::min(lists.period.x - std::abs(offset.x),
+                                                           lists.period.y - std::abs(offset.y)));
+                }
+                distance -= leaf_radius;
+
+                if (distance > 0.0f && size < theta * distance) {
+                    far.push_back(entry);
+                    continue;
+                }
+
+                // Leaves too close for their moments are summed pair by pair. Empty ones
+                // are kept, particles may move in without changing the topology.
+                if (node.count != -1) {
+                    near.push_back(entry);
+                    continue;
+                }
+            }
+
+            const sf::Vector2f child_size(current.bounds.width * 0.5f, current.bounds.height * 0.5f);
+            const sf::Vector2f child_offsets[4] = {
+                sf::Vector2f(current.bounds.left, current.bounds.top),
+                sf::Vector2f(current.bounds.left + child_size.x, current.bounds.top),
+                sf::Vector2f(current.bounds.left, current.bounds.top + child_size.y),
+                sf::Vector2f(current.bounds.left + child_size.x, current.bounds.top + child_size.y),
+            };
+
+            for (int i = 1; i <= 4; ++i) {
+                array[top++] = {4 * current.index + i, sf::FloatRect(child_offsets[i-1], child_size)};
+            }
+        }
+    }
+}
+
+void QuantizedLeaves::layout(const QuadTree& quad_tree, const std::vector<QuadTree::TreeNode*>& leaf_nodes)
+{
+    cells.resize(leaf_nodes.size());
+
+    int num_sources = 0;
+    int max_node = 0;
+
+    for (std::size_t j = 0; j < leaf_nodes.size(); ++j) {
+        cells[j].first = num_sources;
+        num_sources += leaf_nodes[j]->count;
+        max_node = std::max(max_node, quad_tree.getNodeIndex(leaf_nodes[j]));
+    }
+
+    sources.resize(num_sources);
+    if (leaf_of_node.size() < static_cast<std::size_t>(max_node) + 1) leaf_of_node.resize(max_node + 1);
+}
+
+static inline std::uint16_t quantize(Real value, float origin, float inv_step)
+{
+    const float q = std::round((static_cast<float>(value) - origin) * inv_step);
+    return static_cast<std::uint16_t>(std::min(65535.0f, std::max(0.0f, q)));
+}
+
+void quantizeLeaves(const std::vector<Particle>& particles,
+                    const QuadTree& quad_tree,
+                    const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                    std::size_t start_index,
+                    std::size_t end_index,
+                    QuantizedLeaves& quantized)
+{
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree.getParticleElementNodeVec();
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const int node_index = quad_tree.getNodeIndex(leaf_nodes[j]);
+        const sf::FloatRect bounds = quad_tree.getNodeBounds(node_index);
+
+        QuantizedLeaves::Cell& cell = quantized.cells[j];
+        cell.origin = sf::Vector2f(bounds.left, bounds.top);
+        cell.step = sf::Vector2f(bounds.width / 65535.0f, bounds.height / 65535.0f);
+        quantized.leaf_of_node[node_index] = static_cast<int>(j);
+
+        const float inv_step_x = 65535.0f / bounds.width;
+        const float inv_step_y = 65535.0f / bounds.height;
+
+        QuantizedLeaves::Source* source = quantized.sources.data() + cell.first;
+
+        for (int i = leaf_nodes[j]->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+            const Particle& particle = particles[particle_element_nodes[i].particle_index];
+
+            source->x = quantize(particle.position.x, cell.origin.x, inv_step_x);
+            source->y = quantize(particle.position.y, cell.origin.y, inv_step_y);
+            source->mass = static_cast<float>(particle.mass);
+            ++source;
+        }
+    }
+}
+
+template <unsigned Features>
+static void nearFieldNeighbourLeaves(std::vector<Particle>& particles,
+                                     const QuadTree& quad_tree,
+                                     const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                                     const InteractionLists& lists,
+                                     std::size_t start_index,
+                                     std::size_t end_index,
+                                     const std::vector<unsigned char>* active,
+                                     const QuantizedLeaves* quantized)
+{
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree.getParticleElementNodeVec();
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const QuadTree::TreeNode* curr_tree_node = leaf_nodes[j];
+
+        for (int i = curr_tree_node->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+
+            const int particle_index = particle_element_nodes[i].particle_index;
+            if constexpr ((Features & FEATURE_ACTIVE) != 0) {
+                if (!(*active)[particle_index]) continue;
+            }
+
+            Particle& particle = particles[particle_index];
+            Vector2a acceleration(0, 0);
+
+            for (const InteractionLists::Entry& entry : lists.near[j]) {
+                const QuadTree::TreeNode& neighbour = quad_tree.getNode(entry.node);
+
+                // The neighbour's particles as seen from this leaf's side of the box
+                const Vector2r position = particle.position - vectorCast<Real>(lists.shift(entry));
+
+                if constexpr ((Features & FEATURE_QUANTIZED) != 0) {
+                    if (neighbour.count <= 0) continue;
+
+                    const QuantizedLeaves::Cell& cell = quantized->cells[quantized->leaf_of_node[entry.node]];
+                    const QuantizedLeaves::Source* sources = quantized->sources.data() + cell.first;
+
+                    // Relative to the cell's corner, so decoding needs no large coordinates
+                    const Vector2r relative = position - vectorCast<Real>(cell.origin);
+                    const Real step_x = cell.step.x;
+                    const Real step_y = cell.step.y;
+
+                    for (int k = 0; k < neighbour.count; ++k) {
+                        const Vector2r offset(sources[k].x * step_x - relative.x, sources[k].y * step_y - relative.y);
+                        const Real distance_squared = dot(offset, offset);
+
+                        if (distance_squared < MIN_DISTANCE_SQUARED) continue;
+
+                        acceleration += vectorCast<Accum>((sources[k].mass / (distance_squared + SOFTENING)) * offset);
+                    }
+                    continue;
+                }
+
+                for (int k = neighbour.first_particle; k != -1; k = particle_element_nodes[k].next_element_index) {
+                    const Particle& other = particles[particle_element_nodes[k].particle_index];
+
+                    const Real distance_squared = dot(position - other.position, position - other.position);
+
+                    // Pairs across leaves attract softened even within the collision radius.
+                    // Bouncing them would read velocities another thread's leaf is writing.
+                    if (distance_squared < MIN_DISTANCE_SQUARED) continue;
+
+                    acceleration += vectorCast<Accum>((other.mass / (distance_squared + SOFTENING)) *
+                                                      (other.position - position));
+                }
+            }
+
+            particle.acceleration += static_cast<Accum>(BIG_G) * acceleration;
+        }
+    }
+}
+
+void nearFieldNeighbours(std::vector<Particle>& particles,
+                         const QuadTree& quad_tree,
+                         const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                         const InteractionLists& lists,
+                         std::size_t start_index,
+                         std::size_t end_index,
+                         const std::vector<unsigned char>* active,
+                         const QuantizedLeaves* quantized)
+{
+    const unsigned features = (active ? FEATURE_ACTIVE : 0) |
+                              (quantized ? FEATURE_QUANTIZED : 0);
+
+    dispatchFeatures<FEATURE_ACTIVE | FEATURE_QUANTIZED>(features, [&](auto mask) {
+        nearFieldNeighbourLeaves<decltype(mask)::value>(particles, quad_tree, leaf_nodes, lists, start_index,
+                                                        end_index, active, quantized);
+    });
+}
+
+// One cell's moments as seen from a leaf
+struct Multipole {
+    Accum x;
+    Accum y;
+    Accum mass;
+    Accum qxx;
+    Accum qxy;
+    Accum qyy;
+};
+
+// Cells of one leaf, gathered per leaf. Far lists rarely exceed a hundred cells at the
+// usual opening angles, longer ones spill into the caller's frame arena.
+typedef SmallList<Multipole, 128, ArenaAllocator<Multipole>> MultipoleList;
+
+// Mass and COM of a cell's image, false when it is empty
+static inline bool cellMonopole(const QuadTree& quad_tree,
+                                const InteractionLists& lists,
+                                const InteractionLists::Entry& entry,
+                                Multipole& multipole)
+{
+    const QuadTree::TreeNode& node = quad_tree.getNode(entry.node);
+    if (node.count == 0) return false;
+
+    const QuadTree::GravityElementNode& gNode = quad_tree.getGravityNode(entry.node);
+    if (gNode.total_mass <= 0.0f) return false;
+
+    const Vector2a shift = vectorCast<Accum>(lists.shift(entry));
+    multipole = { gNode.com_x / gNode.total_mass + shift.x, gNode.com_y / gNode.total_mass + shift.y,
+                  gNode.total_mass, 0, 0, 0 };
+    return true;
+}
+
+// Periodic correction from the monopoles of every cell, it varies on the scale of the
+// box. The far cells' part is summed on a 3 x 3 grid over the leaf and interpolated
+// quadratically to its particles, the near leaves and the leaf itself are summed per
+// particle.
+struct EwaldField {
+    MultipoleList far;
+    MultipoleList near;
+    const EwaldTable* table;
+    Vector2a origin;
+    Vector2a inv_size;
+    Vector2a nodes[9];      // Row major, corners, edge midpoints and center of the leaf
+
+    explicit EwaldField(MonotonicArena& arena)
+      : far(ArenaAllocator<Multipole>(arena)), near(ArenaAllocator<Multipole>(arena)), table(nullptr) {}
+
+    // The table itself is float, the correction is smooth on the scale of the box
+    inline Vector2a sum(const MultipoleList& cells, const Vector2a& position) const
+    {
+        Vector2a acceleration(0, 0);
+
+        for (const Multipole& cell : cells) {
+            acceleration += cell.mass * vectorCast<Accum>(table->correction(static_cast<float>(position.x - cell.x),
+                                                                            static_cast<float>(position.y - cell.y)));
+        }
+
+        return static_cast<Accum>(BIG_G) * acceleration;
+    }
+
+    void update(const EwaldTable& ewald, const sf::FloatRect& leaf_bounds)
+    {
+        table = &ewald;
+        origin = Vector2a(leaf_bounds.left, leaf_bounds.top);
+        inv_size = Vector2a(1.0f / leaf_bounds.width, 1.0f / leaf_bounds.height);
+
+        for (int n = 0; n < 9; ++n) {
+            nodes[n] = sum(far, Vector2a(leaf_bounds.left + 0.5f * (n % 3) * leaf_bounds.width,
+                                         leaf_bounds.top + 0.5f * (n / 3) * leaf_bounds.height));
+        }
+    }
+
+    // Quadratic Lagrange weights of the nodes at 0, 1/2 and 1
+    static inline void weights(Accum t, Accum w[3])
+    {
+        w[0] = (2.0f * t - 1.0f) * (t - 1.0f);
+        w[1] = 4.0f * t * (1.0f - t);
+        w[2] = t * (2.0f * t - 1.0f);
+    }
+
+    inline Vector2a at(const Vector2a& position) const
+    {
+        Accum wx[3];
+        Accum wy[3];
+        weights((position.x - origin.x) * inv_size.x, wx);
+        weights((position.y - origin.y) * inv_size.y, wy);
+
+        Vector2a acceleration = sum(near, position);
+
+        for (int row = 0; row < 3; ++row) {
+            acceleration += wy[row] * (wx[0] * nodes[3 * row] + wx[1] * nodes[3 * row + 1] + wx[2] * nodes[3 * row + 2]);
+        }
+
+        return acceleration;
+    }
+};
+
+// Current moments of the leaf's far cells, empty cells are skipped. With periodic
+// gravity the Ewald field also gets the monopoles of the near leaves and the leaf.
+template <unsigned Features>
+static void gatherMultipoles(const QuadTree& quad_tree,
+                             const InteractionLists& lists,
+                             std::size_t leaf,
+                             const MultipoleParams& params,
+                             MultipoleList& multipoles,
+                             EwaldField& ewald_field)
+{
+    multipoles.clear();
+
+    Multipole multipole;
+
+    for (const InteractionLists::Entry& entry : lists.far[leaf]) {
+        if (!cellMonopole(quad_tree, lists, entry, multipole)) continue;
+
+        if constexpr ((Features & FEATURE_QUADRUPOLE) != 0) {
+            const QuadTree::GravityElementNode& gNode = quad_tree.getGravityNode(entry.node);
+            multipole.qxx = gNode.qxx;
+            multipole.qxy = gNode.qxy;
+            multipole.qyy = gNode.qyy;
+        }
+
+        multipoles.push_back(multipole);
+    }
+
+    if constexpr ((Features & FEATURE_EWALD) == 0) return;
+
+    ewald_field.far = multipoles;
+    ewald_field.near.clear();
+
+    for (const InteractionLists::Entry& entry : lists.near[leaf]) {
+        if (cellMonopole(quad_tree, lists, entry, multipole)) ewald_field.near.push_back(multipole);
+    }
+
+    const InteractionLists::Entry self = { lists.leaf_indices[leaf], 0, 0 };
+    if (cellMonopole(quad_tree, lists, self, multipole)) ewald_field.near.push_back(multipole);
+
+    ewald_field.update(*params.ewald, quad_tree.getNodeBounds(self.node));
+}
+
+// Acceleration at position from the collected cells. With r from the COM to the
+// position and second moments Q about the COM, the 2D log potential expands to
+// G (M ln r + tr(Q) / 2r^2 - r.Q.r / r^4), whose negative gradient gives the
+// quadrupole term G (tr(Q) r + 2 Q r - 4 (r.Q.r / r^2) r) / r^4.
+template <unsigned Features>
+static inline Vector2a multipoleAcceleration(const MultipoleList& multipoles,
+                                             const Vector2a& position)
+{
+    Accum ax = 0.0f;
+    Accum ay = 0.0f;
+
+    for (const Multipole& multipole : multipoles) {
+        const Accum rx = position.x - multipole.x;
+        const Accum ry = position.y - multipole.y;
+        const Accum inv_r2 = 1.0f / (rx * rx + ry * ry);
+
+        ax -= multipole.mass * inv_r2 * rx;
+        ay -= multipole.mass * inv_r2 * ry;
+
+        if constexpr ((Features & FEATURE_QUADRUPOLE) == 0) continue;
+
+        const Accum qrx = multipole.qxx * rx + multipole.qxy * ry;
+        const Accum qry = multipole.qxy * rx + multipole.qyy * ry;
+        const Accum trace = multipole.qxx + multipole.qyy;
+        const Accum rqr = (rx * qrx + ry * qry) * inv_r2;
+        const Accum inv_r4 = inv_r2 * inv_r2;
+
+        ax += (trace * rx + 2.0f * qrx - 4.0f * rqr * rx) * inv_r4;
+        ay += (trace * ry + 2.0f * qry - 4.0f * rqr * ry) * inv_r4;
+    }
+
+    return Vector2a(BIG_G * ax, BIG_G * ay);
+}
+
+static inline unsigned multipoleFeatures(const MultipoleParams& params)
+{
+    return (params.quadrupole ? FEATURE_QUADRUPOLE : 0) | (params.ewald ? FEATURE_EWALD : 0);
+}
+
+// Far field of leaves [start_index, end_index), integrated when FEATURE_INTEGRATE is set
+template <unsigned Features>
+static void farFieldMultipoleLeaves(std::vector<Particle>& particles,
+                                    const QuadTree& quad_tree,
+                                    const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                                    const InteractionLists& lists,
+                                    std::size_t start_index,
+                                    std::size_t end_index,
+                                    const MultipoleParams& params,
+                                    const std::vector<unsigned char>* active,
+                                    const IntegrationParams* integration,
+                                    MonotonicArena* scratch)
+{
+    std::optional<MonotonicArena> local_arena;
+    if (!scratch) scratch = &local_arena.emplace();
+
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree.getParticleElementNodeVec();
+    MultipoleList multipoles{ArenaAllocator<Multipole>(*scratch)};
+    EwaldField ewald_field(*scratch);
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const QuadTree::TreeNode* curr_tree_node = leaf_nodes[j];
+        gatherMultipoles<Features>(quad_tree, lists, j, params, multipoles, ewald_field);
+
+        for (int i = curr_tree_node->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+
+            const int particle_index = particle_element_nodes[i].particle_index;
+            if constexpr ((Features & FEATURE_ACTIVE) != 0) {
+                if (!(*active)[particle_index]) continue;
+            }
+
+            Particle& particle = particles[particle_index];
+            const Vector2a position = vectorCast<Accum>(particle.position);
+            particle.acceleration += multipoleAcceleration<Features>(multipoles, position);
+
+            if constexpr ((Features & FEATURE_EWALD) != 0) particle.acceleration += ewald_field.at(position);
+
+            if constexpr ((Features & FEATURE_INTEGRATE) != 0) integrateParticle<Features>(particle, *integration);
+        }
+    }
+}
+
+void farFieldMultipole(std::vector<Particle>& particles,
+                       const QuadTree& quad_tree,
+                       const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                       const InteractionLists& lists,
+                       std::size_t start_index,
+                       std::size_t end_index,
+                       const MultipoleParams& params,
+                       const std::vector<unsigned char>* active,
+                       MonotonicArena* scratch)
+{
+    const unsigned features = multipoleFeatures(params) | (active ? FEATURE_ACTIVE : 0);
+
+    dispatchFeatures<FEATURE_ACTIVE | FEATURE_QUADRUPOLE | FEATURE_EWALD>(features, [&](auto mask) {
+        farFieldMultipoleLeaves<decltype(mask)::value>(particles, quad_tree, leaf_nodes, lists, start_index,
+                                                       end_index, params, active, nullptr, scratch);
+    });
+}
+
+void farFieldMultipoleAndIntegrate(std::vector<Particle>& particles,
+                                   const QuadTree& quad_tree,
+                                   const std::vector<QuadTree::TreeNode*>& leaf_nodes,
+                                   const InteractionLists& lists,
+                                   std::size_t start_index,
+                                   std::size_t end_index,
+                                   const MultipoleParams& params,
+                                   const IntegrationParams& integration,
+                                   MonotonicArena* scratch)
+{
+    const unsigned features = multipoleFeatures(params) | integrationFeatures(integration);
+
+    dispatchFeatures<FEATURE_QUADRUPOLE | FEATURE_EWALD | INTEGRATION_FEATURES>(features, [&](auto mask) {
+        farFieldMultipoleLeaves<decltype(mask)::value | FEATURE_INTEGRATE>(particles, quad_tree, leaf_nodes, lists,
+                                                                           start_index, end_index, params, nullptr,
+                                                                           &integration, scratch);
+    });
+}
+
+template <unsigned Features>
+static void integrateRange(std::vector<Particle>& particles,
+                           std::size_t start_index,
+                           std::size_t end_index,
+                           const IntegrationParams& params)
+{
+    for (std::size_t i = start_index; i < end_index; ++i) {
+        integrateParticle<Features>(particles[i], params);
+    }
+}
+
+void integrate(std::vector<Particle>& particles,
+               std::size_t start_index,
+               std::size_t end_index,
+               const IntegrationParams& params)
+{
+    dispatchFeatures<INTEGRATION_FEATURES>(integrationFeatures(params), [&](auto mask) {
+        integrateRange<decltype(mask)::value>(particles, start_index, end_index, params);
+    });
+}
+
+template <unsigned Features>
+static void driftRange(std::vector<Particle>& particles,
+                       std::size_t start_index,
+                       std::size_t end_index,
+                       const IntegrationParams& params)
+{
+    for (std::size_t i = start_index; i < end_index; ++i) {
+        Particle& particle = particles[i];
+
+        // Mouse attraction is a velocity impulse per fine step, as with the Euler integrator
+        if constexpr ((Features & FEATURE_MOUSE) != 0)
+            attractParticleToMousePos(particle, params.mouse_pos);
+
+        particle.position += particle.velocity * static_cast<Real>(params.time_step);
+
+        if constexpr ((Features & FEATURE_BOUNDARY) != 0) applyBoundary(particle, params);
+    }
+}
+
+void drift(std::vector<Particle>& particles,
+           std::size_t start_index,
+           std::size_t end_index,
+           const IntegrationParams& params)
+{
+    dispatchFeatures<FEATURE_MOUSE | FEATURE_BOUNDARY>(integrationFeatures(params) & ~FEATURE_COLOR, [&](auto mask) {
+        driftRange<decltype(mask)::value>(particles, start_index, end_index, params);
+    });
+}
+
+// Coarsest rung whose step satisfies the acceleration and velocity criteria
+static inline int desiredRung(const Particle& particle, const BlockStepParams& block)
+{
+    const float acceleration = std::sqrt(dot(particle.acceleration, particle.acceleration));
+    const float speed = std::sqrt(dot(particle.velocity, particle.velocity));
+    const float radius = std::sqrt(COLLISION_RADIUS_SQUARED);
+
+    float step_limit = block.min_time_step * rungPeriod(0, block.max_rung);
+    if (acceleration > 0.0f) step_limit = std::min(step_limit, LEAPFROG_ETA * std::sqrt(radius / acceleration));
+    if (speed > 0.0f) step_limit = std::min(step_limit, LEAPFROG_COURANT * radius / speed);
+
+    int rung = 0;
+    while (rung < block.max_rung && block.min_time_step * rungPeriod(rung, block.max_rung) > step_limit) ++rung;
+    return rung;
+}
+
+template <unsigned Features>
+static void kickRange(std::vector<Particle>& particles,
+                      const std::vector<unsigned char>& active,
+                      const std::vector<Vector2r>& velocities_before,
+                      std::size_t start_index,
+                      std::size_t end_index,
+                      const BlockStepParams& block)
+{
+    for (std::size_t i = start_index; i < end_index; ++i) {
+        Particle& particle = particles[i];
+
+        if (active[i]) {
+            const bool collided = (particle.velocity != velocities_before[i]);
+
+            // Closing half kick of the step that just ended
+            if (particle.rung >= 0) {
+                const Accum half_step = 0.5f * block.min_time_step * rungPeriod(particle.rung, block.max_rung);
+                particle.velocity += vectorCast<Real>(particle.acceleration * half_step);
+            }
+
+            // A new rung has to start on a boundary of its own period
+            int rung = collided ? block.max_rung : desiredRung(particle, block);
+            while (block.substep_end % rungPeriod(rung, block.max_rung) != 0) ++rung;
+            particle.rung = rung;
+
+            // Opening half kick of the next step
+            const Accum half_step = 0.5f * block.min_time_step * rungPeriod(rung, block.max_rung);
+            particle.velocity += vectorCast<Real>(particle.acceleration * half_step);
+
+            if constexpr ((Features & FEATURE_COLOR) != 0) colorByVelocity(particle);
+        }
+
+        particle.acceleration.x = 0.0f;
+        particle.acceleration.y = 0.0f;
+    }
+}
+
+void kickBlockSteps(std::vector<Particle>& particles,
+                    const std::vector<unsigned char>& active,
+                    const std::vector<Vector2r>& velocities_before,
+                    std::size_t start_index,
+                    std::size_t end_index,
+                    const BlockStepParams& block)
+{
+    dispatchFeatures<FEATURE_COLOR>(block.update_colors ? FEATURE_COLOR : 0, [&](auto mask) {
+        kickRange<decltype(mask)::value>(particles, active, velocities_before, start_index, end_index, block);
+    });
+}
+
+void ParticleSoA::load(const std::vector<Particle>& particles)
+{
+    const std::size_t n = particles.size();
+    x.resize(n);
+    y.resize(n);
+    vx.resize(n);
+    vy.resize(n);
+    mass.resize(n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        x[i] = particles[i].position.x;
+        y[i] = particles[i].position.y;
+        vx[i] = particles[i].velocity.x;
+        vy[i] = particles[i].velocity.y;
+        mass[i] = particles[i].mass;
+    }
+}
+
+// Elastic exchange between i and every colliding j in [j_begin, j_end), using the
+// snapshot velocities. Only particle i is updated; j applies the mirrored impulse
+// when it is processed, so the pair is resolved once and threads never share writes.
+// Pairs slow enough to merge are only recorded, once, by the lower index unless the
+// other particle is inactive.
+template <unsigned Features>
+static void resolveCollisions(Particle& particle,
+                              std::size_t i,
+                              const ParticleSoA& soa,
+                              std::size_t j_begin,
+                              std::size_t j_end,
+                              const std::vector<unsigned char>* active,
+                              Real merge_speed_squared,
+                              std::vector<MergePair>* merges)
+{
+    const Real xi = soa.x[i];
+    const Real yi = soa.y[i];
+
+    for (std::size_t j = j_begin; j < j_end; ++j) {
+        const Real dx = soa.x[j] - xi;
+        const Real dy = soa.y[j] - yi;
+        const Real distance_squared = dx * dx + dy * dy;
+
+        if (distance_squared < MIN_DISTANCE_SQUARED || distance_squared > COLLISION_RADIUS_SQUARED) continue;
+
+        if constexpr ((Features & FEATURE_MERGE) != 0) {
+            const Real rvx = soa.vx[j] - soa.vx[i];
+            const Real rvy = soa.vy[j] - soa.vy[i];
+
+            if (rvx * rvx + rvy * rvy < merge_speed_squared) {
+                bool recorded_by_other = (j < i);
+                if constexpr ((Features & FEATURE_ACTIVE) != 0) recorded_by_other = recorded_by_other && (*active)[j];
+
+                if (!recorded_by_other) merges->push_back({ static_cast<int>(i), static_cast<int>(j) });
+                continue;
+            }
+        }
+
+        const Real inv_distance = inv_Sqrt(distance_squared);
+        const Real rx = dx * inv_distance;
+        const Real ry = dy * inv_distance;
+
+        const Real a1 = soa.vx[i] * rx + soa.vy[i] * ry;
+        const Real a2 = soa.vx[j] * rx + soa.vy[j] * ry;
+
+        const Real p = 2.0f * soa.mass[i] * soa.mass[j] * (a1-a2) / (soa.mass[i] + soa.mass[j]);
+
+        particle.velocity.x -= p / soa.mass[i] * rx;
+        particle.velocity.y -= p / soa.mass[i] * ry;
+    }
+}
+
+template <unsigned Features>
+static void directSumTiles(std::vector<Particle>& particles,
+                           const ParticleSoA& soa,
+                           std::size_t start_index,
+                           std::size_t end_index,
+                           const std::vector<unsigned char>* active,
+                           float merge_speed,
+                           std::vector<MergePair>* merges)
+{
+    const std::size_t n = soa.x.size();
+    const Real merge_speed_squared = merge_speed * merge_speed;
+
+    const Real* __restrict xs = soa.x.data();
+    const Real* __restrict ys = soa.y.data();
+    const Real* __restrict ms = soa.mass.data();
+
+    // Positions and accumulators of the i tile live in small local arrays, the inner
+    // loop runs over i with one j broadcast, so there is no reduction to reassociate
+    Real tile_x[DIRECT_I_TILE];
+    Real tile_y[DIRECT_I_TILE];
+    Accum ax[DIRECT_I_TILE];
+    Accum ay[DIRECT_I_TILE];
+    int colliding[DIRECT_I_TILE];
+
+    for (std::size_t i_tile = start_index; i_tile < end_index; i_tile += DIRECT_I_TILE) {
+        const int tile_size = static_cast<int>(std::min<std::size_t>(DIRECT_I_TILE, end_index - i_tile));
+
+        for (int t = 0; t < tile_size; ++t) {
+            tile_x[t] = xs[i_tile + t];
+            tile_y[t] = ys[i_tile + t];
+            ax[t] = 0.0f;
+            ay[t] = 0.0f;
+        }
+
+        // The j tile stays in L1 while the whole i tile is swept against it
+        for (std::size_t j_tile = 0; j_tile < n; j_tile += DIRECT_J_TILE) {
+            const std::size_t j_end = std::min<std::size_t>(j_tile + DIRECT_J_TILE, n);
+
+            if constexpr ((Features & FEATURE_COLLISIONS) != 0) {
+                for (int t = 0; t < tile_size; ++t) colliding[t] = 0;
+            }
+
+            for (std::size_t j = j_tile; j < j_end; ++j) {
+                const Real xj = xs[j];
+                const Real yj = ys[j];
+                const Real mj = ms[j];
+
+                // Branch free: the weight is always computed (the softened distance is never zero)
+                // and pairs inside the collision radius select zero, which also covers i == j
+                // and pairs below the minimum distance. Without collisions only those two are zero.
+                for (int t = 0; t < tile_size; ++t) {
+                    const Real dx = xj - tile_x[t];
+                    const Real dy = yj - tile_y[t];
+                    const Real distance_squared = dx * dx + dy * dy;
+
+                    const Real weight = mj / (distance_squared + SOFTENING);
+
+                    if constexpr ((Features & FEATURE_COLLISIONS) != 0) {
+                        const Real s = static_cast<Real>(distance_squared > COLLISION_RADIUS_SQUARED) * weight;
+
+                        ax[t] += s * dx;
+                        ay[t] += s * dy;
+                        colliding[t] += (distance_squared >= MIN_DISTANCE_SQUARED) &
+                                        (distance_squared <= COLLISION_RADIUS_SQUARED);
+                    } else {
+                        const Real s = static_cast<Real>(distance_squared >= MIN_DISTANCE_SQUARED) * weight;
+
+                        ax[t] += s * dx;
+                        ay[t] += s * dy;
+                    }
+                }
+            }
+
+            // Collisions are rare, redo the few i that have them against this j tile
+            if constexpr ((Features & FEATURE_COLLISIONS) != 0) {
+                for (int t = 0; t < tile_size; ++t) {
+                    if (!colliding[t]) continue;
+
+                    if constexpr ((Features & FEATURE_ACTIVE) != 0) {
+                        if (!(*active)[i_tile + t]) continue;
+                    }
+
+                    resolveCollisions<Features>(particles[i_tile + t], i_tile + t, soa, j_tile, j_end, active,
+                                                merge_speed_squared, merges);
+                }
+            }
+        }
+
+        for (int t = 0; t < tile_size; ++t) {
+            particles[i_tile + t].acceleration.x += BIG_G * ax[t];
+            particles[i_tile + t].acceleration.y += BIG_G * ay[t];
+        }
+    }
+}
+
+void directSumTiled(std::vector<Particle>& particles,
+                    const ParticleSoA& soa,
+                    std::size_t start_index,
+                    std::size_t end_index,
+                    const std::vector<unsigned char>* active,
+                    float merge_speed,
+                    bool collisions,
+                    std::vector<MergePair>* merges)
+{
+    // The active mask only gates collisions
+    const unsigned features = (collisions ? FEATURE_COLLISIONS : 0) |
+                              (collisions && active ? FEATURE_ACTIVE : 0) |
+                              (collisions && merge_speed > 0.0f && merges ? FEATURE_MERGE : 0);
+
+    dispatchFeatures<FEATURE_COLLISIONS | FEATURE_ACTIVE | FEATURE_MERGE>(features, [&](auto mask) {
+        directSumTiles<decltype(mask)::value>(particles, soa, start_index, end_index, active, merge_speed, merges);
+    });
+}
+
+void mergePairs(std::vector<Particle>& particles, const std::vector<MergePair>& merges)
+{
+    for (const MergePair& merge : merges) {
+        Particle& particle = particles[merge.absorber];
+        Particle& other = particles[merge.absorbed];
+
+        // Already absorbed by an earlier pair
+        if (particle.mass <= 0.0f || other.mass <= 0.0f) continue;
+
+        mergeParticles(particle, other);
+    }
+}
+
+} // namespace ForceKernels
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "FrameGovernor.hpp"
+
+// Weight of the newest frame in the smoothed frame time
+static const double SMOOTHING = 0.25;
+
+// Band around the target where nothing changes
+static const double OVER_RATIO = 1.05;
+static const double UNDER_RATIO = 0.75;
+
+// Consecutive frames outside the band before acting
+static const int OVER_FRAMES = 5;
+static const int UNDER_FRAMES = 30;
+
+// Frames to wait after a change so its effect shows in the smoothed time
+static const int COOLDOWN_FRAMES = 10;
+
+// A restore followed this quickly by going over budget is considered a mistake
+static const int RESTORE_BLAME_FRAMES = 60;
+static const int MAX_RESTORE_BACKOFF = 16;
+
+// Restores blocked by backoff for this long are allowed again
+static const int STABLE_FRAMES = 600;
+
+static int percentOf(double part, double total)
+{
+    return total > 0.0 ? static_cast<int>(100.0 * part / total + 0.5) : 0;
+}
+
+FrameGovernor::FrameGovernor()
+  : enabled_(false),
+    target_ms_(0.0),
+    baseline_(),
+    max_tree_depth_(0),
+    smoothed_ms_(-1.0),
+    over_frames_(0),
+    under_frames_(0),
+    cooldown_frames_(0),
+    restore_backoff_(1),
+    frames_since_restore_(0),
+    frame_(0)
+{}
+
+void FrameGovernor::enable(double target_ms, const Knobs& baseline, int max_tree_depth)
+{
+    enabled_ = target_ms > 0.0;
+    target_ms_ = target_ms;
+    baseline_ = baseline;
+    max_tree_depth_ = max_tree_depth;
+    smoothed_ms_ = -1.0;
+    over_frames_ = 0;
+    under_frames_ = 0;
+    cooldown_frames_ = 0;
+    restore_backoff_ = 1;
+}
+
+void FrameGovernor::setBaseline(const Knobs& baseline)
+{
+    baseline_ = baseline;
+}
+
+bool FrameGovernor::isEnabled() const
+{
+    return enabled_;
+}
+
+double FrameGovernor::getTargetMs() const
+{
+    return target_ms_;
+}
+
+bool FrameGovernor::update(const FrameCost& cost, Knobs& knobs)
+{
+    if (!enabled_) return false;
+
+    ++frame_;
+    ++frames_since_restore_;
+
+    const double total = cost.total();
+    smoothed_ms_ = (smoothed_ms_ < 0.0) ? total : smoothed_ms_ + SMOOTHING * (total - smoothed_ms_);
+
+    if (cooldown_frames_ > 0) {
+        --cooldown_frames_;
+        return false;
+    }
+
+    over_frames_ = (smoothed_ms_ > OVER_RATIO * target_ms_) ? over_frames_ + 1 : 0;
+    under_frames_ = (smoothed_ms_ < UNDER_RATIO * target_ms_) ? under_frames_ + 1 : 0;
+
+    if (frames_since_restore_ > STABLE_FRAMES) restore_backoff_ = 1;
+
+    std::string reason;
+
+    if (over_frames_ >= OVER_FRAMES) {
+        over_frames_ = 0;
+
+        if (frames_since_restore_ < RESTORE_BLAME_FRAMES) {
+            restore_backoff_ = std::min(restore_backoff_ * 2, MAX_RESTORE_BACKOFF);
+        }
+
+        if (degrade(cost, knobs, reason)) {
+            log("over budget", reason);
+            cooldown_frames_ = COOLDOWN_FRAMES;
+            return true;
+        }
+    } else if (under_frames_ >= UNDER_FRAMES * restore_backoff_) {
+        under_frames_ = 0;
+
+        if (restore(cost, knobs, reason)) {
+            log("headroom", reason);
+            cooldown_frames_ = COOLDOWN_FRAMES;
+            frames_since_restore_ = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FrameGovernor::degrade(const FrameCost& cost, Knobs& knobs, std::string& reason)
+{
+    std::ostringstream out;
+    const double total = cost.total();
+    const int min_depth = std::max(1, baseline_.tree_depth - 3);
+    const int min_capacity = std::max(1, baseline_.node_capacity / 8);
+    const int max_capacity = baseline_.node_capacity * 8;
+
+    if (knobs.substeps > 1) {
+        out << "substeps " << knobs.substeps << " -> " << knobs.substeps - 1 << " (less simulated time per frame)";
+        --knobs.substeps;
+    } else if (cost.draw_ms > cost.tree_ms + cost.near_field_ms + cost.far_field_ms &&
+               knobs.draw_stride < MAX_DRAW_STRIDE) {
+        out << "draw is " << percentOf(cost.draw_ms, total) << "%, draw stride " << knobs.draw_stride
+            << " -> " << knobs.draw_stride * 2 << " (fewer particles drawn)";
+        knobs.draw_stride *= 2;
+    } else if (cost.near_field_ms >= cost.tree_ms && knobs.node_capacity > min_capacity) {
+        const int capacity = std::max(min_capacity, knobs.node_capacity / 2);
+        out << "near field is " << percentOf(cost.near_field_ms, total) << "%, node capacity "
+            << knobs.node_capacity << " -> " << capacity << " (fewer exact pairs per leaf)";
+        knobs.node_capacity = capacity;
+    } else if (cost.near_field_ms >= cost.tree_ms && knobs.tree_depth < max_tree_depth_) {
+        out << "near field is " << percentOf(cost.near_field_ms, total) << "%, tree depth "
+            << knobs.tree_depth << " -> " << knobs.tree_depth + 1 << " (smaller leaves, more far field approximation)";
+        ++knobs.tree_depth;
+    } else if (cost.tree_ms > cost.near_field_ms && knobs.tree_depth > min_depth) {
+        out << "tree build is " << percentOf(cost.tree_ms, total) << "%, tree depth "
+            << knobs.tree_depth << " -> " << knobs.tree_depth - 1 << " (cheaper build, larger leaves)";
+        --knobs.tree_depth;
+    } else if (cost.tree_ms > cost.near_field_ms && knobs.node_capacity < max_capacity) {
+        out << "tree build is " << percentOf(cost.tree_ms, total) << "%, node capacity "
+            << knobs.node_capacity << " -> " << knobs.node_capacity * 2 << " (fewer splits, larger leaves)";
+        knobs.node_capacity *= 2;
+    } else if (knobs.draw_stride < MAX_DRAW_STRIDE) {
+        out << "solver knobs exhausted, draw stride " << knobs.draw_stride << " -> " << knobs.draw_stride * 2
+            << " (fewer particles drawn)";
+        knobs.draw_stride *= 2;
+    } else {
+        return false;
+    }
+
+    reason = out.str();
+    return true;
+}
+
+bool FrameGovernor::restore(const FrameCost& cost, Knobs& knobs, std::string& reason)
+{
+    std::ostringstream out;
+
+    if (knobs.tree_depth != baseline_.tree_depth) {
+        const int depth = knobs.tree_depth + (knobs.tree_depth < baseline_.tree_depth ? 1 : -1);
+        out << "tree depth " << knobs.tree_depth << " -> " << depth << " (back toward " << baseline_.tree_depth << ")";
+        knobs.tree_depth = depth;
+    } else if (knobs.node_capacity != baseline_.node_capacity) {
+        const int capacity = (knobs.node_capacity < baseline_.node_capacity)
+                           ? std::min(baseline_.node_capacity, knobs.node_capacity * 2)
+                           : std::max(baseline_.node_capacity, knobs.node_capacity / 2);
+        out << "node capacity " << knobs.node_capacity << " -> " << capacity
+            << " (back toward " << baseline_.node_capacity << ")";
+        knobs.node_capacity = capacity;
+    } else if (knobs.draw_stride > baseline_.draw_stride) {
+        out << "draw stride " << knobs.draw_stride << " -> " << knobs.draw_stride / 2 << " (more particles drawn)";
+        knobs.draw_stride /= 2;
+    } else if (knobs.substeps < MAX_SUBSTEPS) {
+        // Only take another substep when the predicted frame still leaves headroom
+        const double step_ms = (cost.tree_ms + cost.near_field_ms + cost.far_field_ms) / knobs.substeps;
+        if (cost.total() + step_ms > UNDER_RATIO * target_ms_) return false;
+
+        out << "substeps " << knobs.substeps << " -> " << knobs.substeps + 1 << " (more simulated time per frame)";
+        ++knobs.substeps;
+    } else {
+        return false;
+    }
+
+    reason = out.str();
+    return true;
+}
+
+void FrameGovernor::log(const std::string& direction, const std::string& reason) const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2)
+        << "[governor] frame " << frame_ << ": " << smoothed_ms_ << " ms vs " << target_ms_
+        << " ms target, " << direction << ": " << reason << "\n";
+    std::cout << out.str();
+}
@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "HugePageArena.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+enum Backing {
+    EXPLICIT_PAGES,
+    TRANSPARENT_PAGES
+};
+
+struct Mapping {
+    std::size_t bytes;      // Whole huge pages
+    Backing backing;
+};
+
+struct Range {
+    std::uintptr_t begin;
+    std::uintptr_t end;
+};
+
+// Everything below is guarded by s_mutex
+std::mutex s_mutex;
+HugePageArena::Policy s_policy = HugePageArena::TRANSPARENT;
+std::map<void*, Mapping> s_mappings;
+HugePageArena::Stats s_stats;
+
+std::size_t readSize(const char* path, const char* key, std::size_t fallback)
+{
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line)) {
+        if (!*key) return std::strtoull(line.c_str(), nullptr, 10);
+
+        // /proc/meminfo style, "Key:   2048 kB"
+        if (line.compare(0, std::strlen(key), key) == 0) {
+            return std::strtoull(line.c_str() + std::strlen(key), nullptr, 10) * 1024;
+        }
+    }
+    return fallback;
+}
+
+std::size_t roundUp(std::size_t bytes, std::size_t page)
+{
+    return (bytes + page - 1) / page * page;
+}
+
+std::size_t explicitPageSize()
+{
+    static const std::size_t size = readSize("/proc/meminfo", "Hugepagesize:", 2u << 20);
+    return size;
+}
+
+void* heapAllocate(std::size_t bytes)
+{
+    return ::operator new(bytes);
+}
+
+#if defined(__linux__)
+
+void* mapExplicit(std::size_t bytes)
+{
+    void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    return (data == MAP_FAILED) ? nullptr : data;
+}
+
+// Over-maps by one huge page and trims both ends, so the mapping starts on a huge
+// page boundary and every page of it can be collapsed into a huge one
+void* mapTransparent(std::size_t bytes)
+{
+    const std::size_t page = HugePageArena::hugePageSize();
+
+    void* raw = mmap(nullptr, bytes + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+
+    const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(raw);
+    const std::uintptr_t aligned = roundUp(begin, page);
+
+    if (aligned > begin) munmap(raw, aligned - begin);
+    if (begin + page > aligned) munmap(reinterpret_cast<void*>(aligned + bytes), begin + page - aligned);
+
+    void* data = reinterpret_cast<void*>(aligned);
+    madvise(data, bytes, MADV_HUGEPAGE);
+    return data;
+}
+
+// Resident and huge page bytes of every mapping overlapping the ranges, attributed
+// by overlap. Rss leaves out hugetlbfs pages, they are reported on their own.
+void measureRanges(std::vector<Range> ranges, std::size_t& resident, std::size_t& huge)
+{
+    resident = huge = 0;
+    if (ranges.empty()) return;
+
+    std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+
+    std::uintptr_t vma_begin = 0, vma_end = 0;
+    double share = 0.0;
+
+    while (std::getline(smaps, line)) {
+        const std::size_t space = line.find(' ');
+        if (space == std::string::npos || space == 0) continue;
+
+        if (line[space - 1] != ':') {
+            // "7f12a0000000-7f12a0400000 rw-p 00000000 00:00 0"
+            char* dash = nullptr;
+            vma_begin = std::strtoull(line.c_str(), &dash, 16);
+            vma_end = (dash && *dash == '-') ? std::strtoull(dash + 1, nullptr, 16) : vma_begin;
+
+            std::uintptr_t overlap = 0;
+            for (const Range& range : ranges) {
+                if (range.begin >= vma_end) break;
+                const std::uintptr_t begin = std::max(range.begin, vma_begin);
+                const std::uintptr_t end = std::min(range.end, vma_end);
+                if (end > begin) overlap += end - begin;
+            }
+            share = (vma_end > vma_begin) ? static_cast<double>(overlap) / (vma_end - vma_begin) : 0.0;
+            continue;
+        }
+
+        if (share <= 0.0) continue;
+
+        const std::string key = line.substr(0, space);
+        const bool is_rss = key == "Rss:";
+        const bool is_thp = key == "AnonHugePages:";
+        const bool is_hugetlb = key == "Private_Hugetlb:" || key == "Shared_Hugetlb:";
+        if (!is_rss && !is_thp && !is_hugetlb) continue;
+
+        const std::size_t bytes = static_cast<std::size_t>(std::strtoull(line.c_str() + space, nullptr, 10) * 1024 * share);
+        if (is_rss || is_hugetlb) resident += bytes;
+        if (is_thp || is_hugetlb) huge += bytes;
+    }
+}
+
+#else
+
+void* mapExplicit(std::size_t)
+{
+    return nullptr;
+}
+
+void* mapTransparent(std::size_t)
+{
+    return nullptr;
+}
+
+void measureRanges(std::vector<Range>, std::size_t& resident, std::size_t& huge)
+{
+    resident = huge = 0;
+}
+
+#endif
+
+} // namespace
+
+void HugePageArena::setPolicy(Policy policy)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_policy = policy;
+}
+
+HugePageArena::Policy HugePageArena::getPolicy()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_policy;
+}
+
+bool HugePageArena::parse(const char* name, Policy& policy)
+{
+    if (!std::strcmp(name, "off")) {
+        policy = OFF;
+    } else if (!std::strcmp(name, "transparent")) {
+        policy = TRANSPARENT;
+    } else if (!std::strcmp(name, "explicit")) {
+        policy = EXPLICIT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* HugePageArena::name(Policy policy)
+{
+    switch (policy) {
+        case OFF: return "off";
+        case TRANSPARENT: return "transparent";
+        case EXPLICIT: return "explicit";
+    }
+    return "unknown";
+}
+
+std::size_t HugePageArena::hugePageSize()
+{
+    static const std::size_t size = readSize("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "", 2u << 20);
+    return size;
+}
+
+void* HugePageArena::allocate(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    s_stats.allocations++;
+    s_stats.live_bytes += bytes;
+    s_stats.peak_bytes = std::max(s_stats.peak_bytes, s_stats.live_bytes);
+
+    if (s_policy == OFF || bytes < hugePageSize()) return heapAllocate(bytes);
+
+    Mapping mapping = { 0, EXPLICIT_PAGES };
+    void* data = nullptr;
+
+    if (s_policy == EXPLICIT) {
+        mapping.bytes = roundUp(bytes, explicitPageSize());
+        data = mapExplicit(mapping.bytes);
+        if (!data) s_stats.explicit_failures++;
+    }
+
+    if (!data) {
+        mapping = { roundUp(bytes, hugePageSize()), TRANSPARENT_PAGES };
+        data = mapTransparent(mapping.bytes);
+    }
+
+    if (!data) return heapAllocate(bytes);
+
+    s_mappings[data] = mapping;
+    s_stats.mapped_bytes += mapping.bytes;
+    s_stats.total_mapped_bytes += mapping.bytes;
+    (mapping.backing == EXPLICIT_PAGES ? s_stats.explicit_bytes : s_stats.advised_bytes) += mapping.bytes;
+    return data;
+}
+
+void HugePageArena::deallocate(void* data, std::size_t bytes)
+{
+    if (!data) return;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_stats.live_bytes -= bytes;
+
+    // Whatever was not mapped came from the heap, whichever policy was set since
+    const std::map<void*, Mapping>::iterator it = s_mappings.find(data);
+    if (it == s_mappings.end()) {
+        ::operator delete(data);
+        return;
+    }
+
+    const Mapping mapping = it->second;
+    s_mappings.erase(it);
+    s_stats.mapped_bytes -= mapping.bytes;
+    (mapping.backing == EXPLICIT_PAGES ? s_stats.explicit_bytes : s_stats.advised_bytes) -= mapping.bytes;
+
+#if defined(__linux__)
+    munmap(data, mapping.bytes);
+#endif
+}
+
+std::size_t HugePageArena::advise(const void* data, std::size_t bytes)
+{
+    if (getPolicy() == OFF) return 0;
+
+#if defined(__linux__)
+    const std::size_t page = hugePageSize();
+    const std::uintptr_t begin = roundUp(reinterpret_cast<std::uintptr_t>(data), page);
+    const std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(data) + bytes) / page * page;
+    if (begin >= end) return 0;
+
+    return madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) == 0 ? end - begin : 0;
+#else
+    (void)data;
+    (void)bytes;
+    return 0;
+#endif
+}
+
+void HugePageArena::measure(const void* data, std::size_t bytes, std::size_t& resident, std::size_t& huge)
+{
+    const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(data);
+    measureRanges(std::vector<Range>(1, Range{begin, begin + bytes}), resident, huge);
+}
+
+std::size_t HugePageArena::getTotalMappedBytes()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_stats.total_mapped_bytes;
+}
+
+HugePageArena::Stats HugePageArena::getStats()
+{
+    std::vector<Range> ranges;
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        stats = s_stats;
+        for (const std::pair<void* const, Mapping>& mapping : s_mappings) {
+            const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(mapping.first);
+            ranges.push_back({begin, begin + mapping.second.bytes});
+        }
+    }
+
+    measureRanges(ranges, stats.resident_bytes, stats.resident_huge_bytes);
+    return stats;
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "HugePageArena.hpp"
+#include "MonotonicArena.hpp"
+
+MonotonicArena::MonotonicArena(std::size_t initial_bytes)
+  : chunks_(),
+    offset_(0),
+    used_(0),
+    peak_(0),
+    capacity_(0)
+{
+    addChunk(std::max<std::size_t>(initial_bytes, 1));
+}
+
+MonotonicArena::~MonotonicArena()
+{
+    for (const Chunk& chunk : chunks_) HugePageArena::deallocate(chunk.data, chunk.bytes);
+}
+
+void* MonotonicArena::allocate(std::size_t bytes, std::size_t alignment)
+{
+    std::size_t start = (offset_ + alignment - 1) / alignment * alignment;
+
+    if (start + bytes > chunks_.back().bytes) {
+        // Chunks double. Offsets are aligned relative to the chunk, which operator new
+        // or mmap align for any fundamental type.
+        addChunk(std::max(bytes, 2 * chunks_.back().bytes));
+        start = 0;
+    }
+
+    offset_ = start + bytes;
+    used_ += bytes;
+    peak_ = std::max(peak_, used_);
+    return chunks_.back().data + start;
+}
+
+void MonotonicArena::reset()
+{
+    if (chunks_.size() > 1) {
+        for (const Chunk& chunk : chunks_) HugePageArena::deallocate(chunk.data, chunk.bytes);
+        chunks_.clear();
+
+        const std::size_t bytes = capacity_;
+        capacity_ = 0;
+        addChunk(bytes);
+    }
+
+    offset_ = 0;
+    used_ = 0;
+}
+
+std::size_t MonotonicArena::getUsedBytes() const
+{
+    return used_;
+}
+
+std::size_t MonotonicArena::getPeakBytes() const
+{
+    return peak_;
+}
+
+std::size_t MonotonicArena::getCapacityBytes() const
+{
+    return capacity_;
+}
+
+void MonotonicArena::addChunk(std::size_t bytes)
+{
+    chunks_.push_back({static_cast<char*>(HugePageArena::allocate(bytes)), bytes});
+    offset_ = 0;
+    capacity_ += bytes;
+}
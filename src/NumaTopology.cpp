@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "NumaTopology.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// From <numaif.h>, which only comes with libnuma
+static const int MPOL_PREFERRED_MODE = 1;
+static const int MPOL_INTERLEAVE_MODE = 3;
+static const unsigned MPOL_MF_MOVE_FLAG = 1u << 1;
+#endif
+
+// Parses a sysfs CPU or node list such as "0-3,8,10-11"
+static std::vector<int> parseList(const std::string& text)
+{
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+        if (item.empty() || item == "\n") continue;
+
+        const std::size_t dash = item.find('-');
+        const int first = std::atoi(item.c_str());
+        const int last = (dash == std::string::npos) ? first : std::atoi(item.c_str() + dash + 1);
+
+        for (int value = first; value <= last; ++value) values.push_back(value);
+    }
+    return values;
+}
+
+static std::string readLine(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+NumaTopology::NumaTopology()
+  : nodes_(),
+    node_of_id_()
+{
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool have_affinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for (int id : parseList(readLine("/sys/devices/system/node/online"))) {
+        Node node = {id, std::vector<int>()};
+
+        const std::string cpulist = "/sys/devices/system/node/node" + std::to_string(id) + "/cpulist";
+        for (int cpu : parseList(readLine(cpulist))) {
+            if (!have_affinity || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) node.cpus.push_back(cpu);
+        }
+
+        // Memory only nodes get no workers
+        if (!node.cpus.empty()) nodes_.push_back(node);
+    }
+#endif
+
+    if (nodes_.empty()) {
+        Node node = {0, std::vector<int>()};
+        const int cpus = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int cpu = 0; cpu < cpus; ++cpu) node.cpus.push_back(cpu);
+        nodes_.push_back(node);
+    }
+
+    for (std::size_t i = 0; i < nodes_.size(); ++i) {
+        const int id = nodes_[i].id;
+        if (id >= static_cast<int>(node_of_id_.size())) node_of_id_.resize(id + 1, -1);
+        node_of_id_[id] = static_cast<int>(i);
+    }
+}
+
+int NumaTopology::getNodeCount() const
+{
+    return static_cast<int>(nodes_.size());
+}
+
+int NumaTopology::getNodeId(int node) const
+{
+    return nodes_[node].id;
+}
+
+const std::vector<int>& NumaTopology::getNodeCpus(int node) const
+{
+    return nodes_[node].cpus;
+}
+
+int NumaTopology::getCpuCount() const
+{
+    int count = 0;
+    for (const Node& node : nodes_) count += static_cast<int>(node.cpus.size());
+    return count;
+}
+
+int NumaTopology::nodeIndex(int id) const
+{
+    return (id >= 0 && id < static_cast<int>(node_of_id_.size())) ? node_of_id_[id] : -1;
+}
+
+int NumaTopology::threadNode(int thread, int num_threads) const
+{
+    return static_cast<int>(static_cast<long long>(thread) * getNodeCount() / std::max(num_threads, 1));
+}
+
+int NumaTopology::threadCpu(int thread, int num_threads) const
+{
+    const int node = threadNode(thread, num_threads);
+
+    // First worker on the same node
+    int first = thread;
+    while (first > 0 && threadNode(first - 1, num_threads) == node) first--;
+
+    const std::vector<int>& cpus = nodes_[node].cpus;
+    return cpus[(thread - first) % cpus.size()];
+}
+
+std::size_t NumaTopology::pageSize()
+{
+#if defined(__linux__)
+    return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 4096;
+#endif
+}
+
+#if defined(__linux__)
+
+bool NumaTopology::pinCurrentThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// mbind wants a bit mask of kernel node ids and, for historic reasons, one more
+// than the number of bits it may read
+static long bindPages(const void* data, std::size_t bytes, int mode, const std::vector<int>& ids)
+{
+    const std::size_t page = NumaTopology::pageSize();
+    const std::size_t first = (reinterpret_cast<std::size_t>(data) + page - 1) / page * page;
+    const std::size_t last = (reinterpret_cast<std::size_t>(data) + bytes) / page * page;
+    if (first >= last) return 0;
+
+    const int max_id = *std::max_element(ids.begin(), ids.end());
+    std::vector<unsigned long> mask(max_id / (8 * sizeof(unsigned long)) + 1, 0);
+    for (int id : ids) mask[id / (8 * sizeof(unsigned long))] |= 1ul << (id % (8 * sizeof(unsigned long)));
+
+    return syscall(SYS_mbind, first, last - first, mode, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1,
+                   MPOL_MF_MOVE_FLAG);
+}
+
+bool NumaTopology::placeOnNode(const void* data, std::size_t bytes, int node) const
+{
+    if (getNodeCount() <= 1) return false;
+    return bindPages(data, bytes, MPOL_PREFERRED_MODE, std::vector<int>(1, nodes_[node].id)) == 0;
+}
+
+bool NumaTopology::interleave(const void* data, std::size_t bytes) const
+{
+    if (getNodeCount() <= 1) return false;
+
+    std::vector<int> ids;
+    for (const Node& node : nodes_) ids.push_back(node.id);
+    return bindPages(data, bytes, MPOL_INTERLEAVE_MODE, ids) == 0;
+}
+
+void NumaTopology::pageNodes(const void* data, std::size_t bytes, std::vector<int>& nodes) const
+{
+    const std::size_t page = pageSize();
+    const std::size_t first = reinterpret_cast<std::size_t>(data) / page * page;
+    const std::size_t end = reinterpret_cast<std::size_t>(data) + bytes;
+    const std::size_t count = (end > first) ? (end - first + page - 1) / page : 0;
+
+    nodes.assign(count, -1);
+
+    // move_pages without target nodes only reports where each page is
+    const std::size_t batch = 1024;
+    std::vector<void*> pages(batch);
+    std::vector<int> status(batch);
+
+    for (std::size_t start = 0; start < count; start += batch) {
+        const std::size_t n = std::min(batch, count - start);
+        for (std::size_t i = 0; i < n; ++i) pages[i] = reinterpret_cast<void*>(first + (start + i) * page);
+
+        if (syscall(SYS_move_pages, 0, n, pages.data(), nullptr, status.data(), 0) != 0) {
+            // Kernels without NUMA support: everything is on the only node
+            if (getNodeCount() == 1) std::fill(nodes.begin() + start, nodes.begin() + start + n, 0);
+            continue;
+        }
+
+        for (std::size_t i = 0; i < n; ++i) nodes[start + i] = (status[i] >= 0) ? nodeIndex(status[i]) : -1;
+    }
+}
+
+#else
+
+bool NumaTopology::pinCurrentThread(int)
+{
+    return false;
+}
+
+bool NumaTopology::placeOnNode(const void*, std::size_t, int) const
+{
+    return false;
+}
+
+bool NumaTopology::interleave(const void*, std::size_t) const
+{
+    return false;
+}
+
+void NumaTopology::pageNodes(const void* data, std::size_t bytes, std::vector<int>& nodes) const
+{
+    const std::size_t page = pageSize();
+    const std::size_t first = reinterpret_cast<std::size_t>(data) / page * page;
+    const std::size_t end = reinterpret_cast<std::size_t>(data) + bytes;
+    nodes.assign((end > first) ? (end - first + page - 1) / page : 0, 0);
+}
+
+#endif
+
+std::string NumaTopology::describe() const
+{
+    std::stringstream ss;
+    ss << nodes_.size() << (nodes_.size() == 1 ? " node: " : " nodes: ");
+
+    for (std::size_t i = 0; i < nodes_.size(); ++i) {
+        if (i > 0) ss << " | ";
+
+        const std::vector<int>& cpus = nodes_[i].cpus;
+        for (std::size_t j = 0; j < cpus.size();) {
+            std::size_t k = j;
+            while (k + 1 < cpus.size() && cpus[k + 1] == cpus[k] + 1) k++;
+
+            if (j > 0) ss << ',';
+            ss << cpus[j];
+            if (k > j) ss << '-' << cpus[k];
+            j = k + 1;
+        }
+    }
+    return ss.str();
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cmath>
+
+#include "OrbDecomposition.hpp"
+
+OrbDecomposition::OrbDecomposition()
+  : root_(0.0f, 0.0f, 0.0f, 0.0f),
+    root_node_(-1),
+    cuts_(),
+    domains_()
+{}
+
+void OrbDecomposition::build(const sf::FloatRect& root, int num_domains, std::vector<WeightedPoint> points)
+{
+    root_ = root;
+    cuts_.clear();
+    domains_.clear();
+    root_node_ = bisect(root, std::max(num_domains, 1), points, 0, points.size());
+}
+
+int OrbDecomposition::bisect(const sf::FloatRect& bounds,
+                             int num_domains,
+                             std::vector<WeightedPoint>& points,
+                             std::size_t begin,
+                             std::size_t end)
+{
+    if (num_domains == 1) {
+        domains_.push_back(bounds);
+        return -static_cast<int>(domains_.size());
+    }
+
+    const int lower_domains = num_domains / 2;
+    const int axis = (bounds.width >= bounds.height) ? 0 : 1;
+    const float low = axis ? bounds.top : bounds.left;
+    const float extent = axis ? bounds.height : bounds.width;
+
+    auto coordinate = [axis](const WeightedPoint& point) { return axis ? point.position.y : point.position.x; };
+
+    std::sort(points.begin() + begin, points.begin() + end,
+              [&](const WeightedPoint& a, const WeightedPoint& b) { return coordinate(a) < coordinate(b); });
+
+    double total = 0.0;
+    for (std::size_t i = begin; i < end; ++i) total += points[i].weight;
+
+    const double target = total * lower_domains / num_domains;
+
+    // First point of the upper part, chosen so the lower part's weight is closest to target
+    std::size_t middle = begin;
+    double lower_weight = 0.0;
+    while (middle < end && std::abs(lower_weight + points[middle].weight - target) < std::abs(lower_weight - target)) {
+        lower_weight += points[middle].weight;
+        middle++;
+    }
+
+    float split = low + extent * lower_domains / num_domains;
+    if (middle > begin && middle < end) {
+        split = 0.5f * (coordinate(points[middle - 1]) + coordinate(points[middle]));
+    }
+
+    // Keep both halves non-empty, a degenerate domain would own nothing forever
+    const float margin = extent * 1e-3f;
+    split = std::min(std::max(split, low + margin), low + extent - margin);
+
+    sf::FloatRect lower = bounds;
+    sf::FloatRect upper = bounds;
+    if (axis) {
+        lower.height = split - bounds.top;
+        upper.top = split;
+        upper.height = bounds.top + bounds.height - split;
+    } else {
+        lower.width = split - bounds.left;
+        upper.left = split;
+        upper.width = bounds.left + bounds.width - split;
+    }
+
+    // Points exactly on the split go up, like domainOf()
+    while (middle > begin && coordinate(points[middle - 1]) >= split) middle--;
+    while (middle < end && coordinate(points[middle]) < split) middle++;
+
+    const int cut = static_cast<int>(cuts_.size());
+    cuts_.push_back({axis, split, {0, 0}});
+
+    const int lower_child = bisect(lower, lower_domains, points, begin, middle);
+    const int upper_child = bisect(upper, num_domains - lower_domains, points, middle, end);
+    cuts_[cut].children[0] = lower_child;
+    cuts_[cut].children[1] = upper_child;
+    return cut;
+}
+
+int OrbDecomposition::domainOf(const Vector2r& position) const
+{
+    if (!(position.x >= root_.left && position.x < root_.left + root_.width &&
+          position.y >= root_.top && position.y < root_.top + root_.height)) return -1;
+
+    int node = root_node_;
+    while (node >= 0) {
+        const Cut& cut = cuts_[node];
+        const Real coordinate = cut.axis ? position.y : position.x;
+        node = cut.children[coordinate < cut.split ? 0 : 1];
+    }
+    return -1 - node;
+}
+
+int OrbDecomposition::getDomainCount() const
+{
+    return static_cast<int>(domains_.size());
+}
+
+const sf::FloatRect& OrbDecomposition::getDomainBounds(int domain) const
+{
+    return domains_[domain];
+}
+
+const sf::FloatRect& OrbDecomposition::getRootBounds() const
+{
+    return root_;
+}
@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "OutOfCoreSimulation.hpp"
+#include "Parallel.hpp"
+
+// Records streamed between madvise hints when a pass walks the whole file
+static const std::size_t STREAM_CHUNK = 1 << 16;
+
+OutOfCoreSimulation::OutOfCoreSimulation(const Settings& settings)
+  : settings_(settings),
+    tiles_per_side_(1 << settings.tile_level),
+    file_(),
+    swap_file_(),
+    tile_offsets_(),
+    tile_counts_(),
+    pyramid_(),
+    sorted_(true),
+    summarized_(false),
+    tile_tree_(sf::FloatRect(0.0f, 0.0f,
+                             static_cast<int>(settings.width) >> settings.tile_level,
+                             static_cast<int>(settings.height) >> settings.tile_level),
+               settings.tree_depth,
+               settings.node_capacity),
+    leaf_nodes_(),
+    interaction_lists_(),
+    threads_(),
+    numa_topology_(),
+    stats_()
+{
+    settings_.num_threads = std::max(settings_.num_threads, 1);
+    settings_.summary_level = std::max(settings_.summary_level, settings_.tile_level);
+
+    const std::size_t num_tiles = getTileCount();
+    tile_offsets_.assign(num_tiles + 1, 0);
+    tile_counts_.assign(num_tiles, 0);
+
+    pyramid_.resize(settings_.summary_level + 1);
+    for (int level = 0; level <= settings_.summary_level; ++level) {
+        pyramid_[level].resize(std::size_t(1) << (2 * level));
+    }
+}
+
+bool OutOfCoreSimulation::open(const std::string& path, std::size_t capacity)
+{
+    return file_.open(path, capacity) && swap_file_.open(path + ".swap", capacity);
+}
+
+bool OutOfCoreSimulation::addParticles(const std::vector<Particle>& particles)
+{
+    const std::size_t first = file_.size();
+    if (!file_.isOpen() || first + particles.size() > file_.capacity()) return false;
+
+    file_.resize(first + particles.size());
+
+    ParticleFile::Record* records = file_.data() + first;
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        records[i] = { particles[i].position, particles[i].velocity, particles[i].mass };
+    }
+
+    sorted_ = false;
+    summarized_ = false;
+    return true;
+}
+
+void OutOfCoreSimulation::runOnChunks(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work)
+{
+    ::runOnChunks(threads_, settings_.num_threads, count, 1, settings_.numa_aware ? &numa_topology_ : nullptr, work);
+}
+
+sf::FloatRect OutOfCoreSimulation::tileBounds(int tile) const
+{
+    const float width = settings_.width / tiles_per_side_;
+    const float height = settings_.height / tiles_per_side_;
+    return sf::FloatRect((tile % tiles_per_side_) * width, (tile / tiles_per_side_) * height, width, height);
+}
+
+// Column or row of value among cells cells of the extent
+static inline int cellOf(Real value, float extent, int cells)
+{
+    return std::min(cells - 1, static_cast<int>(value * cells / extent));
+}
+
+static inline bool inArea(const Vector2r& position, float width, float height)
+{
+    return std::isfinite(position.x) && std::isfinite(position.y) &&
+           position.x >= 0 && position.x < width && position.y >= 0 && position.y < height;
+}
+
+// Tile holding the position, -1 outside the simulation area
+int OutOfCoreSimulation::tileOf(const Vector2r& position) const
+{
+    if (!inArea(position, settings_.width, settings_.height)) return -1;
+
+    return cellOf(position.y, settings_.height, tiles_per_side_) * tiles_per_side_ +
+           cellOf(position.x, settings_.width, tiles_per_side_);
+}
+
+void OutOfCoreSimulation::binParticle(const Vector2r& position, Real mass, std::vector<SummaryCell>& finest)
+{
+    const int cells = 1 << settings_.summary_level;
+    SummaryCell& cell = finest[cellOf(position.y, settings_.height, cells) * cells +
+                               cellOf(position.x, settings_.width, cells)];
+
+    cell.mass += mass;
+    cell.mass_x += static_cast<Accum>(position.x) * mass;
+    cell.mass_y += static_cast<Accum>(position.y) * mass;
+}
+
+void OutOfCoreSimulation::loadTile(int tile, std::vector<Particle>& buffer) const
+{
+    const ParticleFile::Record* records = file_.data();
+
+    buffer.clear();
+    for (std::size_t i = tile_offsets_[tile]; i < tile_offsets_[tile + 1]; ++i) {
+        buffer.emplace_back(records[i].position, records[i].velocity, records[i].mass);
+    }
+}
+
+// Counts and summary cells of the records as they are, only needed after particles
+// were added. Steps get both from the write back.
+void OutOfCoreSimulation::summarize()
+{
+    std::vector<SummaryCell>& finest = pyramid_[settings_.summary_level];
+    std::fill(finest.begin(), finest.end(), SummaryCell());
+    std::fill(tile_counts_.begin(), tile_counts_.end(), 0);
+
+    const ParticleFile::Record* records = file_.data();
+    const std::size_t n = file_.size();
+
+    for (std::size_t chunk = 0; chunk < n; chunk += STREAM_CHUNK) {
+        file_.prefetch(chunk + STREAM_CHUNK, std::min(n, chunk + 2 * STREAM_CHUNK));
+
+        for (std::size_t i = chunk; i < std::min(n, chunk + STREAM_CHUNK); ++i) {
+            const int tile = tileOf(records[i].position);
+            if (tile < 0) continue;
+
+            tile_counts_[tile]++;
+            binParticle(records[i].position, records[i].mass, finest);
+        }
+    }
+
+    summarized_ = true;
+}
+
+void OutOfCoreSimulation::buildPyramid()
+{
+    for (int level = settings_.summary_level - 1; level >= 0; --level) {
+        const int cells = 1 << level;
+        const std::vector<SummaryCell>& children = pyramid_[level + 1];
+        std::vector<SummaryCell>& parents = pyramid_[level];
+
+        for (int y = 0; y < cells; ++y) {
+            for (int x = 0; x < cells; ++x) {
+                SummaryCell cell;
+                for (int k = 0; k < 4; ++k) {
+                    const SummaryCell& child = children[(2 * y + (k >> 1)) * 2 * cells + 2 * x + (k & 1)];
+                    cell.mass += child.mass;
+                    cell.mass_x += child.mass_x;
+                    cell.mass_y += child.mass_y;
+                }
+                parents[y * cells + x] = cell;
+            }
+        }
+    }
+}
+
+// Counting sort of the records into tile order through the swap file, tile_counts_
+// must hold the tile sizes of the current positions. Particles outside the area are dropped.
+void OutOfCoreSimulation::sortByTile()
+{
+    const std::size_t num_tiles = getTileCount();
+
+    tile_offsets_[0] = 0;
+    for (std::size_t tile = 0; tile < num_tiles; ++tile) {
+        tile_offsets_[tile + 1] = tile_offsets_[tile] + tile_counts_[tile];
+    }
+
+    std::vector<std::size_t> cursors(tile_offsets_.begin(), tile_offsets_.end() - 1);
+    swap_file_.resize(tile_offsets_[num_tiles]);
+
+    const ParticleFile::Record* records = file_.data();
+    ParticleFile::Record* sorted = swap_file_.data();
+    const std::size_t n = file_.size();
+
+    for (std::size_t chunk = 0; chunk < n; chunk += STREAM_CHUNK) {
+        const std::size_t chunk_end = std::min(n, chunk + STREAM_CHUNK);
+        file_.prefetch(chunk_end, std::min(n, chunk + 2 * STREAM_CHUNK));
+
+        for (std::size_t i = chunk; i < chunk_end; ++i) {
+            const int tile = tileOf(records[i].position);
+            if (tile >= 0) sorted[cursors[tile]++] = records[i];
+        }
+
+        file_.release(chunk, chunk_end);
+    }
+
+    file_.swap(swap_file_);
+    swap_file_.release(0, swap_file_.size());
+    swap_file_.resize(0);
+    sorted_ = true;
+}
+
+// The MONOPOLE tree solver within the tile, the summary field from outside it, then
+// integration. The interaction lists are rebuilt for every tile.
+void OutOfCoreSimulation::computeTile(int tile, std::vector<Particle>& particles)
+{
+    if (particles.empty()) return;
+
+    int total_leaf_nodes = 0;
+    Accum tile_mass = 0.0f;
+
+    tile_tree_.deleteTree();
+    tile_tree_.setBounds(tileBounds(tile));
+    tile_tree_.insert(particles);
+    tile_tree_.computeMoments(particles);
+
+    leaf_nodes_.clear();
+    tile_tree_.getLeafNodes(leaf_nodes_, total_leaf_nodes, tile_mass);
+
+    interaction_lists_.resize(leaf_nodes_.size());
+    interaction_lists_.leaf_indices.resize(leaf_nodes_.size());
+    interaction_lists_.root_bounds = tile_tree_.getBounds();
+    interaction_lists_.theta = settings_.theta;
+
+    const ForceKernels::MultipoleParams multipole = { settings_.theta, false, nullptr };
+
+    runOnChunks(leaf_nodes_.size(), [&](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::buildInteractionLists(tile_tree_, leaf_nodes_, start_index, end_index, settings_.theta,
+                                            interaction_lists_);
+        ForceKernels::nearField(particles, tile_tree_.getParticleElementNodeVec(), leaf_nodes_, start_index, end_index);
+    });
+
+    runOnChunks(leaf_nodes_.size(), [&](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::nearFieldNeighbours(particles, tile_tree_, leaf_nodes_, interaction_lists_, start_index, end_index);
+        ForceKernels::farFieldMultipole(particles, tile_tree_, leaf_nodes_, interaction_lists_, start_index, end_index,
+                                        multipole);
+        summaryField(tile, particles, start_index, end_index);
+    });
+
+    const sf::FloatRect area(0.0f, 0.0f, settings_.width, settings_.height);
+    const ForceKernels::IntegrationParams params = { settings_.time_step, false, sf::Vector2f(0.0f, 0.0f),
+                                                     ForceKernels::REMOVE, area, false };
+
+    runOnChunks(particles.size(), [&](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::integrate(particles, start_index, end_index, params);
+    });
+}
+
+// Barnes-Hut walk over the summary pyramid for the leaves [start_index, end_index) of
+// the tile tree. Cells within the tile are skipped, the tile tree covers them, and
+// cells still too close at the finest level are taken as point masses anyway.
+void OutOfCoreSimulation::summaryField(int tile,
+                                       std::vector<Particle>& particles,
+                                       std::size_t start_index,
+                                       std::size_t end_index)
+{
+    struct WalkData {
+        int level;
+        int x;
+        int y;
+    };
+
+    struct PointMass {
+        Vector2a position;
+        Accum mass;
+    };
+
+    const int tile_x = tile % tiles_per_side_;
+    const int tile_y = tile / tiles_per_side_;
+    const int tile_level = settings_.tile_level;
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = tile_tree_.getParticleElementNodeVec();
+
+    WalkData array[128];
+    std::vector<PointMass> sources;
+
+    for (std::size_t j = start_index; j < end_index; ++j) {
+
+        const sf::FloatRect leaf_bounds = tile_tree_.getNodeBounds(tile_tree_.getNodeIndex(leaf_nodes_[j]));
+        const sf::Vector2f leaf_center(leaf_bounds.left + 0.5f * leaf_bounds.width,
+                                       leaf_bounds.top + 0.5f * leaf_bounds.height);
+        const float leaf_radius = 0.5f * std::sqrt(leaf_bounds.width * leaf_bounds.width +
+                                                   leaf_bounds.height * leaf_bounds.height);
+
+        sources.clear();
+
+        int top = 0;
+        array[top++] = {0, 0, 0};
+
+        while (top > 0) {
+            const WalkData current = array[--top];
+
+            if (current.level >= tile_level) {
+                const int shift = current.level - tile_level;
+                if ((current.x >> shift) == tile_x && (current.y >> shift) == tile_y) continue;
+            } else {
+                const int shift = tile_level - current.level;
+                if ((tile_x >> shift) == current.x && (tile_y >> shift) == current.y) {
+                    for (int k = 0; k < 4; ++k) {
+                        array[top++] = {current.level + 1, 2 * current.x + (k & 1), 2 * current.y + (k >> 1)};
+                    }
+                    continue;
+                }
+            }
+
+            const int cells = 1 << current.level;
+            const SummaryCell& cell = pyramid_[current.level][current.y * cells + current.x];
+            if (cell.mass <= 0.0f) continue;
+
+            const float width = settings_.width / cells;
+            const float height = settings_.height / cells;
+            const sf::Vector2f offset((current.x + 0.5f) * width - leaf_center.x,
+                                      (current.y + 0.5f) * height - leaf_center.y);
+            const float distance = std::sqrt(offset.x * offset.x + offset.y * offset.y) - leaf_radius;
+
+            if (current.level == settings_.summary_level ||
+                (distance > 0.0f && std::max(width, height) < settings_.theta * distance)) {
+                sources.push_back({ Vector2a(cell.mass_x / cell.mass, cell.mass_y / cell.mass), cell.mass });
+                continue;
+            }
+
+            for (int k = 0; k < 4; ++k) {
+                array[top++] = {current.level + 1, 2 * current.x + (k & 1), 2 * current.y + (k >> 1)};
+            }
+        }
+
+        for (int i = leaf_nodes_[j]->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+            Particle& particle = particles[particle_element_nodes[i].particle_index];
+            const Vector2a position = vectorCast<Accum>(particle.position);
+            Vector2a acceleration(0, 0);
+
+            for (const PointMass& source : sources) {
+                const Vector2a offset = source.position - position;
+                const Accum distance_squared = offset.x * offset.x + offset.y * offset.y;
+                acceleration += (source.mass / (distance_squared + ForceKernels::SOFTENING)) * offset;
+            }
+
+            particle.acceleration += static_cast<Accum>(ForceKernels::BIG_G) * acceleration;
+        }
+    }
+}
+
+// Stores the tile's particles over their old records and bins the new positions for
+// the next step
+void OutOfCoreSimulation::writeBack(int tile, const std::vector<Particle>& particles, std::vector<SummaryCell>& finest)
+{
+    ParticleFile::Record* records = file_.data() + tile_offsets_[tile];
+
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        const Particle& particle = particles[i];
+        records[i] = { particle.position, particle.velocity, particle.mass };
+
+        const int destination = tileOf(particle.position);
+        if (destination < 0) {
+            stats_.removed++;
+            continue;
+        }
+
+        if (destination != tile) stats_.moved++;
+        tile_counts_[destination]++;
+        binParticle(particle.position, particle.mass, finest);
+    }
+}
+
+void OutOfCoreSimulation::step()
+{
+    stats_ = StepStats();
+
+    if (!summarized_) summarize();
+    if (!sorted_) sortByTile();
+    buildPyramid();
+
+    auto phase_start = std::chrono::steady_clock::now();
+
+    const int num_tiles = static_cast<int>(getTileCount());
+    std::vector<SummaryCell> finest(pyramid_[settings_.summary_level].size());
+    std::fill(tile_counts_.begin(), tile_counts_.end(), 0);
+
+    loadTile(0, tile_buffers_[0]);
+
+    for (int tile = 0; tile < num_tiles; ++tile) {
+        std::vector<Particle>& current = tile_buffers_[tile & 1];
+        std::thread loader;
+
+        if (tile + 1 < num_tiles) {
+            loader = std::thread(&OutOfCoreSimulation::loadTile, this, tile + 1, std::ref(tile_buffers_[(tile + 1) & 1]));
+        }
+        if (tile + 2 < num_tiles) file_.prefetch(tile_offsets_[tile + 2], tile_offsets_[tile + 3]);
+
+        stats_.largest_tile = std::max(stats_.largest_tile, current.size());
+
+        computeTile(tile, current);
+        writeBack(tile, current, finest);
+        file_.release(tile_offsets_[tile], tile_offsets_[tile + 1]);
+
+        const auto wait_start = std::chrono::steady_clock::now();
+        if (loader.joinable()) loader.join();
+        stats_.load_wait_ms += millisecondsSince(wait_start);
+    }
+
+    pyramid_[settings_.summary_level].swap(finest);
+    stats_.force_ms = millisecondsSince(phase_start);
+
+    if (stats_.moved > 0 || stats_.removed > 0) {
+        phase_start = std::chrono::steady_clock::now();
+        sortByTile();
+        stats_.sort_ms = millisecondsSince(phase_start);
+    }
+}
+
+std::size_t OutOfCoreSimulation::getParticleCount() const
+{
+    return file_.size();
+}
+
+std::size_t OutOfCoreSimulation::getTileCount() const
+{
+    return static_cast<std::size_t>(tiles_per_side_) * tiles_per_side_;
+}
+
+const OutOfCoreSimulation::StepStats& OutOfCoreSimulation::getStepStats() const
+{
+    return stats_;
+}
+
+const ParticleFile& OutOfCoreSimulation::getFile() const
+{
+    return file_;
+}
@@ -1,32 +1,36 @@
 #include "Particle.hpp"
 
 Particle::Particle()
-    : position(sf::Vector2f(0,0)),
-      velocity(sf::Vector2f(0,0)),
-      acceleration(sf::Vector2f(0,0)),
+    : position(0, 0),
+      velocity(0, 0),
+      acceleration(0, 0),
       color(sf::Color(15,0,240,30)),
-      mass(1) {}
+      mass(1),
+      rung(-1) {}
 
-Particle::Particle(const sf::Vector2f& pos, const sf::Vector2f& vel, float m)
+Particle::Particle(const Vector2r& pos, const Vector2r& vel, Real m)
     : position(pos),
       velocity(vel),
-      acceleration(sf::Vector2f(0,0)),
+      acceleration(0, 0),
       color(sf::Color(15,0,240,30)),
-      mass(m) {}
+      mass(m),
+      rung(-1) {}
 
 Particle::Particle(const Particle& particle)
     : position(particle.position),
       velocity(particle.velocity),
       acceleration(particle.acceleration),
       color(particle.color),
-      mass(particle.mass) {}
+      mass(particle.mass),
+      rung(particle.rung) {}
 
 Particle::Particle(Particle&& particle)
     : position(std::move(particle.position)),
       velocity(std::move(particle.velocity)),
       acceleration(std::move(particle.acceleration)),
       color(std::move(particle.color)),
-      mass(particle.mass) {}
+      mass(particle.mass),
+      rung(particle.rung) {}
 
 Particle& Particle::operator=(const Particle& particle)
 {
@@ -36,6 +40,7 @@ Particle& Particle::operator=(const Particle& particle)
         acceleration = particle.acceleration;
         color = particle.color;
         mass = particle.mass;
+        rung = particle.rung;
     }
     
     return *this;
@@ -49,6 +54,7 @@ Particle& Particle::operator=(Particle&& particle)
         acceleration = std::move(particle.acceleration);
         color = std::move(particle.color);
         mass = particle.mass;
+        rung = particle.rung;
     }
     
     return *this;
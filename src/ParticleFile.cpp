@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <utility>
+
+#include "ParticleFile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ParticleFile::ParticleFile()
+  : path_(),
+    fd_(-1),
+    records_(nullptr),
+    size_(0),
+    capacity_(0)
+{}
+
+ParticleFile::~ParticleFile()
+{
+    close();
+}
+
+bool ParticleFile::open(const std::string& path, std::size_t capacity)
+{
+    close();
+
+    const std::size_t bytes = std::max<std::size_t>(capacity, 1) * sizeof(Record);
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) return false;
+
+    if (ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+        close();
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    path_ = path;
+    records_ = static_cast<Record*>(mapping);
+    size_ = 0;
+    capacity_ = capacity;
+    return true;
+}
+
+void ParticleFile::close()
+{
+    if (records_) munmap(records_, std::max<std::size_t>(capacity_, 1) * sizeof(Record));
+    if (fd_ >= 0) ::close(fd_);
+
+    fd_ = -1;
+    records_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+// madvise works on whole pages. Prefetches widen the range to them, releases only
+// drop the pages entirely within it, so neighbouring records stay resident.
+void ParticleFile::advise(std::size_t begin, std::size_t end, int advice) const
+{
+    if (!records_ || begin >= end) return;
+
+    const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t base = reinterpret_cast<std::size_t>(records_);
+    std::size_t first = base + begin * sizeof(Record);
+    std::size_t last = base + end * sizeof(Record);
+
+    if (advice == MADV_DONTNEED) {
+        first = (first + page - 1) / page * page;
+        last = last / page * page;
+    } else {
+        first = first / page * page;
+    }
+
+    if (first < last) madvise(reinterpret_cast<void*>(first), last - first, advice);
+}
+
+void ParticleFile::prefetch(std::size_t begin, std::size_t end) const
+{
+    advise(begin, end, MADV_WILLNEED);
+}
+
+void ParticleFile::release(std::size_t begin, std::size_t end) const
+{
+    advise(begin, end, MADV_DONTNEED);
+}
+
+#else
+
+ParticleFile::ParticleFile()
+  : path_(),
+    fd_(-1),
+    records_(nullptr),
+    size_(0),
+    capacity_(0)
+{}
+
+ParticleFile::~ParticleFile() {}
+
+bool ParticleFile::open(const std::string&, std::size_t)
+{
+    return false;
+}
+
+void ParticleFile::close() {}
+void ParticleFile::advise(std::size_t, std::size_t, int) const {}
+void ParticleFile::prefetch(std::size_t, std::size_t) const {}
+void ParticleFile::release(std::size_t, std::size_t) const {}
+
+#endif
+
+bool ParticleFile::isOpen() const
+{
+    return records_ != nullptr;
+}
+
+ParticleFile::Record* ParticleFile::data()
+{
+    return records_;
+}
+
+const ParticleFile::Record* ParticleFile::data() const
+{
+    return records_;
+}
+
+std::size_t ParticleFile::size() const
+{
+    return size_;
+}
+
+void ParticleFile::resize(std::size_t size)
+{
+    size_ = std::min(size, capacity_);
+}
+
+std::size_t ParticleFile::capacity() const
+{
+    return capacity_;
+}
+
+const std::string& ParticleFile::path() const
+{
+    return path_;
+}
+
+void ParticleFile::swap(ParticleFile& other)
+{
+    std::swap(path_, other.path_);
+    std::swap(fd_, other.fd_);
+    std::swap(records_, other.records_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+}
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <cmath>
+
+#include "ParticleMesh.hpp"
+#include "ForceKernels.hpp"
+
+// Split radius of the long/short range kernels, in cells. Below about one cell the
+// cloud-in-cell mesh force deviates from the long range kernel.
+static const float SPLIT_CELLS = 1.25f;
+
+static const float PI = 3.14159265358979f;
+
+// Columns transformed together, 8 complex floats fill a 64 byte cache line. The
+// padded width is a power of two of at least this, so it always divides it.
+static const int COLUMN_BLOCK = 8;
+
+static int nextPowerOfTwo(int n)
+{
+    int power = 1;
+    while (power < n) power *= 2;
+    return power;
+}
+
+// exp(-2 pi i k / n) for k < n / 2
+static void computeTwiddles(std::vector<std::complex<float>>& twiddles, int n)
+{
+    twiddles.resize(n / 2);
+    for (int k = 0; k < n / 2; ++k) {
+        const double angle = -2.0 * PI * k / n;
+        twiddles[k] = std::complex<float>(std::cos(angle), std::sin(angle));
+    }
+}
+
+// In place iterative radix-2 transform of n (a power of two) contiguous values.
+// The inverse is unscaled.
+static void fft(std::complex<float>* data, int n, const std::vector<std::complex<float>>& twiddles, bool inverse)
+{
+    // Bit reversal permutation
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+
+    const float sign = inverse ? -1.0f : 1.0f;
+
+    for (int length = 2; length <= n; length <<= 1) {
+        const int half = length / 2;
+        const int step = n / length;
+
+        for (int start = 0; start < n; start += length) {
+            for (int k = 0; k < half; ++k) {
+                const float wr = twiddles[k * step].real();
+                const float wi = sign * twiddles[k * step].imag();
+
+                // Written out, std::complex multiplication checks for inf/nan without -ffast-math
+                const std::complex<float> u = data[start + k];
+                const std::complex<float> v = data[start + k + half];
+                const float vr = v.real() * wr - v.imag() * wi;
+                const float vi = v.real() * wi + v.imag() * wr;
+
+                data[start + k] = std::complex<float>(u.real() + vr, u.imag() + vi);
+                data[start + k + half] = std::complex<float>(u.real() - vr, u.imag() - vi);
+            }
+        }
+    }
+}
+
+// Lower cell and weight of the upper cell for a cell centred grid, clamped to the grid
+static inline void cellWeights(float position, float inv_cell_size, int cells, int& index, float& fraction)
+{
+    float grid_position = position * inv_cell_size - 0.5f;
+    grid_position = std::max(0.0f, std::min(grid_position, cells - 1.0f));
+    index = std::min(static_cast<int>(grid_position), cells - 2);
+    fraction = grid_position - index;
+}
+
+ParticleMesh::ParticleMesh()
+  : origin_(0.0f, 0.0f),
+    width_(0.0f),
+    height_(0.0f),
+    cells_(0),
+    num_slices_(0),
+    cell_size_(1.0f),
+    split_radius_(SPLIT_CELLS),
+    nx_(0),
+    ny_(0),
+    padded_nx_(0),
+    padded_ny_(0),
+    kernel_ready_(false)
+{}
+
+void ParticleMesh::configure(const sf::FloatRect& area, int cells, int num_slices)
+{
+    const float width = area.width;
+    const float height = area.height;
+    cells = nextPowerOfTwo(std::max(cells, 2));
+    num_slices = std::max(num_slices, 1);
+
+    // The kernel only depends on the grid, moving it is free
+    origin_ = sf::Vector2f(area.left, area.top);
+
+    if (width == width_ && height == height_ && cells == cells_ && num_slices == num_slices_) return;
+
+    width_ = width;
+    height_ = height;
+    cells_ = cells;
+    num_slices_ = num_slices;
+
+    cell_size_ = std::max(width, height) / cells;
+    split_radius_ = SPLIT_CELLS * cell_size_;
+    nx_ = std::max(2, static_cast<int>(std::ceil(width / cell_size_)));
+    ny_ = std::max(2, static_cast<int>(std::ceil(height / cell_size_)));
+    padded_nx_ = nextPowerOfTwo(std::max(2 * nx_, COLUMN_BLOCK));
+    padded_ny_ = nextPowerOfTwo(2 * ny_);
+
+    slices_.assign(num_slices_, std::vector<float>(static_cast<std::size_t>(nx_) * ny_));
+    grid_.assign(static_cast<std::size_t>(padded_nx_) * padded_ny_, Complex());
+    kernel_.assign(grid_.size(), Complex());
+
+    computeTwiddles(twiddles_x_, padded_nx_);
+    computeTwiddles(twiddles_y_, padded_ny_);
+
+    kernel_ready_ = false;
+}
+
+float ParticleMesh::getCellSize() const
+{
+    return cell_size_;
+}
+
+float ParticleMesh::getSplitRadius() const
+{
+    return split_radius_;
+}
+
+std::size_t ParticleMesh::getAllocatedBytes() const
+{
+    std::size_t bytes = (grid_.capacity() + kernel_.capacity() + twiddles_x_.capacity() + twiddles_y_.capacity()) *
+                        sizeof(Complex);
+    for (const std::vector<float>& slice : slices_) bytes += slice.capacity() * sizeof(float);
+    return bytes;
+}
+
+void ParticleMesh::computeAccelerations(std::vector<Particle>& particles, const Runner& run)
+{
+    if (particles.empty() || grid_.empty()) return;
+
+    if (!kernel_ready_) {
+        computeKernel(run);
+        kernel_ready_ = true;
+    }
+
+    deposit(particles, run);
+
+    // Only the first ny_ rows hold mass, the rest of the padding transforms to zero
+    transform(grid_, ny_, false, run);
+
+    run(padded_ny_, [this](std::size_t start_row, std::size_t end_row) {
+        const std::size_t begin = start_row * padded_nx_;
+        const std::size_t end = end_row * padded_nx_;
+
+        for (std::size_t i = begin; i < end; ++i) {
+            const float gr = grid_[i].real();
+            const float gi = grid_[i].imag();
+            const float kr = kernel_[i].real();
+            const float ki = kernel_[i].imag();
+            grid_[i] = Complex(gr * kr - gi * ki, gr * ki + gi * kr);
+        }
+    });
+
+    // Likewise only the first ny_ rows of the result are read back
+    transform(grid_, ny_, true, run);
+
+    interpolate(particles, run);
+}
+
+void ParticleMesh::computeKernel(const Runner& run)
+{
+    const float inv_split_squared = 1.0f / (split_radius_ * split_radius_);
+
+    // Force on a unit mass at displacement r from a unit mass: -G r/r^2 (1 - exp(-r^2/rs^2)),
+    // with the x component in the real and the y component in the imaginary part.
+    // The transform is scaled here so the inverse needs no extra pass.
+    const float scale = ForceKernels::BIG_G / (static_cast<float>(padded_nx_) * padded_ny_);
+
+    run(padded_ny_, [this, inv_split_squared, scale](std::size_t start_row, std::size_t end_row) {
+        for (std::size_t row = start_row; row < end_row; ++row) {
+            const int j = static_cast<int>(row);
+            const float dy = ((j <= padded_ny_ / 2) ? j : j - padded_ny_) * cell_size_;
+
+            for (int i = 0; i < padded_nx_; ++i) {
+                const float dx = ((i <= padded_nx_ / 2) ? i : i - padded_nx_) * cell_size_;
+                const float r2 = dx * dx + dy * dy;
+
+                Complex value;
+                if (r2 > 0.0f) {
+                    const float weight = -scale * (1.0f - std::exp(-r2 * inv_split_squared)) / r2;
+                    value = Complex(weight * dx, weight * dy);
+                }
+
+                kernel_[row * padded_nx_ + i] = value;
+            }
+        }
+    });
+
+    transform(kernel_, padded_ny_, false, run);
+}
+
+void ParticleMesh::deposit(const std::vector<Particle>& particles, const Runner& run)
+{
+    const float inv_cell_size = 1.0f / cell_size_;
+    const std::size_t n = particles.size();
+
+    // Every slice of particles deposits into its own grid, no two threads write the same cell
+    run(num_slices_, [this, &particles, inv_cell_size, n](std::size_t start_slice, std::size_t end_slice) {
+        for (std::size_t s = start_slice; s < end_slice; ++s) {
+            std::vector<float>& slice = slices_[s];
+            std::fill(slice.begin(), slice.end(), 0.0f);
+
+            const std::size_t begin = s * n / num_slices_;
+            const std::size_t end = (s + 1) * n / num_slices_;
+
+            for (std::size_t p = begin; p < end; ++p) {
+                const Particle& particle = particles[p];
+
+                int ix, iy;
+                float fx, fy;
+                cellWeights(particle.position.x - origin_.x, inv_cell_size, nx_, ix, fx);
+                cellWeights(particle.position.y - origin_.y, inv_cell_size, ny_, iy, fy);
+
+                float* cell = &slice[static_cast<std::size_t>(iy) * nx_ + ix];
+                const float m = particle.mass;
+
+                cell[0] += m * (1.0f - fx) * (1.0f - fy);
+                cell[1] += m * fx * (1.0f - fy);
+                cell[nx_] += m * (1.0f - fx) * fy;
+                cell[nx_ + 1] += m * fx * fy;
+            }
+        }
+    });
+
+    // Sum the slices into the padded grid, clearing the padding as we go
+    run(padded_ny_, [this](std::size_t start_row, std::size_t end_row) {
+        for (std::size_t row = start_row; row < end_row; ++row) {
+            Complex* out = &grid_[row * padded_nx_];
+
+            if (static_cast<int>(row) >= ny_) {
+                std::fill(out, out + padded_nx_, Complex());
+                continue;
+            }
+
+            for (int i = 0; i < nx_; ++i) {
+                float mass = 0.0f;
+                for (const std::vector<float>& slice : slices_) mass += slice[row * nx_ + i];
+                out[i] = Complex(mass, 0.0f);
+            }
+
+            std::fill(out + nx_, out + padded_nx_, Complex());
+        }
+    });
+}
+
+// 2D transform as row transforms then column transforms (reversed for the inverse).
+// Only the first rows rows are transformed along x, the others must be zero on the
+// way in (forward) or are not needed on the way out (inverse).
+void ParticleMesh::transform(std::vector<Complex>& data, int rows, bool inverse, const Runner& run) const
+{
+    const std::function<void(std::size_t, std::size_t)> row_pass = [this, &data, inverse](std::size_t start_row,
+                                                                                          std::size_t end_row) {
+        for (std::size_t row = start_row; row < end_row; ++row) {
+            fft(&data[row * padded_nx_], padded_nx_, twiddles_x_, inverse);
+        }
+    };
+
+    // Columns are gathered a cache line's worth at a time, one strided column per
+    // transform would miss on every element
+    const std::function<void(std::size_t, std::size_t)> column_pass = [this, &data, inverse](std::size_t start_block,
+                                                                                             std::size_t end_block) {
+        std::vector<Complex> columns(static_cast<std::size_t>(COLUMN_BLOCK) * padded_ny_);
+
+        for (std::size_t block = start_block; block < end_block; ++block) {
+            const std::size_t first_column = block * COLUMN_BLOCK;
+
+            for (int row = 0; row < padded_ny_; ++row) {
+                const Complex* in = &data[row * padded_nx_ + first_column];
+                for (int c = 0; c < COLUMN_BLOCK; ++c) columns[c * padded_ny_ + row] = in[c];
+            }
+
+            for (int c = 0; c < COLUMN_BLOCK; ++c) fft(&columns[c * padded_ny_], padded_ny_, twiddles_y_, inverse);
+
+            for (int row = 0; row < padded_ny_; ++row) {
+                Complex* out = &data[row * padded_nx_ + first_column];
+                for (int c = 0; c < COLUMN_BLOCK; ++c) out[c] = columns[c * padded_ny_ + row];
+            }
+        }
+    };
+
+    const std::size_t column_blocks = padded_nx_ / COLUMN_BLOCK;
+
+    if (!inverse) {
+        run(rows, row_pass);
+        run(column_blocks, column_pass);
+    } else {
+        run(column_blocks, column_pass);
+        run(rows, row_pass);
+    }
+}
+
+void ParticleMesh::interpolate(std::vector<Particle>& particles, const Runner& run) const
+{
+    const float inv_cell_size = 1.0f / cell_size_;
+
+    run(particles.size(), [this, &particles, inv_cell_size](std::size_t start_index, std::size_t end_index) {
+        for (std::size_t p = start_index; p < end_index; ++p) {
+            Particle& particle = particles[p];
+
+            int ix, iy;
+            float fx, fy;
+            cellWeights(particle.position.x - origin_.x, inv_cell_size, nx_, ix, fx);
+            cellWeights(particle.position.y - origin_.y, inv_cell_size, ny_, iy, fy);
+
+            const Complex* cell = &grid_[static_cast<std::size_t>(iy) * padded_nx_ + ix];
+
+            const Complex field = cell[0] * ((1.0f - fx) * (1.0f - fy)) +
+                                  cell[1] * (fx * (1.0f - fy)) +
+                                  cell[padded_nx_] * ((1.0f - fx) * fy) +
+                                  cell[padded_nx_ + 1] * (fx * fy);
+
+            particle.acceleration.x += field.real();
+            particle.acceleration.y += field.imag();
+        }
+    });
+}
@@ -1,43 +1,32 @@
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 #include "ParticleSimulation.hpp"
-
-static const float BIG_G = 35.00f;
+#include "Parallel.hpp"
 
 static inline sf::Vector2f getMousePosition(const sf::RenderWindow &window)
 {
     return window.mapPixelToCoords(sf::Mouse::getPosition(window));
 }
 
-template <typename T>
-static inline float dot(const sf::Vector2<T>& vec1, const sf::Vector2<T>& vec2)
-{
-    return (vec1.x * vec2.x) + (vec1.y * vec2.y);
-}
-
-static inline float inv_Sqrt(float number)
-{
-    float squareRoot = sqrt(number);
-    return 1.0f / squareRoot;
-}
-
 ParticleSimulation::ParticleSimulation(int simulation_width,
                                        int simulation_height,
-                                       sf::RenderWindow &window,
                                        int num_threads,
                                        float dt,
                                        int tree_depth,
                                        int node_cap)
-  : num_threads_(num_threads),
+  : game_window_(nullptr),
+    num_threads_(num_threads),
     tree_max_depth_(tree_depth),
     simulation_width_(simulation_width),
     simulation_height_(simulation_height),
-    game_view_(sf::Vector2f(window.getSize().x/2, window.getSize().y/2), sf::Vector2f(window.getSize())),
+    game_view_(),
     gen_(std::mt19937(rd_())),
     dis_(std::uniform_int_distribution<>(0, 255)),
     time_step_(dt),
     particle_mass_(1.03f),
-    global_com_(sf::Vector2f(0.0f, 0.0f)),
+    global_com_(0, 0),
     current_mouse_pos_f_(sf::Vector2f(0.0f, 0.0f)),
     initial_mouse_pos_f_(sf::Vector2f(0.0f, 0.0f)),
     final_mouse_Pos_f(sf::Vector2f(0.0f, 0.0f)),
@@ -45,21 +34,75 @@ ParticleSimulation::ParticleSimulation(int simulation_width,
     is_middle_button_pressed_(false),
     is_aiming_(false),
     show_velocity_(false),
-    show_quad_tree_(true),
-    show_particles_(true),
-    is_paused_(true),
+    show_quad_tree_(false),
+    show_particles_(false),
+    is_paused_(false),
     font_(),
     threads_(),
     quad_tree_leaf_nodes_(),
     particles_(),
-    quad_tree_(QuadTree(simulation_width, simulation_height, tree_depth, node_cap))
+    quad_tree_(sf::FloatRect(0.0f, 0.0f, simulation_width, simulation_height), tree_depth, node_cap),
+    total_leaf_nodes_(0),
+    phase_timings_(),
+    solver_policy_(),
+    particle_soa_(),
+    merge_pairs_(),
+    merge_mutex_(),
+    frame_governor_(),
+    substeps_(1),
+    draw_stride_(1),
+    far_field_model_(ForceKernels::GLOBAL_COM),
+    theta_(0.5f),
+    quantized_neighbours_(false),
+    particle_mesh_(),
+    mesh_cells_(ParticleMesh::DEFAULT_CELLS),
+    mesh_short_range_(true),
+    boundary_(ForceKernels::REMOVE),
+    ewald_table_(),
+    collisions_(true),
+    accretion_(false),
+    accretion_speed_(0.0f),
+    dynamic_bounds_(false),
+    root_bounds_(0.0f, 0.0f, simulation_width, simulation_height),
+    integrator_(EULER),
+    max_rung_(3),
+    substep_(0),
+    active_(),
+    velocities_before_(),
+    compacted_particles_(),
+    numa_topology_(),
+    numa_aware_(false),
+    placed_tree_storage_(),
+    advised_particle_storage_(),
+    frame_arena_(),
+    worker_arenas_(),
+    sampling_profiler_(),
+    sample_delay_frames_(0),
+    sample_num_frames_(0),
+    sample_frequency_hz_(0),
+    sample_output_path_()
 {
-    game_window_ = &window;
-
-    font_.loadFromFile("fonts/corbel.TTF");
     threads_.reserve(num_threads);
     quad_tree_leaf_nodes_.reserve(pow(4,tree_depth));
     particles_.reserve(200000);
+}
+
+ParticleSimulation::ParticleSimulation(int simulation_width,
+                                       int simulation_height,
+                                       sf::RenderWindow &window,
+                                       int num_threads,
+                                       float dt,
+                                       int tree_depth,
+                                       int node_cap)
+  : ParticleSimulation(simulation_width, simulation_height, num_threads, dt, tree_depth, node_cap)
+{
+    game_window_ = &window;
+    game_view_ = sf::View(sf::Vector2f(window.getSize().x/2, window.getSize().y/2), sf::Vector2f(window.getSize()));
+    show_quad_tree_ = true;
+    show_particles_ = true;
+    is_paused_ = true;
+
+    font_.loadFromFile("fonts/corbel.TTF");
 
     particle_count_text_.setFont(font_);
     particle_count_text_.setCharacterSize(24);
@@ -99,17 +142,141 @@ ParticleSimulation::~ParticleSimulation()
         threads_.clear();
 }
 
+void ParticleSimulation::addParticles(const std::vector<Particle>& particles)
+{
+    particles_.insert(particles_.end(), particles.begin(), particles.end());
+}
+
+std::size_t ParticleSimulation::getParticleCount() const
+{
+    return particles_.size();
+}
+
+const std::vector<Particle>& ParticleSimulation::getParticles() const
+{
+    return particles_;
+}
+
+const ParticleSimulation::PhaseTimings& ParticleSimulation::getPhaseTimings() const
+{
+    return phase_timings_;
+}
+
+void ParticleSimulation::setPaused(bool paused)
+{
+    is_paused_ = paused;
+}
+
+void ParticleSimulation::setNumThreads(int num_threads)
+{
+    if (num_threads < 1) num_threads = 1;
+    num_threads_ = num_threads;
+    threads_.reserve(num_threads);
+}
+
+void ParticleSimulation::setNumaAware(bool enabled)
+{
+    numa_aware_ = enabled;
+    placed_tree_storage_.clear();
+}
+
+bool ParticleSimulation::isNumaAware() const
+{
+    return numa_aware_;
+}
+
+const NumaTopology& ParticleSimulation::getNumaTopology() const
+{
+    return numa_topology_;
+}
+
+void ParticleSimulation::setSolverMode(SolverPolicy::Mode mode)
+{
+    solver_policy_.setMode(mode);
+}
+
+const SolverPolicy& ParticleSimulation::getSolverPolicy() const
+{
+    return solver_policy_;
+}
+
+FrameGovernor::Knobs ParticleSimulation::getGovernorKnobs()
+{
+    FrameGovernor::Knobs knobs;
+    knobs.tree_depth = quad_tree_.getMaxDepth();
+    knobs.node_capacity = quad_tree_.getNodeCapacity();
+    knobs.substeps = substeps_;
+    knobs.draw_stride = draw_stride_;
+    return knobs;
+}
+
+void ParticleSimulation::setGovernorKnobs(const FrameGovernor::Knobs& knobs)
+{
+    quad_tree_.setMaxDepth(knobs.tree_depth);
+    quad_tree_.setNodeCapacity(knobs.node_capacity);
+    substeps_ = knobs.substeps;
+    draw_stride_ = knobs.draw_stride;
+}
+
+void ParticleSimulation::enableFrameGovernor(double target_ms)
+{
+    // QuadTree nodes are allocated for the constructor's depth, the governor cannot go deeper
+    frame_governor_.enable(target_ms, getGovernorKnobs(), tree_max_depth_);
+}
+
+void ParticleSimulation::enableSamplingProfiler(int delay_frames,
+                                                int num_frames,
+                                                int frequency_hz,
+                                                const std::string& output_path)
+{
+    sample_delay_frames_ = delay_frames;
+    sample_num_frames_ = num_frames;
+    sample_frequency_hz_ = frequency_hz;
+    sample_output_path_ = output_path;
+}
+
+void ParticleSimulation::updateSamplingProfiler(int frame)
+{
+    if (sample_num_frames_ <= 0) return;
+
+    if (frame == sample_delay_frames_) {
+        if (sampling_profiler_.start(sample_frequency_hz_)) {
+            std::cout << "Sampling profiler started for " << sample_num_frames_ << " frames at "
+                      << sample_frequency_hz_ << " Hz.\n";
+        } else {
+            sample_num_frames_ = 0;
+        }
+    } else if (frame == sample_delay_frames_ + sample_num_frames_ && sampling_profiler_.isRunning()) {
+        sampling_profiler_.stop();
+        sample_num_frames_ = 0;
+
+        if (sampling_profiler_.writeFoldedStacks(sample_output_path_)) {
+            std::cout << "Wrote " << sampling_profiler_.getSampleCount() << " samples ("
+                      << sampling_profiler_.getDroppedSampleCount() << " dropped) to "
+                      << sample_output_path_ << "\n";
+        } else {
+            std::cout << "Failed to write folded stacks to " << sample_output_path_ << "\n";
+        }
+    }
+}
+
 void ParticleSimulation::run()
 {
     //addCheckeredParticleChunk();
 
     addSierpinskiTriangleParticleChunk((simulation_width_-simulation_height_)/2, 0, simulation_height_, 11);
     
+    int frame = 0;
+
     while (game_window_->isOpen())
     {
+        updateSamplingProfiler(frame++);
         pollUserEvent();
         updateAndDraw();
     }
+
+    // Window closed before the sampling window ended, keep what we have
+    if (sampling_profiler_.isRunning()) updateSamplingProfiler(sample_delay_frames_ + sample_num_frames_);
 }
 
 void ParticleSimulation::pollUserEvent()
@@ -140,11 +307,13 @@ void ParticleSimulation::pollUserEvent()
                 if (sf::Keyboard::isKeyPressed(sf::Keyboard::Z))
                 {
                     if (quad_tree_.getMaxDepth() > 0) quad_tree_.setMaxDepth(quad_tree_.getMaxDepth()-1);
+                    frame_governor_.setBaseline(getGovernorKnobs());
                 }
 
                 if (sf::Keyboard::isKeyPressed(sf::Keyboard::X))
                 {
                     if (quad_tree_.getMaxDepth() < tree_max_depth_) quad_tree_.setMaxDepth(quad_tree_.getMaxDepth()+1);
+                    frame_governor_.setBaseline(getGovernorKnobs());
                 }
 
                 if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num1))
@@ -185,7 +354,8 @@ void ParticleSimulation::pollUserEvent()
                 {
                     is_aiming_ = false;
                     final_mouse_Pos_f = getMousePosition(*game_window_);
-                    particles_.emplace_back(Particle(initial_mouse_pos_f_, (initial_mouse_pos_f_-final_mouse_Pos_f), particle_mass_));
+                    particles_.emplace_back(Particle(vectorCast<Real>(initial_mouse_pos_f_),
+                                                    vectorCast<Real>(initial_mouse_pos_f_ - final_mouse_Pos_f), particle_mass_));
                 }
 
                 if (is_middle_button_pressed_ && !sf::Mouse::isButtonPressed(sf::Mouse::Middle))
@@ -238,7 +408,7 @@ void ParticleSimulation::pollUserEvent()
 #define P_RADIUS_DIV_2 (0.5f / 2.0f)
 #define TRI_X_OFFSET ((0.5f * std::sqrt(3.0f) / 2.0f)) 
 
-DEFINE_API_PROFILER(PopAndSwap);
+DEFINE_API_PROFILER(Compaction);
 DEFINE_API_PROFILER(InsertIntoQuadTree);
 DEFINE_API_PROFILER(UpdateForces);
 DEFINE_API_PROFILER(DrawParticles);
@@ -250,13 +420,6 @@ void ParticleSimulation::updateAndDraw()
 {
     game_window_->clear();
 
-    {
-        API_PROFILER(DeleteQuadTree);
-        quad_tree_.deleteTree();
-    }
-
-    quad_tree_leaf_nodes_.clear();
-
     if (is_right_button_pressed_ || is_aiming_) {
         current_mouse_pos_f_ = getMousePosition(*game_window_);
     }
@@ -266,77 +429,29 @@ void ParticleSimulation::updateAndDraw()
         game_window_->setView(game_view_);
     }
 
-    {
-        API_PROFILER(PopAndSwap);
-        for (std::size_t i = 0; i < particles_.size(); ++i) {
+    FrameGovernor::FrameCost cost = {};
 
-            if (particles_[i].position.x < 0 || particles_[i].position.x > simulation_width_ ||
-                particles_[i].position.y > simulation_height_ || particles_[i].position.y < 0) {
+    // Paused frames only rebuild the tree, one is enough
+    const int substeps = is_paused_ ? 1 : substeps_;
 
-                std::swap(particles_[i], particles_.back());
-                particles_.pop_back();
-                --i;
-            }
-        }
-    }
+    for (int substep = 0; substep < substeps; ++substep) {
+        step();
 
-    global_com_.x = 0;
-    global_com_.y = 0;
-
-    {
-        API_PROFILER(InsertIntoQuadTree);
-        quad_tree_.insert(particles_);
+        cost.tree_ms += phase_timings_.delete_tree_ms + phase_timings_.insert_ms + phase_timings_.leaf_gather_ms;
+        cost.near_field_ms += phase_timings_.near_field_ms;
+        cost.far_field_ms += phase_timings_.far_field_ms;
+        cost.other_ms += phase_timings_.compaction_ms;
     }
-    
-    int total_leaf_nodes = 0;
-    float global_mass = 0.0f;
-
-    global_com_ = quad_tree_.getLeafNodes(quad_tree_leaf_nodes_, total_leaf_nodes, global_mass);
 
-    if (!is_paused_) {
-
-        if (!particles_.empty()) {
-            API_PROFILER(UpdateForces);
-            updateForces(global_mass);
-        }
-
-    }
+    const auto draw_start = std::chrono::steady_clock::now();
 
     if (!particles_.empty() && show_particles_) {
 
         {
             API_PROFILER(DrawParticles);
             
-            sf::VertexArray particles_vertices(sf::Triangles, particles_.size() * 3);
-            int vi = 0;
-
-            for (std::size_t i = 0; i < particles_.size(); ++i) {
-                const float center_x = particles_[i].position.x;
-                const float center_y = particles_[i].position.y;
-                const float y_pos = center_y - P_RADIUS_DIV_2;
-
-                // Right now to lower time for drawing function we are only drawing a triangle
-                // where the particle circle would be inscribed within the triangle. This will lead total
-                // some visual overlap close to the triangle vertices when particles_ are not actually overlapping,
-                // but allows us to use a vertex array of triangles with only 3 vertices per particle for a batch render
-                
-                // Top vertex
-                particles_vertices[vi].position.x = center_x;
-                particles_vertices[vi].position.y = center_y + 0.5f;
-                particles_vertices[vi++].color = particles_[i].color;
-
-                // Left vertex
-                particles_vertices[vi].position.x = center_x - TRI_X_OFFSET;
-                particles_vertices[vi].position.y = y_pos;
-                particles_vertices[vi++].color = particles_[i].color;
-
-                // Right vertex
-                particles_vertices[vi].position.x = center_x + TRI_X_OFFSET;
-                particles_vertices[vi].position.y = y_pos;
-                particles_vertices[vi++].color = particles_[i].color;
-               
-            }
-
+            sf::VertexArray particles_vertices;
+            buildParticleVertices(particles_vertices);
             game_window_->draw(particles_vertices);
         }
 
@@ -353,18 +468,19 @@ void ParticleSimulation::updateAndDraw()
 
     if (show_quad_tree_) {
         API_PROFILER(DrawQuadTree);
-        quad_tree_.display(game_window_, total_leaf_nodes);
+        quad_tree_.display(game_window_, total_leaf_nodes_);
 
         if (quad_tree_leaf_nodes_.size() != 0) {
             sf::CircleShape circle(20.0f);
             circle.setOrigin(circle.getRadius(), circle.getRadius());
-            circle.setPosition(global_com_);
+            circle.setPosition(toVector2f(global_com_));
             circle.setFillColor(sf::Color(255,0,0,20));
             game_window_->draw(circle);
         }
     }
 
-    particle_count_text_.setString("Particle count: " + std::to_string(particles_.size()));
+    particle_count_text_.setString("Particle count: " + std::to_string(particles_.size()) +
+                                   " (" + SolverPolicy::name(phase_timings_.solver) + ")");
     particle_mass_text_.setString("Particle mass: " + std::to_string(particle_mass_));
 
     game_window_->draw(particle_count_text_);
@@ -373,9 +489,170 @@ void ParticleSimulation::updateAndDraw()
     if (is_paused_) {
         game_window_->draw(is_paused_text_);
     }
+
+    phase_timings_.draw_ms = millisecondsSince(draw_start);
+    cost.draw_ms = phase_timings_.draw_ms;
+
+    if (!is_paused_) {
+        FrameGovernor::Knobs knobs = getGovernorKnobs();
+        if (frame_governor_.update(cost, knobs)) setGovernorKnobs(knobs);
+    }
+
     game_window_->display();
 }
 
+void ParticleSimulation::step()
+{
+    auto phase_start = std::chrono::steady_clock::now();
+
+    resetFrameArenas();
+
+    {
+        API_PROFILER(DeleteQuadTree);
+        quad_tree_.deleteTree();
+    }
+
+    quad_tree_leaf_nodes_.clear();
+
+    phase_timings_.delete_tree_ms = millisecondsSince(phase_start);
+    phase_start = std::chrono::steady_clock::now();
+
+    {
+        API_PROFILER(Compaction);
+        compactParticles();
+        adviseParticleStorage();
+    }
+
+    phase_timings_.compaction_ms = millisecondsSince(phase_start);
+    phase_start = std::chrono::steady_clock::now();
+
+    // Only the tree solvers are periodic, the policy must not switch gravity to isolated
+    // for a frame, or probe the direct sum, while the boundary wraps it
+    const bool run_forces = !is_paused_ && !particles_.empty();
+    const SolverPolicy::Solver solver = periodicGravity() ? SolverPolicy::TREE
+                                      : run_forces ? solver_policy_.choose(particles_.size())
+                                                   : solver_policy_.getCurrent();
+    phase_timings_.solver = solver;
+    phase_timings_.drift_ms = 0.0;
+
+    // The leapfrog drifts every particle before the tree is built on the new positions
+    if (run_forces && integrator_ == LEAPFROG) {
+        const ForceKernels::IntegrationParams params = integrationParams();
+
+        runOnParticleTiles([this, &params](std::size_t start_index, std::size_t end_index) {
+            ForceKernels::drift(particles_, start_index, end_index, params);
+        });
+
+        ++substep_;
+
+        phase_timings_.drift_ms = millisecondsSince(phase_start);
+        phase_start = std::chrono::steady_clock::now();
+    }
+
+    global_com_.x = 0;
+    global_com_.y = 0;
+
+    Accum global_mass = 0.0f;
+
+    // The direct sum does not need the tree, the mesh only for its short range pass.
+    // Otherwise it is only built to be displayed.
+    phase_timings_.insert_ms = 0.0;
+    phase_timings_.leaf_gather_ms = 0.0;
+    phase_timings_.lists_rebuilt = false;
+
+    const bool needs_tree = (solver == SolverPolicy::TREE) ||
+                            (solver == SolverPolicy::MESH && mesh_short_range_) ||
+                            show_quad_tree_;
+
+    if (dynamic_bounds_ && (needs_tree || solver == SolverPolicy::MESH)) {
+        updateRootBounds();
+        quad_tree_.setBounds(root_bounds_);
+    }
+
+    if (needs_tree) {
+        {
+            API_PROFILER(InsertIntoQuadTree);
+            quad_tree_.insert(particles_);
+        }
+
+        phase_timings_.insert_ms = millisecondsSince(phase_start);
+        phase_start = std::chrono::steady_clock::now();
+
+        global_com_ = quad_tree_.getLeafNodes(quad_tree_leaf_nodes_, total_leaf_nodes_, global_mass);
+        if (numa_aware_) placeTreeStorage();
+        if (solver == SolverPolicy::TREE && far_field_model_ != ForceKernels::GLOBAL_COM) {
+            updateInteractionLists();
+        }
+
+        phase_timings_.leaf_gather_ms = millisecondsSince(phase_start);
+    }
+
+    phase_timings_.near_field_ms = 0.0;
+    phase_timings_.far_field_ms = 0.0;
+    phase_timings_.active_particles = 0;
+
+    if (run_forces) {
+        API_PROFILER(UpdateForces);
+
+        if (integrator_ == LEAPFROG) {
+            updateForcesLeapfrog(global_mass, solver);
+        } else if (solver == SolverPolicy::TREE) {
+            updateForces(global_mass);
+        } else if (solver == SolverPolicy::MESH) {
+            updateForcesMesh();
+        } else {
+            updateForcesDirect();
+        }
+
+        const double tree_ms = phase_timings_.delete_tree_ms + phase_timings_.insert_ms + phase_timings_.leaf_gather_ms;
+        solver_policy_.record(solver, particles_.size(),
+                              (solver == SolverPolicy::TREE ? tree_ms : 0.0) + phase_timings_.drift_ms +
+                              phase_timings_.near_field_ms + phase_timings_.far_field_ms);
+    }
+
+    if (numa_aware_ && run_forces && needs_tree) {
+        phase_start = std::chrono::steady_clock::now();
+        reorderByLeaves();
+        phase_timings_.compaction_ms += millisecondsSince(phase_start);
+    }
+}
+
+// Right now to lower time for drawing function we are only drawing a triangle
+// where the particle circle would be inscribed within the triangle. This will lead total
+// some visual overlap close to the triangle vertices when particles_ are not actually overlapping,
+// but allows us to use a vertex array of triangles with only 3 vertices per particle for a batch render
+void ParticleSimulation::buildParticleVertices(sf::VertexArray& particles_vertices) const
+{
+    // With a draw stride above one only every n-th particle is drawn
+    const std::size_t num_drawn = (particles_.size() + draw_stride_ - 1) / draw_stride_;
+
+    particles_vertices.setPrimitiveType(sf::Triangles);
+    particles_vertices.resize(num_drawn * 3);
+    int vi = 0;
+
+    for (std::size_t i = 0; i < particles_.size(); i += draw_stride_) {
+        const float center_x = particles_[i].position.x;
+        const float center_y = particles_[i].position.y;
+        const float y_pos = center_y - P_RADIUS_DIV_2;
+        
+        // Top vertex
+        particles_vertices[vi].position.x = center_x;
+        particles_vertices[vi].position.y = center_y + 0.5f;
+        particles_vertices[vi++].color = particles_[i].color;
+
+        // Left vertex
+        particles_vertices[vi].position.x = center_x - TRI_X_OFFSET;
+        particles_vertices[vi].position.y = y_pos;
+        particles_vertices[vi++].color = particles_[i].color;
+
+        // Right vertex
+        particles_vertices[vi].position.x = center_x + TRI_X_OFFSET;
+        particles_vertices[vi].position.y = y_pos;
+        particles_vertices[vi++].color = particles_[i].color;
+       
+    }
+}
+
 inline void ParticleSimulation::drawAimLine() 
 {	
     velocity_text_.setPosition(initial_mouse_pos_f_.x+5.0f, initial_mouse_pos_f_.y);
@@ -401,7 +678,7 @@ inline void ParticleSimulation::drawParticleVelocity()
         
         lines[i+1].position.x = (particles_[pIdx].position.x + particles_[pIdx].velocity.x/450);
         lines[i+1].position.y = (particles_[pIdx].position.y + particles_[pIdx].velocity.y/450);
-        lines[i].position = particles_[pIdx].position;
+        lines[i].position = toVector2f(particles_[pIdx].position);
         lines[i].color  = sf::Color(0,0,255,85);
         lines[i+1].color = sf::Color(255,0,0,0);
 
@@ -412,188 +689,784 @@ inline void ParticleSimulation::drawParticleVelocity()
     game_window_->draw(lines);
 }
 
-static inline void attractParticleToMousePos(Particle& particle, sf::Vector2f& current_mouse_pos_f) 
+// Splits [0, count) into one contiguous chunk per thread, with every chunk
+// boundary a multiple of alignment
+void ParticleSimulation::runOnChunks(std::size_t count,
+                                     std::size_t alignment,
+                                     const std::function<void(std::size_t, std::size_t)>& work)
 {
-    particle.velocity -= sf::Vector2f(0.35f * (particle.position.x - current_mouse_pos_f.x),
-                                0.35f * (particle.position.y - current_mouse_pos_f.y));
+    ::runOnChunks(threads_, num_threads_, count, alignment, numa_aware_ ? &numa_topology_ : nullptr, work);
 }
 
-void ParticleSimulation::updateForces(float global_mass)
+// Rewrites particles_ in leaf order and renumbers the tree to match. Each leaf chunk
+// of runOnLeafChunks() copies its own particles, so in NUMA mode a chunk's particles
+// are moved to and written from the node whose worker reads them in the next step.
+void ParticleSimulation::reorderByLeaves()
 {
-    int n_threads = num_threads_;
-    
-    if  (quad_tree_leaf_nodes_.size() < static_cast<std::size_t>(num_threads_)) {
-        num_threads_ = quad_tree_leaf_nodes_.size();
+    const std::size_t num_leaves = quad_tree_leaf_nodes_.size();
+    if (num_leaves == 0) return;
+
+    ArenaVector<std::size_t> leaf_offsets(num_leaves + 1, 0, ArenaAllocator<std::size_t>(frame_arena_));
+    for (std::size_t j = 0; j < num_leaves; ++j) {
+        leaf_offsets[j + 1] = leaf_offsets[j] + quad_tree_leaf_nodes_[j]->count;
     }
-	
-    // Divide the leaf nodes up evenly among threads
-    // It may be better to load balance based on distribution of particles
-    const std::size_t chunk_size = quad_tree_leaf_nodes_.size() / num_threads_;
-    const std::size_t remainder = quad_tree_leaf_nodes_.size() % num_threads_;
-    
-    for (int i = 0; i < num_threads_; i++) {
-        
-		const std::size_t start_index = i * chunk_size;
-        const std::size_t end_index = (i==num_threads_-1) ? start_index + chunk_size + remainder : start_index + chunk_size;
-        
-        auto thread_function = [this, start_index, end_index]() {
 
-            const std::vector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree_.getParticleElementNodeVec();
+    // Only a permutation when every particle went into the tree
+    if (leaf_offsets[num_leaves] != particles_.size()) return;
 
-            for (std::size_t j = start_index; j < end_index; j++) {
-				
-                QuadTree::TreeNode* curr_tree_node = quad_tree_leaf_nodes_[j];
-                const int first_particle_idx = curr_tree_node->first_particle;
-				
-                // Handle Particle to Particle interactions for each leaf
-                for (int i = first_particle_idx; i != -1; i = particle_element_nodes[i].next_element_index) {
+    compacted_particles_.resize(particles_.size());
+    HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree_.getParticleElementNodeVec();
 
-                    int particle_index = particle_element_nodes[i].particle_index;
-                    Particle& particle = particles_[particle_index];
+    const int n_threads = chunkCount(num_leaves, num_threads_);
 
-                    for (int j = first_particle_idx; j != -1; j = particle_element_nodes[j].next_element_index) {
-						
-                        int other_index = particle_element_nodes[j].particle_index;
-                        Particle& other = particles_[other_index];
+    runOnLeafChunks([&](std::size_t start_index, std::size_t end_index) {
+        const int chunk = chunkOf(start_index, num_leaves, num_threads_);
+        numa_topology_.placeOnNode(compacted_particles_.data() + leaf_offsets[start_index],
+                                   (leaf_offsets[end_index] - leaf_offsets[start_index]) * sizeof(Particle),
+                                   numa_topology_.threadNode(chunk, n_threads));
 
-                        if (&other == &particle) continue;
+        std::size_t out = leaf_offsets[start_index];
+        for (std::size_t j = start_index; j < end_index; ++j) {
+            for (int i = quad_tree_leaf_nodes_[j]->first_particle; i != -1;
+                 i = particle_element_nodes[i].next_element_index) {
+                compacted_particles_[out] = particles_[particle_element_nodes[i].particle_index];
+                particle_element_nodes[i].particle_index = static_cast<int>(out++);
+            }
+        }
+    });
 
-                        const float distance_squared = dot(particle.position - other.position,
-                                                    particle.position - other.position);
+    particles_.swap(compacted_particles_);
+}
 
-                        if (distance_squared < 0.01f) continue;
-                        
-                        const float radius_squared = 1.0f;
+// Every worker reads the tree's buffers, their pages are spread over the nodes
+// whenever the buffers were reallocated
+void ParticleSimulation::placeTreeStorage()
+{
+    if (numa_topology_.getNodeCount() <= 1) return;
 
-                        const bool is_colliding = (distance_squared <= radius_squared);
-                        
-                        if (is_colliding) {
-                            sf::Vector2f r_hat = (other.position - particle.position) * inv_Sqrt(distance_squared);
+    std::vector<QuadTree::StorageRange> ranges;
+    quad_tree_.getStorageRanges(ranges);
 
-                            const float a1 = dot(particle.velocity, r_hat);
-                            const float a2 = dot(other.velocity, r_hat);
+    for (std::size_t k = 0; k < ranges.size(); ++k) {
+        const bool placed = k < placed_tree_storage_.size() && placed_tree_storage_[k].data == ranges[k].data &&
+                            placed_tree_storage_[k].bytes == ranges[k].bytes;
+        if (!placed) numa_topology_.interleave(ranges[k].data, ranges[k].bytes);
+    }
 
-                            const float p = 2.0f * particle.mass * other.mass * (a1-a2) / (particle.mass + other.mass);
+    placed_tree_storage_ = ranges;
+}
 
-                            particle.velocity -= p / particle.mass * r_hat;
-                            other.velocity += p / other.mass * r_hat;
+// std::vector<Particle> is passed around too widely to take the arena's allocator,
+// its buffers get the huge page advice whenever they move instead
+void ParticleSimulation::adviseParticleStorage()
+{
+    const QuadTree::StorageRange ranges[2] = {
+        {particles_.data(), particles_.capacity() * sizeof(Particle)},
+        {compacted_particles_.data(), compacted_particles_.capacity() * sizeof(Particle)}
+    };
 
-                        } else {
+    for (int k = 0; k < 2; ++k) {
+        if (advised_particle_storage_[k].data == ranges[k].data &&
+            advised_particle_storage_[k].bytes == ranges[k].bytes) continue;
 
-                            // Softening factor to prevent infinite forces at very small distances
-                            const float epsilon = 0.01f;
+        HugePageArena::advise(ranges[k].data, ranges[k].bytes);
+        advised_particle_storage_[k] = ranges[k];
+    }
+}
 
-                            // Modified distance calculation to include softening factor
-                            const float softened_distance_squared = distance_squared + epsilon;
+HugePageArena::Stats ParticleSimulation::getHugePageStats() const
+{
+    HugePageArena::Stats stats = HugePageArena::getStats();
 
-                            particle.acceleration += (other.mass / softened_distance_squared) * 
-                                                        BIG_G * (other.position - particle.position);
+    for (const std::vector<Particle>* buffer : { &particles_, &compacted_particles_ }) {
+        std::size_t resident = 0, huge = 0;
+        HugePageArena::measure(buffer->data(), buffer->capacity() * sizeof(Particle), resident, huge);
+        stats.resident_bytes += resident;
+        stats.resident_huge_bytes += huge;
+    }
+    return stats;
+}
 
-                        }
-                    }
-                }
-            }
-        };
+ParticleSimulation::NumaStats ParticleSimulation::measureNumaPlacement() const
+{
+    NumaStats stats;
+    stats.nodes = numa_topology_.getNodeCount();
+    stats.pinned = numa_aware_;
+    stats.pages_per_node.assign(stats.nodes, 0);
+
+    if (particles_.empty()) return stats;
 
-        threads_.emplace_back(thread_function);
+    std::vector<int> page_nodes;
+    numa_topology_.pageNodes(particles_.data(), particles_.size() * sizeof(Particle), page_nodes);
+
+    for (int node : page_nodes) {
+        if (node >= 0) stats.pages_per_node[node]++;
     }
 
-    for (auto& thread : threads_)
-    {
-        thread.join();
+    const std::size_t num_leaves = quad_tree_leaf_nodes_.size();
+    if (num_leaves == 0) return stats;
+
+    const std::size_t page = NumaTopology::pageSize();
+    const std::size_t base = reinterpret_cast<std::size_t>(particles_.data());
+    const std::size_t first_page = base / page * page;
+    const HugePageVector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree_.getParticleElementNodeVec();
+
+    // Same chunks as runOnLeafChunks()
+    const int n_threads = chunkCount(num_leaves, num_threads_);
+
+    for (std::size_t j = 0; j < num_leaves; ++j) {
+        const int node = numa_topology_.threadNode(chunkOf(j, num_leaves, num_threads_), n_threads);
+
+        for (int i = quad_tree_leaf_nodes_[j]->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+            const std::size_t address = base + particle_element_nodes[i].particle_index * sizeof(Particle);
+            if (page_nodes[(address - first_page) / page] == node) {
+                stats.local_reads++;
+            } else {
+                stats.remote_reads++;
+            }
+        }
+    }
+
+    return stats;
+}
+
+void ParticleSimulation::runOnLeafChunks(const std::function<void(std::size_t, std::size_t)>& work)
+{
+    runOnChunks(quad_tree_leaf_nodes_.size(), 1, work);
+}
+
+void ParticleSimulation::resetFrameArenas()
+{
+    frame_arena_.reset();
+
+    while (worker_arenas_.size() < static_cast<std::size_t>(num_threads_)) {
+        worker_arenas_.emplace_back(new MonotonicArena());
     }
+    for (const std::unique_ptr<MonotonicArena>& arena : worker_arenas_) arena->reset();
+}
 
-    threads_.clear();
+// Every chunk of runOnLeafChunks() runs on its own thread and has an arena of its own
+MonotonicArena* ParticleSimulation::leafChunkArena(std::size_t start_index)
+{
+    return worker_arenas_[chunkOf(start_index, quad_tree_leaf_nodes_.size(), num_threads_)].get();
+}
+
+void ParticleSimulation::runOnParticleTiles(const std::function<void(std::size_t, std::size_t)>& work)
+{
+    runOnChunks(particles_.size(), ForceKernels::DIRECT_I_TILE, work);
+}
+
+void ParticleSimulation::updateForces(Accum global_mass)
+{
+    auto phase_start = std::chrono::steady_clock::now();
+
+    const float merge_speed = mergeSpeed();
+
+    runOnLeafChunks([this, merge_speed](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::nearField(particles_,
+                                quad_tree_.getParticleElementNodeVec(),
+                                quad_tree_leaf_nodes_,
+                                start_index,
+                                end_index,
+                                nullptr,
+                                0.0f,
+                                merge_speed,
+                                collisions_);
+    });
+
+    if (far_field_model_ != ForceKernels::GLOBAL_COM) runNeighbourField(nullptr);
+
+    phase_timings_.near_field_ms = millisecondsSince(phase_start);
+    phase_timings_.active_particles = particles_.size();
+    phase_start = std::chrono::steady_clock::now();
+
+    const ForceKernels::IntegrationParams params = integrationParams();
+
+    if (far_field_model_ != ForceKernels::GLOBAL_COM) {
+        const ForceKernels::MultipoleParams multipole = multipoleParams();
+
+        runOnLeafChunks([this, &multipole, &params](std::size_t start_index, std::size_t end_index) {
+            ForceKernels::farFieldMultipoleAndIntegrate(particles_, quad_tree_, quad_tree_leaf_nodes_, interaction_lists_,
+                                                        start_index, end_index, multipole, params,
+                                                        leafChunkArena(start_index));
+        });
+
+        phase_timings_.far_field_ms = millisecondsSince(phase_start);
+        return;
+    }
 	
     // Use global COM calculate the gravitational force for all leaf nodes besides the current leaf, and apply
     // this force to the particles. We also change the particle color based on its velocity.
-    for (int i = 0; i < num_threads_; i++) {
-        const std::size_t start_index = i * chunk_size;
-        const std::size_t end_index = (i==num_threads_-1) ? start_index + chunk_size + remainder : start_index + chunk_size;
-        
-        auto thread_function = [this, start_index, end_index, global_mass]() {
+    runOnLeafChunks([this, global_mass, &params](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::farFieldAndIntegrate(particles_,
+                                           quad_tree_,
+                                           quad_tree_leaf_nodes_,
+                                           start_index,
+                                           end_index,
+                                           global_mass,
+                                           global_com_,
+                                           params);
+    });
+
+    phase_timings_.far_field_ms = millisecondsSince(phase_start);
+}
 
-            sf::Color c;
-            const std::vector<QuadTree::ParticleElementNode>& particle_element_nodes = quad_tree_.getParticleElementNodeVec();
+// Far field without integration, accumulated into the accelerations of the active particles
+void ParticleSimulation::runFarField(Accum global_mass, const std::vector<unsigned char>* active)
+{
+    if (far_field_model_ == ForceKernels::GLOBAL_COM) {
+        runOnLeafChunks([this, global_mass, active](std::size_t start_index, std::size_t end_index) {
+            ForceKernels::farField(particles_, quad_tree_, quad_tree_leaf_nodes_, start_index, end_index,
+                                   global_mass, global_com_, active);
+        });
+    } else {
+        const ForceKernels::MultipoleParams multipole = multipoleParams();
 
-            for (std::size_t j = start_index; j < end_index; j++) {
-				
-                QuadTree::TreeNode* curr_tree_node = quad_tree_leaf_nodes_[j];
+        runOnLeafChunks([this, &multipole, active](std::size_t start_index, std::size_t end_index) {
+            ForceKernels::farFieldMultipole(particles_, quad_tree_, quad_tree_leaf_nodes_, interaction_lists_,
+                                            start_index, end_index, multipole, active, leafChunkArena(start_index));
+        });
+    }
+}
 
-                sf::Vector2f new_com(0,0);
+ForceKernels::IntegrationParams ParticleSimulation::integrationParams() const
+{
+    const sf::FloatRect area(0.0f, 0.0f, simulation_width_, simulation_height_);
+    return { time_step_, is_right_button_pressed_, current_mouse_pos_f_, boundary_, area, show_particles_ };
+}
 
-                int non_local_particle_count = (particles_.size() - curr_tree_node->count);
-                float non_local_mass = global_mass - quad_tree_.getNodeTotalMass(curr_tree_node);
+ForceKernels::MultipoleParams ParticleSimulation::multipoleParams() const
+{
+    return { theta_, far_field_model_ == ForceKernels::QUADRUPOLE, periodicGravity() ? &ewald_table_ : nullptr };
+}
 
-                if (non_local_particle_count != 0) {
-                    const sf::Vector2f curr_node_com = quad_tree_.getNodeCOM(curr_tree_node);
+bool ParticleSimulation::periodicGravity() const
+{
+    return boundary_ == ForceKernels::PERIODIC && far_field_model_ != ForceKernels::GLOBAL_COM && ewald_table_.isReady();
+}
+
+// Particles the boundary policy gives up on, and those absorbed by accretion. Nothing
+// can hold a non-finite position.
+static inline bool isRemoved(const Particle& particle, bool remove_outside, bool remove_massless,
+                             float width, float height)
+{
+    const Vector2r& position = particle.position;
+
+    if (!std::isfinite(position.x) || !std::isfinite(position.y)) return true;
+    if (remove_massless && particle.mass <= 0.0f) return true;
+
+    return remove_outside && (position.x < 0 || position.x > width || position.y > height || position.y < 0);
+}
+
+// Order preserving compaction: every slice counts its survivors, a prefix sum over the
+// counts gives each slice its output offset and the slices scatter in parallel.
+// Nothing is moved when every particle survives.
+void ParticleSimulation::compactParticles()
+{
+    const std::size_t n = particles_.size();
+    if (n == 0) return;
+
+    const std::size_t num_slices = std::max(1, num_threads_);
+    const bool remove_outside = (boundary_ == ForceKernels::REMOVE) && !dynamic_bounds_;
+    const bool remove_massless = accretion_;
+    const float width = simulation_width_;
+    const float height = simulation_height_;
+    ArenaVector<std::size_t> offsets(num_slices + 1, 0, ArenaAllocator<std::size_t>(frame_arena_));
+
+    runOnChunks(num_slices, 1, [&](std::size_t start_slice, std::size_t end_slice) {
+        for (std::size_t s = start_slice; s < end_slice; ++s) {
+            std::size_t kept = 0;
+            for (std::size_t i = s * n / num_slices; i < (s + 1) * n / num_slices; ++i) {
+                kept += !isRemoved(particles_[i], remove_outside, remove_massless, width, height);
+            }
+            offsets[s + 1] = kept;
+        }
+    });
+
+    for (std::size_t s = 0; s < num_slices; ++s) offsets[s + 1] += offsets[s];
+
+    if (offsets[num_slices] == n) return;
 
-                    new_com.x = static_cast<float>(global_mass * global_com_.x - curr_node_com.x) /
-                                    static_cast<float>(non_local_mass);
-                    new_com.y = static_cast<float>(global_mass * global_com_.y - curr_node_com.y) /
-                                    static_cast<float>(non_local_mass);
+    compacted_particles_.resize(offsets[num_slices]);
+
+    runOnChunks(num_slices, 1, [&](std::size_t start_slice, std::size_t end_slice) {
+        for (std::size_t s = start_slice; s < end_slice; ++s) {
+            std::size_t out = offsets[s];
+            for (std::size_t i = s * n / num_slices; i < (s + 1) * n / num_slices; ++i) {
+                if (!isRemoved(particles_[i], remove_outside, remove_massless, width, height)) {
+                    compacted_particles_[out++] = particles_[i];
                 }
+            }
+        }
+    });
 
-                for (int i = curr_tree_node->first_particle; i != -1; i = particle_element_nodes[i].next_element_index) {
+    particles_.swap(compacted_particles_);
+}
 
-                    int particle_index = particle_element_nodes[i].particle_index;
-                    Particle& particle = particles_[particle_index];
+// Root cell hysteresis: the root grows as soon as a particle is outside it, with a
+// margin on every side, and only shrinks once the particles span less than
+// ROOT_SHRINK_RATIO of it. The root is square so cells keep their aspect ratio.
+static const float ROOT_MARGIN = 0.125f;
+static const float ROOT_SHRINK_RATIO = 0.5f;
+static const float MIN_ROOT_SIZE = 1.0f;
 
-                    if (non_local_particle_count != 0) {
-                        const float distance_squared = dot(particle.position - new_com,
-                                                      particle.position - new_com);
+void ParticleSimulation::updateRootBounds()
+{
+    if (particles_.empty()) return;
+
+    const std::size_t num_slices = std::max(1, num_threads_);
+    const std::size_t n = particles_.size();
+    const float huge = std::numeric_limits<float>::max();
+    const ArenaAllocator<sf::Vector2f> allocator(frame_arena_);
+    ArenaVector<sf::Vector2f> slice_min(num_slices, sf::Vector2f(huge, huge), allocator);
+    ArenaVector<sf::Vector2f> slice_max(num_slices, sf::Vector2f(-huge, -huge), allocator);
+
+    runOnChunks(num_slices, 1, [this, n, num_slices, &slice_min, &slice_max](std::size_t start_slice,
+                                                                             std::size_t end_slice) {
+        for (std::size_t s = start_slice; s < end_slice; ++s) {
+            sf::Vector2f lo = slice_min[s];
+            sf::Vector2f hi = slice_max[s];
+
+            for (std::size_t i = s * n / num_slices; i < (s + 1) * n / num_slices; ++i) {
+                const sf::Vector2f position = toVector2f(particles_[i].position);
+                lo.x = std::min(lo.x, position.x);
+                lo.y = std::min(lo.y, position.y);
+                hi.x = std::max(hi.x, position.x);
+                hi.y = std::max(hi.y, position.y);
+            }
 
-                        particle.acceleration += (non_local_mass / distance_squared) * BIG_G *
-                                                        (new_com - particle.position);
-                    }
+            slice_min[s] = lo;
+            slice_max[s] = hi;
+        }
+    });
 
-                    if (is_right_button_pressed_)
-                        attractParticleToMousePos(particle, current_mouse_pos_f_);
+    sf::Vector2f lo = slice_min[0];
+    sf::Vector2f hi = slice_max[0];
 
-                    particle.velocity += particle.acceleration * time_step_;
-                    particle.position += particle.velocity * time_step_;
-                    
-                    float vel = std::sqrt(particle.velocity.x * particle.velocity.x +
-                                particle.velocity.y * particle.velocity.y);
+    for (std::size_t s = 1; s < num_slices; ++s) {
+        lo.x = std::min(lo.x, slice_min[s].x);
+        lo.y = std::min(lo.y, slice_min[s].y);
+        hi.x = std::max(hi.x, slice_max[s].x);
+        hi.y = std::max(hi.y, slice_max[s].y);
+    }
 
+    const float extent = std::max(MIN_ROOT_SIZE, std::max(hi.x - lo.x, hi.y - lo.y));
 
-                    float maxVel = 3000.0f;
+    // Cells hold [left, left + width), the upper edge must be strictly inside
+    const bool contained = lo.x >= root_bounds_.left && lo.y >= root_bounds_.top &&
+                           hi.x < root_bounds_.left + root_bounds_.width &&
+                           hi.y < root_bounds_.top + root_bounds_.height;
+    const bool oversized = extent < ROOT_SHRINK_RATIO * std::max(root_bounds_.width, root_bounds_.height);
 
-                    if (vel > maxVel) vel = maxVel;
-                    
-                    float p = vel / maxVel;
+    if (contained && !oversized) return;
 
-                    c.r = static_cast<uint8_t>(15.0f + (240.0f * p));
-                    c.g = 0;
-                    c.b = static_cast<uint8_t>(240.0f * (1.0f-p));
-                    c.a = static_cast<uint8_t>(30.0f + (225.0f * p));
+    const float size = extent * (1.0f + 2.0f * ROOT_MARGIN);
+    const sf::Vector2f center(0.5f * (lo.x + hi.x), 0.5f * (lo.y + hi.y));
+    root_bounds_ = sf::FloatRect(center.x - 0.5f * size, center.y - 0.5f * size, size, size);
+}
 
-                    particle.color = c;
+// Refreshes the moments every step, the lists only when the leaves, theta or the
+// periodicity changed
+void ParticleSimulation::updateInteractionLists()
+{
+    quad_tree_.computeMoments(particles_);
 
-                    particle.acceleration.x = 0.0f;
-                    particle.acceleration.y = 0.0f;
+    const sf::Vector2f period = periodicGravity() ? ewald_table_.getPeriod() : sf::Vector2f(0.0f, 0.0f);
 
-                }
-            }
-        };
+    if (interaction_lists_.matches(quad_tree_, quad_tree_leaf_nodes_, theta_, period)) return;
 
-        threads_.emplace_back(thread_function);
+    interaction_lists_.resize(quad_tree_leaf_nodes_.size());
+    interaction_lists_.leaf_indices.resize(quad_tree_leaf_nodes_.size());
+    interaction_lists_.root_bounds = quad_tree_.getBounds();
+    interaction_lists_.period = period;
+    interaction_lists_.theta = theta_;
+
+    runOnLeafChunks([this](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::buildInteractionLists(quad_tree_, quad_tree_leaf_nodes_, start_index, end_index,
+                                            theta_, interaction_lists_);
+    });
+
+    phase_timings_.lists_rebuilt = true;
+}
+
+// Exact forces from the neighbouring leaves of the interaction lists
+void ParticleSimulation::runNeighbourField(const std::vector<unsigned char>* active)
+{
+    const ForceKernels::QuantizedLeaves* quantized = nullptr;
+
+    // Encoded after the leaf near field, which may have merged particles
+    if (quantized_neighbours_) {
+        quantized_leaves_.layout(quad_tree_, quad_tree_leaf_nodes_);
+
+        runOnLeafChunks([this](std::size_t start_index, std::size_t end_index) {
+            ForceKernels::quantizeLeaves(particles_, quad_tree_, quad_tree_leaf_nodes_, start_index, end_index,
+                                         quantized_leaves_);
+        });
+
+        quantized = &quantized_leaves_;
     }
 
-    for (auto& thread : threads_)
-    {
-        thread.join();
+    runOnLeafChunks([this, active, quantized](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::nearFieldNeighbours(particles_, quad_tree_, quad_tree_leaf_nodes_, interaction_lists_,
+                                          start_index, end_index, active, quantized);
+    });
+}
+
+void ParticleSimulation::updateForcesDirect()
+{
+    auto phase_start = std::chrono::steady_clock::now();
+
+    runDirectSum(nullptr, mergeSpeed());
+
+    phase_timings_.near_field_ms = millisecondsSince(phase_start);
+    phase_timings_.active_particles = particles_.size();
+    phase_start = std::chrono::steady_clock::now();
+
+    const ForceKernels::IntegrationParams params = integrationParams();
+
+    runOnParticleTiles([this, &params](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::integrate(particles_, start_index, end_index, params);
+    });
+
+    phase_timings_.far_field_ms = millisecondsSince(phase_start);
+}
+
+// Slow collisions the ranges find are merged afterwards, in index order so the result
+// does not depend on the thread count
+void ParticleSimulation::runDirectSum(const std::vector<unsigned char>* active, float merge_speed)
+{
+    particle_soa_.load(particles_);
+    merge_pairs_.clear();
+
+    runOnParticleTiles([this, active, merge_speed](std::size_t start_index, std::size_t end_index) {
+        std::vector<ForceKernels::MergePair> merges;
+        ForceKernels::directSumTiled(particles_, particle_soa_, start_index, end_index, active, merge_speed,
+                                     collisions_, &merges);
+
+        if (merges.empty()) return;
+
+        std::lock_guard<std::mutex> lock(merge_mutex_);
+        merge_pairs_.insert(merge_pairs_.end(), merges.begin(), merges.end());
+    });
+
+    if (merge_pairs_.empty()) return;
+
+    std::sort(merge_pairs_.begin(), merge_pairs_.end(),
+              [](const ForceKernels::MergePair& a, const ForceKernels::MergePair& b) {
+                  return (a.absorber != b.absorber) ? a.absorber < b.absorber : a.absorbed < b.absorbed;
+              });
+
+    ForceKernels::mergePairs(particles_, merge_pairs_);
+}
+
+// P3M short range remainder from the leaf near field, the tree must be built
+void ParticleSimulation::runMeshShortRange(const std::vector<unsigned char>* active, float merge_speed)
+{
+    particle_mesh_.configure(root_bounds_, mesh_cells_, num_threads_);
+
+    if (!mesh_short_range_) return;
+
+    const float split_radius = particle_mesh_.getSplitRadius();
+
+    runOnLeafChunks([this, active, split_radius, merge_speed](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::nearField(particles_, quad_tree_.getParticleElementNodeVec(), quad_tree_leaf_nodes_,
+                                start_index, end_index, active, split_radius, merge_speed, collisions_);
+    });
+}
+
+void ParticleSimulation::runMeshLongRange()
+{
+    particle_mesh_.configure(root_bounds_, mesh_cells_, num_threads_);
+
+    particle_mesh_.computeAccelerations(particles_, [this](std::size_t count,
+                                                           const std::function<void(std::size_t, std::size_t)>& work) {
+        runOnChunks(count, 1, work);
+    });
+}
+
+void ParticleSimulation::updateForcesMesh()
+{
+    auto phase_start = std::chrono::steady_clock::now();
+
+    runMeshShortRange(nullptr, mergeSpeed());
+
+    phase_timings_.near_field_ms = millisecondsSince(phase_start);
+    phase_timings_.active_particles = particles_.size();
+    phase_start = std::chrono::steady_clock::now();
+
+    runMeshLongRange();
+
+    const ForceKernels::IntegrationParams params = integrationParams();
+
+    runOnParticleTiles([this, &params](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::integrate(particles_, start_index, end_index, params);
+    });
+
+    phase_timings_.far_field_ms = millisecondsSince(phase_start);
+}
+
+void ParticleSimulation::updateForcesLeapfrog(Accum global_mass, SolverPolicy::Solver solver)
+{
+    auto phase_start = std::chrono::steady_clock::now();
+
+    const ForceKernels::BlockStepParams block = { time_step_, max_rung_, substep_, show_particles_ };
+
+    active_.resize(particles_.size());
+    velocities_before_.resize(particles_.size());
+
+    std::size_t num_active = 0;
+    for (std::size_t i = 0; i < particles_.size(); ++i) {
+        active_[i] = ForceKernels::isRungActive(particles_[i].rung, block);
+        velocities_before_[i] = particles_[i].velocity;
+        num_active += active_[i];
     }
 
-    threads_.clear();
+    phase_timings_.active_particles = num_active;
 
-    num_threads_ = n_threads;
+    // Only the active rungs receive forces, everyone else just drifted
+    if (solver == SolverPolicy::TREE) {
+        const float merge_speed = mergeSpeed();
+
+        runOnLeafChunks([this, merge_speed](std::size_t start_index, std::size_t end_index) {
+            ForceKernels::nearField(particles_, quad_tree_.getParticleElementNodeVec(), quad_tree_leaf_nodes_,
+                                    start_index, end_index, &active_, 0.0f, merge_speed, collisions_);
+        });
+
+        if (far_field_model_ != ForceKernels::GLOBAL_COM) runNeighbourField(&active_);
+
+        runFarField(global_mass, &active_);
+    } else if (solver == SolverPolicy::MESH) {
+        // The mesh solves for everyone, inactive results are discarded by the kick
+        runMeshShortRange(&active_, mergeSpeed());
+        runMeshLongRange();
+    } else {
+        // The direct sum works on contiguous ranges, inactive gravity is discarded by the
+        // kick and collisions only touch active particles
+        runDirectSum(&active_, mergeSpeed());
+    }
+
+    phase_timings_.near_field_ms = millisecondsSince(phase_start);
+    phase_start = std::chrono::steady_clock::now();
+
+    runOnParticleTiles([this, &block](std::size_t start_index, std::size_t end_index) {
+        ForceKernels::kickBlockSteps(particles_, active_, velocities_before_, start_index, end_index, block);
+    });
+
+    phase_timings_.far_field_ms = millisecondsSince(phase_start);
+}
+
+void ParticleSimulation::setFarField(ForceKernels::FarFieldModel model, float theta)
+{
+    far_field_model_ = model;
+    theta_ = theta;
+}
+
+ForceKernels::FarFieldModel ParticleSimulation::getFarField() const
+{
+    return far_field_model_;
+}
+
+const char* ParticleSimulation::farFieldName(ForceKernels::FarFieldModel model)
+{
+    switch (model) {
+        case ForceKernels::MONOPOLE: return "monopole";
+        case ForceKernels::QUADRUPOLE: return "quadrupole";
+        default: return "global";
+    }
+}
+
+bool ParticleSimulation::parseFarField(const std::string& str, ForceKernels::FarFieldModel& model)
+{
+    if (str == "global") {
+        model = ForceKernels::GLOBAL_COM;
+    } else if (str == "monopole") {
+        model = ForceKernels::MONOPOLE;
+    } else if (str == "quadrupole") {
+        model = ForceKernels::QUADRUPOLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void ParticleSimulation::setMesh(int cells, bool short_range)
+{
+    mesh_cells_ = cells;
+    mesh_short_range_ = short_range;
+}
+
+bool ParticleSimulation::setBoundary(ForceKernels::BoundaryPolicy boundary)
+{
+    // The policies act on the fixed simulation area, which a dynamic root replaces
+    if (boundary != ForceKernels::REMOVE && dynamic_bounds_) return false;
+
+    boundary_ = boundary;
+
+    if (boundary_ == ForceKernels::PERIODIC) ewald_table_.compute(simulation_width_, simulation_height_);
+    return true;
+}
+
+ForceKernels::BoundaryPolicy ParticleSimulation::getBoundary() const
+{
+    return boundary_;
+}
+
+const char* ParticleSimulation::boundaryName(ForceKernels::BoundaryPolicy boundary)
+{
+    switch (boundary) {
+        case ForceKernels::REFLECT: return "reflect";
+        case ForceKernels::PERIODIC: return "periodic";
+        case ForceKernels::CLAMP: return "clamp";
+        default: return "delete";
+    }
+}
+
+bool ParticleSimulation::parseBoundary(const std::string& str, ForceKernels::BoundaryPolicy& boundary)
+{
+    if (str == "delete") {
+        boundary = ForceKernels::REMOVE;
+    } else if (str == "reflect") {
+        boundary = ForceKernels::REFLECT;
+    } else if (str == "periodic") {
+        boundary = ForceKernels::PERIODIC;
+    } else if (str == "clamp") {
+        boundary = ForceKernels::CLAMP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void ParticleSimulation::setAccretion(bool enabled, float max_speed)
+{
+    accretion_ = enabled && max_speed > 0.0f;
+    accretion_speed_ = max_speed;
+}
+
+void ParticleSimulation::setQuantizedNeighbours(bool enabled)
+{
+    quantized_neighbours_ = enabled;
+}
+
+void ParticleSimulation::setCollisions(bool enabled)
+{
+    collisions_ = enabled;
+}
+
+float ParticleSimulation::mergeSpeed() const
+{
+    return accretion_ ? accretion_speed_ : 0.0f;
+}
+
+bool ParticleSimulation::setDynamicBounds(bool dynamic)
+{
+    if (dynamic && boundary_ != ForceKernels::REMOVE) return false;
+
+    dynamic_bounds_ = dynamic;
+
+    // The fixed root is the simulation area, a dynamic one is computed on the next step
+    root_bounds_ = sf::FloatRect(0.0f, 0.0f, simulation_width_, simulation_height_);
+    quad_tree_.setBounds(root_bounds_);
+    return true;
+}
+
+const sf::FloatRect& ParticleSimulation::getRootBounds() const
+{
+    return root_bounds_;
+}
+
+void ParticleSimulation::setIntegrator(Integrator integrator, int max_rung)
+{
+    integrator_ = integrator;
+    max_rung_ = std::max(0, std::min(max_rung, static_cast<int>(ForceKernels::MAX_RUNG)));
+    substep_ = 0;
+
+    // Everyone restarts on the finest rung with a fresh first force evaluation
+    for (Particle& particle : particles_) particle.rung = -1;
+}
+
+ParticleSimulation::Integrator ParticleSimulation::getIntegrator() const
+{
+    return integrator_;
+}
+
+const char* ParticleSimulation::integratorName(Integrator integrator)
+{
+    return (integrator == LEAPFROG) ? "leapfrog" : "euler";
+}
+
+bool ParticleSimulation::parseIntegrator(const std::string& str, Integrator& integrator)
+{
+    if (str == "euler") {
+        integrator = EULER;
+    } else if (str == "leapfrog") {
+        integrator = LEAPFROG;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void ParticleSimulation::computeAccelerations(std::vector<Vector2a>& accelerations)
+{
+    for (Particle& particle : particles_) {
+        particle.acceleration = Vector2a(0, 0);
+    }
+
+    resetFrameArenas();
+
+    // Collisions change velocities, keep them out of the live state
+    std::vector<Vector2r> velocities(particles_.size());
+    for (std::size_t i = 0; i < particles_.size(); ++i) velocities[i] = particles_[i].velocity;
+
+    const SolverPolicy::Solver solver = periodicGravity() ? SolverPolicy::TREE
+                                                          : solver_policy_.predict(particles_.size());
+
+    if (solver == SolverPolicy::DIRECT) {
+        runDirectSum(nullptr, 0.0f);
+    } else {
+        quad_tree_.deleteTree();
+        quad_tree_leaf_nodes_.clear();
+
+        if (dynamic_bounds_) {
+            updateRootBounds();
+            quad_tree_.setBounds(root_bounds_);
+        }
+
+        quad_tree_.insert(particles_);
+
+        Accum global_mass = 0.0f;
+        global_com_ = quad_tree_.getLeafNodes(quad_tree_leaf_nodes_, total_leaf_nodes_, global_mass);
+
+        if (solver == SolverPolicy::MESH) {
+            runMeshShortRange(nullptr, 0.0f);
+            runMeshLongRange();
+        } else {
+            if (far_field_model_ != ForceKernels::GLOBAL_COM) updateInteractionLists();
+
+            runOnLeafChunks([this](std::size_t start_index, std::size_t end_index) {
+                ForceKernels::nearField(particles_, quad_tree_.getParticleElementNodeVec(), quad_tree_leaf_nodes_,
+                                        start_index, end_index, nullptr, 0.0f, 0.0f, collisions_);
+            });
+
+            if (far_field_model_ != ForceKernels::GLOBAL_COM) runNeighbourField(nullptr);
+
+            runFarField(global_mass, nullptr);
+        }
+    }
+
+    accelerations.resize(particles_.size());
+    for (std::size_t i = 0; i < particles_.size(); ++i) {
+        accelerations[i] = particles_[i].acceleration;
+        particles_[i].acceleration = Vector2a(0, 0);
+        particles_[i].velocity = velocities[i];
+    }
 }
 
 void ParticleSimulation::addSierpinskiTriangleParticleChunk(const int x, const int y, const int size, const int depth)
 {
     if (depth == 0) {
-        particles_.emplace_back(Particle(sf::Vector2f(x,y), sf::Vector2f(0,0), particle_mass_));
+        particles_.emplace_back(Particle(Vector2r(x,y), Vector2r(0,0), particle_mass_));
     } else {
         const int half_size = size/2;
 
@@ -609,7 +1482,7 @@ void ParticleSimulation::addCheckeredParticleChunk()
     for (int i = simulation_width_/3; i < ((2*simulation_width_)/3); ++i) {
         for (int j = simulation_height_/3; j < ((2*simulation_height_)/3); ++j) {
             if((i/7) % 6 == (j/5) % 6)
-                particles_.emplace_back(Particle(sf::Vector2f(i,j), sf::Vector2f(0,0), particle_mass_));
+                particles_.emplace_back(Particle(Vector2r(i,j), Vector2r(0,0), particle_mass_));
         }
     }
 }
@@ -627,7 +1500,7 @@ void ParticleSimulation::addParticleDiagonal(int tiles, int num_particles)
             for (int k = 0; k < row; k++ ) {
                 const float x = (j * small_width / col) + small_width * i;
                 const float y = (k * small_height / row) + small_height * i;
-                particles_.emplace_back(Particle(sf::Vector2f(x,y), sf::Vector2f(0,0), particle_mass_));
+                particles_.emplace_back(Particle(Vector2r(x,y), Vector2r(0,0), particle_mass_));
             }
         }
     }
@@ -647,7 +1520,7 @@ void ParticleSimulation::addParticleDiagonal2(int tiles, int num_particles)
                 const float x = static_cast<float>(simulation_width_) - ((j * small_width / col) + small_width * i);
                 const float y = (k * small_height / row) + small_height * i;
 
-                particles_.emplace_back(Particle(sf::Vector2f(x, y), sf::Vector2f(0, 0), particle_mass_));
+                particles_.emplace_back(Particle(Vector2r(x, y), Vector2r(0, 0), particle_mass_));
             }
         }
     }
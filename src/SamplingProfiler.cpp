@@ -0,0 +1,391 @@
+#include <iostream>
+
+#include "SamplingProfiler.hpp"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <unwind.h>
+
+static std::atomic<SamplingProfiler*> s_active_profiler(nullptr);
+
+// Reads memory of our own process without faulting on a bad address. Used to
+// follow frame pointers that may be garbage when a frame was built without them.
+static inline bool safeRead(uintptr_t address, void* out, std::size_t size)
+{
+    struct iovec local = { out, size };
+    struct iovec remote = { reinterpret_cast<void*>(address), size };
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == static_cast<ssize_t>(size);
+}
+
+struct UnwindState {
+    uintptr_t* frames;
+    int skip;
+    int depth;
+    int max_depth;
+};
+
+static _Unwind_Reason_Code unwindFrame(struct _Unwind_Context* context, void* arg)
+{
+    UnwindState* state = static_cast<UnwindState*>(arg);
+    const uintptr_t pc = _Unwind_GetIP(context);
+    if (pc == 0) return _URC_END_OF_STACK;
+
+    if (state->skip > 0) {
+        state->skip--;
+        return _URC_NO_REASON;
+    }
+
+    state->frames[state->depth++] = pc;
+    return (state->depth < state->max_depth) ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+static void sigprofHandler(int, siginfo_t*, void* ucontext)
+{
+    const int saved_errno = errno;
+
+    SamplingProfiler* profiler = s_active_profiler.load(std::memory_order_acquire);
+    if (profiler) profiler->recordSample(ucontext);
+
+    errno = saved_errno;
+}
+
+static inline void getMachineContext(void* ucontext, uintptr_t& pc, uintptr_t& fp)
+{
+    const ucontext_t* uc = static_cast<const ucontext_t*>(ucontext);
+#if defined(__x86_64__)
+    pc = uc->uc_mcontext.gregs[REG_RIP];
+    fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+    pc = uc->uc_mcontext.pc;
+    fp = uc->uc_mcontext.regs[29];
+#else
+    (void) uc;
+    pc = 0;
+    fp = 0;
+#endif
+}
+
+SamplingProfiler::SamplingProfiler()
+  : next_sample_(0),
+    dropped_samples_(0),
+    unwind_method_(FRAME_POINTER),
+    running_(false)
+{
+}
+
+SamplingProfiler::~SamplingProfiler()
+{
+    stop();
+}
+
+bool SamplingProfiler::start(int frequency_hz, int max_samples)
+{
+    if (running_ || frequency_hz <= 0 || max_samples <= 0) return false;
+
+    SamplingProfiler* expected = nullptr;
+    if (!s_active_profiler.compare_exchange_strong(expected, this)) {
+        std::cout << "SamplingProfiler: another profiler is already running.\n";
+        return false;
+    }
+
+    // Buffer is allocated up front, the signal handler only claims slots
+    samples_.assign(max_samples, Sample());
+    next_sample_.store(0);
+    dropped_samples_.store(0);
+
+    // Fall back to the unwinder if safe reads are blocked (e.g. seccomp)
+    uintptr_t probe = 0;
+    unwind_method_ = safeRead(reinterpret_cast<uintptr_t>(&max_samples), &probe, sizeof(probe)) ?
+                        FRAME_POINTER : UNWIND_TABLES;
+
+    // _Unwind_Backtrace is linked directly, unlike backtrace() it never dlopen()s
+    // libgcc in the handler. Its first call still sets up the unwinder's FDE lookup,
+    // do that here, outside the handler.
+    uintptr_t warmup[4];
+    UnwindState warmup_state = { warmup, 0, 0, 4 };
+    _Unwind_Backtrace(unwindFrame, &warmup_state);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = sigprofHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(SIGPROF, &sa, nullptr) != 0) {
+        s_active_profiler.store(nullptr);
+        return false;
+    }
+
+    // tv_usec must stay below a second
+    const int period_us = std::max(1, 1000000 / frequency_hz);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = period_us / 1000000;
+    timer.it_interval.tv_usec = period_us % 1000000;
+    timer.it_value = timer.it_interval;
+
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        signal(SIGPROF, SIG_IGN);
+        s_active_profiler.store(nullptr);
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void SamplingProfiler::stop()
+{
+    if (!running_) return;
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    // Ignore rather than default: a SIGPROF already in flight would kill the process
+    signal(SIGPROF, SIG_IGN);
+    s_active_profiler.store(nullptr, std::memory_order_release);
+
+    running_ = false;
+}
+
+bool SamplingProfiler::isRunning() const
+{
+    return running_;
+}
+
+int SamplingProfiler::getSampleCount() const
+{
+    return std::min(next_sample_.load(), static_cast<int>(samples_.size()));
+}
+
+int SamplingProfiler::getDroppedSampleCount() const
+{
+    return dropped_samples_.load();
+}
+
+SamplingProfiler::UnwindMethod SamplingProfiler::getUnwindMethod() const
+{
+    return unwind_method_;
+}
+
+void SamplingProfiler::recordSample(void* ucontext)
+{
+    const int index = next_sample_.fetch_add(1, std::memory_order_relaxed);
+
+    if (index >= static_cast<int>(samples_.size())) {
+        dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Sample& sample = samples_[index];
+    const int max_depth = sizeof(sample.frames) / sizeof(sample.frames[0]);
+
+    if (unwind_method_ == UNWIND_TABLES) {
+        // First two frames are this function and the signal handler
+        UnwindState state = { sample.frames, 2, 0, max_depth };
+        _Unwind_Backtrace(unwindFrame, &state);
+        sample.depth = state.depth;
+        return;
+    }
+
+    uintptr_t pc = 0;
+    uintptr_t fp = 0;
+    getMachineContext(ucontext, pc, fp);
+
+    int depth = 0;
+    sample.frames[depth++] = pc;
+
+    // Each frame record is { saved frame pointer, return address }
+    while (depth < max_depth && fp != 0 && (fp % sizeof(uintptr_t)) == 0) {
+        uintptr_t record[2];
+        if (!safeRead(fp, record, sizeof(record))) break;
+        if (record[1] == 0) break;
+
+        sample.frames[depth++] = record[1];
+
+        // Stacks grow down, so callers must live at higher addresses
+        if (record[0] <= fp) break;
+        fp = record[0];
+    }
+
+    sample.depth = depth;
+}
+
+namespace {
+
+struct MappedRegion {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t offset;
+    std::string name;
+};
+
+std::vector<MappedRegion> readExecutableMappings()
+{
+    std::vector<MappedRegion> regions;
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+
+    while (std::getline(maps, line)) {
+        std::istringstream ss(line);
+        std::string range, perms, offset, dev, inode, path;
+        ss >> range >> perms >> offset >> dev >> inode;
+        std::getline(ss >> std::ws, path);
+
+        if (perms.size() < 3 || perms[2] != 'x') continue;
+
+        const std::size_t dash = range.find('-');
+        MappedRegion region;
+        region.start = std::stoull(range.substr(0, dash), nullptr, 16);
+        region.end = std::stoull(range.substr(dash + 1), nullptr, 16);
+        region.offset = std::stoull(offset, nullptr, 16);
+
+        const std::size_t slash = path.find_last_of('/');
+        region.name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+        if (region.name.empty()) region.name = "[anon]";
+
+        regions.push_back(region);
+    }
+
+    return regions;
+}
+
+std::string symbolize(uintptr_t address, const std::vector<MappedRegion>& regions)
+{
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(address), &info) && info.dli_sname) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+        free(demangled);
+
+        // ';' separates frames in the folded format
+        std::replace(name.begin(), name.end(), ';', ':');
+        return name;
+    }
+
+    for (const MappedRegion& region : regions) {
+        if (address >= region.start && address < region.end) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "+0x%lx", static_cast<unsigned long>(address - region.start + region.offset));
+            return region.name + buf;
+        }
+    }
+
+    return "[unknown]";
+}
+
+} // namespace
+
+bool SamplingProfiler::writeFoldedStacks(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out) return false;
+
+    const std::vector<MappedRegion> regions = readExecutableMappings();
+    std::unordered_map<uintptr_t, std::string> symbol_cache;
+    std::map<std::string, int> folded;
+
+    const int sample_count = getSampleCount();
+
+    for (int i = 0; i < sample_count; ++i) {
+        const Sample& sample = samples_[i];
+        if (sample.depth <= 0) continue;
+
+        std::string stack;
+
+        // Folded stacks are written root first
+        for (int f = sample.depth - 1; f >= 0; --f) {
+            // Return addresses point past the call, step back into it for lookup
+            const uintptr_t address = (f == 0) ? sample.frames[f] : sample.frames[f] - 1;
+
+            auto it = symbol_cache.find(address);
+            if (it == symbol_cache.end()) {
+                it = symbol_cache.emplace(address, symbolize(address, regions)).first;
+            }
+
+            if (!stack.empty()) stack += ';';
+            stack += it->second;
+        }
+
+        folded[stack]++;
+    }
+
+    for (const auto& entry : folded) {
+        out << entry.first << ' ' << entry.second << '\n';
+    }
+
+    return static_cast<bool>(out);
+}
+
+#else // Sampling is only implemented for Linux
+
+SamplingProfiler::SamplingProfiler()
+  : next_sample_(0),
+    dropped_samples_(0),
+    unwind_method_(FRAME_POINTER),
+    running_(false)
+{
+}
+
+SamplingProfiler::~SamplingProfiler()
+{
+}
+
+bool SamplingProfiler::start(int, int)
+{
+    std::cout << "SamplingProfiler: not supported on this platform.\n";
+    return false;
+}
+
+void SamplingProfiler::stop()
+{
+}
+
+bool SamplingProfiler::isRunning() const
+{
+    return false;
+}
+
+int SamplingProfiler::getSampleCount() const
+{
+    return 0;
+}
+
+int SamplingProfiler::getDroppedSampleCount() const
+{
+    return 0;
+}
+
+SamplingProfiler::UnwindMethod SamplingProfiler::getUnwindMethod() const
+{
+    return unwind_method_;
+}
+
+void SamplingProfiler::recordSample(void*)
+{
+}
+
+bool SamplingProfiler::writeFoldedStacks(const std::string&) const
+{
+    return false;
+}
+
+#endif // __linux__
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "SharedMemoryRings.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const std::uint32_t RINGS_MAGIC = 0x52494e47;
+
+// magic is stored last by the creator, attaching processes wait for it
+struct SharedMemoryRings::Header {
+    std::atomic<std::uint32_t> magic;
+    std::int32_t num_ranks;
+    std::uint64_t ring_bytes;
+    std::uint64_t total_bytes;
+};
+
+// head counts bytes ever written, tail bytes ever read, on separate cache lines
+struct SharedMemoryRings::Ring {
+    alignas(64) std::atomic<std::uint64_t> head;
+    alignas(64) std::atomic<std::uint64_t> tail;
+};
+
+static const std::size_t HEADER_BYTES = 64;
+static const std::size_t RING_HEADER_BYTES = 128;
+
+static std::size_t ringStride(std::size_t ring_bytes)
+{
+    return RING_HEADER_BYTES + (ring_bytes + 63) / 64 * 64;
+}
+
+SharedMemoryRings::SharedMemoryRings()
+  : name_(),
+    mapping_(nullptr),
+    mapping_bytes_(0),
+    header_(nullptr),
+    bytes_sent_(0)
+{}
+
+SharedMemoryRings::~SharedMemoryRings()
+{
+    close();
+}
+
+bool SharedMemoryRings::create(const std::string& name, int num_ranks, std::size_t ring_bytes)
+{
+    close();
+    if (num_ranks < 1 || ring_bytes == 0) return false;
+
+    const std::size_t bytes = HEADER_BYTES + std::size_t(num_ranks) * num_ranks * ringStride(ring_bytes);
+
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return false;
+
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    name_ = name;
+    mapping_ = mapping;
+    mapping_bytes_ = bytes;
+    header_ = static_cast<Header*>(mapping);
+
+    // A fresh segment is zero filled, which is already every ring empty
+    header_->num_ranks = num_ranks;
+    header_->ring_bytes = ring_bytes;
+    header_->total_bytes = bytes;
+    header_->magic.store(RINGS_MAGIC, std::memory_order_release);
+    return true;
+}
+
+bool SharedMemoryRings::attach(const std::string& name)
+{
+    close();
+
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < HEADER_BYTES) {
+        ::close(fd);
+        return false;
+    }
+
+    const std::size_t bytes = static_cast<std::size_t>(status.st_size);
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) return false;
+
+    Header* header = static_cast<Header*>(mapping);
+    while (header->magic.load(std::memory_order_acquire) != RINGS_MAGIC) std::this_thread::yield();
+
+    if (header->total_bytes != bytes) {
+        munmap(mapping, bytes);
+        return false;
+    }
+
+    name_ = name;
+    mapping_ = mapping;
+    mapping_bytes_ = bytes;
+    header_ = header;
+    return true;
+}
+
+void SharedMemoryRings::unlink()
+{
+    if (!name_.empty()) shm_unlink(name_.c_str());
+}
+
+void SharedMemoryRings::close()
+{
+    if (mapping_) munmap(mapping_, mapping_bytes_);
+
+    name_.clear();
+    mapping_ = nullptr;
+    mapping_bytes_ = 0;
+    header_ = nullptr;
+    bytes_sent_ = 0;
+}
+
+int SharedMemoryRings::getRankCount() const
+{
+    return header_ ? header_->num_ranks : 0;
+}
+
+std::size_t SharedMemoryRings::getRingBytes() const
+{
+    return header_ ? header_->ring_bytes : 0;
+}
+
+SharedMemoryRings::Ring* SharedMemoryRings::ring(int from, int to) const
+{
+    const std::size_t index = std::size_t(from) * header_->num_ranks + to;
+    return reinterpret_cast<Ring*>(static_cast<unsigned char*>(mapping_) + HEADER_BYTES +
+                                   index * ringStride(header_->ring_bytes));
+}
+
+unsigned char* SharedMemoryRings::ringData(int from, int to) const
+{
+    static_assert(sizeof(Header) <= HEADER_BYTES && sizeof(Ring) <= RING_HEADER_BYTES, "ring layout");
+    return reinterpret_cast<unsigned char*>(ring(from, to)) + RING_HEADER_BYTES;
+}
+
+// Copies as much of [data, data + count) as fits, returns how much that was
+std::size_t SharedMemoryRings::push(int from, int to, const unsigned char* data, std::size_t count)
+{
+    Ring* ring = this->ring(from, to);
+    unsigned char* ring_data = ringData(from, to);
+    const std::size_t ring_bytes = getRingBytes();
+
+    const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    const std::uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    const std::size_t bytes = std::min<std::size_t>(count, ring_bytes - static_cast<std::size_t>(head - tail));
+    if (bytes == 0) return 0;
+
+    const std::size_t offset = static_cast<std::size_t>(head % ring_bytes);
+    const std::size_t first = std::min(bytes, ring_bytes - offset);
+    std::memcpy(ring_data + offset, data, first);
+    std::memcpy(ring_data, data + first, bytes - first);
+
+    ring->head.store(head + bytes, std::memory_order_release);
+    return bytes;
+}
+
+std::size_t SharedMemoryRings::pop(int from, int to, unsigned char* data, std::size_t count)
+{
+    Ring* ring = this->ring(from, to);
+    const unsigned char* ring_data = ringData(from, to);
+    const std::size_t ring_bytes = getRingBytes();
+
+    const std::uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+    const std::size_t bytes = std::min<std::size_t>(count, static_cast<std::size_t>(head - tail));
+    if (bytes == 0) return 0;
+
+    const std::size_t offset = static_cast<std::size_t>(tail % ring_bytes);
+    const std::size_t first = std::min(bytes, ring_bytes - offset);
+    std::memcpy(data, ring_data + offset, first);
+    std::memcpy(data + first, ring_data, bytes - first);
+
+    ring->tail.store(tail + bytes, std::memory_order_release);
+    return bytes;
+}
+
+void SharedMemoryRings::exchange(int rank,
+                                 const std::vector<std::vector<char>>& outgoing,
+                                 std::vector<std::vector<char>>& incoming)
+{
+    // Every message goes out as its 8 byte length followed by the payload
+    struct Transfer {
+        std::uint64_t length;
+        std::size_t done;       // Bytes of length and payload through so far
+    };
+
+    const int num_ranks = getRankCount();
+
+    std::vector<Transfer> sends(num_ranks);
+    std::vector<Transfer> receives(num_ranks, Transfer{0, 0});
+    incoming.resize(num_ranks);
+
+    for (int peer = 0; peer < num_ranks; ++peer) {
+        sends[peer] = {outgoing[peer].size(), 0};
+    }
+    incoming[rank] = outgoing[rank];
+
+    const std::size_t prefix = sizeof(std::uint64_t);
+    int pending = 2 * (num_ranks - 1);
+
+    while (pending > 0) {
+        bool progress = false;
+
+        for (int peer = 0; peer < num_ranks; ++peer) {
+            if (peer == rank) continue;
+
+            Transfer& send = sends[peer];
+            if (send.done < prefix + send.length) {
+                std::size_t bytes = 0;
+
+                if (send.done < prefix) {
+                    const unsigned char* length = reinterpret_cast<const unsigned char*>(&send.length);
+                    bytes = push(rank, peer, length + send.done, prefix - send.done);
+                } else {
+                    const unsigned char* payload = reinterpret_cast<const unsigned char*>(outgoing[peer].data());
+                    bytes = push(rank, peer, payload + (send.done - prefix), prefix + send.length - send.done);
+                }
+
+                send.done += bytes;
+                bytes_sent_ += bytes;
+                progress |= (bytes > 0);
+                if (send.done == prefix + send.length) pending--;
+            }
+
+            Transfer& receive = receives[peer];
+            if (receive.done < prefix) {
+                unsigned char* length = reinterpret_cast<unsigned char*>(&receive.length);
+                const std::size_t bytes = pop(peer, rank, length + receive.done, prefix - receive.done);
+
+                receive.done += bytes;
+                progress |= (bytes > 0);
+
+                if (receive.done == prefix) {
+                    incoming[peer].resize(receive.length);
+                    if (receive.length == 0) pending--;
+                }
+            } else if (receive.done < prefix + receive.length) {
+                unsigned char* payload = reinterpret_cast<unsigned char*>(incoming[peer].data());
+                const std::size_t bytes = pop(peer, rank, payload + (receive.done - prefix),
+                                              prefix + receive.length - receive.done);
+
+                receive.done += bytes;
+                progress |= (bytes > 0);
+                if (receive.done == prefix + receive.length) pending--;
+            }
+        }
+
+        if (!progress) std::this_thread::yield();
+    }
+}
+
+#else
+
+struct SharedMemoryRings::Header {};
+struct SharedMemoryRings::Ring {};
+
+SharedMemoryRings::SharedMemoryRings()
+  : name_(),
+    mapping_(nullptr),
+    mapping_bytes_(0),
+    header_(nullptr),
+    bytes_sent_(0)
+{}
+
+SharedMemoryRings::~SharedMemoryRings() {}
+
+bool SharedMemoryRings::create(const std::string&, int, std::size_t)
+{
+    return false;
+}
+
+bool SharedMemoryRings::attach(const std::string&)
+{
+    return false;
+}
+
+void SharedMemoryRings::unlink() {}
+void SharedMemoryRings::close() {}
+
+int SharedMemoryRings::getRankCount() const
+{
+    return 0;
+}
+
+std::size_t SharedMemoryRings::getRingBytes() const
+{
+    return 0;
+}
+
+SharedMemoryRings::Ring* SharedMemoryRings::ring(int, int) const
+{
+    return nullptr;
+}
+
+unsigned char* SharedMemoryRings::ringData(int, int) const
+{
+    return nullptr;
+}
+
+std::size_t SharedMemoryRings::push(int, int, const unsigned char*, std::size_t)
+{
+    return 0;
+}
+
+std::size_t SharedMemoryRings::pop(int, int, unsigned char*, std::size_t)
+{
+    return 0;
+}
+
+void SharedMemoryRings::exchange(int rank,
+                                 const std::vector<std::vector<char>>& outgoing,
+                                 std::vector<std::vector<char>>& incoming)
+{
+    incoming.assign(outgoing.size(), std::vector<char>());
+    if (rank < static_cast<int>(outgoing.size())) incoming[rank] = outgoing[rank];
+}
+
+#endif
+
+std::uint64_t SharedMemoryRings::getBytesSent() const
+{
+    return bytes_sent_;
+}
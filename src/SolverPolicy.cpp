@@ -0,0 +1,122 @@
+#include "SolverPolicy.hpp"
+
+// Weight of the newest measurement in the cost estimates
+static const double SMOOTHING = 0.2;
+
+// The other solver has to be predicted this much cheaper before switching
+static const double SWITCH_RATIO = 0.85;
+
+// Probe the solver not in use when it is predicted within this factor
+static const double PROBE_RATIO = 1.5;
+
+// Initial guess for the direct sum, roughly one SSE core
+static const double INITIAL_MS_PER_PAIR = 0.5e-6;
+
+SolverPolicy::SolverPolicy()
+  : mode_(AUTO),
+    current_(TREE),
+    tree_ms_per_particle_(INITIAL_CROSSOVER * INITIAL_MS_PER_PAIR),
+    direct_ms_per_pair_(INITIAL_MS_PER_PAIR),
+    tree_measured_(false),
+    direct_measured_(false),
+    frames_since_probe_(0)
+{}
+
+void SolverPolicy::setMode(Mode mode)
+{
+    mode_ = mode;
+    if (mode_ == ALWAYS_TREE) current_ = TREE;
+    if (mode_ == ALWAYS_DIRECT) current_ = DIRECT;
+    if (mode_ == ALWAYS_MESH) current_ = MESH;
+}
+
+SolverPolicy::Mode SolverPolicy::getMode() const
+{
+    return mode_;
+}
+
+SolverPolicy::Solver SolverPolicy::getCurrent() const
+{
+    return current_;
+}
+
+double SolverPolicy::predictMs(Solver solver, std::size_t num_particles) const
+{
+    const double n = static_cast<double>(num_particles);
+    return (solver == TREE) ? tree_ms_per_particle_ * n : direct_ms_per_pair_ * n * n;
+}
+
+SolverPolicy::Solver SolverPolicy::predict(std::size_t num_particles) const
+{
+    if (mode_ == ALWAYS_TREE) return TREE;
+    if (mode_ == ALWAYS_DIRECT) return DIRECT;
+    if (mode_ == ALWAYS_MESH) return MESH;
+
+    return (predictMs(DIRECT, num_particles) < predictMs(TREE, num_particles)) ? DIRECT : TREE;
+}
+
+SolverPolicy::Solver SolverPolicy::choose(std::size_t num_particles)
+{
+    if (mode_ != AUTO) return current_;
+
+    const Solver other = (current_ == TREE) ? DIRECT : TREE;
+    const double current_ms = predictMs(current_, num_particles);
+    const double other_ms = predictMs(other, num_particles);
+
+    if (other_ms < SWITCH_RATIO * current_ms) {
+        current_ = other;
+        frames_since_probe_ = 0;
+        return current_;
+    }
+
+    // One frame on the other solver refreshes its estimate, but only when a switch is plausible
+    if (++frames_since_probe_ >= PROBE_INTERVAL && other_ms < PROBE_RATIO * current_ms) {
+        frames_since_probe_ = 0;
+        return other;
+    }
+
+    return current_;
+}
+
+void SolverPolicy::record(Solver solver, std::size_t num_particles, double milliseconds)
+{
+    if (num_particles == 0 || solver == MESH) return;
+
+    const double n = static_cast<double>(num_particles);
+
+    // The first measurement replaces the initial guess outright
+    if (solver == TREE) {
+        const double weight = tree_measured_ ? SMOOTHING : 1.0;
+        tree_ms_per_particle_ += weight * (milliseconds / n - tree_ms_per_particle_);
+        tree_measured_ = true;
+    } else {
+        const double weight = direct_measured_ ? SMOOTHING : 1.0;
+        direct_ms_per_pair_ += weight * (milliseconds / (n * n) - direct_ms_per_pair_);
+        direct_measured_ = true;
+    }
+}
+
+const char* SolverPolicy::name(Solver solver)
+{
+    switch (solver) {
+        case DIRECT: return "direct";
+        case MESH: return "mesh";
+        default: return "tree";
+    }
+}
+
+bool SolverPolicy::parse(const std::string& str, Mode& mode)
+{
+    if (str == "auto") {
+        mode = AUTO;
+    } else if (str == "tree") {
+        mode = ALWAYS_TREE;
+    } else if (str == "direct") {
+        mode = ALWAYS_DIRECT;
+    } else if (str == "mesh") {
+        mode = ALWAYS_MESH;
+    } else {
+        return false;
+    }
+    return true;
+}
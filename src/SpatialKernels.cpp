@@ -0,0 +1,158 @@
+#include <cmath>
+
+#include "SpatialKernels.hpp"
+#include "ForceKernels.hpp"
+
+namespace SpatialKernels {
+
+using ForceKernels::BIG_G;
+using ForceKernels::MIN_DISTANCE_SQUARED;
+using ForceKernels::SOFTENING;
+
+// Acceleration per unit G m and unit displacement at a squared distance
+static inline float gravityScale(float distance_squared)
+{
+    const float inv_distance = 1.0f / std::sqrt(distance_squared + SOFTENING);
+    return inv_distance * inv_distance * inv_distance;
+}
+
+struct Monopole {
+    VectorN<3> position;
+    float mass;
+};
+
+void nearField(std::vector<ParticleN<3>>& particles,
+               const Octree& tree,
+               const std::vector<Octree::TreeNode*>& leaf_nodes,
+               std::size_t start_index,
+               std::size_t end_index)
+{
+    const auto& particle_element_nodes = tree.getParticleElementNodeVec();
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+        for (int a = leaf_nodes[j]->first_particle; a != -1; a = particle_element_nodes[a].next_element_index) {
+            ParticleN<3>& particle = particles[particle_element_nodes[a].particle_index];
+
+            for (int b = particle_element_nodes[a].next_element_index; b != -1; b = particle_element_nodes[b].next_element_index) {
+                ParticleN<3>& other = particles[particle_element_nodes[b].particle_index];
+
+                const VectorN<3> offset = other.position - particle.position;
+                const float distance_squared = dot(offset, offset);
+                if (distance_squared < MIN_DISTANCE_SQUARED) continue;
+
+                const float scale = BIG_G * gravityScale(distance_squared);
+                particle.acceleration += (other.mass * scale) * offset;
+                other.acceleration -= (particle.mass * scale) * offset;
+            }
+        }
+    }
+}
+
+void treeField(std::vector<ParticleN<3>>& particles,
+               const Octree& tree,
+               const std::vector<Octree::TreeNode*>& leaf_nodes,
+               std::size_t start_index,
+               std::size_t end_index,
+               float theta)
+{
+    typedef Octree::Cell Cell;
+
+    struct WalkData {
+        int index;
+        Cell cell;
+    };
+
+    const auto& particle_element_nodes = tree.getParticleElementNodeVec();
+
+    WalkData array[16 * Octree::CHILDREN];
+    std::vector<Monopole> far;
+    std::vector<int> near;
+
+    for (std::size_t j = start_index; j < end_index; j++) {
+
+        const int leaf_index = tree.getNodeIndex(leaf_nodes[j]);
+        const Cell leaf_cell = tree.getNodeBounds(leaf_index);
+        const VectorN<3> leaf_center = leaf_cell.center();
+        const float leaf_radius = 0.5f * std::sqrt(dot(leaf_cell.size, leaf_cell.size));
+
+        far.clear();
+        near.clear();
+
+        int top = 0;
+        array[top++] = {0, tree.getBounds()};
+
+        while (top > 0) {
+            const WalkData current = array[--top];
+            if (current.index == leaf_index) continue;
+
+            const Octree::TreeNode& node = tree.getNode(current.index);
+
+            // Cells are nested, any cell containing the leaf's center is one of its ancestors
+            if (!current.cell.contains(leaf_center)) {
+                if (node.count == 0) continue;
+
+                const VectorN<3> offset = current.cell.center() - leaf_center;
+                const float distance = std::sqrt(dot(offset, offset)) - leaf_radius;
+
+                float size = 0.0f;
+                for (int a = 0; a < 3; ++a) size = std::max(size, current.cell.size[a]);
+
+                if (distance > 0.0f && size < theta * distance) {
+                    const Octree::GravityElementNode& gNode = tree.getGravityNode(node);
+                    if (gNode.total_mass > 0.0f) far.push_back({ gNode.getCenterOfMass(), gNode.total_mass });
+                    continue;
+                }
+
+                if (node.count != -1) {
+                    near.push_back(current.index);
+                    continue;
+                }
+            }
+
+            for (int c = 0; c < Octree::CHILDREN; ++c) {
+                array[top++] = {Octree::CHILDREN * current.index + c + 1, current.cell.child(c)};
+            }
+        }
+
+        for (int a = leaf_nodes[j]->first_particle; a != -1; a = particle_element_nodes[a].next_element_index) {
+            ParticleN<3>& particle = particles[particle_element_nodes[a].particle_index];
+            VectorN<3> acceleration;
+
+            for (int neighbour_index : near) {
+                const Octree::TreeNode& neighbour = tree.getNode(neighbour_index);
+
+                for (int b = neighbour.first_particle; b != -1; b = particle_element_nodes[b].next_element_index) {
+                    const ParticleN<3>& other = particles[particle_element_nodes[b].particle_index];
+
+                    const VectorN<3> offset = other.position - particle.position;
+                    const float distance_squared = dot(offset, offset);
+                    if (distance_squared < MIN_DISTANCE_SQUARED) continue;
+
+                    acceleration += (other.mass * gravityScale(distance_squared)) * offset;
+                }
+            }
+
+            for (const Monopole& cell : far) {
+                const VectorN<3> offset = cell.position - particle.position;
+                acceleration += (cell.mass * gravityScale(dot(offset, offset))) * offset;
+            }
+
+            particle.acceleration += BIG_G * acceleration;
+        }
+    }
+}
+
+void integrate(std::vector<ParticleN<3>>& particles,
+               std::size_t start_index,
+               std::size_t end_index,
+               float time_step)
+{
+    for (std::size_t i = start_index; i < end_index; ++i) {
+        ParticleN<3>& particle = particles[i];
+        particle.velocity += time_step * particle.acceleration;
+        particle.position += time_step * particle.velocity;
+        particle.acceleration = VectorN<3>();
+    }
+}
+
+} // namespace SpatialKernels
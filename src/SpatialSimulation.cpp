@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+
+#include "SpatialSimulation.hpp"
+#include "Parallel.hpp"
+
+SpatialSimulation::SpatialSimulation(const Cell& bounds, int num_threads, float dt, int tree_depth, int node_cap)
+  : tree_(bounds, tree_depth, node_cap),
+    particles_(),
+    leaf_nodes_(),
+    threads_(),
+    num_threads_(std::max(num_threads, 1)),
+    time_step_(dt),
+    theta_(0.5f),
+    step_ms_(0.0)
+{}
+
+void SpatialSimulation::addParticles(const std::vector<ParticleN<3>>& particles)
+{
+    particles_.insert(particles_.end(), particles.begin(), particles.end());
+}
+
+void SpatialSimulation::runOnChunks(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work)
+{
+    ::runOnChunks(threads_, num_threads_, count, 1, nullptr, work);
+}
+
+// Order preserving, the tree only holds particles inside its root
+void SpatialSimulation::removeOutside()
+{
+    const Cell& bounds = tree_.getBounds();
+
+    particles_.erase(std::remove_if(particles_.begin(), particles_.end(), [&bounds](const ParticleN<3>& particle) {
+        return !bounds.contains(particle.position);
+    }), particles_.end());
+}
+
+void SpatialSimulation::buildTree()
+{
+    int total_leaf_nodes = 0;
+    Accum global_mass = 0.0f;
+
+    tree_.deleteTree();
+    tree_.insert(particles_);
+    tree_.computeMoments(particles_);
+
+    leaf_nodes_.clear();
+    tree_.getLeafNodes(leaf_nodes_, total_leaf_nodes, global_mass);
+}
+
+void SpatialSimulation::computeForces()
+{
+    runOnChunks(leaf_nodes_.size(), [this](std::size_t start_index, std::size_t end_index) {
+        SpatialKernels::nearField(particles_, tree_, leaf_nodes_, start_index, end_index);
+        SpatialKernels::treeField(particles_, tree_, leaf_nodes_, start_index, end_index, theta_);
+    });
+}
+
+void SpatialSimulation::step()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    removeOutside();
+    buildTree();
+    computeForces();
+
+    runOnChunks(particles_.size(), [this](std::size_t start_index, std::size_t end_index) {
+        SpatialKernels::integrate(particles_, start_index, end_index, time_step_);
+    });
+
+    step_ms_ = millisecondsSince(start);
+}
+
+void SpatialSimulation::computeAccelerations(std::vector<VectorN<3>>& accelerations)
+{
+    removeOutside();
+    buildTree();
+
+    for (ParticleN<3>& particle : particles_) particle.acceleration = VectorN<3>();
+    computeForces();
+
+    accelerations.resize(particles_.size());
+    for (std::size_t i = 0; i < particles_.size(); ++i) {
+        accelerations[i] = particles_[i].acceleration;
+        particles_[i].acceleration = VectorN<3>();
+    }
+}
+
+const std::vector<ParticleN<3>>& SpatialSimulation::getParticles() const
+{
+    return particles_;
+}
+
+std::size_t SpatialSimulation::getParticleCount() const
+{
+    return particles_.size();
+}
+
+std::size_t SpatialSimulation::getLeafCount() const
+{
+    return leaf_nodes_.size();
+}
+
+const SpatialSimulation::Cell& SpatialSimulation::getBounds() const
+{
+    return tree_.getBounds();
+}
+
+double SpatialSimulation::getStepMs() const
+{
+    return step_ms_;
+}
+
+void SpatialSimulation::setTheta(float theta)
+{
+    theta_ = theta;
+}
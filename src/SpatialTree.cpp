@@ -0,0 +1,333 @@
+#include <algorithm>
+
+#include "SpatialTree.hpp"
+
+template <int D>
+static inline int calculateTotalNodes(const int depth)
+{
+    int total = 0;
+    int level = 1;
+    for (int i = 0; i <= depth; ++i) {
+        total += level;
+        level *= SpatialTree<D>::CHILDREN;
+    }
+    return total;
+}
+
+// Child of the cell holding the particle, one comparison per axis against the center
+template <int D>
+static inline int childOf(const typename SpatialTree<D>::Cell& cell, const typename SpatialTree<D>::ParticleType& particle)
+{
+    int quadrant = 0;
+    for (int a = 0; a < D; ++a) {
+        if (SpatialTraits<D>::coordinate(particle, a) >= SpatialTraits<D>::center(cell, a)) quadrant |= (1 << a);
+    }
+    return quadrant;
+}
+
+template <int D>
+SpatialTree<D>::SpatialTree(const Cell& bounds, int max_depth, int capacity)
+  : bounds_(bounds),
+    tree_max_depth_(max_depth),
+    node_cap_(capacity)
+{
+    const int total_nodes = calculateTotalNodes<D>(max_depth);
+    const int total_leaves = total_nodes - calculateTotalNodes<D>(max_depth - 1);
+
+    particle_nodes_.reserve(static_cast<std::size_t>(total_leaves) * capacity);
+    tree_nodes_ = HugePageVector<TreeNode>(total_nodes, TreeNode());
+    gravity_nodes_ = HugePageVector<GravityElementNode>(total_nodes, GravityElementNode());
+}
+
+template <int D>
+void SpatialTree<D>::addToLeaf(int node_index, int element_index, const ParticleType& particle)
+{
+    TreeNode& node = tree_nodes_[node_index];
+    particle_nodes_[element_index].next_element_index = node.first_particle;
+    node.first_particle = element_index;
+    node.count++;
+
+    gravity_nodes_[node_index].add(particle);
+}
+
+template <int D>
+void SpatialTree<D>::insert(const std::vector<ParticleType>& particles)
+{
+    // Gravity nodes are only cleared when their cell becomes part of the tree, the root
+    // here and the children in split()
+    gravity_nodes_[0] = GravityElementNode();
+
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        if (!SpatialTraits<D>::contains(bounds_, particles[i])) continue;
+
+        int index = 0;
+        int depth = 0;
+        Cell cell = bounds_;
+
+        while (true) {
+            TreeNode& node = tree_nodes_[index];
+
+            if (node.count != -1) {
+                if (depth < tree_max_depth_ && node.count == node_cap_) {
+                    split(index, cell, particles);
+                } else {
+                    particle_nodes_.emplace_back(ParticleElementNode(-1, static_cast<int>(i)));
+                    addToLeaf(index, static_cast<int>(particle_nodes_.size()) - 1, particles[i]);
+                    break;
+                }
+            }
+
+            const int quadrant = childOf<D>(cell, particles[i]);
+            cell = SpatialTraits<D>::child(cell, quadrant);
+            index = CHILDREN * index + quadrant + 1;
+            depth++;
+        }
+    }
+}
+
+template <int D>
+void SpatialTree<D>::split(int parent_index, const Cell& parent, const std::vector<ParticleType>& particles)
+{
+    TreeNode& parent_node = tree_nodes_[parent_index];
+
+    // Clear the gravity nodes of the children, the parent's is rebuilt by computeMoments()
+    for (int j = 1; j <= CHILDREN; ++j) {
+        gravity_nodes_[CHILDREN * parent_index + j] = GravityElementNode();
+    }
+
+    int element = parent_node.first_particle;
+
+    while (element != -1) {
+        const int next_element = particle_nodes_[element].next_element_index;
+        const ParticleType& particle = particles[particle_nodes_[element].particle_index];
+
+        addToLeaf(CHILDREN * parent_index + childOf<D>(parent, particle) + 1, element, particle);
+        element = next_element;
+    }
+
+    parent_node.first_particle = -1;
+    parent_node.count = -1;
+}
+
+template <int D>
+void SpatialTree<D>::deleteTree()
+{
+    std::fill(tree_nodes_.begin(), tree_nodes_.end(), TreeNode());
+    particle_nodes_.clear();
+}
+
+template <int D>
+typename SpatialTree<D>::Vector SpatialTree<D>::getLeafNodes(std::vector<TreeNode*>& vec, int& total_leaf_nodes, Accum& global_mass)
+{
+    GravityElementNode global;
+    total_leaf_nodes = 0;
+
+    int array[16 * CHILDREN];
+    int top = 0;
+    array[top++] = 0;
+
+    while (top > 0) {
+        const int curr_index = array[--top];
+        TreeNode* node = &tree_nodes_[curr_index];
+
+        if (node->count == -1) {
+            for (int j = 1; j <= CHILDREN; ++j) array[top++] = CHILDREN * curr_index + j;
+            continue;
+        }
+
+        total_leaf_nodes++;
+        if (node->count == 0) continue;
+
+        vec.push_back(node);
+        global.add(gravity_nodes_[curr_index]);
+    }
+
+    global_mass = global.total_mass;
+    return global.getCenterOfMass();
+}
+
+template <int D>
+void SpatialTree<D>::computeMoments(const std::vector<ParticleType>& particles)
+{
+    // Post order traversal, a branch is visited again once its children are done
+    struct MomentData {
+        int index;
+        bool children_done;
+    };
+
+    MomentData array[16 * CHILDREN];
+    int top = 0;
+    array[top++] = {0, false};
+
+    while (top > 0) {
+        const MomentData current = array[--top];
+        const TreeNode& node = tree_nodes_[current.index];
+
+        if (node.count != -1) {
+            if constexpr (D == 2) {
+                GravityElementNode& gNode = gravity_nodes_[current.index];
+                gNode.qxx = gNode.qxy = gNode.qyy = 0.0f;
+
+                if (gNode.total_mass <= 0.0f) continue;
+
+                // Moments about the COM straight from the particles, accumulating about the
+                // origin and shifting afterwards loses everything to cancellation in floats
+                const Accum com_x = gNode.com_x / gNode.total_mass;
+                const Accum com_y = gNode.com_y / gNode.total_mass;
+
+                for (int i = node.first_particle; i != -1; i = particle_nodes_[i].next_element_index) {
+                    const ParticleType& particle = particles[particle_nodes_[i].particle_index];
+                    const Accum dx = particle.position.x - com_x;
+                    const Accum dy = particle.position.y - com_y;
+
+                    gNode.qxx += particle.mass * dx * dx;
+                    gNode.qxy += particle.mass * dx * dy;
+                    gNode.qyy += particle.mass * dy * dy;
+                }
+            }
+            continue;
+        }
+
+        if (!current.children_done) {
+            array[top++] = {current.index, true};
+            for (int j = 1; j <= CHILDREN; ++j) array[top++] = {CHILDREN * current.index + j, false};
+            continue;
+        }
+
+        // A branch still holds the sums from before its split, they are replaced here
+        GravityElementNode gNode;
+        for (int j = 1; j <= CHILDREN; ++j) gNode.add(gravity_nodes_[CHILDREN * current.index + j]);
+
+        if constexpr (D == 2) {
+            if (gNode.total_mass > 0.0f) {
+                const Accum com_x = gNode.com_x / gNode.total_mass;
+                const Accum com_y = gNode.com_y / gNode.total_mass;
+
+                // Parallel axis theorem, each child's moments shifted from its COM to ours
+                for (int j = 1; j <= CHILDREN; ++j) {
+                    const GravityElementNode& child = gravity_nodes_[CHILDREN * current.index + j];
+                    if (child.total_mass <= 0.0f) continue;
+
+                    const Accum dx = child.com_x / child.total_mass - com_x;
+                    const Accum dy = child.com_y / child.total_mass - com_y;
+
+                    gNode.qxx += child.qxx + child.total_mass * dx * dx;
+                    gNode.qxy += child.qxy + child.total_mass * dx * dy;
+                    gNode.qyy += child.qyy + child.total_mass * dy * dy;
+                }
+            }
+        }
+
+        gravity_nodes_[current.index] = gNode;
+    }
+}
+
+template <int D>
+const HugePageVector<typename SpatialTree<D>::ParticleElementNode>& SpatialTree<D>::getParticleElementNodeVec() const
+{
+    return particle_nodes_;
+}
+
+template <int D>
+HugePageVector<typename SpatialTree<D>::ParticleElementNode>& SpatialTree<D>::getParticleElementNodeVec()
+{
+    return particle_nodes_;
+}
+
+template <int D>
+const typename SpatialTree<D>::TreeNode& SpatialTree<D>::getNode(int index) const
+{
+    return tree_nodes_[index];
+}
+
+template <int D>
+int SpatialTree<D>::getNodeIndex(const TreeNode* node) const
+{
+    return static_cast<int>(node - tree_nodes_.data());
+}
+
+template <int D>
+typename SpatialTree<D>::Cell SpatialTree<D>::getNodeBounds(int index) const
+{
+    // Walk up to the root collecting which child each level went into
+    int quadrants[40];
+    int depth = 0;
+
+    while (index > 0) {
+        quadrants[depth++] = (index - 1) % CHILDREN;
+        index = (index - 1) / CHILDREN;
+    }
+
+    Cell cell = bounds_;
+    while (depth > 0) cell = SpatialTraits<D>::child(cell, quadrants[--depth]);
+
+    return cell;
+}
+
+template <int D>
+const typename SpatialTree<D>::GravityElementNode& SpatialTree<D>::getGravityNode(const TreeNode& node) const
+{
+    return gravity_nodes_[getNodeIndex(&node)];
+}
+
+template <int D>
+const typename SpatialTree<D>::GravityElementNode& SpatialTree<D>::getGravityNode(int index) const
+{
+    return gravity_nodes_[index];
+}
+
+template <int D>
+std::size_t SpatialTree<D>::getAllocatedBytes() const
+{
+    return tree_nodes_.capacity() * sizeof(TreeNode) +
+           particle_nodes_.capacity() * sizeof(ParticleElementNode) +
+           gravity_nodes_.capacity() * sizeof(GravityElementNode);
+}
+
+template <int D>
+void SpatialTree<D>::getStorageRanges(std::vector<StorageRange>& ranges) const
+{
+    ranges.clear();
+    ranges.push_back({tree_nodes_.data(), tree_nodes_.capacity() * sizeof(TreeNode)});
+    ranges.push_back({particle_nodes_.data(), particle_nodes_.capacity() * sizeof(ParticleElementNode)});
+    ranges.push_back({gravity_nodes_.data(), gravity_nodes_.capacity() * sizeof(GravityElementNode)});
+}
+
+template <int D>
+const typename SpatialTree<D>::Cell& SpatialTree<D>::getBounds() const
+{
+    return bounds_;
+}
+
+template <int D>
+void SpatialTree<D>::setBounds(const Cell& bounds)
+{
+    bounds_ = bounds;
+}
+
+template <int D>
+int SpatialTree<D>::getMaxDepth() const
+{
+    return tree_max_depth_;
+}
+
+template <int D>
+void SpatialTree<D>::setMaxDepth(int depth)
+{
+    tree_max_depth_ = depth;
+}
+
+template <int D>
+int SpatialTree<D>::getNodeCapacity() const
+{
+    return node_cap_;
+}
+
+template <int D>
+void SpatialTree<D>::setNodeCapacity(int capacity)
+{
+    node_cap_ = capacity;
+}
+
+template class SpatialTree<2>;
+template class SpatialTree<3>;
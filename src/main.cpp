@@ -1,5 +1,14 @@
 #include "ParticleSimulation.hpp"
+#include "AutoTuner.hpp"
+#include "SpatialSimulation.hpp"
+#include "OutOfCoreSimulation.hpp"
+#include "DistributedSimulation.hpp"
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <cstring>
+#include <sstream>
+#include <thread>
 
 // Fixed Delta Time - we need to change this
 const float TIME_STEP = 0.000095f;
@@ -8,6 +17,289 @@ const float TIME_STEP = 0.000095f;
 const int WINDOW_WIDTH = 1920;
 const int WINDOW_HEIGHT = 1080;
 
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " <num_threads> <tree_max_depth> <tree_node_capacity> <sim_width> <sim_height> [options]\n"
+              << "       " << program << " [options]                 Use the tuned profile of this machine\n"
+              << "       " << program << " --autotune [tune options] Tune and write the profile of this machine\n"
+              << "Options:\n"
+              << "  --profile <file>           Profile to load or write (default " << AutoTuner::defaultProfilePath() << ")\n"
+              << "  --solver <name>            tree, direct, mesh or auto (default auto)\n"
+              << "  --mesh-cells <n>           Mesh solver cells along the longer side, a power of two up to 4096 (default 512)\n"
+              << "  --no-p3m                   Mesh solver without the short range pass within leaves\n"
+              << "  --accretion <speed>        Merge touching particles slower than this relative to each other\n"
+              << "  --no-collisions            Touching particles attract instead of bouncing (disables accretion)\n"
+              << "  --boundary <name>          delete, reflect, periodic or clamp at the simulation edges (default delete)\n"
+              << "  --dynamic-bounds           Tree root follows the particles instead of deleting those leaving the area,\n"
+              << "                             only with --boundary delete\n"
+              << "  --far-field <name>         Tree far field: global, monopole or quadrupole (default global)\n"
+              << "  --theta <x>                Opening angle of the monopole/quadrupole tree walk, up to 1 (default 0.5)\n"
+              << "  --quantized-neighbours     Neighbour leaves of the monopole/quadrupole walk as 16 bit positions\n"
+              << "  --numa                     Pin workers and place particles and tree on the workers' NUMA nodes\n"
+              << "  --huge-pages <policy>      off, transparent or explicit huge pages for the tree (default transparent)\n"
+              << "  --integrator <name>        euler or leapfrog with block time steps (default euler)\n"
+              << "  --max-rung <n>             Leapfrog rungs below the base step, coarsest step is 2^n steps, up to 8 (default 3)\n"
+              << "  --frame-target <ms>        Adapt depth, capacity, substeps and draw LOD to hold this frame time\n"
+              << "  --3d <n>                   Simulate n particles in a width x height x height box on the octree\n"
+              << "                             engine, shown as a turning projection (tree depth at most 7)\n"
+              << "  --out-of-core <file>       Run headless with the particles in this file instead of RAM, created or\n"
+              << "                             truncated (see OutOfCoreSimulation)\n"
+              << "  --ranks <n>                Run headless on n processes of this host, each with num_threads threads\n"
+              << "                             and its own domain (see DistributedSimulation)\n"
+              << "  --n <n>                    Particles of the --out-of-core or --ranks run (default 1000000)\n"
+              << "  --steps <n>                Steps of the --out-of-core or --ranks run (default 10)\n"
+              << "  --dist <name>              uniform, clustered or sierpinski particles for --3d, --out-of-core and\n"
+              << "                             --ranks (default clustered)\n"
+              << "  --seed <n>                 Seed of those particles (default 12345)\n"
+              << "  --sample-profile <frames>  Run the sampling profiler for this many frames\n"
+              << "  --sample-delay <frames>    Frames to skip before sampling starts (default 0)\n"
+              << "  --sample-hz <hz>           Sampling frequency (default 499)\n"
+              << "  --sample-output <file>     Folded stack output file (default profile.folded)\n"
+              << "Tune options:\n"
+              << "  --tune-dist <name>         uniform, clustered or sierpinski (default sierpinski)\n"
+              << "  --tune-n <n>               Particle count (default 177147)\n"
+              << "  --tune-size <w> <h>        Simulation extents (default 1920 1080)\n"
+              << "  --tune-frames <n>          Measured frames per candidate (default 10)\n"
+              << "  --tune-depths <list>       Depths to try (default 4,5,6,7,8,9,10)\n"
+              << "  --tune-caps <list>         Node capacities to try (default 8,16,32,64,128,256)\n"
+              << "  --tune-threads <list>      Thread counts to try (default powers of two up to hardware threads)\n";
+}
+
+static std::vector<int> parseIntList(const std::string& str)
+{
+    std::vector<int> values;
+    std::stringstream stream(str);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+static int autotune(int argc, char* argv[])
+{
+    AutoTuner::Scenario scenario;
+    std::string profile_path = AutoTuner::defaultProfilePath();
+    std::vector<int> depths = { 4, 5, 6, 7, 8, 9, 10 };
+    std::vector<int> capacities = { 8, 16, 32, 64, 128, 256 };
+    std::vector<int> thread_counts;
+
+    const int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int t = 1; t < hardware_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(hardware_threads);
+
+    for (int i = 2; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
+
+        if (!std::strcmp(argv[i], "--profile") && has_value) {
+            profile_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--tune-dist") && has_value) {
+            if (!Distributions::parse(argv[++i], scenario.distribution)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--tune-n") && has_value) {
+            scenario.num_particles = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--tune-size") && i + 2 < argc) {
+            scenario.width = std::atoi(argv[++i]);
+            scenario.height = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--tune-frames") && has_value) {
+            scenario.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--tune-depths") && has_value) {
+            depths = parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--tune-caps") && has_value) {
+            capacities = parseIntList(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--tune-threads") && has_value) {
+            thread_counts = parseIntList(argv[++i]);
+        } else {
+            std::cout << "Unknown or incomplete option: " << argv[i] << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (depths.empty() || capacities.empty() || thread_counts.empty() || scenario.num_particles <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::cout << "Tuning " << AutoTuner::machineId() << " on " << scenario.num_particles << " "
+              << Distributions::name(scenario.distribution) << " particles...\n";
+
+    const AutoTuner::Profile best = AutoTuner::tune(scenario, depths, capacities, thread_counts);
+
+    std::cout << "Best: " << best.num_threads << " threads, depth " << best.tree_depth << ", capacity "
+              << best.node_capacity << " (" << best.frame_ms << " ms per frame)\n";
+
+    if (!AutoTuner::saveProfile(profile_path, best)) {
+        std::cout << "Failed to write " << profile_path << "\n";
+        return 1;
+    }
+
+    std::cout << "Wrote " << profile_path << "\n";
+    return 0;
+}
+
+// Headless run with the particles in a file, generated a million at a time so the
+// count is not limited by RAM. The tiles are the 64 cells of the third tree level and
+// each tile's tree goes down to the requested depth of the whole tree.
+static int runOutOfCore(const std::string& path, long long num_particles, int steps, int num_threads, int max_depth,
+                        int node_cap, int simulation_width, int simulation_height, float theta, bool numa,
+                        Distributions::Type distribution, unsigned int seed)
+{
+    const int tile_level = 3;
+    const long long chunk_size = 1000000;
+
+    const OutOfCoreSimulation::Settings settings = { static_cast<float>(simulation_width),
+                                                     static_cast<float>(simulation_height), num_threads, TIME_STEP,
+                                                     tile_level, std::max(tile_level, 8),
+                                                     std::max(1, max_depth - tile_level), node_cap, theta, numa };
+    OutOfCoreSimulation simulation(settings);
+
+    if (!simulation.open(path, num_particles)) {
+        std::cout << "Could not map " << path << " for " << num_particles << " particles\n";
+        return 1;
+    }
+
+    std::vector<Particle> chunk;
+    for (long long first = 0; first < num_particles; first += chunk_size) {
+        chunk.clear();
+        Distributions::generate(distribution, chunk, static_cast<int>(std::min(chunk_size, num_particles - first)),
+                                simulation_width, simulation_height, 1.03f,
+                                seed + static_cast<unsigned int>(first / chunk_size));
+        simulation.addParticles(chunk);
+    }
+
+    std::cout << "Starting out-of-core particle sim with " << simulation.getParticleCount() << " particles in "
+              << path << "...\n";
+
+    for (int step = 0; step < steps; ++step) {
+        simulation.step();
+
+        const OutOfCoreSimulation::StepStats& stats = simulation.getStepStats();
+        std::cout << "Step " << step << ": " << simulation.getParticleCount() << " particles, force "
+                  << stats.force_ms << " ms (" << stats.load_wait_ms << " ms waiting for tiles), sort "
+                  << stats.sort_ms << " ms\n";
+    }
+
+    std::cout << "Particle sim ended\n";
+    return 0;
+}
+
+// Headless run split over num_ranks processes of this host, see DistributedSimulation.
+// Every rank generates its share of the particles anywhere in the area, the first step
+// sorts them into domains. Rank 0 prints the particle count and the slowest rank of
+// each step.
+static int runDistributed(int num_ranks, long long num_particles, int steps, int num_threads, int max_depth,
+                          int node_cap, int simulation_width, int simulation_height, float theta, bool numa,
+                          Distributions::Type distribution, unsigned int seed)
+{
+    struct RankReport {
+        std::size_t owned;
+        double step_ms;
+    };
+
+    const DistributedSimulation::Settings settings = { static_cast<float>(simulation_width),
+                                                       static_cast<float>(simulation_height), num_threads,
+                                                       TIME_STEP, max_depth, node_cap, theta, 5, 1024, numa };
+
+    std::cout << "Starting particle sim on " << num_ranks << " ranks...\n";
+
+    const int result = DistributedSimulation::launch(num_ranks, 1024 * 1024, [&](SharedMemoryRings& rings, int rank) {
+        DistributedSimulation simulation(settings, rings, rank);
+
+        const long long share = num_particles / num_ranks;
+        const long long count = (rank == num_ranks - 1) ? num_particles - share * (num_ranks - 1) : share;
+
+        std::vector<Particle> particles;
+        Distributions::generate(distribution, particles, static_cast<int>(count), simulation_width,
+                                simulation_height, 1.03f, seed + rank);
+        simulation.addParticles(particles);
+
+        for (int step = 0; step < steps; ++step) {
+            const auto start = std::chrono::steady_clock::now();
+            simulation.step();
+
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            const RankReport report = { simulation.getStepStats().owned, elapsed.count() };
+            const std::vector<char> message(reinterpret_cast<const char*>(&report),
+                                            reinterpret_cast<const char*>(&report) + sizeof(report));
+            const std::vector<std::vector<char>> gathered = simulation.allGather(message);
+            if (rank != 0) continue;
+
+            std::size_t owned = 0;
+            double slowest_ms = 0.0;
+            for (const std::vector<char>& bytes : gathered) {
+                RankReport other;
+                std::memcpy(&other, bytes.data(), sizeof(other));
+                owned += other.owned;
+                slowest_ms = std::max(slowest_ms, other.step_ms);
+            }
+
+            std::cout << "Step " << step << ": " << owned << " particles, slowest rank " << slowest_ms << " ms\n";
+        }
+        return 0;
+    });
+
+    std::cout << "Particle sim ended\n";
+    return result;
+}
+
+// 3D run on the octree engine, drawn as an orthographic projection turning slowly
+// around the vertical axis
+static void runSpatial(sf::RenderWindow& window, int num_particles, int num_threads, int max_depth, int node_cap,
+                       int simulation_width, int simulation_height, Distributions::Type distribution,
+                       unsigned int seed, float theta)
+{
+    VectorN<3> extent;
+    extent[0] = simulation_width;
+    extent[1] = simulation_height;
+    extent[2] = simulation_height;
+
+    std::vector<ParticleN<3>> particles;
+    Distributions::generateN<3>(distribution, particles, num_particles, extent, 1.03f, seed);
+
+    const SpatialSimulation::Cell bounds = { VectorN<3>(), extent };
+    SpatialSimulation simulation(bounds, num_threads, TIME_STEP, std::min(max_depth, 7), node_cap);
+    simulation.setTheta(theta);
+    simulation.addParticles(particles);
+
+    const float scale = std::min(static_cast<float>(WINDOW_WIDTH) / simulation_width,
+                                 static_cast<float>(WINDOW_HEIGHT) / simulation_height);
+    const float center_x = 0.5f * extent[0];
+    const float center_z = 0.5f * extent[2];
+
+    sf::VertexArray vertices(sf::Points, 0);
+    float angle = 0.0f;
+
+    while (window.isOpen()) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed) window.close();
+        }
+
+        simulation.step();
+        angle += 0.002f;
+
+        const float cos_angle = std::cos(angle);
+        const float sin_angle = std::sin(angle);
+        const std::vector<ParticleN<3>>& current = simulation.getParticles();
+
+        vertices.resize(current.size());
+        for (std::size_t i = 0; i < current.size(); ++i) {
+            const VectorN<3>& p = current[i].position;
+            const float x = center_x + (p[0] - center_x) * cos_angle + (p[2] - center_z) * sin_angle;
+            vertices[i].position = sf::Vector2f(x * scale, p[1] * scale);
+            vertices[i].color = sf::Color(255, 255, 255, 60);
+        }
+
+        window.clear();
+        window.draw(vertices);
+        window.display();
+    }
+}
+
 int main(int argc, char* argv[])
 {
     int num_threads = 1;
@@ -16,29 +308,227 @@ int main(int argc, char* argv[])
     int simulation_width = WINDOW_WIDTH;
     int simulation_height = WINDOW_HEIGHT;
 
-    if (argc < 6) {
-        std::cout << "Usage: " << argv[0] << " <num_threads> <tree_max_depth> <tree_node_capacity> <sim_width> <sim_height>\n";
-        return 1;
-    } else {
+    int sample_frames = 0;
+    int sample_delay = 0;
+    int sample_hz = 499;
+    std::string sample_output = "profile.folded";
+    SolverPolicy::Mode solver_mode = SolverPolicy::AUTO;
+    std::string profile_path = AutoTuner::defaultProfilePath();
+    double frame_target_ms = 0.0;
+    ParticleSimulation::Integrator integrator = ParticleSimulation::EULER;
+    int max_rung = 3;
+    ForceKernels::FarFieldModel far_field = ForceKernels::GLOBAL_COM;
+    float theta = 0.5f;
+    bool quantized_neighbours = false;
+    bool numa = false;
+    HugePageArena::Policy huge_pages = HugePageArena::TRANSPARENT;
+    int mesh_cells = ParticleMesh::DEFAULT_CELLS;
+    bool mesh_short_range = true;
+    bool dynamic_bounds = false;
+    ForceKernels::BoundaryPolicy boundary = ForceKernels::REMOVE;
+    float accretion_speed = 0.0f;
+    bool collisions = true;
+    int spatial_particles = 0;
+    std::string out_of_core_path;
+    int num_ranks = 0;
+    long long headless_particles = 1000000;
+    int headless_steps = 10;
+    Distributions::Type distribution = Distributions::CLUSTERED;
+    unsigned int seed = 12345;
+
+    if (argc > 1 && !std::strcmp(argv[1], "--autotune")) {
+        return autotune(argc, argv);
+    }
+
+    // Without the positional arguments the tree parameters come from the tuned profile
+    const bool use_profile = (argc == 1 || !std::strncmp(argv[1], "--", 2));
+    int first_option = 1;
+
+    if (!use_profile) {
+        if (argc < 6) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
         num_threads = std::atoi(argv[1]);
         max_depth = std::atoi(argv[2]);
         node_cap = std::atoi(argv[3]);
         simulation_width = std::atoi(argv[4]);
         simulation_height = std::atoi(argv[5]);
+        first_option = 6;
+    }
 
-        if (max_depth > 10) max_depth = 10;
+    for (int i = first_option; i < argc; ++i) {
+        const bool has_value = (i + 1 < argc);
 
-        if (!num_threads || !max_depth || !node_cap || !simulation_width || !simulation_height) {
-            std::cout << "Usage: " << argv[0] << " <num_threads> <tree_max_depth> <tree_node_capacity> <sim_width> <sim_height>\n";
-            std::cout << "--  Please ensure valid integers are passed as arguments.\n";
+        if (!std::strcmp(argv[i], "--profile") && has_value) {
+            profile_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--solver") && has_value) {
+            if (!SolverPolicy::parse(argv[++i], solver_mode)) {
+                std::cout << "Unknown solver: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--mesh-cells") && has_value) {
+            mesh_cells = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--no-p3m")) {
+            mesh_short_range = false;
+        } else if (!std::strcmp(argv[i], "--accretion") && has_value) {
+            accretion_speed = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--no-collisions")) {
+            collisions = false;
+        } else if (!std::strcmp(argv[i], "--boundary") && has_value) {
+            if (!ParticleSimulation::parseBoundary(argv[++i], boundary)) {
+                std::cout << "Unknown boundary: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--dynamic-bounds")) {
+            dynamic_bounds = true;
+        } else if (!std::strcmp(argv[i], "--far-field") && has_value) {
+            if (!ParticleSimulation::parseFarField(argv[++i], far_field)) {
+                std::cout << "Unknown far field: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--theta") && has_value) {
+            theta = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--quantized-neighbours")) {
+            quantized_neighbours = true;
+        } else if (!std::strcmp(argv[i], "--numa")) {
+            numa = true;
+        } else if (!std::strcmp(argv[i], "--huge-pages") && has_value) {
+            if (!HugePageArena::parse(argv[++i], huge_pages)) {
+                std::cout << "Unknown huge page policy: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--integrator") && has_value) {
+            if (!ParticleSimulation::parseIntegrator(argv[++i], integrator)) {
+                std::cout << "Unknown integrator: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--max-rung") && has_value) {
+            max_rung = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--frame-target") && has_value) {
+            frame_target_ms = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--3d") && has_value) {
+            spatial_particles = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--dist") && has_value) {
+            if (!Distributions::parse(argv[++i], distribution)) {
+                std::cout << "Unknown distribution: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--seed") && has_value) {
+            seed = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--out-of-core") && has_value) {
+            out_of_core_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--ranks") && has_value) {
+            num_ranks = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--n") && has_value) {
+            headless_particles = std::atoll(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--steps") && has_value) {
+            headless_steps = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--sample-profile") && has_value) {
+            sample_frames = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--sample-delay") && has_value) {
+            sample_delay = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--sample-hz") && has_value) {
+            sample_hz = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--sample-output") && has_value) {
+            sample_output = argv[++i];
+        } else {
+            std::cout << "Unknown or incomplete option: " << argv[i] << "\n";
+            printUsage(argv[0]);
             return 1;
         }
     }
 
+    const char* invalid = nullptr;
+
+    if (!(theta > 0.0f && theta <= 1.0f)) {
+        invalid = "--theta must be in (0, 1].";
+    } else if (mesh_cells < 2 || mesh_cells > 4096 || (mesh_cells & (mesh_cells - 1)) != 0) {
+        invalid = "--mesh-cells must be a power of two from 2 to 4096.";
+    } else if (max_rung < 0 || max_rung > ForceKernels::MAX_RUNG) {
+        invalid = "--max-rung must be from 0 to 8.";
+    } else if (sample_hz <= 0) {
+        invalid = "--sample-hz must be positive.";
+    } else if (dynamic_bounds && boundary != ForceKernels::REMOVE) {
+        invalid = "--dynamic-bounds only works with --boundary delete.";
+    } else if (boundary == ForceKernels::PERIODIC && far_field != ForceKernels::GLOBAL_COM &&
+               (solver_mode == SolverPolicy::ALWAYS_DIRECT || solver_mode == SolverPolicy::ALWAYS_MESH)) {
+        invalid = "Periodic gravity needs --solver tree or auto.";
+    } else if (headless_particles <= 0 || headless_steps < 0) {
+        invalid = "--n must be positive and --steps at least 0.";
+    } else if (num_ranks < 0 || (num_ranks > 0 && !out_of_core_path.empty())) {
+        invalid = "--ranks must be positive and cannot be combined with --out-of-core.";
+    }
+
+    if (invalid) {
+        printUsage(argv[0]);
+        std::cout << "--  " << invalid << "\n";
+        return 1;
+    }
+
+    // Before anything allocates a tree
+    HugePageArena::setPolicy(huge_pages);
+
+    if (use_profile) {
+        AutoTuner::Profile profile;
+
+        if (!AutoTuner::loadProfile(profile_path, profile)) {
+            printUsage(argv[0]);
+            std::cout << "--  No tuned profile at " << profile_path << ", pass the arguments or run with --autotune first.\n";
+            return 1;
+        }
+
+        if (profile.machine != AutoTuner::machineId()) {
+            std::cout << "Warning: " << profile_path << " was tuned on " << profile.machine << "\n";
+        }
+
+        num_threads = profile.num_threads;
+        max_depth = profile.tree_depth;
+        node_cap = profile.node_capacity;
+        simulation_width = profile.width;
+        simulation_height = profile.height;
+
+        std::cout << "Loaded " << profile_path << ": " << num_threads << " threads, depth " << max_depth
+                  << ", capacity " << node_cap << "\n";
+    }
+
+    if (max_depth > 10) max_depth = 10;
+
+    if (!num_threads || !max_depth || !node_cap || !simulation_width || !simulation_height) {
+        printUsage(argv[0]);
+        std::cout << "--  Please ensure valid integers are passed as arguments.\n";
+        return 1;
+    }
+
+    if (!out_of_core_path.empty()) {
+        return runOutOfCore(out_of_core_path, headless_particles, headless_steps, num_threads, max_depth, node_cap,
+                            simulation_width, simulation_height, theta, numa, distribution, seed);
+    }
+
+    if (num_ranks > 0) {
+        return runDistributed(num_ranks, headless_particles, headless_steps, num_threads, max_depth, node_cap,
+                              simulation_width, simulation_height, theta, numa, distribution, seed);
+    }
+
     // Create the window
     sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "Particle Simulator");
     window.setFramerateLimit(60); // Limit the frame rate to 60 FPS
 
+    if (spatial_particles > 0) {
+        std::cout << "Starting 3D particle sim...\n";
+        runSpatial(window, spatial_particles, num_threads, max_depth, node_cap, simulation_width, simulation_height,
+                   distribution, seed, theta);
+        std::cout << "Particle sim ended\n";
+        return 0;
+    }
+
     //Start Particle Simulation 
     ParticleSimulation particleSimulation(simulation_width,
                                           simulation_height,
@@ -48,9 +538,35 @@ int main(int argc, char* argv[])
                                           max_depth,
                                           node_cap);
 
+    particleSimulation.setSolverMode(solver_mode);
+    particleSimulation.setIntegrator(integrator, max_rung);
+    particleSimulation.setFarField(far_field, theta);
+    particleSimulation.setQuantizedNeighbours(quantized_neighbours);
+    particleSimulation.setNumaAware(numa);
+    particleSimulation.setMesh(mesh_cells, mesh_short_range);
+    particleSimulation.setBoundary(boundary);
+    particleSimulation.setAccretion(accretion_speed > 0.0f, accretion_speed);
+    particleSimulation.setCollisions(collisions);
+    particleSimulation.setDynamicBounds(dynamic_bounds);
+
+    if (frame_target_ms > 0.0) {
+        particleSimulation.enableFrameGovernor(frame_target_ms);
+    }
+
+    if (sample_frames > 0) {
+        particleSimulation.enableSamplingProfiler(sample_delay, sample_frames, sample_hz, sample_output);
+    }
+
     std::cout << "Starting particle sim...\n";
     particleSimulation.run();
     std::cout << "Particle sim ended\n";
 
+    const HugePageArena::Stats huge_page_stats = particleSimulation.getHugePageStats();
+    std::cout << "Huge pages (" << HugePageArena::name(huge_pages) << "): "
+              << huge_page_stats.mapped_bytes / (1024 * 1024) << " MB mapped, "
+              << huge_page_stats.explicit_bytes / (1024 * 1024) << " MB of it explicit, "
+              << huge_page_stats.resident_huge_bytes / (1024 * 1024) << " of "
+              << huge_page_stats.resident_bytes / (1024 * 1024) << " MB resident on huge pages\n";
+
     return 0;
 }